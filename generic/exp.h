@@ -176,12 +176,21 @@ typedef struct {
     int console;
     int pty_only;
     int leaveOpen;
+    int stripAnsi;	/* strip escape sequences before matching */
+    int pipe;		/* connect the child with pipes, not a pty */
+    int pipeSize;	/* requested size of each pipe's buffer */
+    int stderrMode;	/* EXP_STDERR_* for -pipe */
+    Tcl_Channel stderrChan; /* (out) child's stderr with -stderr separate */
     int slave_write_ioctls;
     int slave_opens;
     int ignore[NSIG];		/* if true, signal in child is ignored */
 				/* if false, signal gets default behavior */
 } Exp_SpawnOptionSet;
 
+#define EXP_STDERR_MERGE	0	/* stderr shares the stdout pipe */
+#define EXP_STDERR_SEPARATE	1	/* stderr gets a pipe of its own */
+#define EXP_PIPE_SIZE		(1024*1024)
+
 
 /*
  * The following defines identify the various types of applications that 
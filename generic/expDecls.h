@@ -501,7 +501,7 @@ TCL_EXTERNC ExpStubs *expStubsPtr;
 #endif
 #ifndef Exp_CloseOnEofCmd
 #define Exp_CloseOnEofCmd \
-	(expStubsPtr->exp_CloseOnEofCmd) /* 23 */
+	(expStubsPtr->exp_CloseOnEofCmd) /* 37 */
 #endif
 /* Slot 38 is reserved */
 /* Slot 39 is reserved */
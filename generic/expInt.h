@@ -158,6 +158,25 @@
 #define EXP_CMD_BG	2
 #define EXP_CMD_FG	3
 
+/* event types kept by the diagnostic flight recorder (exp_recorder.c) */
+#define EXP_REC_READ	0	/* expRead, result is bytes read or EXP_XXX */
+#define EXP_REC_CASE	1	/* one case evaluated against one spawn id */
+#define EXP_REC_SHUFFLE	2	/* buffer full, first half discarded */
+#define EXP_REC_MATCH	3	/* expMatchProcess consumed the match */
+
+/* intervals kept by the latency histograms (exp_latency.c) */
+#define EXP_LAT_NOTIFY	0	/* readable -> read */
+#define EXP_LAT_MATCH	1	/* read -> match */
+#define EXP_LAT_BODY	2	/* match -> body done */
+#define EXP_LAT_TOTAL	3	/* readable -> match */
+#define EXP_LAT_STAGES	4
+
+struct ExpLatency;
+struct ExpScreen;
+struct ExpStream;
+struct ExpCapture;
+struct ExpDispatch;
+
 /*
  * This structure describes per-instance state of an Exp channel.
  */
@@ -177,6 +196,7 @@ typedef struct ExpState {
     int pid;		/* True process identifier or EXP_NOPID if no pid */
     Tcl_Pid tclPid;	/* ugly HANDLE abstraction used for the windows OS. */
     Tcl_Obj *buffer;	/* input buffer */
+    int generation;	/* bumped whenever the buffer changes */
     int msize;	        /* # of bytes that buffer can hold (max) */
     int umsize;	        /* # of bytes (min) that is guaranteed to match */
 			/* this comes from match_max command */
@@ -186,6 +206,8 @@ typedef struct ExpState {
                         /* echoed back but not actually returned via a match */
                         /* yet.  This supports interact -echo */
     int rm_nulls;	/* if nulls should be stripped before pat matching */
+    int strip_ansi;	/* if escape sequences should be stripped too */
+    int ansi_state;	/* where the stripper is within a sequence */
     int open;		/* if fdin/fdout open */
     int user_waited;    /* if user has issued "wait" command */
     int sys_waited;	/* if wait() (or variant) has been called */
@@ -248,6 +270,49 @@ typedef struct ExpState {
 
     /*  Remember that "reserved" esPtrs are no longer in use. */
     int valid;
+
+    /*
+     * Latency bookkeeping, only maintained while exp_latency is on.
+     * Times are in microseconds, 0 if not yet seen.
+     */
+    Tcl_WideInt notifyTime;	/* channel reported readable */
+    Tcl_WideInt readTime;	/* last read that returned data */
+    Tcl_WideInt arrivalTime;	/* best guess at when that data arrived */
+    struct ExpLatency *latency;	/* histograms, allocated on first use */
+
+    /* virtual terminal fed by expIRead, NULL until exp_screen (exp_screen.c) */
+    struct ExpScreen *screen;
+
+    /*
+     * expect -lines: lines before lineStart have been tried by the
+     * command whose serial number is lineKey.  lineObj holds the line
+     * being tried.
+     */
+    int lineStart;
+    int lineKey;
+    Tcl_Obj *lineObj;
+
+    /* exp_stream state, or NULL (exp_stream.c) */
+    struct ExpStream *stream;
+
+    /* cases of expect_before/after/background naming this id (expect.c) */
+    struct ExpDispatch *dispatch;
+
+    /* direct_read state, or NULL to read through the channel (exp_chan.c) */
+    struct ExpDirect *direct;
+
+    /*
+     * Bytes of buffer charged against match_max -global: the most it
+     * has held since it was last compacted (expect.c).  lastRead orders
+     * spawn ids by idleness when the budget is exceeded.
+     */
+    int charged;
+    unsigned long lastRead;
+    int chunk8;		/* average bytes per read times 8, for the
+			 * read size */
+
+    /* exp_capture state, or NULL (exp_capture.c) */
+    struct ExpCapture *capture;
     
     struct ExpState *nextPtr;	/* Pointer to next file in list of all
 				 * file channels. */
@@ -271,6 +336,12 @@ struct exp_state_list {
 	struct exp_state_list *next;
 };
 
+/* a position in the expect arena, see exp_arena.c */
+typedef struct ExpArenaMark {
+	struct ExpArenaChunk *chunk;
+	char *next;
+} ExpArenaMark;
+
 /* describes a -i flag */
 struct exp_i {
 	int cmdtype;	/* EXP_CMD_XXX.  When an indirect update is */
@@ -289,6 +360,9 @@ struct exp_i {
 			/* cached value of variable use this to tell if it */
 			/* has changed or not, and ergo whether it's */
 			/* necessary to reparse. */
+	Tcl_Obj *valueObj;	/* value as an object.  Its elements */
+			/* cache the spawn ids they name, so parsing */
+			/* the same list again skips the lookups. */
 
 	int ecount;	/* # of ecases this is used by */
 
@@ -334,7 +408,10 @@ TCL_EXTERNC int exp_nostack_dump;
 TCL_EXTERNC int exp_default_parity;
 TCL_EXTERNC int exp_default_match_max;
 TCL_EXTERNC int exp_default_rm_nulls;
+TCL_EXTERNC int exp_default_strip_ansi;
 TCL_EXTERNC int exp_default_close_on_eof;
+TCL_EXTERNC int exp_default_direct_read;
+TCL_EXTERNC int exp_latency_enabled;	/* if exp_latency is timestamping */
 
 /* abstraction for a file descriptor (int on Unix, HANDLE on windows) */
 typedef struct exp_file_ *exp_file;
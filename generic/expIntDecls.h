@@ -314,7 +314,12 @@ TCL_EXTERN(void)	exp_init_most_cmds _ANSI_ARGS_((Tcl_Interp * interp));
 /* 60 */
 TCL_EXTERN(void)	exp_init_trap_cmds _ANSI_ARGS_((Tcl_Interp * interp));
 #endif
-/* Slot 61 is reserved */
+#ifndef exp_init_interact_cmds_TCL_DECLARED
+#define exp_init_interact_cmds_TCL_DECLARED
+/* 61 */
+TCL_EXTERN(void)	exp_init_interact_cmds _ANSI_ARGS_((
+				Tcl_Interp * interp));
+#endif
 #ifndef exp_init_tty_cmds_TCL_DECLARED
 #define exp_init_tty_cmds_TCL_DECLARED
 /* 62 */
@@ -406,7 +411,7 @@ TCL_EXTERN(void)	exp_ecmd_remove_state_direct_and_indirect _ANSI_ARGS_((
 #ifndef expWriteChars_TCL_DECLARED
 #define expWriteChars_TCL_DECLARED
 /* 79 */
-TCL_EXTERN(int)		expWriteChars _ANSI_ARGS_((ExpState * esPtr,
+TCL_EXTERN(int)		expWriteChars _ANSI_ARGS_((ExpState * esPtr, 
 				CONST char * str, int len));
 #endif
 /* Slot 80 is reserved */
@@ -767,6 +772,217 @@ TCL_EXTERN(Tcl_Channel)	 Exp_CreatePairChannel _ANSI_ARGS_((
 				Tcl_Interp * interp, Tcl_Channel chanIn, 
 				Tcl_Channel chanOut, CONST char * chanName));
 #endif
+#ifndef exp_init_recorder_cmds_TCL_DECLARED
+#define exp_init_recorder_cmds_TCL_DECLARED
+/* 162 */
+TCL_EXTERN(void)	exp_init_recorder_cmds _ANSI_ARGS_((
+				Tcl_Interp * interp));
+#endif
+#ifndef expRecorderAdd_TCL_DECLARED
+#define expRecorderAdd_TCL_DECLARED
+/* 163 */
+TCL_EXTERN(void)	expRecorderAdd _ANSI_ARGS_((int type, 
+				ExpState * esPtr, int cmdtype, int index, 
+				int result, int start, int end, int length));
+#endif
+#ifndef expRecorderDumpOnError_TCL_DECLARED
+#define expRecorderDumpOnError_TCL_DECLARED
+/* 164 */
+TCL_EXTERN(void)	expRecorderDumpOnError _ANSI_ARGS_((void));
+#endif
+#ifndef exp_init_latency_cmds_TCL_DECLARED
+#define exp_init_latency_cmds_TCL_DECLARED
+/* 165 */
+TCL_EXTERN(void)	exp_init_latency_cmds _ANSI_ARGS_((
+				Tcl_Interp * interp));
+#endif
+#ifndef expLatencyNow_TCL_DECLARED
+#define expLatencyNow_TCL_DECLARED
+/* 166 */
+TCL_EXTERN(Tcl_WideInt)	 expLatencyNow _ANSI_ARGS_((void));
+#endif
+#ifndef expLatencyRecord_TCL_DECLARED
+#define expLatencyRecord_TCL_DECLARED
+/* 167 */
+TCL_EXTERN(void)	expLatencyRecord _ANSI_ARGS_((ExpState * esPtr, 
+				int stage, Tcl_WideInt usec));
+#endif
+#ifndef expLatencyFree_TCL_DECLARED
+#define expLatencyFree_TCL_DECLARED
+/* 168 */
+TCL_EXTERN(void)	expLatencyFree _ANSI_ARGS_((ExpState * esPtr));
+#endif
+#ifndef exp_init_screen_cmds_TCL_DECLARED
+#define exp_init_screen_cmds_TCL_DECLARED
+/* 169 */
+TCL_EXTERN(void)	exp_init_screen_cmds _ANSI_ARGS_((
+				Tcl_Interp * interp));
+#endif
+#ifndef expScreenFeed_TCL_DECLARED
+#define expScreenFeed_TCL_DECLARED
+/* 170 */
+TCL_EXTERN(void)	expScreenFeed _ANSI_ARGS_((ExpState * esPtr, 
+				CONST char * string, int length));
+#endif
+#ifndef expScreenText_TCL_DECLARED
+#define expScreenText_TCL_DECLARED
+/* 171 */
+TCL_EXTERN(Tcl_Obj *)	expScreenText _ANSI_ARGS_((ExpState * esPtr));
+#endif
+#ifndef expScreenFree_TCL_DECLARED
+#define expScreenFree_TCL_DECLARED
+/* 172 */
+TCL_EXTERN(void)	expScreenFree _ANSI_ARGS_((ExpState * esPtr));
+#endif
+#ifndef exp_init_stream_cmds_TCL_DECLARED
+#define exp_init_stream_cmds_TCL_DECLARED
+/* 173 */
+TCL_EXTERN(void)	exp_init_stream_cmds _ANSI_ARGS_((
+				Tcl_Interp * interp));
+#endif
+#ifndef expStreamFree_TCL_DECLARED
+#define expStreamFree_TCL_DECLARED
+/* 174 */
+TCL_EXTERN(void)	expStreamFree _ANSI_ARGS_((ExpState * esPtr));
+#endif
+#ifndef expDispatchFree_TCL_DECLARED
+#define expDispatchFree_TCL_DECLARED
+/* 175 */
+TCL_EXTERN(void)	expDispatchFree _ANSI_ARGS_((ExpState * esPtr));
+#endif
+#ifndef expStateFromChannelObj_TCL_DECLARED
+#define expStateFromChannelObj_TCL_DECLARED
+/* 176 */
+TCL_EXTERN(ExpState *)	expStateFromChannelObj _ANSI_ARGS_((
+				Tcl_Interp * interp, Tcl_Obj * objPtr, 
+				int opened, int adjust, int any, 
+				CONST char * msg));
+#endif
+#ifndef expSpawnIdInvalidate_TCL_DECLARED
+#define expSpawnIdInvalidate_TCL_DECLARED
+/* 177 */
+TCL_EXTERN(void)	expSpawnIdInvalidate _ANSI_ARGS_((void));
+#endif
+#ifndef exp_new_i_obj_TCL_DECLARED
+#define exp_new_i_obj_TCL_DECLARED
+/* 178 */
+TCL_EXTERN(struct exp_i *) exp_new_i_obj _ANSI_ARGS_((Tcl_Interp * interp, 
+				Tcl_Obj * argObj, int duration, 
+				Tcl_VarTraceProc * updateproc));
+#endif
+#ifndef expDirectSet_TCL_DECLARED
+#define expDirectSet_TCL_DECLARED
+/* 179 */
+TCL_EXTERN(int)		expDirectSet _ANSI_ARGS_((Tcl_Interp * interp, 
+				ExpState * esPtr, int enable));
+#endif
+#ifndef expDirectRead_TCL_DECLARED
+#define expDirectRead_TCL_DECLARED
+/* 180 */
+TCL_EXTERN(int)		expDirectRead _ANSI_ARGS_((ExpState * esPtr, 
+				int toRead));
+#endif
+#ifndef expDirectFree_TCL_DECLARED
+#define expDirectFree_TCL_DECLARED
+/* 181 */
+TCL_EXTERN(void)	expDirectFree _ANSI_ARGS_((ExpState * esPtr));
+#endif
+#ifndef expBufferCharge_TCL_DECLARED
+#define expBufferCharge_TCL_DECLARED
+/* 182 */
+TCL_EXTERN(void)	expBufferCharge _ANSI_ARGS_((ExpState * esPtr));
+#endif
+#ifndef expBufferCompact_TCL_DECLARED
+#define expBufferCompact_TCL_DECLARED
+/* 183 */
+TCL_EXTERN(int)		expBufferCompact _ANSI_ARGS_((ExpState * esPtr, 
+				int keep));
+#endif
+#ifndef expBufferPressure_TCL_DECLARED
+#define expBufferPressure_TCL_DECLARED
+/* 184 */
+TCL_EXTERN(void)	expBufferPressure _ANSI_ARGS_((ExpState * except));
+#endif
+#ifndef expGetBytes_TCL_DECLARED
+#define expGetBytes_TCL_DECLARED
+/* 185 */
+TCL_EXTERN(int)		expGetBytes _ANSI_ARGS_((Tcl_Interp * interp, 
+				CONST char * string, Tcl_WideInt * bytesPtr));
+#endif
+#ifndef exp_init_capture_cmds_TCL_DECLARED
+#define exp_init_capture_cmds_TCL_DECLARED
+/* 186 */
+TCL_EXTERN(void)	exp_init_capture_cmds _ANSI_ARGS_((
+				Tcl_Interp * interp));
+#endif
+#ifndef expCaptureAdd_TCL_DECLARED
+#define expCaptureAdd_TCL_DECLARED
+/* 187 */
+TCL_EXTERN(void)	expCaptureAdd _ANSI_ARGS_((ExpState * esPtr, 
+				CONST char * data, int length));
+#endif
+#ifndef expCaptureFree_TCL_DECLARED
+#define expCaptureFree_TCL_DECLARED
+/* 188 */
+TCL_EXTERN(void)	expCaptureFree _ANSI_ARGS_((ExpState * esPtr));
+#endif
+#ifndef expArenaMark_TCL_DECLARED
+#define expArenaMark_TCL_DECLARED
+/* 189 */
+TCL_EXTERN(void)	expArenaMark _ANSI_ARGS_((ExpArenaMark * markPtr));
+#endif
+#ifndef expArenaAlloc_TCL_DECLARED
+#define expArenaAlloc_TCL_DECLARED
+/* 190 */
+TCL_EXTERN(void *)	expArenaAlloc _ANSI_ARGS_((int size));
+#endif
+#ifndef expArenaRelease_TCL_DECLARED
+#define expArenaRelease_TCL_DECLARED
+/* 191 */
+TCL_EXTERN(void)	expArenaRelease _ANSI_ARGS_((ExpArenaMark * markPtr));
+#endif
+#ifndef expSlabAlloc_TCL_DECLARED
+#define expSlabAlloc_TCL_DECLARED
+/* 192 */
+TCL_EXTERN(void *)	expSlabAlloc _ANSI_ARGS_((int size));
+#endif
+#ifndef expSlabFree_TCL_DECLARED
+#define expSlabFree_TCL_DECLARED
+/* 193 */
+TCL_EXTERN(void)	expSlabFree _ANSI_ARGS_((void * ptr, int size));
+#endif
+#ifndef expAllocReport_TCL_DECLARED
+#define expAllocReport_TCL_DECLARED
+/* 194 */
+TCL_EXTERN(void)	expAllocReport _ANSI_ARGS_((Tcl_Interp * interp, 
+				int reset));
+#endif
+#ifndef expStreamRead_TCL_DECLARED
+#define expStreamRead_TCL_DECLARED
+/* 195 */
+TCL_EXTERN(int)		expStreamRead _ANSI_ARGS_((ExpState * esPtr));
+#endif
+#ifndef expBufferSetCharge_TCL_DECLARED
+#define expBufferSetCharge_TCL_DECLARED
+/* 196 */
+TCL_EXTERN(void)	expBufferSetCharge _ANSI_ARGS_((ExpState * esPtr, 
+				int charged));
+#endif
+#ifndef expMatchCharged_TCL_DECLARED
+#define expMatchCharged_TCL_DECLARED
+/* 197 */
+TCL_EXTERN(Tcl_WideInt)	 expMatchCharged _ANSI_ARGS_((void));
+#endif
+#ifndef expMatchBudget_TCL_DECLARED
+#define expMatchBudget_TCL_DECLARED
+/* 198 */
+TCL_EXTERN(Tcl_WideInt)	 expMatchBudget _ANSI_ARGS_((void));
+#endif
+#ifndef expSetMatchBudget_TCL_DECLARED
+#define expSetMatchBudget_TCL_DECLARED
+/* 199 */
+TCL_EXTERN(void)	expSetMatchBudget _ANSI_ARGS_((Tcl_WideInt budget));
+#endif
 
 typedef struct ExpIntStubs {
     int magic;
@@ -833,7 +1049,7 @@ typedef struct ExpIntStubs {
     void (*exp_init_expect_cmds) _ANSI_ARGS_((Tcl_Interp * interp)); /* 58 */
     void (*exp_init_most_cmds) _ANSI_ARGS_((Tcl_Interp * interp)); /* 59 */
     void (*exp_init_trap_cmds) _ANSI_ARGS_((Tcl_Interp * interp)); /* 60 */
-    void *reserved61;
+    void (*exp_init_interact_cmds) _ANSI_ARGS_((Tcl_Interp * interp)); /* 61 */
     void (*exp_init_tty_cmds) _ANSI_ARGS_((Tcl_Interp * interp)); /* 62 */
     ExpState * (*expStateCheck) _ANSI_ARGS_((Tcl_Interp * interp, ExpState * esPtr, int open, int adjust, CONST char * msg)); /* 63 */
     ExpState * (*expStateCurrent) _ANSI_ARGS_((Tcl_Interp * interp, int opened, int adjust, int any)); /* 64 */
@@ -851,7 +1067,7 @@ typedef struct ExpIntStubs {
     int (*expSizeGet) _ANSI_ARGS_((ExpState * esPtr)); /* 76 */
     int (*expSizeZero) _ANSI_ARGS_((ExpState * esPtr)); /* 77 */
     void (*exp_ecmd_remove_state_direct_and_indirect) _ANSI_ARGS_((Tcl_Interp * interp, ExpState * esPtr)); /* 78 */
-    void *reserved79;
+    int (*expWriteChars) _ANSI_ARGS_((ExpState * esPtr, CONST char * str, int len)); /* 79 */
     void *reserved80;
     void *reserved81;
     void *reserved82;
@@ -934,6 +1150,44 @@ typedef struct ExpIntStubs {
     void *reserved159;
     Tcl_Channel (*exp_CreateExpChannel) _ANSI_ARGS_((Tcl_Interp * interp, Tcl_Channel chan, int pid, Tcl_Pid tclPid, ExpState ** esOut)); /* 160 */
     Tcl_Channel (*exp_CreatePairChannel) _ANSI_ARGS_((Tcl_Interp * interp, Tcl_Channel chanIn, Tcl_Channel chanOut, CONST char * chanName)); /* 161 */
+    void (*exp_init_recorder_cmds) _ANSI_ARGS_((Tcl_Interp * interp)); /* 162 */
+    void (*expRecorderAdd) _ANSI_ARGS_((int type, ExpState * esPtr, int cmdtype, int index, int result, int start, int end, int length)); /* 163 */
+    void (*expRecorderDumpOnError) _ANSI_ARGS_((void)); /* 164 */
+    void (*exp_init_latency_cmds) _ANSI_ARGS_((Tcl_Interp * interp)); /* 165 */
+    Tcl_WideInt (*expLatencyNow) _ANSI_ARGS_((void)); /* 166 */
+    void (*expLatencyRecord) _ANSI_ARGS_((ExpState * esPtr, int stage, Tcl_WideInt usec)); /* 167 */
+    void (*expLatencyFree) _ANSI_ARGS_((ExpState * esPtr)); /* 168 */
+    void (*exp_init_screen_cmds) _ANSI_ARGS_((Tcl_Interp * interp)); /* 169 */
+    void (*expScreenFeed) _ANSI_ARGS_((ExpState * esPtr, CONST char * string, int length)); /* 170 */
+    Tcl_Obj * (*expScreenText) _ANSI_ARGS_((ExpState * esPtr)); /* 171 */
+    void (*expScreenFree) _ANSI_ARGS_((ExpState * esPtr)); /* 172 */
+    void (*exp_init_stream_cmds) _ANSI_ARGS_((Tcl_Interp * interp)); /* 173 */
+    void (*expStreamFree) _ANSI_ARGS_((ExpState * esPtr)); /* 174 */
+    void (*expDispatchFree) _ANSI_ARGS_((ExpState * esPtr)); /* 175 */
+    ExpState * (*expStateFromChannelObj) _ANSI_ARGS_((Tcl_Interp * interp, Tcl_Obj * objPtr, int opened, int adjust, int any, CONST char * msg)); /* 176 */
+    void (*expSpawnIdInvalidate) _ANSI_ARGS_((void)); /* 177 */
+    struct exp_i * (*exp_new_i_obj) _ANSI_ARGS_((Tcl_Interp * interp, Tcl_Obj * argObj, int duration, Tcl_VarTraceProc * updateproc)); /* 178 */
+    int (*expDirectSet) _ANSI_ARGS_((Tcl_Interp * interp, ExpState * esPtr, int enable)); /* 179 */
+    int (*expDirectRead) _ANSI_ARGS_((ExpState * esPtr, int toRead)); /* 180 */
+    void (*expDirectFree) _ANSI_ARGS_((ExpState * esPtr)); /* 181 */
+    void (*expBufferCharge) _ANSI_ARGS_((ExpState * esPtr)); /* 182 */
+    int (*expBufferCompact) _ANSI_ARGS_((ExpState * esPtr, int keep)); /* 183 */
+    void (*expBufferPressure) _ANSI_ARGS_((ExpState * except)); /* 184 */
+    int (*expGetBytes) _ANSI_ARGS_((Tcl_Interp * interp, CONST char * string, Tcl_WideInt * bytesPtr)); /* 185 */
+    void (*exp_init_capture_cmds) _ANSI_ARGS_((Tcl_Interp * interp)); /* 186 */
+    void (*expCaptureAdd) _ANSI_ARGS_((ExpState * esPtr, CONST char * data, int length)); /* 187 */
+    void (*expCaptureFree) _ANSI_ARGS_((ExpState * esPtr)); /* 188 */
+    void (*expArenaMark) _ANSI_ARGS_((ExpArenaMark * markPtr)); /* 189 */
+    void * (*expArenaAlloc) _ANSI_ARGS_((int size)); /* 190 */
+    void (*expArenaRelease) _ANSI_ARGS_((ExpArenaMark * markPtr)); /* 191 */
+    void * (*expSlabAlloc) _ANSI_ARGS_((int size)); /* 192 */
+    void (*expSlabFree) _ANSI_ARGS_((void * ptr, int size)); /* 193 */
+    void (*expAllocReport) _ANSI_ARGS_((Tcl_Interp * interp, int reset)); /* 194 */
+    int (*expStreamRead) _ANSI_ARGS_((ExpState * esPtr)); /* 195 */
+    void (*expBufferSetCharge) _ANSI_ARGS_((ExpState * esPtr, int charged)); /* 196 */
+    Tcl_WideInt (*expMatchCharged) _ANSI_ARGS_((void)); /* 197 */
+    Tcl_WideInt (*expMatchBudget) _ANSI_ARGS_((void)); /* 198 */
+    void (*expSetMatchBudget) _ANSI_ARGS_((Tcl_WideInt budget)); /* 199 */
 } ExpIntStubs;
 TCL_EXTERNC ExpIntStubs *expIntStubsPtr;
 
@@ -1142,7 +1396,10 @@ TCL_EXTERNC ExpIntStubs *expIntStubsPtr;
 #define exp_init_trap_cmds \
 	(expIntStubsPtr->exp_init_trap_cmds) /* 60 */
 #endif
-/* Slot 61 is reserved */
+#ifndef exp_init_interact_cmds
+#define exp_init_interact_cmds \
+	(expIntStubsPtr->exp_init_interact_cmds) /* 61 */
+#endif
 #ifndef exp_init_tty_cmds
 #define exp_init_tty_cmds \
 	(expIntStubsPtr->exp_init_tty_cmds) /* 62 */
@@ -1208,7 +1465,10 @@ TCL_EXTERNC ExpIntStubs *expIntStubsPtr;
 #define exp_ecmd_remove_state_direct_and_indirect \
 	(expIntStubsPtr->exp_ecmd_remove_state_direct_and_indirect) /* 78 */
 #endif
-/* Slot 79 is reserved */
+#ifndef expWriteChars
+#define expWriteChars \
+	(expIntStubsPtr->expWriteChars) /* 79 */
+#endif
 /* Slot 80 is reserved */
 /* Slot 81 is reserved */
 /* Slot 82 is reserved */
@@ -1474,6 +1734,158 @@ TCL_EXTERNC ExpIntStubs *expIntStubsPtr;
 #define Exp_CreatePairChannel \
 	(expIntStubsPtr->exp_CreatePairChannel) /* 161 */
 #endif
+#ifndef exp_init_recorder_cmds
+#define exp_init_recorder_cmds \
+	(expIntStubsPtr->exp_init_recorder_cmds) /* 162 */
+#endif
+#ifndef expRecorderAdd
+#define expRecorderAdd \
+	(expIntStubsPtr->expRecorderAdd) /* 163 */
+#endif
+#ifndef expRecorderDumpOnError
+#define expRecorderDumpOnError \
+	(expIntStubsPtr->expRecorderDumpOnError) /* 164 */
+#endif
+#ifndef exp_init_latency_cmds
+#define exp_init_latency_cmds \
+	(expIntStubsPtr->exp_init_latency_cmds) /* 165 */
+#endif
+#ifndef expLatencyNow
+#define expLatencyNow \
+	(expIntStubsPtr->expLatencyNow) /* 166 */
+#endif
+#ifndef expLatencyRecord
+#define expLatencyRecord \
+	(expIntStubsPtr->expLatencyRecord) /* 167 */
+#endif
+#ifndef expLatencyFree
+#define expLatencyFree \
+	(expIntStubsPtr->expLatencyFree) /* 168 */
+#endif
+#ifndef exp_init_screen_cmds
+#define exp_init_screen_cmds \
+	(expIntStubsPtr->exp_init_screen_cmds) /* 169 */
+#endif
+#ifndef expScreenFeed
+#define expScreenFeed \
+	(expIntStubsPtr->expScreenFeed) /* 170 */
+#endif
+#ifndef expScreenText
+#define expScreenText \
+	(expIntStubsPtr->expScreenText) /* 171 */
+#endif
+#ifndef expScreenFree
+#define expScreenFree \
+	(expIntStubsPtr->expScreenFree) /* 172 */
+#endif
+#ifndef exp_init_stream_cmds
+#define exp_init_stream_cmds \
+	(expIntStubsPtr->exp_init_stream_cmds) /* 173 */
+#endif
+#ifndef expStreamFree
+#define expStreamFree \
+	(expIntStubsPtr->expStreamFree) /* 174 */
+#endif
+#ifndef expDispatchFree
+#define expDispatchFree \
+	(expIntStubsPtr->expDispatchFree) /* 175 */
+#endif
+#ifndef expStateFromChannelObj
+#define expStateFromChannelObj \
+	(expIntStubsPtr->expStateFromChannelObj) /* 176 */
+#endif
+#ifndef expSpawnIdInvalidate
+#define expSpawnIdInvalidate \
+	(expIntStubsPtr->expSpawnIdInvalidate) /* 177 */
+#endif
+#ifndef exp_new_i_obj
+#define exp_new_i_obj \
+	(expIntStubsPtr->exp_new_i_obj) /* 178 */
+#endif
+#ifndef expDirectSet
+#define expDirectSet \
+	(expIntStubsPtr->expDirectSet) /* 179 */
+#endif
+#ifndef expDirectRead
+#define expDirectRead \
+	(expIntStubsPtr->expDirectRead) /* 180 */
+#endif
+#ifndef expDirectFree
+#define expDirectFree \
+	(expIntStubsPtr->expDirectFree) /* 181 */
+#endif
+#ifndef expBufferCharge
+#define expBufferCharge \
+	(expIntStubsPtr->expBufferCharge) /* 182 */
+#endif
+#ifndef expBufferCompact
+#define expBufferCompact \
+	(expIntStubsPtr->expBufferCompact) /* 183 */
+#endif
+#ifndef expBufferPressure
+#define expBufferPressure \
+	(expIntStubsPtr->expBufferPressure) /* 184 */
+#endif
+#ifndef expGetBytes
+#define expGetBytes \
+	(expIntStubsPtr->expGetBytes) /* 185 */
+#endif
+#ifndef exp_init_capture_cmds
+#define exp_init_capture_cmds \
+	(expIntStubsPtr->exp_init_capture_cmds) /* 186 */
+#endif
+#ifndef expCaptureAdd
+#define expCaptureAdd \
+	(expIntStubsPtr->expCaptureAdd) /* 187 */
+#endif
+#ifndef expCaptureFree
+#define expCaptureFree \
+	(expIntStubsPtr->expCaptureFree) /* 188 */
+#endif
+#ifndef expArenaMark
+#define expArenaMark \
+	(expIntStubsPtr->expArenaMark) /* 189 */
+#endif
+#ifndef expArenaAlloc
+#define expArenaAlloc \
+	(expIntStubsPtr->expArenaAlloc) /* 190 */
+#endif
+#ifndef expArenaRelease
+#define expArenaRelease \
+	(expIntStubsPtr->expArenaRelease) /* 191 */
+#endif
+#ifndef expSlabAlloc
+#define expSlabAlloc \
+	(expIntStubsPtr->expSlabAlloc) /* 192 */
+#endif
+#ifndef expSlabFree
+#define expSlabFree \
+	(expIntStubsPtr->expSlabFree) /* 193 */
+#endif
+#ifndef expAllocReport
+#define expAllocReport \
+	(expIntStubsPtr->expAllocReport) /* 194 */
+#endif
+#ifndef expStreamRead
+#define expStreamRead \
+	(expIntStubsPtr->expStreamRead) /* 195 */
+#endif
+#ifndef expBufferSetCharge
+#define expBufferSetCharge \
+	(expIntStubsPtr->expBufferSetCharge) /* 196 */
+#endif
+#ifndef expMatchCharged
+#define expMatchCharged \
+	(expIntStubsPtr->expMatchCharged) /* 197 */
+#endif
+#ifndef expMatchBudget
+#define expMatchBudget \
+	(expIntStubsPtr->expMatchBudget) /* 198 */
+#endif
+#ifndef expSetMatchBudget
+#define expSetMatchBudget \
+	(expIntStubsPtr->expSetMatchBudget) /* 199 */
+#endif
 
 #endif /* defined(USE_EXP_STUBS) && !defined(USE_EXP_STUB_PROCS) */
 
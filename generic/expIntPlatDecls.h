@@ -38,7 +38,7 @@
 #ifndef ExpWinInit_TCL_DECLARED
 #define ExpWinInit_TCL_DECLARED
 /* 0 */
-TCL_EXTERN(int)	ExpWinInit _ANSI_ARGS_((Tcl_Interp *interp));
+TCL_EXTERN(int)		ExpWinInit _ANSI_ARGS_((Tcl_Interp * interp));
 #endif
 #ifndef ExpWinErrId_TCL_DECLARED
 #define ExpWinErrId_TCL_DECLARED
@@ -68,7 +68,7 @@ typedef struct ExpIntPlatStubs {
     struct ExpIntPlatStubHooks *hooks;
 
 #ifdef __WIN32__
-    void (*expWinInit) _ANSI_ARGS_((void)); /* 0 */
+    int (*expWinInit) _ANSI_ARGS_((Tcl_Interp * interp)); /* 0 */
     CONST char * (*expWinErrId) _ANSI_ARGS_((DWORD errorCode)); /* 1 */
     CONST char * (*expWinErrMsg) _ANSI_ARGS_(TCL_VARARGS(DWORD,errorCode)); /* 2 */
     CONST char * (*expWinErrMsgVA) _ANSI_ARGS_((DWORD errorCode, va_list argList)); /* 3 */
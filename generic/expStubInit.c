@@ -101,7 +101,7 @@ ExpIntStubs expIntStubs = {
     exp_init_expect_cmds, /* 58 */
     exp_init_most_cmds, /* 59 */
     exp_init_trap_cmds, /* 60 */
-    NULL, /* 61 */
+    exp_init_interact_cmds, /* 61 */
     exp_init_tty_cmds, /* 62 */
     expStateCheck, /* 63 */
     expStateCurrent, /* 64 */
@@ -202,6 +202,44 @@ ExpIntStubs expIntStubs = {
     NULL, /* 159 */
     Exp_CreateExpChannel, /* 160 */
     Exp_CreatePairChannel, /* 161 */
+    exp_init_recorder_cmds, /* 162 */
+    expRecorderAdd, /* 163 */
+    expRecorderDumpOnError, /* 164 */
+    exp_init_latency_cmds, /* 165 */
+    expLatencyNow, /* 166 */
+    expLatencyRecord, /* 167 */
+    expLatencyFree, /* 168 */
+    exp_init_screen_cmds, /* 169 */
+    expScreenFeed, /* 170 */
+    expScreenText, /* 171 */
+    expScreenFree, /* 172 */
+    exp_init_stream_cmds, /* 173 */
+    expStreamFree, /* 174 */
+    expDispatchFree, /* 175 */
+    expStateFromChannelObj, /* 176 */
+    expSpawnIdInvalidate, /* 177 */
+    exp_new_i_obj, /* 178 */
+    expDirectSet, /* 179 */
+    expDirectRead, /* 180 */
+    expDirectFree, /* 181 */
+    expBufferCharge, /* 182 */
+    expBufferCompact, /* 183 */
+    expBufferPressure, /* 184 */
+    expGetBytes, /* 185 */
+    exp_init_capture_cmds, /* 186 */
+    expCaptureAdd, /* 187 */
+    expCaptureFree, /* 188 */
+    expArenaMark, /* 189 */
+    expArenaAlloc, /* 190 */
+    expArenaRelease, /* 191 */
+    expSlabAlloc, /* 192 */
+    expSlabFree, /* 193 */
+    expAllocReport, /* 194 */
+    expStreamRead, /* 195 */
+    expBufferSetCharge, /* 196 */
+    expMatchCharged, /* 197 */
+    expMatchBudget, /* 198 */
+    expSetMatchBudget, /* 199 */
 };
 
 ExpIntPlatStubs expIntPlatStubs = {
@@ -0,0 +1,316 @@
+/* ----------------------------------------------------------------------------
+ * exp_arena.c --
+ *
+ *	Allocators for the structures the expect commands make from their
+ *	arguments.  Those of a single expect (its cases, the flattened
+ *	spawn id list and array) come from a bump arena: an expect marks
+ *	the arena when it starts and releases it back to the mark when it
+ *	is done, which frees them all at once.  Nested expects, run from
+ *	the body of another, mark and release within the outer one, so the
+ *	arena behaves as a stack.  The longer lived structures (the cases
+ *	of expect_before/after/background and every exp_i with its spawn
+ *	id list, which an indirect variable trace can rebuild at any time)
+ *	come from slabs of a few size classes instead.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "expInt.h"
+
+#define EXP_ALIGN(n)	(((n) + 7) & ~7)
+
+#ifndef EXP_ARENA_CHUNK
+#define EXP_ARENA_CHUNK		8192
+#endif
+#ifndef EXP_SLAB_CHUNK
+#define EXP_SLAB_CHUNK		4096
+#endif
+#define EXP_SLAB_QUANTUM	16
+#define EXP_SLAB_MAX		256	/* bigger ones go to ckalloc */
+#define EXP_SLAB_CLASSES	(EXP_SLAB_MAX / EXP_SLAB_QUANTUM)
+
+/*
+ * An arena chunk.  The chunks after the current one are spares kept
+ * from an earlier, deeper use of the arena.
+ */
+typedef struct ExpArenaChunk {
+    struct ExpArenaChunk *next;
+    char *end;
+} ExpArenaChunk;
+
+#define ARENA_DATA(c)	((char *) (c) + EXP_ALIGN(sizeof(ExpArenaChunk)))
+
+typedef struct SlabChunk {
+    struct SlabChunk *next;
+} SlabChunk;
+
+typedef struct SlabFree {
+    struct SlabFree *next;
+} SlabFree;
+
+#define SLAB_DATA(c)	((char *) (c) + EXP_ALIGN(sizeof(SlabChunk)))
+
+/*
+ * The arena, the slabs and their counters belong to the thread that
+ * runs the commands, as the spawn ids do.
+ */
+typedef struct ThreadSpecificData {
+    ExpArenaChunk *arenaFirst;
+    ExpArenaChunk *arenaCur;	/* NULL if nothing allocated */
+    char *arenaNext;
+    int arenaMarks;		/* marks not yet released */
+
+    struct {
+	SlabFree *free;
+	SlabChunk *chunks;
+	int live;		/* handed out and not yet freed */
+    } slabs[EXP_SLAB_CLASSES];
+
+    /* counters reported by "exp_profile -alloc" */
+    Tcl_WideUInt allocArena;	/* allocations from the arena */
+    Tcl_WideUInt allocSlab;	/* allocations from a slab */
+    Tcl_WideUInt allocHeap;	/* ckallocs made for either */
+    long allocHeld;		/* bytes held in chunks */
+} ThreadSpecificData;
+static Tcl_ThreadDataKey dataKey;
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expArenaMark --
+ *
+ *	Remember where the arena is, for expArenaRelease.  Every mark
+ *	must be released, innermost first.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+expArenaMark (
+    ExpArenaMark *markPtr)
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+
+    markPtr->chunk = tsdPtr->arenaCur;
+    markPtr->next = tsdPtr->arenaNext;
+    tsdPtr->arenaMarks++;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expArenaAlloc --
+ *
+ *	Allocate size bytes from the arena.  They stay until the arena is
+ *	released to a mark taken before them and are never freed alone.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void *
+expArenaAlloc (
+    int size)
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+    ExpArenaChunk *next;
+    char *p;
+    int chunkSize;
+
+    if (tsdPtr->arenaMarks == 0) {
+	Tcl_Panic("expArenaAlloc: arena not marked");
+    }
+    size = EXP_ALIGN(size);
+    tsdPtr->allocArena++;
+
+    if (tsdPtr->arenaCur && size <= tsdPtr->arenaCur->end - tsdPtr->arenaNext) {
+	p = tsdPtr->arenaNext;
+	tsdPtr->arenaNext += size;
+	return p;
+    }
+
+    /* move to the next chunk, reusing a spare if it is big enough */
+    next = (tsdPtr->arenaCur ? tsdPtr->arenaCur->next : tsdPtr->arenaFirst);
+    if (next == NULL || ARENA_DATA(next) + size > next->end) {
+	chunkSize = EXP_ALIGN(sizeof(ExpArenaChunk)) + size;
+	if (chunkSize < EXP_ARENA_CHUNK) chunkSize = EXP_ARENA_CHUNK;
+	tsdPtr->allocHeap++;
+	tsdPtr->allocHeld += chunkSize;
+	p = ckalloc(chunkSize);
+	((ExpArenaChunk *) p)->next = next;
+	((ExpArenaChunk *) p)->end = p + chunkSize;
+	next = (ExpArenaChunk *) p;
+	if (tsdPtr->arenaCur) {
+	    tsdPtr->arenaCur->next = next;
+	} else {
+	    tsdPtr->arenaFirst = next;
+	}
+    }
+    tsdPtr->arenaCur = next;
+    tsdPtr->arenaNext = ARENA_DATA(next) + size;
+    return ARENA_DATA(next);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expArenaRelease --
+ *
+ *	Free everything allocated from the arena since the mark.  When the
+ *	last mark is released, all but the first chunk go back to the
+ *	heap, so a single large expect does not keep its memory.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+expArenaRelease (
+    ExpArenaMark *markPtr)
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+    ExpArenaChunk *c, *next;
+
+    tsdPtr->arenaCur = markPtr->chunk;
+    tsdPtr->arenaNext = markPtr->next;
+    if (--tsdPtr->arenaMarks > 0 || tsdPtr->arenaFirst == NULL) return;
+
+    for (c = tsdPtr->arenaFirst->next; c; c = next) {
+	next = c->next;
+	tsdPtr->allocHeld -= c->end - (char *) c;
+	ckfree((char *) c);
+    }
+    tsdPtr->arenaFirst->next = NULL;
+    tsdPtr->arenaCur = NULL;
+    tsdPtr->arenaNext = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expSlabAlloc --
+ *
+ *	Allocate size bytes from the slab of its size class.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void *
+expSlabAlloc (
+    int size)
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+    SlabChunk *c;
+    SlabFree *f;
+    char *p;
+    int cls, objSize, n;
+
+    if (size > EXP_SLAB_MAX) {
+	tsdPtr->allocHeap++;
+	return ckalloc(size);
+    }
+    cls = (size - 1) / EXP_SLAB_QUANTUM;
+    tsdPtr->allocSlab++;
+
+    if (tsdPtr->slabs[cls].free == NULL) {
+	/* none free, carve a new chunk into objects of this class */
+	objSize = (cls + 1) * EXP_SLAB_QUANTUM;
+	tsdPtr->allocHeap++;
+	tsdPtr->allocHeld += EXP_SLAB_CHUNK;
+	c = (SlabChunk *) ckalloc(EXP_SLAB_CHUNK);
+	c->next = tsdPtr->slabs[cls].chunks;
+	tsdPtr->slabs[cls].chunks = c;
+	n = (EXP_SLAB_CHUNK - EXP_ALIGN(sizeof(SlabChunk))) / objSize;
+	for (p = SLAB_DATA(c) + (n - 1) * objSize; n > 0; n--, p -= objSize) {
+	    ((SlabFree *) p)->next = tsdPtr->slabs[cls].free;
+	    tsdPtr->slabs[cls].free = (SlabFree *) p;
+	}
+    }
+
+    f = tsdPtr->slabs[cls].free;
+    tsdPtr->slabs[cls].free = f->next;
+    tsdPtr->slabs[cls].live++;
+    return (void *) f;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expSlabFree --
+ *
+ *	Free what expSlabAlloc returned for the same size.  When the last
+ *	object of a class is freed, all but one of its chunks go back to
+ *	the heap.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+expSlabFree (
+    void *ptr,
+    int size)
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+    SlabChunk *c, *next;
+    char *p;
+    int cls, objSize, n;
+
+    if (size > EXP_SLAB_MAX) {
+	ckfree((char *) ptr);
+	return;
+    }
+    cls = (size - 1) / EXP_SLAB_QUANTUM;
+    ((SlabFree *) ptr)->next = tsdPtr->slabs[cls].free;
+    tsdPtr->slabs[cls].free = (SlabFree *) ptr;
+    if (--tsdPtr->slabs[cls].live > 0 || tsdPtr->slabs[cls].chunks->next == NULL) return;
+
+    for (c = tsdPtr->slabs[cls].chunks->next; c; c = next) {
+	next = c->next;
+	tsdPtr->allocHeld -= EXP_SLAB_CHUNK;
+	ckfree((char *) c);
+    }
+    c = tsdPtr->slabs[cls].chunks;
+    c->next = NULL;
+    objSize = (cls + 1) * EXP_SLAB_QUANTUM;
+    n = (EXP_SLAB_CHUNK - EXP_ALIGN(sizeof(SlabChunk))) / objSize;
+    tsdPtr->slabs[cls].free = NULL;
+    for (p = SLAB_DATA(c) + (n - 1) * objSize; n > 0; n--, p -= objSize) {
+	((SlabFree *) p)->next = tsdPtr->slabs[cls].free;
+	tsdPtr->slabs[cls].free = (SlabFree *) p;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expAllocReport --
+ *
+ *	Leave "-arena n -slab n -heap n -held n" in the interp result: the
+ *	allocations served by the arena and by the tsdPtr->slabs, each of which
+ *	would otherwise have been a ckalloc, the ckallocs actually made
+ *	for them, and the bytes the allocators now hold.  With reset, the
+ *	counts are zeroed instead.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+expAllocReport (
+    Tcl_Interp *interp,
+    int reset)
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+    Tcl_Obj *objs[8];
+
+    if (reset) {
+	tsdPtr->allocArena = tsdPtr->allocSlab = tsdPtr->allocHeap = 0;
+	return;
+    }
+    objs[0] = Tcl_NewStringObj("-arena", -1);
+    objs[1] = Tcl_NewWideIntObj((Tcl_WideInt) tsdPtr->allocArena);
+    objs[2] = Tcl_NewStringObj("-slab", -1);
+    objs[3] = Tcl_NewWideIntObj((Tcl_WideInt) tsdPtr->allocSlab);
+    objs[4] = Tcl_NewStringObj("-heap", -1);
+    objs[5] = Tcl_NewWideIntObj((Tcl_WideInt) tsdPtr->allocHeap);
+    objs[6] = Tcl_NewStringObj("-held", -1);
+    objs[7] = Tcl_NewLongObj(tsdPtr->allocHeld);
+    Tcl_SetObjResult(interp, Tcl_NewListObj(8, objs));
+}
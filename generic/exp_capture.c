@@ -0,0 +1,435 @@
+/* ----------------------------------------------------------------------------
+ * exp_capture.c --
+ *
+ *	Capture mode for a spawn id, for dumps too big to hold in a match
+ *	buffer.  Everything read from the spawn id is also appended to the
+ *	capture: in memory up to a threshold, then in a file.  Matching is
+ *	not affected and still only sees the last match_max*2 bytes, so
+ *	match_max can stay small.  When the capture is stopped the whole of
+ *	it is handed back as a channel open on the file, never as a Tcl
+ *	string.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "expInt.h"
+
+#define CAPTURE_DEFAULT_THRESHOLD (1024*1024)
+#define CAPTURE_BUFFERSIZE "1048576"	/* -buffersize of the file */
+
+struct ExpCapture {
+    Tcl_Channel chan;		/* the file, open for read and write */
+    Tcl_Obj *path;
+    int temporary;		/* we named it, so we delete it */
+    int threshold;		/* bytes kept in memory before the file */
+    char *mem;			/* those bytes */
+    int memLength;
+    int memSize;
+    int spilled;		/* if they have gone to the file */
+    Tcl_WideInt bytes;		/* captured so far */
+    int error;			/* errno of a failed write, or 0 */
+};
+
+static int captureCount = 0;
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CaptureSpill --
+ *
+ *	Write what is held in memory to the file and keep writing there.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CaptureSpill (
+    struct ExpCapture *cPtr)
+{
+    if (cPtr->memLength > 0 && !cPtr->error
+	    && Tcl_Write(cPtr->chan, cPtr->mem, cPtr->memLength) < 0) {
+	cPtr->error = Tcl_GetErrno();
+    }
+    if (cPtr->mem) {
+	ckfree(cPtr->mem);
+	cPtr->mem = NULL;
+    }
+    cPtr->memLength = cPtr->memSize = 0;
+    cPtr->spilled = TRUE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expCaptureAdd --
+ *
+ *	Called by expIRead with the bytes it just appended to the buffer.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+expCaptureAdd (
+    ExpState *esPtr,
+    CONST char *data,
+    int length)
+{
+    struct ExpCapture *cPtr = esPtr->capture;
+
+    if (cPtr == NULL || length <= 0) {
+	return;
+    }
+    cPtr->bytes += length;
+
+    if (!cPtr->spilled) {
+	if (cPtr->memLength + length <= cPtr->threshold) {
+	    if (cPtr->memLength + length > cPtr->memSize) {
+		cPtr->memSize = 2 * (cPtr->memLength + length);
+		if (cPtr->memSize > cPtr->threshold) {
+		    cPtr->memSize = cPtr->threshold;
+		}
+		cPtr->mem = cPtr->mem
+			? ckrealloc(cPtr->mem, (unsigned) cPtr->memSize)
+			: ckalloc((unsigned) cPtr->memSize);
+	    }
+	    memcpy(cPtr->mem + cPtr->memLength, data, (size_t) length);
+	    cPtr->memLength += length;
+	    return;
+	}
+	CaptureSpill(cPtr);
+    }
+    if (!cPtr->error && Tcl_Write(cPtr->chan, data, length) < 0) {
+	cPtr->error = Tcl_GetErrno();
+    }
+}
+
+#ifdef __WIN32__
+/*
+ * A temporary capture file is deleted once the channel handed out for
+ * it has been closed, which is after the close handlers have run.  On
+ * UNIX it was unlinked as soon as it was opened.
+ */
+
+static void
+CaptureDelete (
+    ClientData clientData)
+{
+    Tcl_Obj *path = (Tcl_Obj *) clientData;
+
+    Tcl_FSDeleteFile(path);
+    Tcl_DecrRefCount(path);
+}
+
+static void
+CaptureCloseHandler (
+    ClientData clientData)
+{
+    Tcl_DoWhenIdle(CaptureDelete, clientData);
+}
+#endif
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expCaptureFree --
+ *
+ *	Throw the capture away.  Called when the spawn id is closed
+ *	without the capture having been collected.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+expCaptureFree (
+    ExpState *esPtr)
+{
+    struct ExpCapture *cPtr = esPtr->capture;
+
+    if (cPtr == NULL) {
+	return;
+    }
+    esPtr->capture = NULL;
+    if (cPtr->mem) ckfree(cPtr->mem);
+    if (cPtr->chan) {
+	Tcl_Close(NULL, cPtr->chan);
+#ifdef __WIN32__
+	if (cPtr->temporary) {
+	    Tcl_FSDeleteFile(cPtr->path);
+	}
+#endif
+    }
+    Tcl_DecrRefCount(cPtr->path);
+    ckfree((char *) cPtr);
+}
+
+/*
+ * Pick a file name in the temporary directory.
+ */
+
+static Tcl_Obj *
+CaptureTempPath (
+    Tcl_Interp *interp)
+{
+    static CONST char *vars[] = {"TMPDIR", "TEMP", "TMP", NULL};
+    CONST char *dir = NULL;
+    char name[80];
+    Tcl_Obj *path;
+    Tcl_Time now;
+    int i;
+
+    for (i = 0; vars[i] && dir == NULL; i++) {
+	dir = Tcl_GetVar2(interp, "env", vars[i], TCL_GLOBAL_ONLY);
+    }
+    if (dir == NULL) {
+#ifdef __WIN32__
+	dir = ".";
+#else
+	dir = "/tmp";
+#endif
+    }
+    Tcl_GetTime(&now);
+    sprintf(name, "exp_capture%d_%d_%lx.tmp", exp_getpid, ++captureCount,
+	    (unsigned long) (now.sec ^ (now.usec << 12)));
+    path = Tcl_NewStringObj(dir, -1);
+    Tcl_IncrRefCount(path);
+    Tcl_AppendToObj(path, "/", 1);
+    Tcl_AppendToObj(path, name, -1);
+    return path;
+}
+
+/*
+ * Create a new file in the temporary directory.  It is opened with
+ * EXCL, so a file or link someone else put there under the same name
+ * is never written through; another name is tried instead.  On UNIX
+ * it is unlinked right away, so it is gone however the process ends.
+ */
+
+static Tcl_Channel
+CaptureTempOpen (
+    Tcl_Interp *interp,
+    Tcl_Obj **pathPtr)
+{
+    Tcl_Channel chan = NULL;
+    Tcl_Obj *path = NULL;
+    int tries;
+
+    for (tries = 0; tries < 100 && chan == NULL; tries++) {
+	if (path) Tcl_DecrRefCount(path);
+	path = CaptureTempPath(interp);
+	chan = Tcl_FSOpenFileChannel(NULL, path, "RDWR CREAT EXCL", 0600);
+	if (chan == NULL && Tcl_GetErrno() != EEXIST) {
+	    break;
+	}
+    }
+    if (chan == NULL) {
+	Tcl_AppendResult(interp, "couldn't create capture file \"",
+		Tcl_GetString(path), "\": ", Tcl_PosixError(interp),
+		(char *) NULL);
+	Tcl_DecrRefCount(path);
+	return NULL;
+    }
+#ifndef __WIN32__
+    Tcl_FSDeleteFile(path);
+#endif
+    *pathPtr = path;
+    return chan;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Exp_CaptureObjCmd --
+ *
+ *	exp_capture ?-i spawn_id? ?-threshold size? ?-file name?
+ *	exp_capture ?-i spawn_id? -off | -info
+ *
+ *	-off returns a channel open for reading at the start of the
+ *	capture.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Exp_CaptureObjCmd (
+    ClientData clientData,
+    Tcl_Interp *interp,
+    int objc,
+    Tcl_Obj *CONST objv[])
+{
+    static char *flags[] = {"-i", "-threshold", "-file", "-off", "-info",
+	(char *)0};
+    enum flags {FLAG_SPAWN_ID, FLAG_THRESHOLD, FLAG_FILE, FLAG_OFF,
+	FLAG_INFO};
+    int i, index;
+    int action = -1;
+    char *chanName = NULL;
+    Tcl_Obj *path = NULL;
+    Tcl_WideInt threshold = CAPTURE_DEFAULT_THRESHOLD;
+    ExpState *esPtr;
+    struct ExpCapture *cPtr;
+    Tcl_Channel chan;
+    Tcl_Obj *resultPtr;
+
+    for (i = 1; i < objc; i++) {
+	if (Tcl_GetIndexFromObj(interp, objv[i], flags, "flag", 0,
+		&index) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	switch ((enum flags) index) {
+	case FLAG_SPAWN_ID:
+	    if (++i >= objc) goto usage;
+	    chanName = Tcl_GetString(objv[i]);
+	    break;
+	case FLAG_THRESHOLD:
+	    if (++i >= objc) goto usage;
+	    if (expGetBytes(interp, Tcl_GetString(objv[i]), &threshold)
+		    != TCL_OK) {
+		return TCL_ERROR;
+	    }
+	    if (threshold > 0x3fffffff) {
+		exp_error(interp, "-threshold is too large");
+		return TCL_ERROR;
+	    }
+	    break;
+	case FLAG_FILE:
+	    if (++i >= objc) goto usage;
+	    path = objv[i];
+	    break;
+	case FLAG_OFF:
+	case FLAG_INFO:
+	    action = index;
+	    break;
+	}
+    }
+
+    if (chanName) {
+	esPtr = expStateFromChannelName(interp, chanName, 0, 0, 0,
+		"exp_capture");
+    } else {
+	esPtr = expStateCurrent(interp, 0, 0, 0);
+    }
+    if (esPtr == NULL) {
+	return TCL_ERROR;
+    }
+    cPtr = esPtr->capture;
+
+    if (action == FLAG_INFO) {
+	if (cPtr) {
+	    resultPtr = Tcl_NewListObj(0, NULL);
+	    Tcl_ListObjAppendElement(NULL, resultPtr,
+		    Tcl_NewStringObj("-threshold", -1));
+	    Tcl_ListObjAppendElement(NULL, resultPtr,
+		    Tcl_NewIntObj(cPtr->threshold));
+	    Tcl_ListObjAppendElement(NULL, resultPtr,
+		    Tcl_NewStringObj("-file", -1));
+	    Tcl_ListObjAppendElement(NULL, resultPtr, cPtr->path);
+	    Tcl_ListObjAppendElement(NULL, resultPtr,
+		    Tcl_NewStringObj("bytes", -1));
+	    Tcl_ListObjAppendElement(NULL, resultPtr,
+		    Tcl_NewWideIntObj(cPtr->bytes));
+	    Tcl_ListObjAppendElement(NULL, resultPtr,
+		    Tcl_NewStringObj("spilled", -1));
+	    Tcl_ListObjAppendElement(NULL, resultPtr,
+		    Tcl_NewBooleanObj(cPtr->spilled));
+	    Tcl_SetObjResult(interp, resultPtr);
+	}
+	return TCL_OK;
+    }
+
+    if (action == FLAG_OFF) {
+	if (cPtr == NULL) {
+	    exp_error(interp, "spawn id %s is not being captured",
+		    esPtr->name);
+	    return TCL_ERROR;
+	}
+	CaptureSpill(cPtr);
+	if (!cPtr->error && Tcl_Seek(cPtr->chan, 0, SEEK_SET) < 0) {
+	    cPtr->error = Tcl_GetErrno();
+	}
+	if (cPtr->error) {
+	    exp_error(interp, "error writing capture file \"%.200s\": %s",
+		    Tcl_GetString(cPtr->path), Tcl_ErrnoMsg(cPtr->error));
+	    expCaptureFree(esPtr);
+	    return TCL_ERROR;
+	}
+
+	/* hand the file over as it is, now for reading text */
+	chan = cPtr->chan;
+	cPtr->chan = NULL;
+	Tcl_SetChannelOption(NULL, chan, "-translation", "lf");
+	Tcl_SetChannelOption(NULL, chan, "-encoding", "utf-8");
+	Tcl_RegisterChannel(interp, chan);
+#ifdef __WIN32__
+	if (cPtr->temporary) {
+	    Tcl_IncrRefCount(cPtr->path);
+	    Tcl_CreateCloseHandler(chan, CaptureCloseHandler,
+		    (ClientData) cPtr->path);
+	}
+#endif
+	expCaptureFree(esPtr);
+	Tcl_SetResult(interp, (char *) Tcl_GetChannelName(chan), TCL_VOLATILE);
+	return TCL_OK;
+    }
+
+    if (cPtr) {
+	exp_error(interp, "spawn id %s is already being captured",
+		esPtr->name);
+	return TCL_ERROR;
+    }
+
+    /* open it now, so a bad name is reported here and not at the spill */
+    cPtr = (struct ExpCapture *) ckalloc(sizeof(struct ExpCapture));
+    if (path) {
+	cPtr->chan = Tcl_FSOpenFileChannel(interp, path, "w+", 0600);
+	cPtr->path = path;
+	Tcl_IncrRefCount(path);
+	cPtr->temporary = FALSE;
+    } else {
+	cPtr->chan = CaptureTempOpen(interp, &cPtr->path);
+	cPtr->temporary = TRUE;
+    }
+    if (cPtr->chan == NULL) {
+	if (path) Tcl_DecrRefCount(cPtr->path);
+	ckfree((char *) cPtr);
+	return TCL_ERROR;
+    }
+    Tcl_SetChannelOption(NULL, cPtr->chan, "-translation", "binary");
+    Tcl_SetChannelOption(NULL, cPtr->chan, "-buffersize",
+	    CAPTURE_BUFFERSIZE);
+
+    cPtr->threshold = (int) threshold;
+    cPtr->mem = NULL;
+    cPtr->memLength = cPtr->memSize = 0;
+    cPtr->spilled = FALSE;
+    cPtr->bytes = 0;
+    cPtr->error = 0;
+    esPtr->capture = cPtr;
+
+    /* what expect has read but not yet matched comes first */
+    {
+	int length;
+	char *str = Tcl_GetStringFromObj(esPtr->buffer, &length);
+
+	expCaptureAdd(esPtr, str, length);
+    }
+    return TCL_OK;
+
+ usage:
+    exp_error(interp, "usage: ?-i spawn_id? ?-threshold size? ?-file name? "
+	    "| -off | -info");
+    return TCL_ERROR;
+}
+
+static struct exp_cmd_data cmd_data[]  = {
+{"exp_capture",	Exp_CaptureObjCmd,	0,	0,	0},
+{0}};
+
+void
+exp_init_capture_cmds (
+    Tcl_Interp *interp)
+{
+    exp_create_commands(interp,cmd_data);
+}
@@ -41,6 +41,9 @@ static Tcl_DriverGetHandleProc ExpChanGetHandle;
 static Tcl_DriverBlockModeProc	ExpChanBlock;
 static Tcl_DriverFlushProc ExpChanFlush;
 //static Tcl_DriverHandlerProc ExpChanHandler;
+#ifdef TCL_CHANNEL_VERSION_4
+static Tcl_DriverThreadActionProc ExpChanThreadAction;
+#endif
 
 static Tcl_FileProc ExpChanReadable;
 static Tcl_FileProc ExpChanWritable;
@@ -48,7 +51,11 @@ static Tcl_CloseProc ExpChanCloseHandler;
 
 Tcl_ChannelType ExpChannelType = {
     "exp",
+#ifdef TCL_CHANNEL_VERSION_4
+    TCL_CHANNEL_VERSION_4,
+#else
     TCL_CHANNEL_VERSION_2,
+#endif
     ExpChanClose,		/* Close proc. */
     ExpChanInput,		/* Input proc. */
     ExpChanOutput,		/* Output proc. */
@@ -61,6 +68,10 @@ Tcl_ChannelType ExpChannelType = {
     ExpChanBlock,		/* Set blocking/nonblocking mode.*/
     ExpChanFlush,		/* Flush proc. */
     NULL,			/* Handle channel event proc. */
+#ifdef TCL_CHANNEL_VERSION_4
+    NULL,			/* No wide seek either. */
+    ExpChanThreadAction,	/* Thread action proc. */
+#endif
 };
 
 typedef struct ExpPairState {
@@ -69,6 +80,7 @@ typedef struct ExpPairState {
     Tcl_Channel outChannelPtr;	/* The output child channel */
     int watchMask;		/* Events that are being checked for */
     int blockingPropagate;	/* Propagate a blocking option to children */
+    int closeChildren;		/* Close the children with this channel */
     struct ExpPairState *nextPtr;
 } ExpPairState;
 
@@ -86,6 +98,14 @@ typedef struct ThreadSpecificData {
     int channelCount;	 /* this is process-wide as it is used to
 			     give user some hint as to why a spawn has failed
 			     by looking at process-wide resource usage */
+
+    /*
+     * match_max -global.  Like the channel list these are per thread, so
+     * each thread has its own budget for the buffers it can read.
+     */
+
+    Tcl_WideInt matchBudget;	/* 0 if none */
+    Tcl_WideInt matchCharged;	/* charged to all buffers */
 } ThreadSpecificData;
 static Tcl_ThreadDataKey dataKey;
 
@@ -157,17 +177,22 @@ Exp_CreateExpChannel (
     esPtr->pid = pid;
     esPtr->tclPid = tclPid;
     esPtr->msize = 0;
+    esPtr->charged = 0;
+    esPtr->lastRead = 0;
+    esPtr->chunk8 = 0;
 
     /* initialize a dummy buffer */
     esPtr->buffer = Tcl_NewStringObj("",0);
     Tcl_IncrRefCount(esPtr->buffer);
     esPtr->umsize = exp_default_match_max;
-    /* this will reallocate object with an appropriate sized buffer */
+    /* this sets the buffer limits; the buffer itself grows as data arrives */
     expAdjust(esPtr);
 
     esPtr->printed = 0;
     esPtr->echoed = 0;
     esPtr->rm_nulls = exp_default_rm_nulls;
+    esPtr->strip_ansi = exp_default_strip_ansi;
+    esPtr->ansi_state = 0;
     esPtr->parity = exp_default_parity;
     esPtr->close_on_eof = exp_default_close_on_eof;
     esPtr->key = expect_key++;
@@ -186,6 +211,22 @@ Exp_CreateExpChannel (
     esPtr->freeWhenBgHandlerUnblocked = FALSE;
     esPtr->keepForever = FALSE;
     esPtr->valid = TRUE;
+    esPtr->notifyTime = 0;
+    esPtr->readTime = 0;
+    esPtr->arrivalTime = 0;
+    esPtr->latency = NULL;
+    esPtr->screen = NULL;
+    esPtr->lineStart = 0;
+    esPtr->lineKey = 0;
+    esPtr->lineObj = NULL;
+    esPtr->stream = NULL;
+    esPtr->dispatch = NULL;
+    esPtr->direct = NULL;
+    esPtr->capture = NULL;
+    if (exp_default_direct_read) {
+	expDirectSet(NULL, esPtr, 1);
+    }
+    esPtr->generation = 0;
     tsdPtr->channelCount++;
 
     return esPtr->channel;
@@ -241,7 +282,14 @@ ExpChanClose (
     ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
     int result = TCL_OK;
 
+    expSpawnIdInvalidate();
+    expBufferSetCharge(esPtr, 0);
     Tcl_DecrRefCount(esPtr->buffer);
+    if (esPtr->lineObj) {
+	Tcl_DecrRefCount(esPtr->lineObj);
+	esPtr->lineObj = NULL;
+    }
+    expStreamFree(esPtr);
 
     /*
      * Conceivably, the process may not yet have been waited for.  If this
@@ -334,6 +382,440 @@ ExpChanInput (
     return -1;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Direct reads --
+ *
+ *	Tcl_ReadChars on an exp channel has the generic channel code pull
+ *	bytes from ExpChanInput into its own buffers, convert and translate
+ *	them into a second buffer and append that to the match buffer.
+ *	In direct mode expIRead calls expDirectRead instead, which reads
+ *	from the slave driver straight into the end of esPtr->buffer and
+ *	does the utf-8 check and end of line translation in the same pass
+ *	over the new bytes.  Other encodings are converted from a scratch
+ *	buffer into esPtr->buffer in one step.
+ *
+ *	The -encoding and -translation of the channel are sampled by
+ *	expDirectSet; fconfigure after that has no effect on direct reads
+ *	until direct_read is turned on again.
+ *
+ *----------------------------------------------------------------------
+ */
+
+#define DIRECT_LF	0	/* leave \r alone */
+#define DIRECT_CR	1	/* \r becomes \n */
+#define DIRECT_AUTO	2	/* \r and \r\n become \n */
+
+#define DIRECT_MIN_READ	4096	/* smallest read while the buffer is small */
+
+typedef struct ExpDirect {
+    Tcl_Encoding encoding;	/* NULL for utf-8, which is checked in place */
+    Tcl_Encoding utf8;		/* for utf-8 input that is not valid */
+    Tcl_EncodingState state;
+    int flags;			/* TCL_ENCODING_START until the first read */
+    int eol;			/* DIRECT_* */
+    int sawCR;			/* last character was a translated \r */
+    char pend[8];		/* partial character held for the next read */
+    int pendLen;
+    char *scratch;		/* raw bytes for other encodings */
+    int scratchSize;
+} ExpDirect;
+
+static void
+DirectFree(dPtr)
+    ExpDirect *dPtr;
+{
+    if (dPtr->encoding) {
+	Tcl_FreeEncoding(dPtr->encoding);
+    }
+    if (dPtr->utf8) {
+	Tcl_FreeEncoding(dPtr->utf8);
+    }
+    if (dPtr->scratch) {
+	ckfree(dPtr->scratch);
+    }
+    ckfree((char *) dPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expDirectSet --
+ *
+ *	Turn direct reads on or off for a spawn id.  Turning them on
+ *	samples the channel's input encoding and translation.
+ *
+ * Results:
+ *	TCL_OK, or TCL_ERROR with a message in interp (if not NULL) when
+ *	the channel is configured for -translation crlf, which direct
+ *	reads do not handle.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+expDirectSet(interp, esPtr, enable)
+    Tcl_Interp *interp;
+    ExpState *esPtr;
+    int enable;
+{
+    ExpDirect *dPtr;
+    Tcl_DString dStr;
+    CONST char *name;
+    int eol = DIRECT_AUTO;
+    int argc;
+    CONST char **argv;
+
+    if (esPtr->direct) {
+	DirectFree(esPtr->direct);
+	esPtr->direct = NULL;
+    }
+    if (!enable) {
+	return TCL_OK;
+    }
+
+    /* the first element is the input translation */
+    Tcl_DStringInit(&dStr);
+    if (Tcl_GetChannelOption(interp, esPtr->channel, "-translation", &dStr)
+	    == TCL_OK
+	    && Tcl_SplitList(NULL, Tcl_DStringValue(&dStr), &argc, &argv)
+	    == TCL_OK) {
+	if (argc > 0) {
+	    if (strcmp(argv[0], "lf") == 0 || strcmp(argv[0], "binary") == 0) {
+		eol = DIRECT_LF;
+	    } else if (strcmp(argv[0], "cr") == 0) {
+		eol = DIRECT_CR;
+	    } else if (strcmp(argv[0], "crlf") == 0) {
+		eol = -1;
+	    }
+	}
+	ckfree((char *) argv);
+    }
+    Tcl_DStringFree(&dStr);
+    if (eol < 0) {
+	if (interp) {
+	    Tcl_SetResult(interp,
+		    "direct reads do not support -translation crlf",
+		    TCL_STATIC);
+	}
+	return TCL_ERROR;
+    }
+
+    dPtr = (ExpDirect *) ckalloc(sizeof(ExpDirect));
+    dPtr->encoding = NULL;
+    dPtr->utf8 = NULL;
+    dPtr->state = NULL;
+    dPtr->flags = TCL_ENCODING_START;
+    dPtr->eol = eol;
+    dPtr->sawCR = FALSE;
+    dPtr->pendLen = 0;
+    dPtr->scratch = NULL;
+    dPtr->scratchSize = 0;
+
+    Tcl_DStringInit(&dStr);
+    if (Tcl_GetChannelOption(interp, esPtr->channel, "-encoding", &dStr)
+	    == TCL_OK) {
+	name = Tcl_DStringValue(&dStr);
+	/* a binary channel maps each byte to the character of that code */
+	if (strcmp(name, "binary") == 0) {
+	    name = "iso8859-1";
+	}
+	if (strcmp(name, "utf-8") != 0) {
+	    dPtr->encoding = Tcl_GetEncoding(NULL, name);
+	}
+    }
+    Tcl_DStringFree(&dStr);
+
+    esPtr->direct = dPtr;
+    return TCL_OK;
+}
+
+/*
+ * Translate end of lines in place over len bytes of utf-8.  Returns the
+ * new length and takes the dropped characters off *charsPtr.
+ */
+
+static int
+DirectEol(dPtr, buf, len, charsPtr)
+    ExpDirect *dPtr;
+    char *buf;
+    int len;
+    int *charsPtr;
+{
+    char *src, *dst, *end = buf + len;
+
+    if (dPtr->eol == DIRECT_LF) {
+	return len;
+    }
+    for (src = dst = buf; src < end; src++) {
+	if (*src == '\r') {
+	    *dst++ = '\n';
+	    dPtr->sawCR = (dPtr->eol == DIRECT_AUTO);
+	    continue;
+	}
+	if (*src == '\n' && dPtr->sawCR) {
+	    dPtr->sawCR = FALSE;
+	    (*charsPtr)--;
+	    continue;
+	}
+	dPtr->sawCR = FALSE;
+	*dst++ = *src;
+    }
+    return dst - buf;
+}
+
+/*
+ * Check and translate utf-8 in place.  Stops at the first byte that
+ * needs Tcl_ExternalToUtf (a null, which Tcl keeps as \xC0\x80, or
+ * anything that is not valid utf-8 of up to three bytes).  A character
+ * cut off by the end of the read is moved to dPtr->pend.  Returns the
+ * number of characters; *lenPtr is set to the bytes written and
+ * *usedPtr to the bytes consumed.
+ */
+
+static int
+DirectUtf8(dPtr, buf, len, lenPtr, usedPtr)
+    ExpDirect *dPtr;
+    char *buf;
+    int len;
+    int *lenPtr;
+    int *usedPtr;
+{
+    unsigned char *src = (unsigned char *) buf;
+    unsigned char *end = src + len;
+    char *dst = buf;
+    int chars = 0;
+    int cr = (dPtr->eol != DIRECT_LF);
+    int n, i;
+
+    while (src < end) {
+	unsigned char c = *src;
+
+	if (c < 0x80) {
+	    if (c == 0) {
+		break;
+	    }
+	    src++;
+	    if (c == '\r' && cr) {
+		*dst++ = '\n';
+		dPtr->sawCR = (dPtr->eol == DIRECT_AUTO);
+		chars++;
+		continue;
+	    }
+	    if (c == '\n' && dPtr->sawCR) {
+		dPtr->sawCR = FALSE;
+		continue;
+	    }
+	    dPtr->sawCR = FALSE;
+	    *dst++ = c;
+	    chars++;
+	    continue;
+	}
+
+	if (c >= 0xC2 && c <= 0xDF) {
+	    n = 2;
+	} else if (c >= 0xE0 && c <= 0xEF) {
+	    n = 3;
+	} else {
+	    break;
+	}
+	for (i = 1; i < n && src + i < end; i++) {
+	    if ((src[i] & 0xC0) != 0x80) {
+		break;
+	    }
+	}
+	if (n == 3 && i > 1 && c == 0xE0 && src[1] < 0xA0) {
+	    break;			/* overlong */
+	}
+	if (src + i == end && i < n) {
+	    /* the rest of this character is still on its way */
+	    memcpy(dPtr->pend, src, i);
+	    dPtr->pendLen = i;
+	    src = end;
+	    break;
+	}
+	if (i < n) {
+	    break;
+	}
+	dPtr->sawCR = FALSE;
+	while (n--) {
+	    *dst++ = *src++;
+	}
+	chars++;
+    }
+    *lenPtr = dst - buf;
+    *usedPtr = (char *) src - buf;
+    return chars;
+}
+
+/*
+ * Convert srcLen bytes with encoding and append them to esPtr->buffer
+ * after its first offset bytes.  Bytes of an incomplete character are
+ * kept in dPtr->pend.  Returns the number of characters appended.
+ */
+
+static int
+DirectConvert(esPtr, encoding, src, srcLen, flags, offset)
+    ExpState *esPtr;
+    Tcl_Encoding encoding;
+    CONST char *src;
+    int srcLen;
+    int flags;
+    int offset;
+{
+    ExpDirect *dPtr = esPtr->direct;
+    int room = srcLen * TCL_UTF_MAX + 1;
+    int srcRead, dstWrote, dstChars;
+    char *dst;
+
+    Tcl_SetObjLength(esPtr->buffer, offset + room);
+    dst = Tcl_GetString(esPtr->buffer) + offset;
+    Tcl_ExternalToUtf(NULL, encoding, src, srcLen, flags | dPtr->flags,
+	    &dPtr->state, dst, room, &srcRead, &dstWrote, &dstChars);
+    dPtr->flags = 0;
+
+    dPtr->pendLen = srcLen - srcRead;
+    if (dPtr->pendLen > (int) sizeof(dPtr->pend)) {
+	dPtr->pendLen = 0;
+    }
+    memcpy(dPtr->pend, src + srcRead, dPtr->pendLen);
+
+    dstWrote = DirectEol(dPtr, dst, dstWrote, &dstChars);
+    Tcl_SetObjLength(esPtr->buffer, offset + dstWrote);
+    return dstChars;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expDirectRead --
+ *
+ *	Read up to toRead bytes from the spawned process and append them,
+ *	converted and translated, to esPtr->buffer.
+ *
+ * Results:
+ *	The number of characters appended, 0 if nothing was available,
+ *	EXP_EOF at end of file or -1 with errno set on error.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+expDirectRead(esPtr, toRead)
+    ExpState *esPtr;
+    int toRead;
+{
+    ExpDirect *dPtr = esPtr->direct;
+    Tcl_Obj *objPtr = esPtr->buffer;
+    Tcl_Encoding encoding;
+    int length, n, err = 0;
+    int chars, outLen, used;
+    char *dst;
+
+    if (Tcl_IsShared(objPtr)) {
+	objPtr = Tcl_DuplicateObj(objPtr);
+	Tcl_IncrRefCount(objPtr);
+	Tcl_DecrRefCount(esPtr->buffer);
+	esPtr->buffer = objPtr;
+    }
+    Tcl_GetStringFromObj(objPtr, &length);
+
+    /*
+     * Let the buffer grow with what arrives instead of reserving all of
+     * match_max up front: read at most as much again as it holds.
+     */
+    if (toRead > length && toRead > DIRECT_MIN_READ) {
+	toRead = (length > DIRECT_MIN_READ) ? length : DIRECT_MIN_READ;
+    }
+
+    if (dPtr->encoding == NULL) {
+	/* utf-8: read in place, behind any held partial character */
+	Tcl_SetObjLength(objPtr, length + dPtr->pendLen + toRead);
+	dst = Tcl_GetString(objPtr) + length;
+	memcpy(dst, dPtr->pend, dPtr->pendLen);
+	n = ExpChanInput((ClientData) esPtr, dst + dPtr->pendLen, toRead, &err);
+	if (n <= 0) {
+	    Tcl_SetObjLength(objPtr, length);
+	    goto noData;
+	}
+	n += dPtr->pendLen;
+	dPtr->pendLen = 0;
+	chars = DirectUtf8(dPtr, dst, n, &outLen, &used);
+	if (used == n) {
+	    Tcl_SetObjLength(objPtr, length + outLen);
+	    return chars;
+	}
+
+	/* hand the rest to the encoding code, which may move the object */
+	if (dPtr->scratchSize < n - used) {
+	    dPtr->scratch = ckrealloc(dPtr->scratch, n - used);
+	    dPtr->scratchSize = n - used;
+	}
+	memcpy(dPtr->scratch, dst + used, n - used);
+	if (dPtr->utf8 == NULL) {
+	    dPtr->utf8 = Tcl_GetEncoding(NULL, "utf-8");
+	}
+	return chars + DirectConvert(esPtr, dPtr->utf8, dPtr->scratch,
+		n - used, 0, length + outLen);
+    }
+
+    if (dPtr->scratchSize < dPtr->pendLen + toRead) {
+	dPtr->scratch = ckrealloc(dPtr->scratch, dPtr->pendLen + toRead);
+	dPtr->scratchSize = dPtr->pendLen + toRead;
+    }
+    memcpy(dPtr->scratch, dPtr->pend, dPtr->pendLen);
+    n = ExpChanInput((ClientData) esPtr, dPtr->scratch + dPtr->pendLen,
+	    toRead, &err);
+    if (n <= 0) {
+	goto noData;
+    }
+    return DirectConvert(esPtr, dPtr->encoding, dPtr->scratch,
+	    n + dPtr->pendLen, 0, length);
+
+noData:
+    if (n < 0) {
+	if (err == EAGAIN || err == EWOULDBLOCK) {
+	    return 0;
+	}
+	Tcl_SetErrno(err);
+	return -1;
+    }
+    if (dPtr->pendLen == 0) {
+	return EXP_EOF;
+    }
+    /* end of file: flush what is left of a partial character */
+    encoding = dPtr->encoding;
+    if (encoding == NULL) {
+	if (dPtr->utf8 == NULL) {
+	    dPtr->utf8 = Tcl_GetEncoding(NULL, "utf-8");
+	}
+	encoding = dPtr->utf8;
+    }
+    n = dPtr->pendLen;
+    if (dPtr->scratchSize < n) {
+	dPtr->scratch = ckrealloc(dPtr->scratch, n);
+	dPtr->scratchSize = n;
+    }
+    memcpy(dPtr->scratch, dPtr->pend, n);
+    return DirectConvert(esPtr, encoding, dPtr->scratch, n,
+	    TCL_ENCODING_END, length);
+}
+
+/*
+ * Called from expStateFree.
+ */
+
+void
+expDirectFree(esPtr)
+    ExpState *esPtr;
+{
+    if (esPtr->direct) {
+	DirectFree(esPtr->direct);
+	esPtr->direct = NULL;
+    }
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -495,7 +977,7 @@ ExpChanWatch (
     if (mask & TCL_WRITABLE) {
 	if (!(old_mask & TCL_WRITABLE)) {
 	    Tcl_CreateChannelHandler(channel, TCL_WRITABLE,
-		ExpChanReadable, instanceData);
+		ExpChanWritable, instanceData);
 	}
     } else if (old_mask & TCL_WRITABLE) {
 	Tcl_DeleteChannelHandler(channel, ExpChanWritable, instanceData);
@@ -606,6 +1088,33 @@ ExpChanFlush (
     return TCL_OK;
 }
 
+#ifdef TCL_CHANNEL_VERSION_4
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpChanThreadAction --
+ *
+ *	Called as the channel is cut from a thread or spliced into one.
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	Spawn ids cached by expStateFromChannelObj in the thread are
+ *	looked up again.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ExpChanThreadAction (
+    ClientData instanceData,
+    int action)
+{
+    expSpawnIdInvalidate();
+}
+#endif
+
 /*
  *----------------------------------------------------------------------
  *
@@ -725,6 +1234,12 @@ expStateFree(esPtr)
 #endif
 
     esPtr->valid = FALSE;
+    expSpawnIdInvalidate();
+    expLatencyFree(esPtr);
+    expScreenFree(esPtr);
+    expDispatchFree(esPtr);
+    expDirectFree(esPtr);
+    expCaptureFree(esPtr);
     
     if (!esPtr->keepForever) {
 	ckfree((char *)esPtr);
@@ -821,6 +1336,130 @@ expWaitOnOne() {
 }
 #endif
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * expBufferPressure --
+ *
+ *	Called whenever a buffer may have grown, and does nothing unless
+ *	this thread's buffers are over match_max -global.  Then the
+ *	buffers of the other spawn ids are compacted, least recently read
+ *	first, and if that is not enough they are trimmed to their own
+ *	match_max, which is all a match is guaranteed to see anyway.  It
+ *	stops once the total is an eighth under the budget.
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ExpIdleCompare (
+    CONST VOID *a,
+    CONST VOID *b)
+{
+    ExpState *x = *(ExpState **) a;
+    ExpState *y = *(ExpState **) b;
+
+    return (x->lastRead > y->lastRead) - (x->lastRead < y->lastRead);
+}
+
+void
+expBufferPressure (
+    ExpState *except)	/* being read, so left alone */
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+    Tcl_WideInt target = tsdPtr->matchBudget - tsdPtr->matchBudget / 8;
+    ExpState *esPtr;
+    ExpState **idle;
+    int i, n = 0, pass;
+
+    if (tsdPtr->matchBudget <= 0
+	    || tsdPtr->matchCharged <= tsdPtr->matchBudget
+	    || tsdPtr->channelCount <= 0) {
+	return;
+    }
+    idle = (ExpState **) ckalloc(tsdPtr->channelCount * sizeof(ExpState *));
+    for (esPtr = tsdPtr->firstExpPtr; esPtr; esPtr = esPtr->nextPtr) {
+	if (esPtr != except && esPtr->charged > 0
+		&& n < tsdPtr->channelCount) {
+	    idle[n++] = esPtr;
+	}
+    }
+    qsort((VOID *) idle, (size_t) n, sizeof(ExpState *), ExpIdleCompare);
+
+    for (pass = 0; pass < 2 && tsdPtr->matchCharged > target; pass++) {
+	for (i = 0; i < n && tsdPtr->matchCharged > target; i++) {
+	    expBufferCompact(idle[i], pass == 0 ? -1 : idle[i]->umsize);
+	}
+    }
+    ckfree((char *) idle);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expBufferSetCharge --
+ *
+ *	Sets what a buffer is charged against match_max -global, keeping
+ *	the thread's total in step.
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+expBufferSetCharge (
+    ExpState *esPtr,
+    int charged)
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+
+    tsdPtr->matchCharged += charged - esPtr->charged;
+    esPtr->charged = charged;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expMatchCharged, expMatchBudget, expSetMatchBudget --
+ *
+ *	Get the bytes charged to this thread's buffers, and get or set
+ *	its match_max -global budget.  Setting a budget under what is
+ *	already charged compacts the buffers at once.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_WideInt
+expMatchCharged (void)
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+
+    return tsdPtr->matchCharged;
+}
+
+Tcl_WideInt
+expMatchBudget (void)
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+
+    return tsdPtr->matchBudget;
+}
+
+void
+expSetMatchBudget (
+    Tcl_WideInt budget)
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+
+    tsdPtr->matchBudget = budget;
+    expBufferPressure(NULL);
+}
+
 void
 exp_background_channelhandlers_run_all()
 {
@@ -944,6 +1583,7 @@ Exp_CreatePairChannel (
     epsPtr->thisChannelPtr = chan;
     epsPtr->watchMask = 0;
     epsPtr->blockingPropagate = 0;
+    epsPtr->closeChildren = 0;
 
     Tcl_CreateCloseHandler(chanIn, ExpPairInputCloseHandler,
 	(ClientData) epsPtr);
@@ -1167,16 +1807,23 @@ ExpPairClose (
     }
 
     /*
-     *  Only let them go, don't actually close them.
+     *  Only let them go, don't actually close them, unless they were
+     *  made for this channel alone (spawn -pipe).
      */
 
     if (epsPtr->inChannelPtr) {
 	Tcl_DeleteCloseHandler(epsPtr->inChannelPtr, ExpPairInputCloseHandler,
 	    (ClientData) epsPtr);
+	if (epsPtr->closeChildren) {
+	    Tcl_Close(NULL, epsPtr->inChannelPtr);
+	}
     }
     if (epsPtr->outChannelPtr) {
 	Tcl_DeleteCloseHandler(epsPtr->outChannelPtr, ExpPairOutputCloseHandler,
 	    (ClientData) epsPtr);
+	if (epsPtr->closeChildren) {
+	    Tcl_Close(NULL, epsPtr->outChannelPtr);
+	}
     }
     ckfree((char *)epsPtr);
 
@@ -1223,6 +1870,13 @@ ExpPairSetOption (
 	ssPtr->blockingPropagate = newMode;
 	return TCL_OK;
     }
+    if (strcmp(nameStr, "-closechildren") == 0) {
+        if (Tcl_GetBoolean(interp, valStr, &newMode) == TCL_ERROR) {
+            return TCL_ERROR;
+        }
+	ssPtr->closeChildren = newMode;
+	return TCL_OK;
+    }
 
     /*
      * If the option can be applied to either channel, the result is OK.
@@ -1291,6 +1945,15 @@ ExpPairGetOption (
 		(ssPtr->blockingPropagate) ? "0" : "1");
 	valid = 1;
     }
+    if (len == 0) {
+	Tcl_DStringAppendElement(dsPtr, "-closechildren");
+    }
+    if ((len == 0) ||
+	    ((len > 2) && (strcmp(nameStr, "-closechildren") == 0))) {
+        Tcl_DStringAppendElement(dsPtr,
+		(ssPtr->closeChildren) ? "1" : "0");
+	valid = 1;
+    }
 
     if (inChannelPtr && Tcl_ChannelGetOptionProc(Tcl_GetChannelType(inChannelPtr))) {
 	ret = (Tcl_ChannelGetOptionProc(Tcl_GetChannelType(inChannelPtr)))
@@ -0,0 +1,967 @@
+/* ----------------------------------------------------------------------------
+ * exp_clib.c --
+ *
+ *	The C expect library: exp_spawnl/exp_spawnv/exp_popen to start a
+ *	process and exp_expectl/exp_expectv to wait for its output, for
+ *	programs that want expect without a Tcl interpreter.  Everything
+ *	works over plain file descriptors.  Each descriptor has its own
+ *	match buffer, so one process can drive many sessions; the
+ *	exp_match/exp_buffer globals describe the last call only.
+ *
+ *	Matching follows the expect command: glob patterns go through
+ *	Exp_StringCaseMatch, regexps through Tcl's engine, the buffer
+ *	keeps exp_match_max bytes matchable and forgets the oldest half
+ *	when it fills, and nulls are stripped unless exp_remove_nulls
+ *	is 0.
+ *
+ *	On UNIX the process runs on a pty.  On Windows it runs with its
+ *	standard handles on one end of a duplex named pipe, so console
+ *	programs that insist on a real console are better driven through
+ *	the extension.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#if !defined(_WIN32) && !defined(_XOPEN_SOURCE)
+#   define _XOPEN_SOURCE 600	/* posix_openpt and friends */
+#endif
+
+#include "expect.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#ifdef __WIN32__
+#   define WIN32_LEAN_AND_MEAN
+#   include <windows.h>
+#   include <io.h>
+#   include <fcntl.h>
+#   define read _read
+#else
+#   include <unistd.h>
+#   include <fcntl.h>
+#   include <termios.h>
+#   include <poll.h>
+#   include <sys/types.h>
+#   include <sys/time.h>
+#   include <sys/ioctl.h>
+#endif
+
+/* exp_glob.c */
+extern int Exp_StringCaseMatch (CONST char *string, CONST char *pattern,
+	int nocase, int *offset);
+
+int exp_timeout = 10;
+int exp_match_max = 2000;
+int exp_full_buffer = 0;
+int exp_remove_nulls = 1;
+char *exp_match = NULL;
+char *exp_match_end = NULL;
+char *exp_buffer = NULL;
+char *exp_buffer_end = NULL;
+
+int exp_pid = 0;
+int exp_ttycopy = 1;
+int exp_autoallocpty = 1;
+int exp_pty[2];
+char *exp_pty_slave_name = NULL;
+void (*exp_close_in_child) (void) = NULL;
+void (*exp_child_exec_prelude) (void) = NULL;
+
+/*
+ * Per descriptor state, indexed by the descriptor itself.
+ */
+
+typedef struct ExpClibBuf {
+    char *buffer;	/* Bytes read and not yet consumed, with a
+			 * trailing null so the matchers can treat it
+			 * as a string. */
+    int length;		/* Bytes in buffer. */
+    int msize;		/* Usable size of buffer, twice exp_match_max
+			 * so that exp_match_max bytes stay matchable
+			 * after the oldest half is dropped. */
+    int consumed;	/* Bytes matched by the last call, dropped at
+			 * the start of the next one so that exp_match
+			 * stays valid in between. */
+    char *pend;		/* Bytes handed to exp_fill, not yet moved
+			 * into buffer. */
+    int pendStart, pendLength, pendSize;
+    int eof;		/* exp_fill reported end of file... */
+    int error;		/* ...or this errno. */
+} ExpClibBuf;
+
+static ExpClibBuf **bufs = NULL;
+static int bufCount = 0;
+static int initialized = 0;
+
+
+static ExpClibBuf *
+ExpClibGetBuf (int fd)
+{
+    ExpClibBuf *f;
+
+    if (fd < 0) {
+	errno = EBADF;
+	return NULL;
+    }
+    if (!initialized) {
+	/* The regexp engine and Tcl's allocator need this, nothing else. */
+	Tcl_FindExecutable(NULL);
+	initialized = 1;
+    }
+    if (fd >= bufCount) {
+	int n = (bufCount ? bufCount : 16);
+	ExpClibBuf **b;
+
+	while (n <= fd) n *= 2;
+	b = (ExpClibBuf **) realloc(bufs, n * sizeof(ExpClibBuf *));
+	if (b == NULL) {
+	    errno = ENOMEM;
+	    return NULL;
+	}
+	memset(b + bufCount, 0, (n - bufCount) * sizeof(ExpClibBuf *));
+	bufs = b;
+	bufCount = n;
+    }
+    if ((f = bufs[fd]) == NULL) {
+	f = (ExpClibBuf *) calloc(1, sizeof(ExpClibBuf));
+	if (f == NULL) {
+	    errno = ENOMEM;
+	    return NULL;
+	}
+	bufs[fd] = f;
+    }
+    return f;
+}
+
+static void
+ExpClibResetBuf (int fd)
+{
+    if (fd >= 0 && fd < bufCount && bufs[fd] != NULL) {
+	free(bufs[fd]->buffer);
+	free(bufs[fd]->pend);
+	free(bufs[fd]);
+	bufs[fd] = NULL;
+    }
+}
+
+/*
+ * Drop what the last call matched and size the buffer for the current
+ * exp_match_max, keeping the newest bytes if it shrank.
+ */
+
+static int
+ExpClibPrepare (ExpClibBuf *f)
+{
+    int msize = 2 * (exp_match_max > 0 ? exp_match_max : 1);
+
+    if (f->consumed) {
+	f->length -= f->consumed;
+	memmove(f->buffer, f->buffer + f->consumed, f->length);
+	f->consumed = 0;
+    }
+    if (msize != f->msize || f->buffer == NULL) {
+	char *b;
+
+	if (f->length > msize) {
+	    memmove(f->buffer, f->buffer + f->length - msize, msize);
+	    f->length = msize;
+	}
+	b = (char *) realloc(f->buffer, msize + 1);
+	if (b == NULL) {
+	    errno = ENOMEM;
+	    return -1;
+	}
+	f->buffer = b;
+	f->msize = msize;
+    }
+    f->buffer[f->length] = '\0';
+    return 0;
+}
+
+/*
+ * Try each case against the buffer.  Returns the index of the case that
+ * matched and points startPtr and endPtr at the bytes it matched, or -1.
+ */
+
+static int
+ExpClibMatch (ExpClibBuf *f, struct exp_case *cases, char **startPtr,
+	char **endPtr)
+{
+    struct exp_case *c;
+    char *buf = f->buffer;
+
+    for (c = cases; c->type != exp_end; c++) {
+	switch (c->type) {
+	case exp_glob: {
+	    int offset, n;
+
+	    n = Exp_StringCaseMatch(buf, c->pattern, 0, &offset);
+	    if (n >= 0) {
+		*startPtr = buf + offset;
+		*endPtr = buf + offset + n;
+		return c - cases;
+	    }
+	    break;
+	}
+	case exp_exact: {
+	    char *s = strstr(buf, c->pattern);
+
+	    if (s != NULL) {
+		*startPtr = s;
+		*endPtr = s + strlen(c->pattern);
+		return c - cases;
+	    }
+	    break;
+	}
+	case exp_regexp:
+	case exp_compiled: {
+	    Tcl_RegExp re = c->re;
+	    CONST char *s, *e;
+
+	    if (c->type == exp_regexp) {
+		/* Compiled patterns are kept in Tcl's per thread cache. */
+		re = Tcl_RegExpCompile(NULL, c->pattern);
+	    }
+	    if (re != NULL && Tcl_RegExpExec(NULL, re, buf, buf) > 0) {
+		Tcl_RegExpRange(re, 0, &s, &e);
+		*startPtr = (char *) s;
+		*endPtr = (char *) e;
+		return c - cases;
+	    }
+	    break;
+	}
+	case exp_null: {
+	    char *s = memchr(buf, 0, f->length);
+
+	    if (s != NULL) {
+		*startPtr = s;
+		*endPtr = s + 1;
+		return c - cases;
+	    }
+	    break;
+	}
+	default:
+	    break;
+	}
+    }
+    return -1;
+}
+
+static long
+ExpClibNow (void)
+{
+#ifdef __WIN32__
+    return (long) GetTickCount();
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000L + tv.tv_usec / 1000;
+#endif
+}
+
+/*
+ * Wait for fd to become readable.  Returns 1 when it is (or when it is
+ * at eof or in error, which the read will report), 0 on timeout and -1
+ * on error.  A negative timeout waits forever.
+ */
+
+static int
+ExpClibWait (int fd, long msec)
+{
+#ifdef __WIN32__
+    HANDLE h = (HANDLE) _get_osfhandle(fd);
+    DWORD avail, start = GetTickCount();
+
+    if (GetFileType(h) != FILE_TYPE_PIPE) {
+	return 1;
+    }
+    for (;;) {
+	if (!PeekNamedPipe(h, NULL, 0, NULL, &avail, NULL) || avail > 0) {
+	    return 1;
+	}
+	if (msec >= 0 && (long) (GetTickCount() - start) >= msec) {
+	    return 0;
+	}
+	Sleep(10);
+    }
+#else
+    /* poll rather than select: fd may be past FD_SETSIZE. */
+    struct pollfd pfd;
+    long deadline = 0;
+    int rc, wait = -1;
+
+    if (msec >= 0) {
+	deadline = ExpClibNow() + msec;
+    }
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    for (;;) {
+	if (msec >= 0 && (wait = (int) (deadline - ExpClibNow())) < 0) {
+	    wait = 0;
+	}
+	rc = poll(&pfd, 1, wait);
+	if (rc >= 0 || errno != EINTR) {
+	    break;
+	}
+    }
+    return (rc > 0 ? 1 : rc);
+#endif
+}
+
+/*
+ * Set the exp_buffer globals for a return from expect.
+ */
+
+static void
+ExpClibReport (ExpClibBuf *f, char *start, char *end)
+{
+    exp_buffer = f->buffer;
+    exp_buffer_end = f->buffer + f->length;
+    exp_match = start;
+    exp_match_end = end;
+}
+
+/*
+ * Append cc bytes at the end of the buffer, dropping nulls if asked to.
+ */
+
+static void
+ExpClibAppend (ExpClibBuf *f, const char *data, int cc)
+{
+    if (exp_remove_nulls) {
+	const char *src = data, *stop = data + cc;
+	char *dst = f->buffer + f->length;
+
+	for (; src < stop; src++) {
+	    if (*src != '\0') *dst++ = *src;
+	}
+	cc = dst - (f->buffer + f->length);
+    } else if (data != f->buffer + f->length) {
+	memcpy(f->buffer + f->length, data, cc);
+    }
+    f->length += cc;
+    f->buffer[f->length] = '\0';
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_expectv --
+ *
+ *	Read from fd until one of cases matches, the timeout expires or
+ *	the process closes its end.
+ *
+ * Results:
+ *	The value of the case that matched, EXP_TIMEOUT, EXP_EOF,
+ *	EXP_FULLBUFFER, or -1 with errno set.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+exp_expectv (int fd, struct exp_case *cases)
+{
+    ExpClibBuf *f;
+    char *start, *end;
+    long deadline = 0;
+    int i;
+
+    if ((f = ExpClibGetBuf(fd)) == NULL || ExpClibPrepare(f) < 0) {
+	return -1;
+    }
+    if (exp_timeout > 0) {
+	deadline = ExpClibNow() + exp_timeout * 1000L;
+    }
+
+    /* What is left over from the last call may already match. */
+    if (f->length > 0 && (i = ExpClibMatch(f, cases, &start, &end)) >= 0) {
+	f->consumed = end - f->buffer;
+	ExpClibReport(f, start, end);
+	return cases[i].value;
+    }
+
+    for (;;) {
+	int cc, rc;
+
+	if (f->length == f->msize) {
+	    if (exp_full_buffer) {
+		f->consumed = f->length;
+		ExpClibReport(f, f->buffer, f->buffer + f->length);
+		return EXP_FULLBUFFER;
+	    }
+	    f->length -= f->msize / 2;
+	    memmove(f->buffer, f->buffer + f->msize / 2, f->length);
+	}
+
+	{
+	    /* a timeout of 0 still polls, so a blocking fd can't hang us */
+	    long wait = -1;
+
+	    if (exp_timeout == 0) {
+		wait = 0;
+	    } else if (exp_timeout > 0
+		    && (wait = deadline - ExpClibNow()) < 0) {
+		wait = 0;
+	    }
+	    if ((rc = ExpClibWait(fd, wait)) < 0) {
+		return -1;
+	    }
+	    if (rc == 0) {
+		ExpClibReport(f, NULL, NULL);
+		return EXP_TIMEOUT;
+	    }
+	}
+
+	cc = read(fd, f->buffer + f->length, f->msize - f->length);
+	if (cc < 0 && errno == EINTR) {
+	    continue;
+	}
+	if (cc <= 0) {
+	    /* A pty reports the slave closing as EIO. */
+	    if (cc < 0 && errno != EIO) {
+#ifdef __WIN32__
+		if (errno != EPIPE)
+#endif
+		return -1;
+	    }
+	    f->consumed = f->length;
+	    ExpClibReport(f, NULL, NULL);
+	    return EXP_EOF;
+	}
+
+	ExpClibAppend(f, f->buffer + f->length, cc);
+
+	if ((i = ExpClibMatch(f, cases, &start, &end)) >= 0) {
+	    f->consumed = end - f->buffer;
+	    ExpClibReport(f, start, end);
+	    return cases[i].value;
+	}
+	if (exp_timeout == 0) {
+	    ExpClibReport(f, NULL, NULL);
+	    return EXP_TIMEOUT;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_bufferedv --
+ *
+ *	Like exp_expectv, but never reads fd.  The cases are tried
+ *	against what is buffered and then against what exp_fill has
+ *	queued, a buffer at a time, the way exp_expectv tries them
+ *	against each read.  Event driven callers use this before waiting
+ *	and either exp_expectv with exp_timeout of 0 once fd is readable,
+ *	or exp_fill and this again when they do the reading themselves.
+ *
+ * Results:
+ *	The value of the case that matched, EXP_TIMEOUT if none did,
+ *	EXP_FULLBUFFER, EXP_EOF once exp_fill has reported the end and
+ *	everything queued is used up, or -1 with errno set.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+exp_bufferedv (int fd, struct exp_case *cases)
+{
+    ExpClibBuf *f;
+    char *start, *end;
+    int i;
+
+    if ((f = ExpClibGetBuf(fd)) == NULL || ExpClibPrepare(f) < 0) {
+	return -1;
+    }
+    if (f->length > 0 && (i = ExpClibMatch(f, cases, &start, &end)) >= 0) {
+	f->consumed = end - f->buffer;
+	ExpClibReport(f, start, end);
+	return cases[i].value;
+    }
+
+    while (f->pendLength > 0) {
+	int cc;
+
+	if (f->length == f->msize) {
+	    if (exp_full_buffer) {
+		f->consumed = f->length;
+		ExpClibReport(f, f->buffer, f->buffer + f->length);
+		return EXP_FULLBUFFER;
+	    }
+	    f->length -= f->msize / 2;
+	    memmove(f->buffer, f->buffer + f->msize / 2, f->length);
+	}
+
+	cc = f->msize - f->length;
+	if (cc > f->pendLength) {
+	    cc = f->pendLength;
+	}
+	ExpClibAppend(f, f->pend + f->pendStart, cc);
+	f->pendStart += cc;
+	f->pendLength -= cc;
+
+	if ((i = ExpClibMatch(f, cases, &start, &end)) >= 0) {
+	    f->consumed = end - f->buffer;
+	    ExpClibReport(f, start, end);
+	    return cases[i].value;
+	}
+    }
+
+    if (f->error) {
+	errno = f->error;
+	return -1;
+    }
+    if (f->eof) {
+	f->consumed = f->length;
+	ExpClibReport(f, NULL, NULL);
+	return EXP_EOF;
+    }
+    ExpClibReport(f, NULL, NULL);
+    return EXP_TIMEOUT;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_fill --
+ *
+ *	Queue bytes read from fd by the caller (an io_uring completion,
+ *	say) for exp_bufferedv to match.  A len of 0 reports end of file
+ *	and a negative len reports the error -len; EIO counts as end of
+ *	file, as it does for a pty.
+ *
+ * Results:
+ *	0, or -1 with errno set.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+exp_fill (int fd, const char *data, int len)
+{
+    ExpClibBuf *f;
+
+    if ((f = ExpClibGetBuf(fd)) == NULL) {
+	return -1;
+    }
+    if (len <= 0) {
+	if (len == 0 || len == -EIO) {
+	    f->eof = 1;
+	} else {
+	    f->error = -len;
+	}
+	return 0;
+    }
+    if (f->pendStart > 0) {
+	memmove(f->pend, f->pend + f->pendStart, f->pendLength);
+	f->pendStart = 0;
+    }
+    if (f->pendLength + len > f->pendSize) {
+	int n = (f->pendSize ? f->pendSize : 4096);
+	char *b;
+
+	while (n < f->pendLength + len) n *= 2;
+	if ((b = (char *) realloc(f->pend, n)) == NULL) {
+	    errno = ENOMEM;
+	    return -1;
+	}
+	f->pend = b;
+	f->pendSize = n;
+    }
+    memcpy(f->pend + f->pendLength, data, len);
+    f->pendLength += len;
+    return 0;
+}
+
+int
+exp_fexpectv (FILE *fp, struct exp_case *cases)
+{
+    return exp_expectv(fileno(fp), cases);
+}
+
+/*
+ * Gather the (type, pattern, [re,] value) ... exp_end argument list
+ * into an array of cases.
+ */
+
+static struct exp_case *
+ExpClibCases (va_list args, struct exp_case *cases, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+	cases[i].type = (enum exp_type) va_arg(args, int);
+	cases[i].pattern = va_arg(args, char *);
+	cases[i].re = NULL;
+	if (cases[i].type == exp_compiled) {
+	    cases[i].re = va_arg(args, Tcl_RegExp);
+	}
+	cases[i].value = va_arg(args, int);
+    }
+    cases[count].type = exp_end;
+    return cases;
+}
+
+static int
+ExpClibCount (va_list args)
+{
+    enum exp_type type;
+    int count = 0;
+
+    while ((type = (enum exp_type) va_arg(args, int)) != exp_end) {
+	(void) va_arg(args, char *);
+	if (type == exp_compiled) {
+	    (void) va_arg(args, Tcl_RegExp);
+	}
+	(void) va_arg(args, int);
+	count++;
+    }
+    return count;
+}
+
+int
+exp_expectl (int fd, ...)
+{
+    struct exp_case static_cases[16], *cases = static_cases;
+    va_list args;
+    int count, rc;
+
+    va_start(args, fd);
+    count = ExpClibCount(args);
+    va_end(args);
+
+    if (count >= 16) {
+	cases = (struct exp_case *) malloc((count + 1) * sizeof(*cases));
+	if (cases == NULL) {
+	    errno = ENOMEM;
+	    return -1;
+	}
+    }
+    va_start(args, fd);
+    ExpClibCases(args, cases, count);
+    va_end(args);
+
+    rc = exp_expectv(fd, cases);
+    if (cases != static_cases) {
+	free(cases);
+    }
+    return rc;
+}
+
+int
+exp_fexpectl (FILE *fp, ...)
+{
+    struct exp_case static_cases[16], *cases = static_cases;
+    va_list args;
+    int count, rc;
+
+    va_start(args, fp);
+    count = ExpClibCount(args);
+    va_end(args);
+
+    if (count >= 16) {
+	cases = (struct exp_case *) malloc((count + 1) * sizeof(*cases));
+	if (cases == NULL) {
+	    errno = ENOMEM;
+	    return -1;
+	}
+    }
+    va_start(args, fp);
+    ExpClibCases(args, cases, count);
+    va_end(args);
+
+    rc = exp_expectv(fileno(fp), cases);
+    if (cases != static_cases) {
+	free(cases);
+    }
+    return rc;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_spawnv --
+ *
+ *	Start file with argv, its stdin, stdout and stderr connected to
+ *	the returned descriptor.
+ *
+ * Results:
+ *	The descriptor, or -1 with errno set.
+ *
+ * Side effects:
+ *	Sets exp_pid (and exp_pty_slave_name on UNIX).
+ *
+ *----------------------------------------------------------------------
+ */
+
+#ifdef __WIN32__
+
+/*
+ * Quote one argument the way the C runtime's argv parser undoes it.
+ */
+
+static char *
+ExpClibQuoteArg (char *dst, CONST char *arg)
+{
+    CONST char *p;
+    int slashes = 0;
+
+    if (*arg != '\0' && strpbrk(arg, " \t\"") == NULL) {
+	strcpy(dst, arg);
+	return dst + strlen(arg);
+    }
+    *dst++ = '"';
+    for (p = arg; *p; p++) {
+	if (*p == '\\') {
+	    slashes++;
+	} else if (*p == '"') {
+	    for (slashes = slashes * 2 + 1; slashes > 0; slashes--) {
+		*dst++ = '\\';
+	    }
+	    slashes = 0;
+	} else {
+	    for (; slashes > 0; slashes--) *dst++ = '\\';
+	}
+	if (*p != '\\') *dst++ = *p;
+    }
+    for (slashes *= 2; slashes > 0; slashes--) *dst++ = '\\';
+    *dst++ = '"';
+    return dst;
+}
+
+int
+exp_spawnv (char *file, char *argv[])
+{
+    static LONG serial = 0;
+    char pipeName[64], *cmdline, *dst;
+    SECURITY_ATTRIBUTES sa;
+    STARTUPINFO si;
+    PROCESS_INFORMATION pi;
+    HANDLE server, client;
+    size_t len = 1;
+    int i, fd;
+
+    for (i = 0; argv[i] != NULL; i++) {
+	len += 2 * strlen(argv[i]) + 3;
+    }
+    if ((cmdline = (char *) malloc(len)) == NULL) {
+	errno = ENOMEM;
+	return -1;
+    }
+    for (dst = cmdline, i = 0; argv[i] != NULL; i++) {
+	if (i > 0) *dst++ = ' ';
+	dst = ExpClibQuoteArg(dst, argv[i]);
+    }
+    *dst = '\0';
+
+    sprintf(pipeName, "\\\\.\\pipe\\expect-%lu-%ld",
+	    GetCurrentProcessId(), InterlockedIncrement(&serial));
+    server = CreateNamedPipe(pipeName, PIPE_ACCESS_DUPLEX,
+	    PIPE_TYPE_BYTE | PIPE_WAIT, 1, 4096, 4096, 0, NULL);
+    if (server == INVALID_HANDLE_VALUE) {
+	free(cmdline);
+	errno = EMFILE;
+	return -1;
+    }
+    sa.nLength = sizeof(sa);
+    sa.lpSecurityDescriptor = NULL;
+    sa.bInheritHandle = TRUE;
+    client = CreateFile(pipeName, GENERIC_READ | GENERIC_WRITE, 0, &sa,
+	    OPEN_EXISTING, 0, NULL);
+    if (client == INVALID_HANDLE_VALUE) {
+	CloseHandle(server);
+	free(cmdline);
+	errno = EMFILE;
+	return -1;
+    }
+
+    ZeroMemory(&si, sizeof(si));
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = si.hStdOutput = si.hStdError = client;
+
+    /*
+     * exp_close_in_child and exp_child_exec_prelude are not called:
+     * there is no fork, so they would run in the caller instead.  The
+     * child inherits only the pipe and other inheritable handles.
+     */
+    if (!CreateProcess((strchr(file, '\\') || strchr(file, '/'))
+	    ? file : NULL, cmdline, NULL, NULL, TRUE, 0, NULL, NULL,
+	    &si, &pi)) {
+	CloseHandle(client);
+	CloseHandle(server);
+	free(cmdline);
+	errno = ENOENT;
+	return -1;
+    }
+    CloseHandle(client);
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+    free(cmdline);
+
+    if ((fd = _open_osfhandle((intptr_t) server, _O_BINARY)) < 0) {
+	CloseHandle(server);
+	return -1;
+    }
+    ExpClibResetBuf(fd);
+    exp_pid = (int) pi.dwProcessId;
+    return fd;
+}
+
+#else /* !__WIN32__ */
+
+int
+exp_spawnv (char *file, char *argv[])
+{
+    struct termios tios;
+    int master, slave = -1, havetios = 0;
+    pid_t pid;
+
+    if (exp_autoallocpty) {
+	if ((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0) {
+	    return -1;
+	}
+	/* Neither this child nor any other process should inherit it. */
+	fcntl(master, F_SETFD, FD_CLOEXEC);
+	if (grantpt(master) < 0 || unlockpt(master) < 0
+		|| (exp_pty_slave_name = ptsname(master)) == NULL) {
+	    close(master);
+	    return -1;
+	}
+	if (exp_ttycopy && isatty(0) && tcgetattr(0, &tios) == 0) {
+	    havetios = 1;
+	}
+    } else {
+	master = exp_pty[0];
+	slave = exp_pty[1];
+    }
+
+    if ((pid = fork()) < 0) {
+	if (exp_autoallocpty) close(master);
+	return -1;
+    }
+    if (pid == 0) {
+	setsid();
+	if (exp_autoallocpty) {
+	    slave = open(exp_pty_slave_name, O_RDWR);
+	    if (slave < 0) _exit(-1);
+	    if (havetios) tcsetattr(slave, TCSANOW, &tios);
+	}
+#ifdef TIOCSCTTY
+	ioctl(slave, TIOCSCTTY, 0);
+#endif
+	close(master);
+	dup2(slave, 0);
+	dup2(slave, 1);
+	dup2(slave, 2);
+	if (slave > 2) close(slave);
+	if (exp_close_in_child != NULL) {
+	    (*exp_close_in_child)();
+	}
+	if (exp_child_exec_prelude != NULL) {
+	    (*exp_child_exec_prelude)();
+	}
+	execvp(file, argv);
+	fprintf(stderr, "execvp(%s): %s\n", file, strerror(errno));
+	_exit(-1);
+    }
+
+    if (!exp_autoallocpty) {
+	close(slave);
+    }
+    ExpClibResetBuf(master);
+    exp_pid = (int) pid;
+    return master;
+}
+
+#endif /* __WIN32__ */
+
+int
+exp_spawnl (char *file, ...)
+{
+    char *static_argv[16], **argv = static_argv;
+    va_list args;
+    int argc = 0, i, fd;
+
+    va_start(args, file);
+    while (va_arg(args, char *) != NULL) {
+	argc++;
+    }
+    va_end(args);
+
+    if (argc >= 16) {
+	argv = (char **) malloc((argc + 1) * sizeof(char *));
+	if (argv == NULL) {
+	    errno = ENOMEM;
+	    return -1;
+	}
+    }
+    va_start(args, file);
+    for (i = 0; i <= argc; i++) {
+	argv[i] = va_arg(args, char *);
+    }
+    va_end(args);
+
+    fd = exp_spawnv(file, argv);
+    if (argv != static_argv) {
+	free(argv);
+    }
+    return fd;
+}
+
+int
+exp_spawnfd (int fd)
+{
+    if (ExpClibGetBuf(fd) == NULL) {
+	return -1;
+    }
+    ExpClibResetBuf(fd);
+    return fd;
+}
+
+FILE *
+exp_popen (char *command)
+{
+    FILE *fp;
+    int fd;
+
+#ifdef __WIN32__
+    fd = exp_spawnl("cmd.exe", "cmd.exe", "/c", command, (char *) NULL);
+#else
+    fd = exp_spawnl("sh", "sh", "-c", command, (char *) NULL);
+#endif
+    if (fd < 0) {
+	return NULL;
+    }
+    if ((fp = fdopen(fd, "r+")) == NULL) {
+	return NULL;
+    }
+    setbuf(fp, (char *) NULL);
+    return fp;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * exp_closefd --
+ *
+ *	Close a descriptor returned by a spawn function and free its
+ *	match buffer.  Programs that cycle through many sessions should
+ *	use this rather than close().
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+exp_closefd (int fd)
+{
+    ExpClibResetBuf(fd);
+#ifdef __WIN32__
+    return _close(fd);
+#else
+    return close(fd);
+#endif
+}
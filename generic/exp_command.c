@@ -92,6 +92,10 @@ typedef struct ThreadSpecificData {
     Tcl_Channel *diagChannel;
     Tcl_DString diagDString;
     int diagEnabled;
+
+    unsigned long spawnIdEpoch;	/* bumped whenever a spawn id name may
+				 * stop resolving to the ExpState cached
+				 * for it; see expStateFromChannelObj */
 } ThreadSpecificData;
 
 static Tcl_ThreadDataKey dataKey;
@@ -139,11 +143,19 @@ int adjust;
 int any;
 {
     static char *user_spawn_id = "exp0";
+    Tcl_Obj *objPtr;
 
-    CONST char *name = exp_get_var(interp,SPAWN_ID_VARNAME);
-    if (!name) name = user_spawn_id;
-
-    return expStateFromChannelName(interp,name,opened,adjust,any,SPAWN_ID_VARNAME);
+    objPtr = Tcl_GetVar2Ex(interp,SPAWN_ID_VARNAME,(char *)0,0 /* local */);
+    if (!objPtr) {
+	objPtr = Tcl_GetVar2Ex(interp,SPAWN_ID_VARNAME,(char *)0,
+		TCL_GLOBAL_ONLY);
+    }
+    if (!objPtr) {
+	return expStateFromChannelName(interp,user_spawn_id,opened,adjust,
+		any,SPAWN_ID_VARNAME);
+    }
+    return expStateFromChannelObj(interp,objPtr,opened,adjust,any,
+	    SPAWN_ID_VARNAME);
 }
 
 ExpState *
@@ -195,6 +207,120 @@ expStateFromChannelName(interp,name,open,adjust,any,msg)
     return expStateCheck(interp,esPtr,open,adjust,msg);
 }
 
+/*
+ * Spawn ids as Tcl_Objs.  The spawn id named by an object is cached in
+ * its internal rep together with the interp it was resolved in and the
+ * spawn id epoch at that time, so repeated commands on the same
+ * spawn_id skip Tcl_GetChannel and friends.  The epoch is bumped when a
+ * spawn id is closed, unregistered or freed, or its channel moves to
+ * another thread, which makes every cached pointer stale at once.  A
+ * spawn id whose channel is no longer registered, such as one closed
+ * while its background handler runs, is always looked up again.
+ */
+
+typedef struct SpawnIdRep {
+    ExpState *esPtr;
+    Tcl_Interp *interp;
+    unsigned long epoch;
+} SpawnIdRep;
+
+static void	SpawnIdFreeIntRep _ANSI_ARGS_((Tcl_Obj *objPtr));
+static void	SpawnIdDupIntRep _ANSI_ARGS_((Tcl_Obj *srcPtr,
+		    Tcl_Obj *dupPtr));
+
+static Tcl_ObjType expSpawnIdType = {
+    "expSpawnId",
+    SpawnIdFreeIntRep,
+    SpawnIdDupIntRep,
+    NULL,		/* the string rep is never invalidated */
+    NULL		/* only set by expStateFromChannelObj */
+};
+
+#define SPAWNID_REP(objPtr) \
+    ((SpawnIdRep *) (objPtr)->internalRep.otherValuePtr)
+
+static void
+SpawnIdFreeIntRep(objPtr)
+    Tcl_Obj *objPtr;
+{
+    ckfree((char *) SPAWNID_REP(objPtr));
+    objPtr->typePtr = NULL;
+}
+
+static void
+SpawnIdDupIntRep(srcPtr, dupPtr)
+    Tcl_Obj *srcPtr;
+    Tcl_Obj *dupPtr;
+{
+    SpawnIdRep *rep = (SpawnIdRep *) ckalloc(sizeof(SpawnIdRep));
+
+    *rep = *SPAWNID_REP(srcPtr);
+    dupPtr->internalRep.otherValuePtr = (VOID *) rep;
+    dupPtr->typePtr = &expSpawnIdType;
+}
+
+void
+expSpawnIdInvalidate()
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+
+    tsdPtr->spawnIdEpoch++;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expStateFromChannelObj --
+ *
+ *	expStateFromChannelName for a Tcl_Obj, caching the result in the
+ *	object's internal rep.
+ *
+ *----------------------------------------------------------------------
+ */
+
+ExpState *
+expStateFromChannelObj(interp,objPtr,open,adjust,any,msg)
+    Tcl_Interp *interp;
+    Tcl_Obj *objPtr;
+    int open;
+    int adjust;
+    int any;
+    CONST char *msg;
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+    ExpState *esPtr;
+    SpawnIdRep *rep;
+
+    if (objPtr->typePtr == &expSpawnIdType) {
+	rep = SPAWNID_REP(objPtr);
+	if (rep->interp == interp && rep->epoch == tsdPtr->spawnIdEpoch
+		&& (rep->esPtr == tsdPtr->any ? any : rep->esPtr->registered)) {
+	    return expStateCheck(interp,rep->esPtr,open,adjust,msg);
+	}
+    }
+
+    /* Check open and adjust only once the rep is in place. */
+    esPtr = expStateFromChannelName(interp,Tcl_GetString(objPtr),0,0,any,
+	    msg);
+    if (!esPtr) return 0;
+
+    if (objPtr->typePtr == &expSpawnIdType) {
+	rep = SPAWNID_REP(objPtr);
+    } else {
+	if (objPtr->typePtr && objPtr->typePtr->freeIntRepProc) {
+	    objPtr->typePtr->freeIntRepProc(objPtr);
+	}
+	rep = (SpawnIdRep *) ckalloc(sizeof(SpawnIdRep));
+	objPtr->internalRep.otherValuePtr = (VOID *) rep;
+	objPtr->typePtr = &expSpawnIdType;
+    }
+    rep->esPtr = esPtr;
+    rep->interp = interp;
+    rep->epoch = tsdPtr->spawnIdEpoch;
+
+    return expStateCheck(interp,esPtr,open,adjust,msg);
+}
+
 /* zero out the wait status field */
 static void
 exp_wait_zero(status)
@@ -282,6 +408,7 @@ exp_close(interp,esPtr)
 
     if (0 == expStateCheck(interp,esPtr,1,0,"close")) return TCL_ERROR;
     esPtr->open = FALSE;
+    expSpawnIdInvalidate();
 
     /* restore blocking for some shells that would otherwise be */
     /* surprised finding stdio or /dev/tty nonblocking */
@@ -565,13 +692,15 @@ Exp_SpawnObjCmd (
 {
     static char *options[] = {
 	"-nottyinit", "-nottycopy", "-noecho", "-console", "-pty", "-open",
-	"-leaveopen", /*"-ignore", "-trap",*/ "-environment", "-directory", NULL
+	"-leaveopen", /*"-ignore", "-trap",*/ "-environment", "-directory",
+	"-stripansi", "-pipe", "-stderr", NULL
     };
     enum options {
 	SPAWN_NOTTYINIT, SPAWN_NOTTYCOPY, SPAWN_NOECHO,	SPAWN_CONSOLE,
 	SPAWN_PTY, SPAWN_OPEN, SPAWN_LEAVEOPEN, /*SPAWN_IGNORE, SPAWN_TRAP,*/
-	SPAWN_ENV, SPAWN_DIR
+	SPAWN_ENV, SPAWN_DIR, SPAWN_STRIPANSI, SPAWN_PIPE, SPAWN_STDERR
     };
+    static char *stderrModes[] = {"merge", "separate", NULL};
     int option, j, done=0, len;
     CONST char *arg;
 //    CONST char *text;
@@ -579,7 +708,7 @@ Exp_SpawnObjCmd (
     Tcl_Obj *chanName = NULL, *resultObj;
     Exp_SpawnOptionSet opts;
     Tcl_Channel container, original;
-    ExpState *esPtr;
+    ExpState *esPtr, *errEsPtr;
     int pid = 0L;
     Tcl_Pid theUglyHandleHackJob = NULL;
 
@@ -595,6 +724,11 @@ Exp_SpawnObjCmd (
     opts.console = FALSE;
     opts.pty_only = FALSE;
     opts.leaveOpen = FALSE;
+    opts.stripAnsi = exp_default_strip_ansi;
+    opts.pipe = FALSE;
+    opts.pipeSize = EXP_PIPE_SIZE;
+    opts.stderrMode = EXP_STDERR_MERGE;
+    opts.stderrChan = NULL;
     opts.slave_write_ioctls = 1;
 		/* by default, slave will be write-ioctled this many times */
     opts.slave_opens = 3;
@@ -713,6 +847,27 @@ Exp_SpawnObjCmd (
 		    }
 		    break;
 
+		case SPAWN_STRIPANSI:
+		    opts.stripAnsi = TRUE;
+		    break;
+
+		case SPAWN_PIPE:
+		    opts.pipe = TRUE;
+		    break;
+
+		case SPAWN_STDERR:
+		    if (objc > j+1) {
+			if (Tcl_GetIndexFromObj(interp, objv[++j], stderrModes,
+				"-stderr mode", 0, &opts.stderrMode) != TCL_OK) {
+			    goto error;
+			}
+			break;
+		    } else {
+			exp_error(interp,
+			    "The -stderr option requires merge or separate.");
+			goto error;
+		    }
+
 		}
 	    } else {
 		done = 1;
@@ -724,6 +879,15 @@ Exp_SpawnObjCmd (
 	if (!opts.pty_only && !chanName && (objc == j)) {
 	    goto usage;
 	}
+	if (opts.pipe && (opts.pty_only || chanName)) {
+	    exp_error(interp,
+		"The -pipe option can not be used with -pty, -open or -leaveopen.");
+	    goto error;
+	}
+	if (opts.stderrMode != EXP_STDERR_MERGE && !opts.pipe) {
+	    exp_error(interp, "The -stderr option requires -pipe.");
+	    goto error;
+	}
     } else {
 usage:
 	exp_error(interp, "usage: %s [spawn-args] program [program-args]",
@@ -776,6 +940,21 @@ usage:
 	goto error;
     }
     esPtr->leaveopen = opts.leaveOpen;
+    esPtr->strip_ansi = opts.stripAnsi;
+
+    /*
+     * With -stderr separate the child's stderr is a spawn id of its
+     * own, without a process; wait goes through the main one.
+     */
+    if (opts.stderrChan) {
+	if (!Exp_CreateExpChannel(interp, opts.stderrChan, 0, NULL,
+		&errEsPtr)) {
+	    Tcl_AppendToObj(resultObj, "Can't create new exp channel.", -1);
+	    goto error;
+	}
+	errEsPtr->strip_ansi = opts.stripAnsi;
+	Tcl_SetVar2(interp, "spawn_out", "stderr,spawn_id", errEsPtr->name, 0);
+    }
 
     /* tell user of new spawn id. */
     Tcl_SetVar(interp, SPAWN_ID_VARNAME, esPtr->name, 0);
@@ -1045,33 +1224,15 @@ struct human_arg *arg;
     return(0);
 }
 
-struct exp_i *exp_i_pool = 0;
-struct exp_state_list *exp_state_list_pool = 0;
-
-#define EXP_I_INIT_COUNT	10
-#define EXP_FD_INIT_COUNT	10
-
+/* exp_i's and their spawn id lists come from the slabs (exp_arena.c) */
 struct exp_i *
 exp_new_i()
 {
-    int n;
     struct exp_i *i;
 
-    if (!exp_i_pool) {
-	/* none avail, generate some new ones */
-	exp_i_pool = i = (struct exp_i *)ckalloc(
-		EXP_I_INIT_COUNT * sizeof(struct exp_i));
-	for (n=0;n<EXP_I_INIT_COUNT-1;n++,i++) {
-	    i->next = i+1;
-	}
-	i->next = 0;
-    }
-
-    /* now that we've made some, unlink one and give to user */
-
-    i = exp_i_pool;
-    exp_i_pool = exp_i_pool->next;
+    i = (struct exp_i *)expSlabAlloc(sizeof(struct exp_i));
     i->value = 0;
+    i->valueObj = 0;
     i->variable = 0;
     i->state_list = 0;
     i->ecount = 0;
@@ -1083,23 +1244,10 @@ struct exp_state_list *
 exp_new_state(esPtr)
 ExpState *esPtr;
 {
-    int n;
     struct exp_state_list *fd;
 
-    if (!exp_state_list_pool) {
-	/* none avail, generate some new ones */
-	exp_state_list_pool = fd = (struct exp_state_list *)ckalloc(
-	    EXP_FD_INIT_COUNT * sizeof(struct exp_state_list));
-	for (n=0;n<EXP_FD_INIT_COUNT-1;n++,fd++) {
-	    fd->next = fd+1;
-	}
-	fd->next = 0;
-    }
-
-    /* now that we've made some, unlink one and give to user */
-
-    fd = exp_state_list_pool;
-    exp_state_list_pool = exp_state_list_pool->next;
+    fd = (struct exp_state_list *)expSlabAlloc(
+	    sizeof(struct exp_state_list));
     fd->esPtr = esPtr;
     /* fd->next is assumed to be changed by caller */
     return fd;
@@ -1109,19 +1257,12 @@ void
 exp_free_state(fd_first)
 struct exp_state_list *fd_first;
 {
-    struct exp_state_list *fd, *penultimate=NULL;
-
-    if (!fd_first) return;
-
-    /* link entire chain back in at once by first finding last pointer */
-    /* making that point back to pool, and then resetting pool to this */
+    struct exp_state_list *fd, *next;
 
-    /* run to end */
-    for (fd = fd_first;fd;fd=fd->next) {
-	    penultimate = fd;
+    for (fd = fd_first;fd;fd=next) {
+	next = fd->next;
+	expSlabFree(fd,sizeof(struct exp_state_list));
     }
-    penultimate->next = exp_state_list_pool;
-    exp_state_list_pool = fd_first;
 }
 
 /* free a single fd */
@@ -1129,8 +1270,7 @@ void
 exp_free_state_single(fd)
 struct exp_state_list *fd;
 {
-    fd->next = exp_state_list_pool;
-    exp_state_list_pool = fd;
+    expSlabFree(fd,sizeof(struct exp_state_list));
 }
 
 void
@@ -1142,6 +1282,9 @@ Tcl_VarTraceProc *updateproc;	/* proc to invoke if indirect is written */
     if (i->next) exp_free_i(interp,i->next,updateproc);
 
     exp_free_state(i->state_list);
+    if (i->valueObj) {
+	Tcl_DecrRefCount(i->valueObj);
+    }
 
     if (i->direct == EXP_INDIRECT) {
 	Tcl_UntraceVar(interp,i->variable,
@@ -1170,8 +1313,7 @@ Tcl_VarTraceProc *updateproc;	/* proc to invoke if indirect is written */
 	if (i->variable) ckfree(i->variable);
     }
 
-    i->next = exp_i_pool;
-    exp_i_pool = i;
+    expSlabFree(i,sizeof(struct exp_i));
 }
 
 /* generate a descriptor for a "-i" flag */
@@ -1184,10 +1326,26 @@ exp_new_i_complex(interp,arg,duration,updateproc)
     int duration;		/* if we have to copy the args */
 			    /* should only need do this in expect_before/after */
     Tcl_VarTraceProc *updateproc;	/* proc to invoke if indirect is written */
+{
+    return exp_new_i_obj(interp,Tcl_NewStringObj(arg,-1),duration,
+	    updateproc);
+}
+
+/* same, but keeps a direct spawn id list object so that the spawn ids */
+/* cached in its elements are reused by the next command given it */
+struct exp_i *
+exp_new_i_obj(interp,argObj,duration,updateproc)
+    Tcl_Interp *interp;
+    Tcl_Obj *argObj;
+    int duration;
+    Tcl_VarTraceProc *updateproc;
 {
     struct exp_i *i;
     char **stringp;
+    CONST char *arg;
 
+    Tcl_IncrRefCount(argObj);
+    arg = Tcl_GetString(argObj);
     i = exp_new_i();
 
     i->direct = (isExpChannelName(arg) || (0 == strcmp(arg, EXP_SPAWN_ID_ANY_LIT))?EXP_DIRECT:EXP_INDIRECT);
@@ -1209,6 +1367,11 @@ exp_new_i_complex(interp,arg,duration,updateproc)
     }
 
     i->state_list = 0;
+    if (i->direct == EXP_DIRECT) {
+	i->valueObj = argObj;
+    } else {
+	Tcl_DecrRefCount(argObj);
+    }
     if (TCL_ERROR == exp_i_update(interp,i)) {
 	exp_free_i(interp,i,(Tcl_VarTraceProc *)0);
 	return 0;
@@ -1246,19 +1409,33 @@ Tcl_Interp *interp;
 struct exp_i *i;
 {
     struct ExpState *esPtr;
-    char *p = i->value;
-    int argc;
-    char **argv;
+    Tcl_Obj *listPtr = i->valueObj;
+    Tcl_Obj **objv;
+    CONST char *p;
+    int objc;
     int j;
 
-    if (Tcl_SplitList(NULL, p, &argc, &argv) != TCL_OK) goto error;
+    if (!listPtr) {
+	listPtr = Tcl_NewStringObj(i->value ? i->value : "",-1);
+	Tcl_IncrRefCount(listPtr);
+	i->valueObj = listPtr;
+    }
+
+    /* a lone spawn id is used as is rather than shimmered into a list */
+    p = Tcl_GetString(listPtr);
+    if (listPtr->typePtr == &expSpawnIdType
+	    || (*p && !strpbrk(p," \t\n\r\f\v{}\"\\[]$;"))) {
+	objc = 1;
+	objv = &listPtr;
+    } else if (Tcl_ListObjGetElements(NULL,listPtr,&objc,&objv) != TCL_OK) {
+	goto error;
+    }
 
-    for (j = 0; j < argc; j++) {
-        esPtr = expStateFromChannelName(interp,argv[j],1,0,1,"");
+    for (j = 0; j < objc; j++) {
+        esPtr = expStateFromChannelObj(interp,objv[j],1,0,1,"");
 	if (!esPtr) goto error;
 	exp_i_add_state(i,esPtr);
     }
-    ckfree((char*)argv);
     return TCL_OK;
 error:
     expDiagLogU("exp_i_parse_states: ");
@@ -1275,14 +1452,26 @@ Tcl_Interp *interp;
 struct exp_i *i;
 {
     CONST char *p;	/* string representation of list of spawn ids */
+    Tcl_Obj *objPtr;
 
     if (i->direct == EXP_INDIRECT) {
-	p = Tcl_GetVar(interp,i->variable,TCL_GLOBAL_ONLY);
-	if (!p) {
+	objPtr = Tcl_GetVar2Ex(interp,i->variable,(char *)0,TCL_GLOBAL_ONLY);
+
+	/* we hold a reference, so the same object means the same value */
+	if (objPtr && objPtr == i->valueObj) return TCL_OK;
+
+	if (!objPtr) {
 	    p = "";
 	    /* *really* big variable names could blow up expDiagLog! */
 	    expDiagLog("warning: indirect variable %s undefined",i->variable);
+	} else {
+	    p = Tcl_GetString(objPtr);
+	    Tcl_IncrRefCount(objPtr);
+	}
+	if (i->valueObj) {
+	    Tcl_DecrRefCount(i->valueObj);
 	}
+	i->valueObj = objPtr;
 
 	if (i->value) {
 	    if (streq(p,i->value)) return TCL_OK;
@@ -2295,6 +2484,7 @@ Exp_WaitCmd (
      * This can cause writes to the result, so guard against that.
      */
     if (!esPtr->open && esPtr->registered) {
+	expSpawnIdInvalidate();
 	if (objPtr != NULL) {
 	    Tcl_Obj *resultObj;
 
@@ -138,6 +138,9 @@ static void exp_channelhandler(clientData,mask)
 
     esPtr->notified = TRUE;
     esPtr->notifiedMask = mask;
+    if (exp_latency_enabled && !esPtr->notifyTime) {
+	esPtr->notifyTime = expLatencyNow();
+    }
 
     exp_event_disarm_fg(esPtr);
 }
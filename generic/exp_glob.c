@@ -11,7 +11,17 @@ would appreciate credit if this program or parts of it are used.
 
 */
 
-#include "expInt.h"
+#ifdef EXP_CLIB
+/* built into the C library (exp_clib.c), which has only Tcl's public API */
+#   include "tcl.h"
+#   include <string.h>
+#   ifndef TRUE
+#	define TRUE 1
+#	define FALSE 0
+#   endif
+#else
+#   include "expInt.h"
+#endif
 
 int Exp_StringCaseMatch2(CONST char *string, CONST char *pattern, int nocase);
 
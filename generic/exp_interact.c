@@ -0,0 +1,1750 @@
+/* ----------------------------------------------------------------------------
+ * exp_interact.c --
+ *
+ *	The interact command.  Bytes are moved between the user and the
+ *	spawned process with Tcl_ReadRaw and Tcl_WriteRaw through one fixed
+ *	buffer per input, so the bulk of the traffic never becomes a Tcl_Obj,
+ *	is never converted to UTF-8 and never reaches the expect buffer.
+ *
+ *	Exact string patterns are incremental (Knuth-Morris-Pratt) matchers,
+ *	so a pattern split across two reads is still found and only the
+ *	bytes of a partial match in progress are held back.  While no match
+ *	is in progress the scanner skips straight to the next byte that can
+ *	start one, with memchr when that is a single escape character, so an
+ *	interaction with no patterns or only an escape character runs at
+ *	close to the speed of the channel itself.
+ *
+ *	An input with a -re pattern, or one being captured, is matched the
+ *	general way instead: its bytes are converted to UTF-8 and kept in a
+ *	window, every pattern is run over the window after each read, and
+ *	only the tail that a pattern could still match is held back.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "expInt.h"
+
+#ifndef EXP_INTER_BUFSIZE
+#define EXP_INTER_BUFSIZE 16384	/* most bytes moved by one read */
+#endif
+
+#define INTER_OUT "interact_out"
+
+/*
+ * One exact string pattern and the state of its matcher.
+ */
+
+typedef struct InterPat {
+    Tcl_Obj *pat;
+    Tcl_Obj *body;
+    unsigned char *str;		/* bytes of pat */
+    int len;
+    unsigned char *ustr;	/* str as UTF-8, for the general matcher */
+    int ulen;
+    int re;			/* pat is a regexp (general matcher only) */
+    int indices;		/* set interact_out(n,start) and (n,end) */
+    int *fail;			/* KMP failure function of str, if not re */
+    int state;			/* # of bytes of str matched so far */
+    int nobuffer;		/* pass matching bytes on, don't consume */
+    int echo;			/* echo matching bytes back as they arrive */
+    int iwrite;			/* set interact_out(spawn_id) */
+} InterPat;
+
+/*
+ * An output, or the spawn id of an input.  What an output would not take
+ * without blocking waits in pend until it becomes writable.
+ */
+
+typedef struct InterOut {
+    ExpState *esPtr;
+    char name[EXP_CHANNELNAMELEN+1];	/* to find it again after a body */
+    char *pend;			/* bytes not yet written */
+    int pendLen;
+    int pendMax;
+    int writable;		/* a TCL_WRITABLE handler is waiting */
+} InterOut;
+
+/*
+ * One input: where its bytes go, the patterns watching them, and the
+ * buffer they are read into.  A partial match in progress is kept at
+ * the front of the buffer until it either completes or fails.
+ */
+
+typedef struct InterIn {
+    InterOut in;
+    InterOut *out;
+    int outc;
+    InterPat *pats;
+    int patc;
+    Tcl_Obj *eofBody;		/* NULL to return on eof */
+    int eofIwrite;
+    int timeout;		/* seconds, or -1 */
+    Tcl_Obj *timeoutBody;
+    Tcl_WideInt deadline;	/* ms, when timeout is next due */
+    unsigned char first[256];	/* bytes that can start a pattern */
+    int firstc;			/* # of distinct bytes in first */
+    unsigned char firstByte;	/* the byte, if firstc == 1 */
+    int active;			/* # of patterns with state > 0 */
+    int maxlen;			/* longest pattern */
+    char *buf;			/* EXP_INTER_BUFSIZE + maxlen bytes */
+    int held;			/* bytes of partial match at buf[0] */
+    int ready;			/* channel handler has fired */
+    int done;			/* eof seen */
+    int bgBlocked;		/* we blocked an expect_background */
+    int paused;			/* not read while an output is backed up */
+    int general;		/* -re pattern or capture, use the window */
+    Tcl_Obj *window;		/* general: UTF-8 read but not passed on */
+    int echoed;			/* general: bytes of window echoed */
+    Tcl_Encoding encoding;	/* general: of the input */
+    Tcl_EncodingState encState;
+    int encStart;		/* general: nothing converted yet */
+} InterIn;
+
+typedef struct Inter {
+    Tcl_Interp *interp;
+    InterIn *in;
+    int inc;
+    int rr;			/* round robin start */
+    int configure;		/* exp_configure_count last validated */
+    Tcl_TimerToken timer;	/* due when the next timeout is */
+    Tcl_Obj *indirect;		/* {variable value ...} of indirect ids */
+    int restart;		/* an indirect id changed, parse again */
+} Inter;
+
+static Tcl_ObjCmdProc		Exp_InteractObjCmd;
+static int			InterOnce (Tcl_Interp *interp, int objc,
+				    Tcl_Obj *CONST objv[], int *restartPtr);
+static void			InterReadable (ClientData clientData,
+				    int mask);
+static void			InterTimer (ClientData clientData);
+static void			InterWritable (ClientData clientData,
+				    int mask);
+static int			InterAddPattern (Tcl_Interp *interp,
+				    InterIn *ip, Tcl_Obj *pat, int len,
+				    Tcl_Obj *body, int re, int indices,
+				    int nobuffer, int echo, int iwrite);
+static void			InterFinish (InterIn *ip);
+static void			InterFree (InterIn *ip);
+static int			InterValidate (Inter *iPtr);
+static int			InterBody (Inter *iPtr, InterIn *ip,
+				    Tcl_Obj *body, int iwrite);
+static void			InterWrite (InterIn *ip, CONST char *data,
+				    int len);
+static void			InterFlush (InterOut *op);
+static void			InterDrain (InterOut *op);
+static void			InterUnread (ExpState *esPtr,
+				    CONST char *data, int len);
+static void			InterUnreadUtf (ExpState *esPtr,
+				    CONST char *data, int len);
+static int			InterScan (Inter *iPtr, InterIn *ip, int end);
+static int			InterMatch (Inter *iPtr, InterIn *ip);
+static int			InterDecode (Inter *iPtr, InterIn *ip,
+				    int end);
+static void			InterSend (InterIn *ip, CONST char *data,
+				    int len);
+static int			InterPrime (Inter *iPtr, InterIn *ip);
+static int			InterRead (Inter *iPtr, InterIn *ip);
+static int			InterLoop (Inter *iPtr);
+
+static Tcl_WideInt
+InterNow (void)
+{
+    Tcl_Time now;
+
+    Tcl_GetTime(&now);
+    return ((Tcl_WideInt) now.sec) * 1000 + now.usec / 1000;
+}
+
+static void
+InterReadable (
+    ClientData clientData,
+    int mask)
+{
+    ((InterIn *) clientData)->ready = 1;
+}
+
+static void
+InterWritable (
+    ClientData clientData,
+    int mask)
+{
+    InterFlush((InterOut *) clientData);
+}
+
+static void
+InterTimer (
+    ClientData clientData)
+{
+    ((Inter *) clientData)->timer = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InterAddPattern --
+ *
+ *	Add a pattern to an input.  An exact string gets its failure
+ *	function, a regexp is compiled to check it.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+InterAddPattern (
+    Tcl_Interp *interp,
+    InterIn *ip,
+    Tcl_Obj *pat,
+    int len,			/* -1 for all of pat */
+    Tcl_Obj *body,
+    int re,
+    int indices,
+    int nobuffer,
+    int echo,
+    int iwrite)
+{
+    InterPat *pp = &ip->pats[ip->patc];
+    int i, k;
+
+    pp->str = (unsigned char *) (len < 0 ?
+	    Tcl_GetStringFromObj(pat, &len) : Tcl_GetString(pat));
+    if (len == 0) {
+	exp_error(interp, "interact: empty pattern");
+	return TCL_ERROR;
+    }
+    if (re && !Tcl_GetRegExpFromObj(interp, pat,
+	    TCL_REG_ADVANCED|TCL_REG_CANMATCH)) {
+	return TCL_ERROR;
+    }
+    pp->len = len;
+    pp->ustr = pp->str;
+    pp->ulen = len;
+    if (len == 1 && pp->str[0] == 0) {
+	/* null; Tcl keeps a 0 byte as two in UTF-8 */
+	pp->ustr = (unsigned char *) "\300\200";
+	pp->ulen = 2;
+    }
+    pp->pat = pat;
+    Tcl_IncrRefCount(pat);
+    pp->body = body;
+    Tcl_IncrRefCount(body);
+    pp->re = re;
+    pp->indices = indices;
+    pp->nobuffer = nobuffer;
+    pp->echo = echo;
+    pp->iwrite = iwrite;
+    pp->state = 0;
+    ip->patc++;
+    if (re) {
+	pp->fail = NULL;
+	ip->general = 1;
+	return TCL_OK;
+    }
+    pp->fail = (int *) ckalloc(len * sizeof(int));
+    pp->fail[0] = 0;
+    for (i = 1, k = 0; i < len; i++) {
+	while (k > 0 && pp->str[i] != pp->str[k]) {
+	    k = pp->fail[k-1];
+	}
+	if (pp->str[i] == pp->str[k]) {
+	    k++;
+	}
+	pp->fail[i] = k;
+    }
+    return TCL_OK;
+}
+
+/* the encoding of a channel, "binary" being iso8859-1 */
+static Tcl_Encoding
+InterEncoding (
+    ExpState *esPtr)
+{
+    Tcl_DString name;
+    Tcl_Encoding encoding;
+
+    Tcl_DStringInit(&name);
+    Tcl_GetChannelOption(NULL, esPtr->channel, "-encoding", &name);
+    encoding = Tcl_GetEncoding(NULL, streq(Tcl_DStringValue(&name), "binary")
+	    ? "iso8859-1" : Tcl_DStringValue(&name));
+    Tcl_DStringFree(&name);
+    return encoding;
+}
+
+/* size the buffer and first byte table once all patterns are known */
+static void
+InterFinish (
+    InterIn *ip)
+{
+    int i;
+
+    /* a capture wants UTF-8, as expect gives it, so decode for it too */
+    if (ip->in.esPtr && ip->in.esPtr->capture) {
+	ip->general = 1;
+    }
+    if (ip->general) {
+	/* room after a read for the start of a character split by it */
+	ip->buf = ckalloc(EXP_INTER_BUFSIZE + 16);
+	ip->window = Tcl_NewObj();
+	Tcl_IncrRefCount(ip->window);
+	ip->encoding = InterEncoding(ip->in.esPtr);
+	ip->encStart = 1;
+	return;
+    }
+    ip->maxlen = 1;
+    for (i = 0; i < ip->patc; i++) {
+	InterPat *pp = &ip->pats[i];
+
+	if (pp->len > ip->maxlen) {
+	    ip->maxlen = pp->len;
+	}
+	if (!ip->first[pp->str[0]]) {
+	    ip->first[pp->str[0]] = 1;
+	    ip->firstByte = pp->str[0];
+	    ip->firstc++;
+	}
+    }
+    ip->buf = ckalloc(EXP_INTER_BUFSIZE + ip->maxlen);
+}
+
+static void
+InterFree (
+    InterIn *ip)
+{
+    int i;
+
+    for (i = 0; i < ip->patc; i++) {
+	Tcl_DecrRefCount(ip->pats[i].pat);
+	Tcl_DecrRefCount(ip->pats[i].body);
+	if (ip->pats[i].fail) ckfree((char *) ip->pats[i].fail);
+    }
+    if (ip->pats) ckfree((char *) ip->pats);
+    for (i = 0; i < ip->outc; i++) {
+	if (ip->out[i].pend) ckfree(ip->out[i].pend);
+    }
+    if (ip->out) ckfree((char *) ip->out);
+    if (ip->buf) ckfree(ip->buf);
+    if (ip->eofBody) Tcl_DecrRefCount(ip->eofBody);
+    if (ip->timeoutBody) Tcl_DecrRefCount(ip->timeoutBody);
+    if (ip->window) Tcl_DecrRefCount(ip->window);
+    if (ip->encoding) Tcl_FreeEncoding(ip->encoding);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InterValidate --
+ *
+ *	A body may have closed any of the spawn ids in use.  When
+ *	exp_configure_count says something was closed, look each one up
+ *	again by name; anything no longer there is forgotten.
+ *
+ * Results:
+ *	1 if all of them are still open, 0 if not.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+InterCheck (
+    Tcl_Interp *interp,
+    InterOut *op)
+{
+    Tcl_Channel channel;
+
+    if (op->esPtr == NULL) {
+	return 0;
+    }
+    if (op->esPtr->keepForever) {
+	if (!op->esPtr->open && op->writable) {
+	    Tcl_DeleteChannelHandler(op->esPtr->channel, InterWritable,
+		    (ClientData) op);
+	    op->writable = 0;
+	}
+	if (!op->esPtr->open) op->pendLen = 0;
+	return op->esPtr->open;
+    }
+    channel = Tcl_GetChannel(interp, op->name, (int *) 0);
+    if (channel == NULL || !isExpChannelName(Tcl_GetChannelName(channel))
+	    || (ExpState *) Tcl_GetChannelInstanceData(channel) != op->esPtr
+	    || !op->esPtr->open) {
+	/* closing the channel took any writable handler with it */
+	op->esPtr = NULL;
+	op->pendLen = 0;
+	op->writable = 0;
+	return 0;
+    }
+    return 1;
+}
+
+static int
+InterValidate (
+    Inter *iPtr)
+{
+    int i, k, ok = 1;
+
+    if (iPtr->configure == exp_configure_count) {
+	return 1;
+    }
+    for (i = 0; i < iPtr->inc; i++) {
+	InterIn *ip = &iPtr->in[i];
+
+	ok &= InterCheck(iPtr->interp, &ip->in);
+	for (k = 0; k < ip->outc; k++) {
+	    ok &= InterCheck(iPtr->interp, &ip->out[k]);
+	}
+    }
+    Tcl_ResetResult(iPtr->interp);
+    iPtr->configure = exp_configure_count;
+    return ok;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InterBody --
+ *
+ *	Run an action.  break and return end interact, inter_return makes
+ *	its caller return too.  If the action changed the variable of an
+ *	indirect spawn id, interact ends and starts again with its new
+ *	value.
+ *
+ * Results:
+ *	EXP_CONTINUE to keep interacting, otherwise the code interact
+ *	should return.
+ *
+ *----------------------------------------------------------------------
+ */
+
+/* has the variable of an indirect spawn id changed? */
+static int
+InterIndirect (
+    Inter *iPtr)
+{
+    Tcl_Obj **objv, *valueObj;
+    int objc, i;
+
+    if (iPtr->indirect == NULL) {
+	return 0;
+    }
+    Tcl_ListObjGetElements(NULL, iPtr->indirect, &objc, &objv);
+    for (i = 0; i < objc; i += 2) {
+	valueObj = Tcl_GetVar2Ex(iPtr->interp, Tcl_GetString(objv[i]), NULL,
+		TCL_GLOBAL_ONLY);
+	if (valueObj == NULL
+		|| !streq(Tcl_GetString(valueObj), Tcl_GetString(objv[i+1]))) {
+	    iPtr->restart = 1;
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+static int
+InterBody (
+    Inter *iPtr,
+    InterIn *ip,
+    Tcl_Obj *body,
+    int iwrite)
+{
+    Tcl_Interp *interp = iPtr->interp;
+    int rc;
+
+    if (iwrite && ip->in.esPtr) {
+	Tcl_SetVar2(interp, INTER_OUT, "spawn_id", ip->in.name, 0);
+    }
+    rc = Tcl_EvalObjEx(interp, body, 0);
+    switch (rc) {
+	case TCL_OK:
+	case TCL_CONTINUE:
+	    Tcl_ResetResult(interp);
+	    if (!InterValidate(iPtr) || InterIndirect(iPtr)) {
+		return TCL_OK;
+	    }
+	    return EXP_CONTINUE;
+	case TCL_BREAK:
+	case TCL_RETURN:
+	    return TCL_OK;
+	case EXP_TCL_RETURN:
+	    return TCL_RETURN;
+	case TCL_ERROR:
+	    Tcl_AddErrorInfo(interp, "\n    (body of interact)");
+	    return TCL_ERROR;
+    }
+    return rc;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InterWrite --
+ *
+ *	Copy bytes to every output of an input.  What goes to the user is
+ *	also logged, interact always shows the user what the process says.
+ *	An output that would block keeps the rest, and anything written to
+ *	it after, until a writable event lets InterFlush send it.
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+InterPend (
+    InterOut *op,
+    CONST char *data,
+    int len)
+{
+    if (op->pendLen + len > op->pendMax) {
+	op->pendMax = 2 * (op->pendLen + len);
+	op->pend = ckrealloc(op->pend, op->pendMax);
+    }
+    memcpy(op->pend + op->pendLen, data, len);
+    op->pendLen += len;
+    if (!op->writable) {
+	Tcl_CreateChannelHandler(op->esPtr->channel, TCL_WRITABLE,
+		InterWritable, (ClientData) op);
+	op->writable = 1;
+    }
+}
+
+static void
+InterWrite (
+    InterIn *ip,
+    CONST char *data,
+    int len)
+{
+    int i;
+
+    if (len <= 0) {
+	return;
+    }
+    for (i = 0; i < ip->outc; i++) {
+	InterOut *op = &ip->out[i];
+	ExpState *esPtr = op->esPtr;
+	CONST char *p = data;
+	int left = len, wc;
+
+	if (esPtr == NULL) {
+	    continue;
+	}
+	if (op->pendLen > 0) {
+	    /* still backed up; keep the order */
+	    InterPend(op, p, left);
+	    left = 0;
+	}
+	while (left > 0) {
+	    wc = Tcl_WriteRaw(esPtr->channel, p, left);
+	    if (wc < 0) {
+		if (Tcl_GetErrno() == EAGAIN) InterPend(op, p, left);
+		break;
+	    }
+	    p += wc;
+	    left -= wc;
+	}
+	if (expStdinOutIs(esPtr) || expDevttyIs(esPtr)) {
+	    Tcl_Channel logChannel = expLogChannelGet();
+
+	    if (logChannel) {
+		Tcl_Write(logChannel, data, len);
+	    }
+	    expDiagWriteBytes(data, len);
+	}
+    }
+}
+
+/* send what an output has pending, as far as it will take it */
+static void
+InterFlush (
+    InterOut *op)
+{
+    int wc;
+
+    while (op->pendLen > 0 && op->esPtr) {
+	wc = Tcl_WriteRaw(op->esPtr->channel, op->pend, op->pendLen);
+	if (wc < 0) {
+	    if (Tcl_GetErrno() == EAGAIN) return;
+	    op->pendLen = 0;
+	    break;
+	}
+	op->pendLen -= wc;
+	memmove(op->pend, op->pend + wc, op->pendLen);
+    }
+    if (op->writable && op->esPtr) {
+	Tcl_DeleteChannelHandler(op->esPtr->channel, InterWritable,
+		(ClientData) op);
+    }
+    op->writable = 0;
+}
+
+/* when interact is done, wait for what is still pending to be written */
+static void
+InterDrain (
+    InterOut *op)
+{
+    Tcl_DString blocking;
+
+    if (op->pendLen > 0 && op->esPtr) {
+	Tcl_DStringInit(&blocking);
+	Tcl_GetChannelOption(NULL, op->esPtr->channel, "-blocking",
+		&blocking);
+	Tcl_SetChannelOption(NULL, op->esPtr->channel, "-blocking", "1");
+	InterFlush(op);
+	Tcl_SetChannelOption(NULL, op->esPtr->channel, "-blocking",
+		Tcl_DStringValue(&blocking));
+	Tcl_DStringFree(&blocking);
+    }
+    op->pendLen = 0;
+    InterFlush(op);
+}
+
+/* is an output of this input waiting to become writable? */
+static int
+InterBackedUp (
+    InterIn *ip)
+{
+    int i;
+
+    for (i = 0; i < ip->outc; i++) {
+	if (ip->out[i].pendLen > 0) return 1;
+    }
+    return 0;
+}
+
+/* put bytes back into the expect buffer for the next expect to see */
+static void
+InterUnread (
+    ExpState *esPtr,
+    CONST char *data,
+    int len)
+{
+    Tcl_DString utf;
+    Tcl_Encoding encoding;
+
+    if (len <= 0 || esPtr == NULL) {
+	return;
+    }
+    encoding = InterEncoding(esPtr);
+    Tcl_ExternalToUtfDString(encoding, data, len, &utf);
+    InterUnreadUtf(esPtr, Tcl_DStringValue(&utf), Tcl_DStringLength(&utf));
+    Tcl_DStringFree(&utf);
+    if (encoding) Tcl_FreeEncoding(encoding);
+}
+
+static void
+InterUnreadUtf (
+    ExpState *esPtr,
+    CONST char *data,
+    int len)
+{
+    if (len <= 0 || esPtr == NULL) {
+	return;
+    }
+    if (Tcl_IsShared(esPtr->buffer)) {
+	Tcl_Obj *newObj = Tcl_DuplicateObj(esPtr->buffer);
+	Tcl_DecrRefCount(esPtr->buffer);
+	esPtr->buffer = newObj;
+	Tcl_IncrRefCount(newObj);
+    }
+    Tcl_AppendToObj(esPtr->buffer, data, len);
+    expBufferCharge(esPtr);
+    esPtr->generation++;
+    esPtr->printed = expSizeGet(esPtr);
+}
+
+/* the longest partial match of a buffered pattern, which is held back */
+static int
+InterHold (
+    InterIn *ip)
+{
+    int k, hold = 0;
+
+    for (k = 0; k < ip->patc; k++) {
+	if (!ip->pats[k].nobuffer && ip->pats[k].state > hold) {
+	    hold = ip->pats[k].state;
+	}
+    }
+    return hold;
+}
+
+static void
+InterReset (
+    InterIn *ip)
+{
+    int k;
+
+    for (k = 0; k < ip->patc; k++) {
+	ip->pats[k].state = 0;
+    }
+    ip->active = 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InterScan --
+ *
+ *	Run the patterns of an input over buf[held..end), forwarding
+ *	everything that cannot be part of a match and running the body of
+ *	each pattern that completes, including several that complete on
+ *	the same byte.
+ *
+ * Results:
+ *	EXP_CONTINUE, or the code interact should return.  In the latter
+ *	case the bytes not yet forwarded are put back in the expect buffer.
+ *
+ * Side Effects:
+ *	A trailing partial match is moved to the front of the buffer.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+InterScan (
+    Inter *iPtr,
+    InterIn *ip,
+    int end)
+{
+    unsigned char *buf = (unsigned char *) ip->buf;
+    int sent = 0;		/* buf[0..sent) is written or consumed */
+    int i = ip->held;
+    int k, hold, rc;
+
+    while (i < end) {
+	int matched = 0;
+	unsigned char c;
+
+	if (ip->active == 0) {
+	    /* no match in progress, skip to a byte that could start one */
+	    if (ip->firstc == 0) {
+		i = end;
+		break;
+	    } else if (ip->firstc == 1) {
+		unsigned char *p = memchr(buf + i, ip->firstByte, end - i);
+
+		if (p == NULL) {
+		    i = end;
+		    break;
+		}
+		i = p - buf;
+	    } else {
+		while (i < end && !ip->first[buf[i]]) i++;
+		if (i == end) break;
+	    }
+	}
+
+	c = buf[i++];
+	for (k = 0; k < ip->patc; k++) {
+	    InterPat *pp = &ip->pats[k];
+	    int s = pp->state;
+
+	    while (s > 0 && pp->str[s] != c) {
+		s = pp->fail[s-1];
+	    }
+	    if (pp->str[s] == c) {
+		s++;
+		if (pp->echo && ip->in.esPtr) {
+		    Tcl_WriteRaw(ip->in.esPtr->channel, (char *) &c, 1);
+		}
+	    }
+	    if ((s > 0) != (pp->state > 0)) {
+		ip->active += (s > 0) ? 1 : -1;
+	    }
+	    pp->state = s;
+	    if (s == pp->len) {
+		matched = 1;
+	    }
+	}
+	if (!matched) {
+	    continue;
+	}
+
+	/*
+	 * Run every pattern that completed on this byte, in order, until a
+	 * buffered one consumes the match.  That resets all of them; a
+	 * nobuffer pattern instead falls back to its longest proper prefix
+	 * so that an overlapping match is still seen.
+	 */
+	for (k = 0; k < ip->patc; k++) {
+	    InterPat *pp = &ip->pats[k];
+
+	    if (pp->state != pp->len) {
+		continue;
+	    }
+	    if (pp->nobuffer) {
+		/* everything up to here has gone by, bar buffered partials */
+		hold = InterHold(ip);
+		if (i - hold > sent) {
+		    InterWrite(ip, (char *) buf + sent, i - hold - sent);
+		    sent = i - hold;
+		}
+		pp->state = pp->fail[pp->len-1];
+		if (pp->state == 0) {
+		    ip->active--;
+		}
+	    } else {
+		/* send what came before the match, and consume the match */
+		InterWrite(ip, (char *) buf + sent, i - pp->len - sent);
+		sent = i;
+		InterReset(ip);
+	    }
+
+	    rc = InterBody(iPtr, ip, pp->body, pp->iwrite);
+	    if (rc != EXP_CONTINUE) {
+		InterUnread(ip->in.esPtr, (char *) buf + sent, end - sent);
+		ip->held = 0;
+		InterReset(ip);
+		return rc;
+	    }
+	}
+    }
+
+    /* hold back the longest partial match of a buffered pattern */
+    hold = InterHold(ip);
+    InterWrite(ip, (char *) buf + sent, end - hold - sent);
+    if (hold > 0) {
+	memmove(buf, buf + end - hold, hold);
+    }
+    ip->held = hold;
+    return EXP_CONTINUE;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InterSend --
+ *
+ *	Send UTF-8 from the window of a general input to its outputs, in
+ *	the encoding it was read in so that the bytes pass unchanged.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+InterSend (
+    InterIn *ip,
+    CONST char *data,
+    int len)
+{
+    Tcl_DString ext;
+
+    if (len <= 0) {
+	return;
+    }
+    Tcl_UtfToExternalDString(ip->encoding, data, len, &ext);
+    InterWrite(ip, Tcl_DStringValue(&ext), Tcl_DStringLength(&ext));
+    Tcl_DStringFree(&ext);
+}
+
+/* echo window[echoed..to) back to the input */
+static void
+InterEcho (
+    InterIn *ip,
+    int from,
+    int to)
+{
+    Tcl_DString ext;
+    CONST char *p;
+
+    if (from < ip->echoed) from = ip->echoed;
+    if (to <= from || ip->in.esPtr == NULL) {
+	return;
+    }
+    p = Tcl_GetString(ip->window);
+    Tcl_UtfToExternalDString(ip->encoding, p + from, to - from, &ext);
+    Tcl_WriteRaw(ip->in.esPtr->channel, Tcl_DStringValue(&ext),
+	    Tcl_DStringLength(&ext));
+    Tcl_DStringFree(&ext);
+    ip->echoed = to;
+}
+
+/* drop window[0..n), which has been sent or consumed */
+static void
+InterConsume (
+    InterIn *ip,
+    int n)
+{
+    Tcl_Obj *rest;
+    CONST char *p;
+    int len;
+
+    if (n <= 0) {
+	return;
+    }
+    p = Tcl_GetStringFromObj(ip->window, &len);
+    rest = Tcl_NewStringObj(p + n, len - n);
+    Tcl_IncrRefCount(rest);
+    Tcl_DecrRefCount(ip->window);
+    ip->window = rest;
+    ip->echoed = (ip->echoed > n) ? ip->echoed - n : 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InterMatch --
+ *
+ *	The general matcher.  Find the earliest match of any pattern of an
+ *	input in its window, the first pattern winning a tie, and run its
+ *	body, until none matches.  Then send everything before the first
+ *	byte at which a pattern could still match; a regexp says where that
+ *	is through TCL_REG_CANMATCH.  At most EXP_INTER_BUFSIZE bytes are
+ *	held back this way.
+ *
+ * Results:
+ *	EXP_CONTINUE, or the code interact should return.  In the latter
+ *	case the window is put back in the expect buffer.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+InterMatch (
+    Inter *iPtr,
+    InterIn *ip)
+{
+    Tcl_Interp *interp = iPtr->interp;
+    Tcl_RegExp re;
+    Tcl_RegExpInfo info;
+    InterPat *match;
+    CONST char *str;
+    char name[32];
+    int len, hold, start, end, mstart, mend, k, g, rc;
+
+    for (;;) {
+	str = Tcl_GetStringFromObj(ip->window, &len);
+	if (len == 0) {
+	    return EXP_CONTINUE;
+	}
+	match = NULL;
+	mstart = mend = 0;
+	hold = len;
+
+	for (k = 0; k < ip->patc; k++) {
+	    InterPat *pp = &ip->pats[k];
+
+	    if (pp->re) {
+		re = Tcl_GetRegExpFromObj(interp, pp->pat,
+			TCL_REG_ADVANCED|TCL_REG_CANMATCH);
+		if (re == NULL) goto error;
+		rc = Tcl_RegExpExecObj(interp, re, ip->window, 0, -1, 0);
+		if (rc < 0) goto error;
+		Tcl_RegExpGetInfo(re, &info);
+		if (rc == 0) {
+		    if (info.extendStart >= 0) {
+			start = Tcl_UtfAtIndex(str, info.extendStart) - str;
+			if (start < hold) hold = start;
+		    }
+		    continue;
+		}
+		if (info.matches[0].end == info.matches[0].start) {
+		    continue;		/* an empty match would never end */
+		}
+		start = Tcl_UtfAtIndex(str, info.matches[0].start) - str;
+		end = Tcl_UtfAtIndex(str, info.matches[0].end) - str;
+	    } else {
+		CONST char *p = str;
+		int n;
+
+		for (;;) {
+		    p = memchr(p, pp->ustr[0], str + len - p);
+		    if (p == NULL || str + len - p < pp->ulen
+			    || memcmp(p, pp->ustr, pp->ulen) == 0) break;
+		    p++;
+		}
+		if (p == NULL || str + len - p < pp->ulen) {
+		    /* the longest tail that starts the pattern */
+		    for (n = (pp->ulen - 1 < len) ? pp->ulen - 1 : len;
+			    n > 0; n--) {
+			if (memcmp(str + len - n, pp->ustr, n) == 0) break;
+		    }
+		    if (len - n < hold) hold = len - n;
+		    if (pp->echo) InterEcho(ip, len - n, len);
+		    continue;
+		}
+		start = p - str;
+		end = start + pp->ulen;
+	    }
+	    if (match == NULL || start < mstart) {
+		match = pp;
+		mstart = start;
+		mend = end;
+	    }
+	}
+
+	if (match == NULL) {
+	    if (len - hold > EXP_INTER_BUFSIZE) {
+		hold = len - EXP_INTER_BUFSIZE;
+		while ((str[hold] & 0xC0) == 0x80) hold++;
+	    }
+	    InterSend(ip, str, hold);
+	    InterConsume(ip, hold);
+	    return EXP_CONTINUE;
+	}
+
+	if (match->echo) InterEcho(ip, mstart, mend);
+	if (match->re) {
+	    /* the info went with any other use of the same regexp */
+	    re = Tcl_GetRegExpFromObj(interp, match->pat,
+		    TCL_REG_ADVANCED|TCL_REG_CANMATCH);
+	    Tcl_RegExpExecObj(interp, re, ip->window, 0, -1, 0);
+	    Tcl_RegExpGetInfo(re, &info);
+	    for (g = 0; g <= info.nsubs; g++) {
+		if (info.matches[g].start < 0) continue;
+		sprintf(name, "%d,string", g);
+		Tcl_SetVar2Ex(interp, INTER_OUT, name,
+			Tcl_GetRange(ip->window, info.matches[g].start,
+				info.matches[g].end - 1), 0);
+		if (match->indices) {
+		    sprintf(name, "%d,start", g);
+		    Tcl_SetVar2Ex(interp, INTER_OUT, name,
+			    Tcl_NewIntObj(info.matches[g].start), 0);
+		    sprintf(name, "%d,end", g);
+		    Tcl_SetVar2Ex(interp, INTER_OUT, name,
+			    Tcl_NewIntObj(info.matches[g].end - 1), 0);
+		}
+	    }
+	}
+
+	/* send what came before the match, and the match if nobuffer */
+	InterSend(ip, str, match->nobuffer ? mend : mstart);
+	InterConsume(ip, mend);
+
+	rc = InterBody(iPtr, ip, match->body, match->iwrite);
+	if (rc != EXP_CONTINUE) {
+	    str = Tcl_GetStringFromObj(ip->window, &len);
+	    InterUnreadUtf(ip->in.esPtr, str, len);
+	    InterConsume(ip, len);
+	    return rc;
+	}
+    }
+
+ error:
+    Tcl_AddErrorInfo(interp, "\n    (pattern of interact)");
+    return TCL_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InterDecode --
+ *
+ *	Convert buf[0..end) of a general input to UTF-8, add it to the
+ *	window and to any capture, and match.  A character split by the
+ *	read stays in buf for the next.
+ *
+ * Results:
+ *	EXP_CONTINUE, or the code interact should return.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+InterDecode (
+    Inter *iPtr,
+    InterIn *ip,
+    int end)
+{
+    char dst[4096];
+    CONST char *src = ip->buf;
+    int left = end, result, srcRead, dstWrote;
+
+    do {
+	result = Tcl_ExternalToUtf(NULL, ip->encoding, src, left,
+		ip->encStart ? TCL_ENCODING_START : 0, &ip->encState,
+		dst, sizeof(dst), &srcRead, &dstWrote, NULL);
+	ip->encStart = 0;
+	Tcl_AppendToObj(ip->window, dst, dstWrote);
+	expCaptureAdd(ip->in.esPtr, dst, dstWrote);
+	src += srcRead;
+	left -= srcRead;
+    } while (result == TCL_CONVERT_NOSPACE);
+
+    if (left > 16) {
+	/* not a split character after all; pass it on untouched */
+	InterWrite(ip, src, left);
+	left = 0;
+    }
+    memmove(ip->buf, src, left);
+    ip->held = left;
+    return InterMatch(iPtr, ip);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InterPrime --
+ *
+ *	Whatever an earlier expect read but did not match is input too.
+ *	Take it out of the expect buffer and scan it first.
+ *
+ * Results:
+ *	EXP_CONTINUE, or the code interact should return.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+InterPrime (
+    Inter *iPtr,
+    InterIn *ip)
+{
+    ExpState *esPtr = ip->in.esPtr;
+    Tcl_DString ext;
+    Tcl_Encoding encoding;
+    CONST char *p;
+    int len, left, n, rc = EXP_CONTINUE;
+
+    p = Tcl_GetStringFromObj(esPtr->buffer, &len);
+    if (len == 0) {
+	return EXP_CONTINUE;
+    }
+    if (ip->general) {
+	/* already UTF-8, just what the window wants */
+	Tcl_AppendToObj(ip->window, p, len);
+	Tcl_SetObjLength(esPtr->buffer, 0);
+	esPtr->generation++;
+	esPtr->printed = 0;
+	esPtr->echoed = 0;
+	return InterMatch(iPtr, ip);
+    }
+    encoding = InterEncoding(esPtr);
+    Tcl_UtfToExternalDString(encoding, p, len, &ext);
+    if (encoding) Tcl_FreeEncoding(encoding);
+
+    Tcl_SetObjLength(esPtr->buffer, 0);
+    esPtr->generation++;
+    esPtr->printed = 0;
+    esPtr->echoed = 0;
+
+    p = Tcl_DStringValue(&ext);
+    left = Tcl_DStringLength(&ext);
+    while (left > 0) {
+	n = (left > EXP_INTER_BUFSIZE) ? EXP_INTER_BUFSIZE : left;
+	memcpy(ip->buf + ip->held, p, n);
+	p += n;
+	left -= n;
+	rc = InterScan(iPtr, ip, ip->held + n);
+	if (rc != EXP_CONTINUE) {
+	    InterUnread(ip->in.esPtr, p, left);
+	    break;
+	}
+    }
+    Tcl_DStringFree(&ext);
+    return rc;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InterRead --
+ *
+ *	Read whatever an input has and scan it.
+ *
+ * Results:
+ *	EXP_CONTINUE, or the code interact should return.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+InterRead (
+    Inter *iPtr,
+    InterIn *ip)
+{
+    Tcl_Channel channel = ip->in.esPtr->channel;
+    CONST char *p;
+    int n, len, rc;
+
+    n = Tcl_ReadRaw(channel, ip->buf + ip->held, EXP_INTER_BUFSIZE);
+    if (n > 0) {
+	/* a full read probably left more; try again before waiting */
+	ip->ready = (n == EXP_INTER_BUFSIZE);
+	if (ip->timeout >= 0) {
+	    ip->deadline = InterNow() + 1000 * (Tcl_WideInt) ip->timeout;
+	}
+	if (ip->general) {
+	    return InterDecode(iPtr, ip, ip->held + n);
+	}
+	return InterScan(iPtr, ip, ip->held + n);
+    }
+    if ((n < 0 && Tcl_GetErrno() == EAGAIN)
+	    || (n == 0 && !Tcl_Eof(channel))) {
+	return EXP_CONTINUE;
+    }
+
+    /* eof; a partial match can't complete now, so let it go */
+    if (ip->general) {
+	p = Tcl_GetStringFromObj(ip->window, &len);
+	InterSend(ip, p, len);
+	Tcl_SetObjLength(ip->window, 0);
+	ip->echoed = 0;
+    }
+    InterWrite(ip, ip->buf, ip->held);
+    ip->held = 0;
+    ip->done = 1;
+    if (ip->eofBody == NULL) {
+	return TCL_OK;
+    }
+    rc = InterBody(iPtr, ip, ip->eofBody, ip->eofIwrite);
+    if (rc == EXP_CONTINUE) {
+	/* keep going only while some input is left */
+	int i;
+	for (i = 0; i < iPtr->inc; i++) {
+	    if (!iPtr->in[i].done) return EXP_CONTINUE;
+	}
+	return TCL_OK;
+    }
+    return rc;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InterLoop --
+ *
+ *	Wait for input and move it until a body or an eof ends things.
+ *	Data Tcl has already buffered for a channel counts as readable,
+ *	since no event will be raised for it.  An input whose output is
+ *	backed up waits until InterFlush has caught up.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+InterLoop (
+    Inter *iPtr)
+{
+    int i, rc;
+
+    for (i = 0; i < iPtr->inc; i++) {
+	InterIn *ip = &iPtr->in[i];
+
+	if (ip->timeout >= 0) {
+	    ip->deadline = InterNow() + 1000 * (Tcl_WideInt) ip->timeout;
+	}
+	rc = InterPrime(iPtr, ip);
+	if (rc != EXP_CONTINUE) return rc;
+    }
+
+    for (;;) {
+	InterIn *ip = NULL;
+	Tcl_WideInt next = -1;
+
+	/*
+	 * Stop reading an input while one of its outputs is backed up, and
+	 * stop watching it too, or its readable events would keep the
+	 * loop spinning until the output drains.
+	 */
+	for (i = 0; i < iPtr->inc; i++) {
+	    InterIn *cand = &iPtr->in[i];
+
+	    if (cand->done || cand->in.esPtr == NULL) continue;
+	    if (InterBackedUp(cand) != cand->paused) {
+		cand->paused = !cand->paused;
+		if (cand->paused) {
+		    Tcl_DeleteChannelHandler(cand->in.esPtr->channel,
+			    InterReadable, (ClientData) cand);
+		} else {
+		    Tcl_CreateChannelHandler(cand->in.esPtr->channel,
+			    TCL_READABLE, InterReadable, (ClientData) cand);
+		}
+	    }
+	}
+
+	for (i = 0; i < iPtr->inc; i++) {
+	    InterIn *cand = &iPtr->in[(iPtr->rr + i) % iPtr->inc];
+
+	    if (cand->done || cand->in.esPtr == NULL || cand->paused) continue;
+	    if (cand->ready
+		    || Tcl_InputBuffered(cand->in.esPtr->channel) > 0) {
+		ip = cand;
+		break;
+	    }
+	}
+
+	if (ip) {
+	    iPtr->rr = (ip - iPtr->in + 1) % iPtr->inc;
+	    ip->ready = 0;
+	    rc = InterRead(iPtr, ip);
+	    if (rc != EXP_CONTINUE) return rc;
+	    continue;
+	}
+
+	/* nothing to read; run any timeouts that are due */
+	for (i = 0; i < iPtr->inc; i++) {
+	    ip = &iPtr->in[i];
+	    if (ip->done || ip->timeout < 0) continue;
+	    if (ip->deadline <= InterNow()) {
+		ip->deadline = InterNow() + 1000 * (Tcl_WideInt) ip->timeout;
+		rc = InterBody(iPtr, ip, ip->timeoutBody, 0);
+		if (rc != EXP_CONTINUE) return rc;
+	    }
+	    if (next < 0 || ip->deadline < next) {
+		next = ip->deadline;
+	    }
+	}
+	if (next >= 0 && iPtr->timer == NULL) {
+	    Tcl_WideInt ms = next - InterNow();
+	    iPtr->timer = Tcl_CreateTimerHandler(ms > 0 ? (int) ms : 0,
+		    InterTimer, (ClientData) iPtr);
+	}
+
+	Tcl_DoOneEvent(TCL_ALL_EVENTS);
+	if (!InterValidate(iPtr) || InterIndirect(iPtr)) {
+	    return TCL_OK;
+	}
+    }
+}
+
+/*
+ * While parsing, flags and patterns apply to a group of inputs: the
+ * user, the process, or the spawn ids named by the latest -input.
+ */
+
+typedef struct InterParse {
+    Tcl_Interp *interp;
+    InterIn *in;		/* in[0] is the user, in[1] the process */
+    int inc;
+    int inmax;
+    int *group;			/* indices into in of the current group */
+    int groupc;
+    int inputs;			/* # of -input flags so far */
+    int patmax;			/* room for patterns in each input */
+    Tcl_Obj *indirect;		/* {variable value ...} of indirect ids */
+} InterParse;
+
+static int
+InterNewIn (
+    InterParse *psPtr,
+    ExpState *esPtr)
+{
+    InterIn *ip;
+
+    if (psPtr->inc == psPtr->inmax) {
+	psPtr->inmax *= 2;
+	psPtr->in = (InterIn *) ckrealloc((char *) psPtr->in,
+		psPtr->inmax * sizeof(InterIn));
+	psPtr->group = (int *) ckrealloc((char *) psPtr->group,
+		psPtr->inmax * sizeof(int));
+    }
+    ip = &psPtr->in[psPtr->inc];
+    memset(ip, 0, sizeof(InterIn));
+    ip->in.esPtr = esPtr;
+    ip->pats = (InterPat *) ckalloc(psPtr->patmax * sizeof(InterPat));
+    ip->timeout = -1;
+    return psPtr->inc++;
+}
+
+static void
+InterAddOut (
+    InterIn *ip,
+    ExpState *esPtr)
+{
+    if ((ip->outc & 3) == 0) {
+	ip->out = (InterOut *) ckrealloc((char *) ip->out,
+		(ip->outc + 4) * sizeof(InterOut));
+    }
+    memset(&ip->out[ip->outc], 0, sizeof(InterOut));
+    ip->out[ip->outc].esPtr = esPtr;
+    strcpy(ip->out[ip->outc].name, esPtr->name);
+    ip->outc++;
+}
+
+/*
+ * Resolve a -input or -output list of spawn ids.  Anything else names
+ * a global variable holding the list, an indirect spawn id, which is
+ * added to indirect with its value so that a change can be noticed.
+ */
+
+static int
+InterSpawnList (
+    Tcl_Interp *interp,
+    Tcl_Obj *listObj,
+    Tcl_Obj *indirect,
+    ExpState ***esPtrsPtr,
+    int *countPtr)
+{
+    Tcl_Obj **objv, *valueObj;
+    CONST char *arg = Tcl_GetString(listObj);
+    int objc, i;
+
+    if (!isExpChannelName(arg)) {
+	valueObj = Tcl_GetVar2Ex(interp, arg, NULL, TCL_GLOBAL_ONLY);
+	if (valueObj == NULL) {
+	    exp_error(interp, "interact: indirect spawn id variable %s is "
+		    "not set", arg);
+	    return TCL_ERROR;
+	}
+	Tcl_ListObjAppendElement(NULL, indirect, listObj);
+	Tcl_ListObjAppendElement(NULL, indirect, valueObj);
+	listObj = valueObj;
+    }
+    if (Tcl_ListObjGetElements(interp, listObj, &objc, &objv) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    if (objc == 0) {
+	exp_error(interp, "interact: empty spawn id list");
+	return TCL_ERROR;
+    }
+    *esPtrsPtr = (ExpState **) ckalloc(objc * sizeof(ExpState *));
+    for (i = 0; i < objc; i++) {
+	if (!((*esPtrsPtr)[i] = expStateFromChannelName(interp,
+		Tcl_GetString(objv[i]),1,0,0,"interact"))) {
+	    ckfree((char *) *esPtrsPtr);
+	    return TCL_ERROR;
+	}
+    }
+    *countPtr = objc;
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Exp_InteractObjCmd --
+ *
+ *	interact ?-u spawn_id? ?-i spawn_id? ?-o? ?flags? ?pattern body ...?
+ *		?eof body? ?timeout seconds body? ?null body?
+ *	interact ?-input spawn_ids ?-output spawn_ids ...? ?flags?
+ *		?pattern body ...? ...? ...
+ *
+ *	Patterns apply to what the user types until -o or -i, after which
+ *	they apply to the process, or to the spawn ids of the latest
+ *	-input.  Bytes from an input go to every spawn id of the -output
+ *	lists that follow it; the user and the process default to each
+ *	other, any other input with no -output is discarded.  Once -input
+ *	is given, the current spawn id is only read if -i or -o asks for
+ *	the process.  A pattern
+ *	with no body runs "interpreter".  An input with a -re pattern uses
+ *	the general matcher.  When the variable of an indirect spawn id
+ *	changes, interact starts again with its new value.  -reset is
+ *	accepted and has no effect.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Exp_InteractObjCmd (
+    ClientData clientData,
+    Tcl_Interp *interp,
+    int objc,
+    Tcl_Obj *CONST objv[])
+{
+    int rc, restart;
+
+    if ((objc == 2) && exp_one_arg_braced(objv[1])) {
+	return(exp_eval_with_one_arg(clientData,interp,objv));
+    } else if ((objc == 3) && streq(Tcl_GetString(objv[1]),"-brace")) {
+	Tcl_Obj *new_objv[2];
+	new_objv[0] = objv[0];
+	new_objv[1] = objv[2];
+	return(exp_eval_with_one_arg(clientData,interp,new_objv));
+    }
+
+    do {
+	rc = InterOnce(interp, objc, objv, &restart);
+    } while (rc == TCL_OK && restart);
+    return rc;
+}
+
+/* parse the arguments of interact and interact until something ends it */
+static int
+InterOnce (
+    Tcl_Interp *interp,
+    int objc,
+    Tcl_Obj *CONST objv[],
+    int *restartPtr)
+{
+    Inter inter;
+    InterParse ps;
+    InterIn *in;
+    ExpState **esPtrs;
+    Tcl_Obj *interpreterObj;
+    int i, j, k, g, n, index, rc = TCL_OK;
+    int given[2];		/* -output was given for in[0], in[1] */
+    int overridden[2];		/* -input replaced in[0], in[1] */
+    int nobuffer = 0, echo = 0, iwrite = 0, exact = 0, re = 0, indices = 0;
+    static char *flags[] = {"-u", "-i", "-o", "-input", "-output", "-ex",
+	"-nobuffer", "-echo", "-iwrite", "-reset", "-nobrace", "-re",
+	"-indices", (char *)0};
+    enum flags {FLAG_U, FLAG_I, FLAG_O, FLAG_INPUT, FLAG_OUTPUT, FLAG_EX,
+	FLAG_NOBUFFER, FLAG_ECHO, FLAG_IWRITE, FLAG_RESET, FLAG_NOBRACE,
+	FLAG_RE, FLAG_INDICES};
+
+    *restartPtr = 0;
+    memset(&ps, 0, sizeof(ps));
+    ps.interp = interp;
+    ps.inmax = 4;
+    ps.in = (InterIn *) ckalloc(ps.inmax * sizeof(InterIn));
+    ps.group = (int *) ckalloc(ps.inmax * sizeof(int));
+    ps.patmax = objc;
+    ps.indirect = Tcl_NewObj();
+    Tcl_IncrRefCount(ps.indirect);
+    InterNewIn(&ps, expStdinoutGet());
+    InterNewIn(&ps, NULL);		/* the process, resolved below */
+    ps.group[0] = 0;
+    ps.groupc = 1;
+    given[0] = given[1] = overridden[0] = overridden[1] = 0;
+    interpreterObj = Tcl_NewStringObj("interpreter", -1);
+    Tcl_IncrRefCount(interpreterObj);
+
+    for (i = 1; i < objc; i++) {
+	char *arg = Tcl_GetString(objv[i]);
+	Tcl_Obj *pat = objv[i];
+	int len = -1;
+
+	if (!exact && arg[0] == '-' && arg[1] != '\0') {
+	    if (Tcl_GetIndexFromObj(interp, objv[i], flags, "flag", 0,
+		    &index) != TCL_OK) {
+		goto error;
+	    }
+	    switch ((enum flags) index) {
+	    case FLAG_U:
+	    case FLAG_I:
+	    case FLAG_INPUT:
+	    case FLAG_OUTPUT:
+		if (++i >= objc) {
+		    exp_error(interp, "interact: %s requires a spawn id", arg);
+		    goto error;
+		}
+		if (InterSpawnList(interp, objv[i], ps.indirect, &esPtrs, &n)
+			!= TCL_OK) {
+		    goto error;
+		}
+		if (index == FLAG_OUTPUT) {
+		    for (g = 0; g < ps.groupc; g++) {
+			for (k = 0; k < n; k++) {
+			    InterAddOut(&ps.in[ps.group[g]], esPtrs[k]);
+			}
+			if (ps.group[g] < 2) given[ps.group[g]] = 1;
+		    }
+		} else if (index == FLAG_INPUT) {
+		    /* the first two replace the user and the process */
+		    ps.groupc = 0;
+		    for (k = 0; k < n; k++) {
+			if (k == 0 && ps.inputs < 2) {
+			    ps.in[ps.inputs].in.esPtr = esPtrs[0];
+			    overridden[ps.inputs] = 1;
+			    ps.group[ps.groupc++] = ps.inputs;
+			} else {
+			    ps.group[ps.groupc++] = InterNewIn(&ps, esPtrs[k]);
+			}
+		    }
+		    ps.inputs++;
+		} else if (n != 1) {
+		    exp_error(interp, "interact: %s takes a single spawn id",
+			    arg);
+		    ckfree((char *) esPtrs);
+		    goto error;
+		} else if (index == FLAG_U) {
+		    ps.in[0].in.esPtr = esPtrs[0];
+		} else {
+		    ps.in[1].in.esPtr = esPtrs[0];
+		    ps.group[0] = 1;
+		    ps.groupc = 1;
+		}
+		ckfree((char *) esPtrs);
+		break;
+	    case FLAG_O:
+		ps.group[0] = 1;
+		ps.groupc = 1;
+		break;
+	    case FLAG_EX:
+		exact = 1;
+		break;
+	    case FLAG_NOBUFFER:
+		nobuffer = 1;
+		break;
+	    case FLAG_ECHO:
+		echo = 1;
+		break;
+	    case FLAG_IWRITE:
+		iwrite = 1;
+		break;
+	    case FLAG_RESET:
+	    case FLAG_NOBRACE:
+		break;
+	    case FLAG_RE:
+		/* the next argument is the pattern, whatever it looks like */
+		re = exact = 1;
+		break;
+	    case FLAG_INDICES:
+		indices = 1;
+		break;
+	    }
+	    continue;
+	}
+
+	if (!exact && streq(arg, "eof")) {
+	    if (++i >= objc) {
+		exp_error(interp, "interact: eof requires a body");
+		goto error;
+	    }
+	    for (g = 0; g < ps.groupc; g++) {
+		InterIn *ip = &ps.in[ps.group[g]];
+
+		if (ip->eofBody) Tcl_DecrRefCount(ip->eofBody);
+		ip->eofBody = objv[i];
+		Tcl_IncrRefCount(ip->eofBody);
+		ip->eofIwrite = iwrite;
+	    }
+	    iwrite = 0;
+	    continue;
+	}
+	if (!exact && streq(arg, "timeout")) {
+	    int timeout;
+
+	    if (i + 2 >= objc) {
+		exp_error(interp, "interact: timeout requires seconds and a body");
+		goto error;
+	    }
+	    if (Tcl_GetIntFromObj(interp, objv[++i], &timeout) != TCL_OK) {
+		goto error;
+	    }
+	    i++;
+	    for (g = 0; g < ps.groupc; g++) {
+		InterIn *ip = &ps.in[ps.group[g]];
+
+		ip->timeout = timeout;
+		if (ip->timeoutBody) Tcl_DecrRefCount(ip->timeoutBody);
+		ip->timeoutBody = objv[i];
+		Tcl_IncrRefCount(ip->timeoutBody);
+	    }
+	    continue;
+	}
+	if (!exact && streq(arg, "null")) {
+	    pat = Tcl_NewStringObj("", 1);	/* a single 0 byte */
+	    len = 1;
+	}
+
+	Tcl_IncrRefCount(pat);
+	for (g = 0; g < ps.groupc; g++) {
+	    if (InterAddPattern(interp, &ps.in[ps.group[g]], pat, len,
+		    (i + 1 < objc) ? objv[i+1] : interpreterObj,
+		    re, indices, nobuffer, echo, iwrite) != TCL_OK) {
+		Tcl_DecrRefCount(pat);
+		goto error;
+	    }
+	}
+	Tcl_DecrRefCount(pat);
+	i++;
+	nobuffer = echo = iwrite = exact = re = indices = 0;
+    }
+
+    in = ps.in;
+    if (in[1].in.esPtr == NULL && ps.inputs > 0 && in[1].patc == 0
+	    && in[1].outc == 0 && !in[1].eofBody && !in[1].timeoutBody) {
+	/* -input gave both ends; the process was never asked for */
+	InterFree(&in[1]);
+	memmove(&in[1], &in[2], (ps.inc - 2) * sizeof(InterIn));
+	ps.inc--;
+	overridden[1] = 1;
+    } else if (in[1].in.esPtr == NULL
+	    && !(in[1].in.esPtr = expStateCurrent(interp,1,0,0))) {
+	goto error;
+    }
+    for (i = 0; i < ps.inc; i++) {
+	if (in[i].in.esPtr->stream) {
+	    exp_error(interp, "interact: spawn id %s is in use by exp_stream",
+		    in[i].in.esPtr->name);
+	    goto error;
+	}
+	for (j = 0; j < i; j++) {
+	    if (in[i].in.esPtr == in[j].in.esPtr) {
+		exp_error(interp, "interact: spawn id %s is read twice",
+			in[i].in.esPtr->name);
+		goto error;
+	    }
+	}
+    }
+    /* the user and the process talk to each other unless told otherwise */
+    for (i = 0; i < 2 && i < ps.inc; i++) {
+	if (!given[i] && !overridden[i]) {
+	    InterAddOut(&in[i], in[1-i].in.esPtr);
+	}
+    }
+
+    memset(&inter, 0, sizeof(inter));
+    inter.interp = interp;
+    inter.in = in;
+    inter.inc = ps.inc;
+    inter.configure = exp_configure_count;
+    inter.indirect = ps.indirect;
+    for (i = 0; i < ps.inc; i++) {
+	InterIn *ip = &in[i];
+
+	strcpy(ip->in.name, ip->in.esPtr->name);
+	InterFinish(ip);
+	if (ip->in.esPtr->bg_status == armed) {
+	    exp_block_background_channelhandler(ip->in.esPtr);
+	    ip->bgBlocked = 1;
+	}
+	Tcl_CreateChannelHandler(ip->in.esPtr->channel, TCL_READABLE,
+		InterReadable, (ClientData) ip);
+    }
+
+    rc = InterLoop(&inter);
+    *restartPtr = inter.restart;
+
+    if (inter.timer) {
+	Tcl_DeleteTimerHandler(inter.timer);
+    }
+    inter.configure = -1;
+    InterValidate(&inter);
+    for (i = 0; i < ps.inc; i++) {
+	InterIn *ip = &in[i];
+
+	for (k = 0; k < ip->outc; k++) {
+	    InterDrain(&ip->out[k]);
+	}
+	if (ip->in.esPtr) {
+	    /* a partial match never completed; give it to expect */
+	    if (ip->window) {
+		CONST char *p;
+		int len;
+
+		p = Tcl_GetStringFromObj(ip->window, &len);
+		InterUnreadUtf(ip->in.esPtr, p, len);
+	    }
+	    InterUnread(ip->in.esPtr, ip->buf, ip->held);
+	    Tcl_DeleteChannelHandler(ip->in.esPtr->channel, InterReadable,
+		    (ClientData) ip);
+	    if (ip->bgBlocked) {
+		exp_unblock_background_channelhandler(ip->in.esPtr);
+	    }
+	}
+    }
+    goto done;
+
+ error:
+    rc = TCL_ERROR;
+ done:
+    for (i = 0; i < ps.inc; i++) {
+	InterFree(&ps.in[i]);
+    }
+    ckfree((char *) ps.in);
+    ckfree((char *) ps.group);
+    Tcl_DecrRefCount(ps.indirect);
+    Tcl_DecrRefCount(interpreterObj);
+    return rc;
+}
+
+static struct exp_cmd_data cmd_data[]  = {
+{"interact",	Exp_InteractObjCmd,	0,	0,	0},
+{0}};
+
+void
+exp_init_interact_cmds (
+    Tcl_Interp *interp)
+{
+    exp_create_commands(interp,cmd_data);
+}
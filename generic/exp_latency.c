@@ -0,0 +1,375 @@
+/* ----------------------------------------------------------------------------
+ * exp_latency.c --
+ *
+ *	Latency histograms for the path from data arriving on a spawn id
+ *	to the expect body that reacts to it.  Each interval is kept per
+ *	ExpState and globally in a log-linear ("HDR") histogram: exact
+ *	below 32 microseconds, then 16 buckets per power of two, which
+ *	bounds the error of any reported value to about 6% while keeping
+ *	the histogram a fixed few kilobytes.
+ *
+ *	The intervals are:
+ *
+ *	    notify	channel became readable -> expRead got the data
+ *			(Tcl notifier plus exp_get_next_event round robin)
+ *	    match	expRead got the data -> a case matched
+ *	    body	a case matched -> its body returned
+ *	    total	channel became readable -> a case matched
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "expInt.h"
+
+#define LAT_SUB_BITS	5			/* 32 exact buckets */
+#define LAT_SUB		(1 << LAT_SUB_BITS)
+#define LAT_HALF	(LAT_SUB >> 1)
+#define LAT_MAX_SHIFT	36			/* ~19 hours in usecs */
+#define LAT_BUCKETS	(LAT_SUB + LAT_MAX_SHIFT * LAT_HALF)
+
+typedef struct ExpHistogram {
+    Tcl_WideUInt count;
+    Tcl_WideUInt sum;
+    Tcl_WideUInt min;
+    Tcl_WideUInt max;
+    unsigned int buckets[LAT_BUCKETS];
+} ExpHistogram;
+
+struct ExpLatency {
+    ExpHistogram stage[EXP_LAT_STAGES];
+};
+
+int exp_latency_enabled = FALSE;
+
+/* the histograms for all spawn ids belong to the thread that reads them */
+typedef struct ThreadSpecificData {
+    struct ExpLatency globalLatency;
+} ThreadSpecificData;
+static Tcl_ThreadDataKey dataKey;
+
+static CONST char *stageNames[] = {"notify", "match", "body", "total",
+    (char *) NULL};
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expLatencyNow --
+ *
+ *	Current time in microseconds.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_WideInt
+expLatencyNow (void)
+{
+    Tcl_Time now;
+
+    Tcl_GetTime(&now);
+    return ((Tcl_WideInt) now.sec) * 1000000 + now.usec;
+}
+
+static int
+BucketIndex (
+    Tcl_WideUInt value)
+{
+    int shift = 0;
+
+    if (value < LAT_SUB) {
+	return (int) value;
+    }
+    while ((value >> shift) >= LAT_SUB) {
+	shift++;
+    }
+    if (shift > LAT_MAX_SHIFT) {
+	return LAT_BUCKETS - 1;
+    }
+    /* value >> shift is now in [LAT_HALF, LAT_SUB) */
+    return LAT_SUB + (shift - 1) * LAT_HALF
+	    + (int) ((value >> shift) - LAT_HALF);
+}
+
+/* highest value that lands in the given bucket */
+static Tcl_WideUInt
+BucketValue (
+    int index)
+{
+    int shift;
+    Tcl_WideUInt sub;
+
+    if (index < LAT_SUB) {
+	return (Tcl_WideUInt) index;
+    }
+    shift = (index - LAT_SUB) / LAT_HALF + 1;
+    sub = (index - LAT_SUB) % LAT_HALF + LAT_HALF;
+    return ((sub + 1) << shift) - 1;
+}
+
+static void
+HistogramAdd (
+    ExpHistogram *hPtr,
+    Tcl_WideInt usec)
+{
+    Tcl_WideUInt value = (usec < 0) ? 0 : (Tcl_WideUInt) usec;
+
+    if (hPtr->count == 0 || value < hPtr->min) {
+	hPtr->min = value;
+    }
+    if (value > hPtr->max) {
+	hPtr->max = value;
+    }
+    hPtr->count++;
+    hPtr->sum += value;
+    hPtr->buckets[BucketIndex(value)]++;
+}
+
+static Tcl_WideUInt
+HistogramPercentile (
+    ExpHistogram *hPtr,
+    double percentile)
+{
+    Tcl_WideUInt want, seen = 0;
+    Tcl_WideUInt value;
+    int i;
+
+    if (hPtr->count == 0) {
+	return 0;
+    }
+    want = (Tcl_WideUInt) (percentile / 100.0 * (double) hPtr->count + 0.5);
+    if (want < 1) {
+	want = 1;
+    }
+    for (i = 0; i < LAT_BUCKETS; i++) {
+	seen += hPtr->buckets[i];
+	if (seen >= want) {
+	    break;
+	}
+    }
+    value = BucketValue(i);
+    return (value > hPtr->max) ? hPtr->max : value;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expLatencyRecord --
+ *
+ *	Add one interval to the global histogram and, if esPtr is given,
+ *	to that spawn id's histogram.
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	The per ExpState histograms are allocated on first use.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+expLatencyRecord (
+    ExpState *esPtr,
+    int stage,
+    Tcl_WideInt usec)
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+
+    HistogramAdd(&tsdPtr->globalLatency.stage[stage], usec);
+    if (esPtr) {
+	if (!esPtr->latency) {
+	    esPtr->latency = (struct ExpLatency *)
+		    ckalloc(sizeof(struct ExpLatency));
+	    memset(esPtr->latency, 0, sizeof(struct ExpLatency));
+	}
+	HistogramAdd(&esPtr->latency->stage[stage], usec);
+    }
+}
+
+void
+expLatencyFree (
+    ExpState *esPtr)
+{
+    if (esPtr->latency) {
+	ckfree((char *) esPtr->latency);
+	esPtr->latency = NULL;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Exp_LatencyObjCmd --
+ *
+ *	exp_latency 0|1
+ *	exp_latency -info
+ *	exp_latency -reset ?-i spawn_id?
+ *	exp_latency -report ?-i spawn_id? ?-stage name? ?-percentiles list?
+ *
+ *	-report returns "-count n -min n -mean n -max n -p50 n ..." with
+ *	all times in microseconds.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Exp_LatencyObjCmd (
+    ClientData clientData,
+    Tcl_Interp *interp,
+    int objc,
+    Tcl_Obj *CONST objv[])
+{
+    static char *flags[] = {"-info", "-reset", "-report", "-i", "-stage",
+	"-percentiles", (char *)0};
+    enum flags {FLAG_INFO, FLAG_RESET, FLAG_REPORT, FLAG_SPAWN_ID,
+	FLAG_STAGE, FLAG_PERCENTILES};
+    static double defaultPercentiles[] = {50, 90, 99, 99.9};
+    int i, index, value;
+    int action = -1;
+    int stage = EXP_LAT_TOTAL;
+    ExpState *esPtr = NULL;
+    Tcl_Obj *percentilesObj = NULL;
+    struct ExpLatency *latPtr;
+    ExpHistogram *hPtr;
+    Tcl_Obj *resultPtr;
+    char name[40];
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+
+    if (objc == 2 && Tcl_GetString(objv[1])[0] != '-') {
+	if (Tcl_GetBooleanFromObj(interp, objv[1], &value) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	exp_latency_enabled = value;
+	return TCL_OK;
+    }
+
+    for (i = 1; i < objc; i++) {
+	if (Tcl_GetIndexFromObj(interp, objv[i], flags, "flag", 0,
+		&index) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	switch ((enum flags) index) {
+	case FLAG_INFO:
+	case FLAG_RESET:
+	case FLAG_REPORT:
+	    action = index;
+	    break;
+	case FLAG_SPAWN_ID:
+	    if (++i >= objc) goto usage;
+	    esPtr = expStateFromChannelName(interp, Tcl_GetString(objv[i]),
+		    0, 0, 0, "exp_latency");
+	    if (esPtr == NULL) {
+		return TCL_ERROR;
+	    }
+	    break;
+	case FLAG_STAGE:
+	    if (++i >= objc) goto usage;
+	    if (Tcl_GetIndexFromObj(interp, objv[i], stageNames, "stage", 0,
+		    &stage) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+	    break;
+	case FLAG_PERCENTILES:
+	    if (++i >= objc) goto usage;
+	    percentilesObj = objv[i];
+	    break;
+	}
+    }
+
+    switch (action) {
+    case FLAG_INFO:
+	Tcl_SetObjResult(interp, Tcl_NewBooleanObj(exp_latency_enabled));
+	return TCL_OK;
+    case FLAG_RESET:
+	if (esPtr) {
+	    expLatencyFree(esPtr);
+	} else {
+	    memset(&tsdPtr->globalLatency, 0, sizeof(struct ExpLatency));
+	}
+	return TCL_OK;
+    case FLAG_REPORT:
+	break;
+    default:
+	goto usage;
+    }
+
+    latPtr = esPtr ? esPtr->latency : &tsdPtr->globalLatency;
+    resultPtr = Tcl_NewListObj(0, NULL);
+    if (latPtr == NULL) {
+	/* nothing recorded for this spawn id yet */
+	static struct ExpLatency empty;
+	latPtr = &empty;
+    }
+    hPtr = &latPtr->stage[stage];
+
+    Tcl_ListObjAppendElement(interp, resultPtr, Tcl_NewStringObj("-count",-1));
+    Tcl_ListObjAppendElement(interp, resultPtr,
+	    Tcl_NewWideIntObj((Tcl_WideInt) hPtr->count));
+    Tcl_ListObjAppendElement(interp, resultPtr, Tcl_NewStringObj("-min",-1));
+    Tcl_ListObjAppendElement(interp, resultPtr,
+	    Tcl_NewWideIntObj((Tcl_WideInt) hPtr->min));
+    Tcl_ListObjAppendElement(interp, resultPtr, Tcl_NewStringObj("-mean",-1));
+    Tcl_ListObjAppendElement(interp, resultPtr,
+	    Tcl_NewWideIntObj(hPtr->count ?
+		    (Tcl_WideInt) (hPtr->sum / hPtr->count) : 0));
+    Tcl_ListObjAppendElement(interp, resultPtr, Tcl_NewStringObj("-max",-1));
+    Tcl_ListObjAppendElement(interp, resultPtr,
+	    Tcl_NewWideIntObj((Tcl_WideInt) hPtr->max));
+
+    if (percentilesObj) {
+	int n;
+	Tcl_Obj **pv;
+	double p;
+
+	if (Tcl_ListObjGetElements(interp, percentilesObj, &n, &pv)
+		!= TCL_OK) {
+	    Tcl_DecrRefCount(resultPtr);
+	    return TCL_ERROR;
+	}
+	for (i = 0; i < n; i++) {
+	    if (Tcl_GetDoubleFromObj(interp, pv[i], &p) != TCL_OK) {
+		Tcl_DecrRefCount(resultPtr);
+		return TCL_ERROR;
+	    }
+	    if (p < 0 || p > 100) {
+		Tcl_DecrRefCount(resultPtr);
+		exp_error(interp, "percentile must be between 0 and 100");
+		return TCL_ERROR;
+	    }
+	    sprintf(name, "-p%s", Tcl_GetString(pv[i]));
+	    Tcl_ListObjAppendElement(interp, resultPtr,
+		    Tcl_NewStringObj(name, -1));
+	    Tcl_ListObjAppendElement(interp, resultPtr, Tcl_NewWideIntObj(
+		    (Tcl_WideInt) HistogramPercentile(hPtr, p)));
+	}
+    } else {
+	for (i = 0; i < 4; i++) {
+	    sprintf(name, "-p%g", defaultPercentiles[i]);
+	    Tcl_ListObjAppendElement(interp, resultPtr,
+		    Tcl_NewStringObj(name, -1));
+	    Tcl_ListObjAppendElement(interp, resultPtr, Tcl_NewWideIntObj(
+		    (Tcl_WideInt) HistogramPercentile(hPtr,
+			    defaultPercentiles[i])));
+	}
+    }
+    Tcl_SetObjResult(interp, resultPtr);
+    return TCL_OK;
+
+ usage:
+    exp_error(interp, "usage: 0|1 | -info | -reset ?-i spawn_id? | "
+	    "-report ?-i spawn_id? ?-stage stage? ?-percentiles list?");
+    return TCL_ERROR;
+}
+
+static struct exp_cmd_data cmd_data[]  = {
+{"exp_latency",	Exp_LatencyObjCmd,	0,	0,	0},
+{0}};
+
+void
+exp_init_latency_cmds (
+    Tcl_Interp *interp)
+{
+    exp_create_commands(interp,cmd_data);
+}
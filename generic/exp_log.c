@@ -579,43 +579,113 @@ expLogUserSet(logUser)
 
 
 
+/*
+ * Classes of bytes for expPrintifyReal.  PRINT_COPY bytes are passed
+ * through unchanged; everything else breaks up a run and is escaped.
+ */
+#define PRINT_COPY	0	/* printable ASCII */
+#define PRINT_SHORT	1	/* \r \n \t */
+#define PRINT_HEX	2	/* other control chars and all non-ASCII */
+
+static CONST unsigned char printClass[256] = {
+    2,2,2,2,2,2,2,2, 2,1,1,2,2,1,2,2,	/* 0x00 - \t \n \r */
+    2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2,	/* 0x10 */
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,	/* 0x20 */
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,	/* 0x30 */
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,	/* 0x40 */
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,	/* 0x50 */
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,	/* 0x60 */
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,2,	/* 0x70 - DEL */
+    2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2,	/* 0x80 - 0xff: UTF-8 */
+    2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2,
+    2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2,
+    2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2,
+    2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2,
+    2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2,
+    2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2,
+    2,2,2,2,2,2,2,2, 2,2,2,2,2,2,2,2
+};
+
+static CONST char hexDigits[] = "0123456789abcdef";
+
 /* generate printable versions of random ASCII strings.  Primarily used */
 /* in diagnostic mode, "expect -d" */
+/*
+ * Runs of printable ASCII, which is most of what a terminal sends, are
+ * found with a table lookup and copied with a single memcpy.  Only the
+ * exceptions are escaped.  The output is written straight into the
+ * scratch DString, which is sized for the common case up front and keeps
+ * its space from one call to the next.
+ */
 static CONST char *
-expPrintifyReal(s)
+expPrintifyReal(s,length)
     CONST char *s;
+    int length;		/* bytes in s, or -1 to use strlen */
 {
     ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
     Tcl_DString *ds = &tsdPtr->printifyScratch;
-    int len;
-    char d[7];
+    CONST char *end, *run;
+    char *base, *dst, *limit;
+    int need, n;
     Tcl_UniChar ch;
 
     if (s == NULL) {
 	return("<null>");
     }
-
-    if (ds == NULL) {
-	Tcl_DStringInit(ds);
-    } else {
-	Tcl_DStringSetLength(ds, 0);
+    if (length < 0) {
+	length = strlen(s);
     }
+    end = s + length;
 
-    while (*s != '\0') {
-	s += Tcl_UtfToUniChar(s, &ch);
-	if (ch == '\r') {
-	    Tcl_DStringAppend(ds,"\\r", 2);
-	} else if (ch == '\n') {
-	    Tcl_DStringAppend(ds,"\\n", 2);
-	} else if (ch == '\t') {
-	    Tcl_DStringAppend(ds,"\\t", 2);
-	} else if ((ch < 0x80) && isprint(UCHAR(ch))) {
-	    Tcl_DStringAppend(ds, (char *) &ch, 1);
+    /* most input needs little or no escaping */
+    Tcl_DStringSetLength(ds, length + length/4 + 16);
+    base = dst = Tcl_DStringValue(ds);
+    limit = base + Tcl_DStringLength(ds);
+
+    while (s < end) {
+	for (run = s; run < end && printClass[UCHAR(*run)] == PRINT_COPY;
+		run++) {
+	    /* empty */
+	}
+	n = run - s;
+
+	/* room for the run plus the widest escape, "\uXXXXXX" */
+	need = n + 8;
+	if (dst + need > limit) {
+	    int used = dst - base;
+	    Tcl_DStringSetLength(ds, 2*Tcl_DStringLength(ds) + need);
+	    base = Tcl_DStringValue(ds);
+	    dst = base + used;
+	    limit = base + Tcl_DStringLength(ds);
+	}
+	memcpy(dst, s, (size_t) n);
+	dst += n;
+	s = run;
+	if (s >= end) {
+	    break;
+	}
+
+	if (printClass[UCHAR(*s)] == PRINT_SHORT) {
+	    *dst++ = '\\';
+	    *dst++ = (*s == '\r') ? 'r' : ((*s == '\n') ? 'n' : 't');
+	    s++;
 	} else {
-	    len = sprintf(d, "\\u%04x", ch);
-	    Tcl_DStringAppend(ds, d, len);
+	    s += Tcl_UtfToUniChar(s, &ch);
+	    *dst++ = '\\';
+	    *dst++ = 'u';
+#if TCL_UTF_MAX > 3
+	    if (ch > 0xffff) {
+		*dst++ = hexDigits[(ch >> 20) & 0xf];
+		*dst++ = hexDigits[(ch >> 16) & 0xf];
+	    }
+#endif
+	    *dst++ = hexDigits[(ch >> 12) & 0xf];
+	    *dst++ = hexDigits[(ch >> 8) & 0xf];
+	    *dst++ = hexDigits[(ch >> 4) & 0xf];
+	    *dst++ = hexDigits[ch & 0xf];
 	}
     }
+    Tcl_DStringSetLength(ds, dst - base);
 
     return Tcl_DStringValue(ds);
 }
@@ -625,13 +695,16 @@ expPrintifyObj(obj)
     Tcl_Obj *obj;
 {
     ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+    CONST char *s;
+    int length;
 
     /* don't bother writing into bigbuf if we're not going to ever use it */
     if ((!tsdPtr->diagToStderr) && (!tsdPtr->diagChannel)) {
 	return NULL;
     }
 
-    return expPrintifyReal(Tcl_GetString(obj));
+    s = Tcl_GetStringFromObj(obj, &length);
+    return expPrintifyReal(s, length);
 }
 
 CONST char *
@@ -645,7 +718,7 @@ expPrintify(s) /* INTL */
 	return NULL;
     }
 
-    return expPrintifyReal(s);
+    return expPrintifyReal(s, -1);
 }
  
 void
@@ -654,6 +727,7 @@ expDiagInit()
     ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
 
     Tcl_DStringInit(&tsdPtr->diagFilename);
+    Tcl_DStringInit(&tsdPtr->printifyScratch);
     tsdPtr->diagChannel = 0;
     tsdPtr->diagToStderr = 0;
 }
@@ -577,7 +577,12 @@ Expect_Init(interp)
     exp_init_main_cmds(interp);		/* add main     cmds to interpreter */
     exp_init_trap_cmds(interp);		/* add trap     cmds to interpreter */
     exp_init_tty_cmds(interp);		/* add tty      cmds to interpreter */
-//    exp_init_interact_cmds(interp);	/* add interact cmds to interpreter */
+    exp_init_recorder_cmds(interp);	/* add recorder cmds to interpreter */
+    exp_init_latency_cmds(interp);	/* add latency  cmds to interpreter */
+    exp_init_interact_cmds(interp);	/* add interact cmds to interpreter */
+    exp_init_screen_cmds(interp);	/* add screen   cmds to interpreter */
+    exp_init_stream_cmds(interp);	/* add stream   cmds to interpreter */
+    exp_init_capture_cmds(interp);	/* add capture  cmds to interpreter */
 
     /* initialize variables */
     exp_init_spawn_id_vars(interp);
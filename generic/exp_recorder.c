@@ -0,0 +1,348 @@
+/* ----------------------------------------------------------------------------
+ * exp_recorder.c --
+ *
+ *	Diagnostic flight recorder.  Rather than formatting the whole
+ *	buffer through expPrintify for every case evaluation (which is
+ *	what "exp_internal 1" does), the engine drops small fixed size
+ *	binary events into a per-thread ring.  Nothing is formatted until
+ *	someone asks for it with "exp_recorder -dump" or until an expect
+ *	command fails while -onerror is set.
+ *
+ *	The ring belongs to the thread that writes it, so no locking is
+ *	needed to record or to dump.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "expInt.h"
+
+#ifndef EXP_RECORDER_SIZE
+#define EXP_RECORDER_SIZE 256	/* default # of events kept per thread */
+#endif
+
+/*
+ * One recorded event.  Kept small; the spawn id is stored as the numeric
+ * part of its channel name so the event stays meaningful after the
+ * ExpState has been freed.
+ */
+
+typedef struct ExpRecEvent {
+    Tcl_Time when;
+    unsigned char type;		/* EXP_REC_XXX */
+    unsigned char cmdtype;	/* EXP_CMD_XXX, only for EXP_REC_CASE */
+    short index;		/* case index within cmdtype */
+    int spawnId;		/* N of expN, or -1 if none */
+    int result;			/* bytes read or EXP_XXX */
+    int start;			/* type dependent offsets */
+    int end;
+    int length;			/* buffer length in bytes at this point */
+} ExpRecEvent;
+
+typedef struct ThreadSpecificData {
+    int initialized;
+    ExpRecEvent *ring;
+    int size;			/* # of slots in ring, 0 if disabled */
+    unsigned long count;	/* # of events recorded since last clear */
+    int onError;		/* dump to stderr when expect fails */
+} ThreadSpecificData;
+
+static Tcl_ThreadDataKey dataKey;
+
+static CONST char *typeNames[] = {"read", "case", "shuffle", "match"};
+static CONST char *cmdNames[] = {"before", "after", "bg", "fg"};
+
+static ThreadSpecificData *	RecorderGet (void);
+static void			RecorderResize (ThreadSpecificData *tsdPtr,
+				    int size);
+static void			RecorderFormat (Tcl_DString *dsPtr,
+				    ExpRecEvent *evPtr);
+static void			RecorderDump (Tcl_DString *dsPtr, int count);
+static Tcl_ObjCmdProc		Exp_RecorderObjCmd;
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RecorderGet --
+ *
+ *	Fetch this thread's recorder, creating the default sized ring
+ *	the first time through.
+ *
+ * Results:
+ *	The thread specific data.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ThreadSpecificData *
+RecorderGet (void)
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+
+    if (!tsdPtr->initialized) {
+	tsdPtr->initialized = 1;
+	RecorderResize(tsdPtr, EXP_RECORDER_SIZE);
+    }
+    return tsdPtr;
+}
+
+static void
+RecorderResize (
+    ThreadSpecificData *tsdPtr,
+    int size)
+{
+    if (tsdPtr->ring) {
+	ckfree((char *) tsdPtr->ring);
+	tsdPtr->ring = NULL;
+    }
+    tsdPtr->size = size;
+    tsdPtr->count = 0;
+    if (size > 0) {
+	tsdPtr->ring = (ExpRecEvent *) ckalloc(size * sizeof(ExpRecEvent));
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expRecorderAdd --
+ *
+ *	Record one event.  This is on the hot path of every read and
+ *	every case evaluation, so it does no formatting at all.
+ *
+ * Results:
+ *	None
+ *
+ * Side Effects:
+ *	Overwrites the oldest event once the ring is full.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+expRecorderAdd (
+    int type,
+    ExpState *esPtr,
+    int cmdtype,
+    int index,
+    int result,
+    int start,
+    int end,
+    int length)
+{
+    ThreadSpecificData *tsdPtr = RecorderGet();
+    ExpRecEvent *evPtr;
+
+    if (tsdPtr->size == 0) {
+	return;
+    }
+    evPtr = &tsdPtr->ring[tsdPtr->count++ % tsdPtr->size];
+    Tcl_GetTime(&evPtr->when);
+    evPtr->type = (unsigned char) type;
+    evPtr->cmdtype = (unsigned char) cmdtype;
+    evPtr->index = (short) index;
+    evPtr->spawnId = (esPtr && isExpChannelName(esPtr->name)) ?
+	    atoi(esPtr->name + EXP_CHANNEL_PREFIX_LENGTH) : -1;
+    evPtr->result = result;
+    evPtr->start = start;
+    evPtr->end = end;
+    evPtr->length = length;
+}
+
+static CONST char *
+ResultName (
+    int result)
+{
+    switch (result) {
+	case EXP_MATCH:		return "match";
+	case EXP_NOMATCH:	return "nomatch";
+	case EXP_FULLBUFFER:	return "fullbuffer";
+	case EXP_TIMEOUT:	return "timeout";
+	case EXP_EOF:		return "eof";
+	case EXP_TCLERROR:	return "error";
+	case EXP_ABEOF:		return "abeof";
+    }
+    return NULL;
+}
+
+static void
+RecorderFormat (
+    Tcl_DString *dsPtr,
+    ExpRecEvent *evPtr)
+{
+    char buf[200];
+    CONST char *result = ResultName(evPtr->result);
+    char *p = buf;
+
+    p += sprintf(p, "%ld.%06ld exp%d %s", evPtr->when.sec,
+	    evPtr->when.usec, evPtr->spawnId, typeNames[evPtr->type]);
+    if (evPtr->type == EXP_REC_CASE) {
+	p += sprintf(p, " %s#%d", cmdNames[evPtr->cmdtype & 3],
+		evPtr->index);
+    }
+    if (result) {
+	p += sprintf(p, " %s", result);
+    } else {
+	p += sprintf(p, " %d", evPtr->result);
+    }
+    if (evPtr->start >= 0) {
+	p += sprintf(p, " %d-%d", evPtr->start, evPtr->end);
+    }
+    sprintf(p, " len=%d\n", evPtr->length);
+    Tcl_DStringAppend(dsPtr, buf, -1);
+}
+
+/* format the last count events, oldest first */
+static void
+RecorderDump (
+    Tcl_DString *dsPtr,
+    int count)
+{
+    ThreadSpecificData *tsdPtr = RecorderGet();
+    unsigned long i;
+
+    if (tsdPtr->size == 0) {
+	return;
+    }
+    if (count < 0 || count > tsdPtr->size) {
+	count = tsdPtr->size;
+    }
+    if ((unsigned long) count > tsdPtr->count) {
+	count = (int) tsdPtr->count;
+    }
+    for (i = tsdPtr->count - count; i < tsdPtr->count; i++) {
+	RecorderFormat(dsPtr, &tsdPtr->ring[i % tsdPtr->size]);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expRecorderDumpOnError --
+ *
+ *	Called when an expect command fails.  If "exp_recorder -onerror"
+ *	is set, the ring is written to stderr so there is a trail of what
+ *	the engine saw leading up to the failure.
+ *
+ * Results:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+expRecorderDumpOnError (void)
+{
+    ThreadSpecificData *tsdPtr = RecorderGet();
+    Tcl_DString ds;
+
+    if (!tsdPtr->onError || tsdPtr->count == 0) {
+	return;
+    }
+    Tcl_DStringInit(&ds);
+    RecorderDump(&ds, -1);
+    expErrorLogU("exp_recorder: last events before error\r\n");
+    expErrorLogU(Tcl_DStringValue(&ds));
+    Tcl_DStringFree(&ds);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Exp_RecorderObjCmd --
+ *
+ *	exp_recorder -info
+ *	exp_recorder -dump ?count?
+ *	exp_recorder -clear
+ *	exp_recorder ?-size n? ?-onerror 0|1?
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Exp_RecorderObjCmd (
+    ClientData clientData,
+    Tcl_Interp *interp,
+    int objc,
+    Tcl_Obj *CONST objv[])
+{
+    ThreadSpecificData *tsdPtr = RecorderGet();
+    int i, index, value;
+    static char *flags[] = {"-info", "-dump", "-clear", "-size", "-onerror",
+	(char *)0};
+    enum flags {FLAG_INFO, FLAG_DUMP, FLAG_CLEAR, FLAG_SIZE, FLAG_ONERROR};
+
+    if (objc == 1) {
+	goto usage;
+    }
+
+    for (i = 1; i < objc; i++) {
+	if (Tcl_GetIndexFromObj(interp, objv[i], flags, "flag", 0,
+		&index) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	switch ((enum flags) index) {
+	case FLAG_INFO: {
+	    char buf[60];
+	    sprintf(buf, "-size %d -onerror %d", tsdPtr->size,
+		    tsdPtr->onError);
+	    Tcl_SetResult(interp, buf, TCL_VOLATILE);
+	    return TCL_OK;
+	}
+	case FLAG_DUMP: {
+	    Tcl_DString ds;
+	    int count = -1;
+
+	    if (i + 1 < objc) {
+		if (Tcl_GetIntFromObj(interp, objv[++i], &count) != TCL_OK) {
+		    return TCL_ERROR;
+		}
+	    }
+	    Tcl_DStringInit(&ds);
+	    RecorderDump(&ds, count);
+	    Tcl_DStringResult(interp, &ds);
+	    return TCL_OK;
+	}
+	case FLAG_CLEAR:
+	    tsdPtr->count = 0;
+	    break;
+	case FLAG_SIZE:
+	    if (++i >= objc) goto usage;
+	    if (Tcl_GetIntFromObj(interp, objv[i], &value) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+	    if (value < 0) {
+		exp_error(interp, "-size must be non-negative");
+		return TCL_ERROR;
+	    }
+	    RecorderResize(tsdPtr, value);
+	    break;
+	case FLAG_ONERROR:
+	    if (++i >= objc) goto usage;
+	    if (Tcl_GetBooleanFromObj(interp, objv[i], &value) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+	    tsdPtr->onError = value;
+	    break;
+	}
+    }
+    return TCL_OK;
+
+ usage:
+    exp_error(interp, "usage: -info | -dump ?count? | -clear | "
+	    "?-size n? ?-onerror 0|1?");
+    return TCL_ERROR;
+}
+
+static struct exp_cmd_data cmd_data[]  = {
+{"exp_recorder",	Exp_RecorderObjCmd,	0,	0,	0},
+{0}};
+
+void
+exp_init_recorder_cmds (
+    Tcl_Interp *interp)
+{
+    exp_create_commands(interp,cmd_data);
+}
@@ -0,0 +1,1031 @@
+/* ----------------------------------------------------------------------------
+ * exp_screen.c --
+ *
+ *	A VT100/ANSI virtual screen attached to an ExpState.  Once turned
+ *	on with exp_screen, every chunk expIRead appends to the spawn id's
+ *	buffer is also run through a small terminal emulator, so scripts
+ *	driving full screen programs can look at what the screen shows
+ *	rather than at the escape sequences that drew it.
+ *
+ *	Handled are the sequences curses and most full screen programs
+ *	limit themselves to: cursor motion (CUP, CUU/CUD/CUF/CUB, CHA, VPA,
+ *	CNL/CPL, HT), erasing (ED, EL, ECH), insert and delete of lines and
+ *	characters, scroll regions (DECSTBM, IND, RI, NEL, SU/SD), cursor
+ *	save/restore, autowrap and SGR attributes (bold, underline, blink,
+ *	reverse and the eight colors).  OSC strings (window titles) and
+ *	character set designations are parsed and ignored.  The parser is
+ *	a state machine, so sequences split across reads are fine.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "expInt.h"
+
+#define SCR_DEFAULT_ROWS	24
+#define SCR_DEFAULT_COLS	80
+#define SCR_MAXPARAMS		16
+#define SCR_MAX_SIZE		1000	/* most rows or columns */
+
+/* cell attributes: 4 flag bits, then foreground and background colors */
+#define SCR_BOLD	0x0001
+#define SCR_UNDERLINE	0x0002
+#define SCR_BLINK	0x0004
+#define SCR_REVERSE	0x0008
+#define SCR_FG_SHIFT	4	/* 0 is the default color, else color+1 */
+#define SCR_BG_SHIFT	8
+#define SCR_COLOR_MASK	0xf
+
+/* parser states */
+#define SCR_GROUND	0
+#define SCR_ESC		1	/* after ESC */
+#define SCR_CSI		2	/* after ESC [ */
+#define SCR_OSC		3	/* after ESC ], until BEL or ST */
+#define SCR_OSC_ESC	4	/* ESC seen inside an OSC string */
+#define SCR_CHARSET	5	/* after ESC ( or ESC ), one more byte */
+
+struct ExpScreen {
+    int rows, cols;
+    Tcl_UniChar *text;		/* rows*cols cells, row major */
+    unsigned short *attr;	/* SCR_XXX bits of each cell */
+    int row, col;		/* cursor, 0 based */
+    int wrapPending;		/* last column written, wrap on next char */
+    int autowrap;		/* DECAWM */
+    int top, bottom;		/* scroll region, inclusive */
+    unsigned short curAttr;	/* applied to characters written */
+    int savedRow, savedCol;	/* DECSC */
+    unsigned short savedAttr;
+    int state;			/* SCR_GROUND etc */
+    int params[SCR_MAXPARAMS];	/* CSI parameters, -1 if omitted */
+    int nparams;
+    int priv;			/* CSI private marker ('?', '>'), or 0 */
+    Tcl_Obj *textObj;		/* cached rendering, NULL when stale */
+};
+
+static void
+ScreenErase (
+    struct ExpScreen *scr,
+    int from,			/* first cell */
+    int to)			/* one past the last cell */
+{
+    int i;
+
+    for (i = from; i < to; i++) {
+	scr->text[i] = ' ';
+	scr->attr[i] = 0;
+    }
+}
+
+/* drop the cached rendering */
+static void
+ScreenChanged (
+    struct ExpScreen *scr)
+{
+    if (scr->textObj) {
+	Tcl_DecrRefCount(scr->textObj);
+	scr->textObj = NULL;
+    }
+}
+
+static void
+ScreenReset (
+    struct ExpScreen *scr)
+{
+    ScreenChanged(scr);
+    ScreenErase(scr, 0, scr->rows * scr->cols);
+    scr->row = scr->col = 0;
+    scr->wrapPending = 0;
+    scr->autowrap = 1;
+    scr->top = 0;
+    scr->bottom = scr->rows - 1;
+    scr->curAttr = 0;
+    scr->savedRow = scr->savedCol = 0;
+    scr->savedAttr = 0;
+    scr->state = SCR_GROUND;
+}
+
+static struct ExpScreen *
+ScreenCreate (
+    int rows,
+    int cols)
+{
+    struct ExpScreen *scr;
+
+    if (rows > SCR_MAX_SIZE || cols > SCR_MAX_SIZE) {
+	Tcl_Panic("ScreenCreate: %dx%d screen is too big", rows, cols);
+    }
+    scr = (struct ExpScreen *) ckalloc(sizeof(struct ExpScreen));
+    scr->rows = rows;
+    scr->cols = cols;
+    scr->text = (Tcl_UniChar *) ckalloc(rows * cols * sizeof(Tcl_UniChar));
+    scr->attr = (unsigned short *)
+	    ckalloc(rows * cols * sizeof(unsigned short));
+    scr->textObj = NULL;
+    ScreenReset(scr);
+    return scr;
+}
+
+/*
+ * Change the size, keeping the top left of what is on the screen as a
+ * terminal window being resized would.
+ */
+
+static void
+ScreenResize (
+    struct ExpScreen *scr,
+    int rows,
+    int cols)
+{
+    Tcl_UniChar *text;
+    unsigned short *attr;
+    int r, c;
+
+    if (rows == scr->rows && cols == scr->cols) {
+	return;
+    }
+    if (rows > SCR_MAX_SIZE || cols > SCR_MAX_SIZE) {
+	Tcl_Panic("ScreenResize: %dx%d screen is too big", rows, cols);
+    }
+    ScreenChanged(scr);
+    text = (Tcl_UniChar *) ckalloc(rows * cols * sizeof(Tcl_UniChar));
+    attr = (unsigned short *) ckalloc(rows * cols * sizeof(unsigned short));
+    for (r = 0; r < rows; r++) {
+	for (c = 0; c < cols; c++) {
+	    if (r < scr->rows && c < scr->cols) {
+		text[r*cols + c] = scr->text[r*scr->cols + c];
+		attr[r*cols + c] = scr->attr[r*scr->cols + c];
+	    } else {
+		text[r*cols + c] = ' ';
+		attr[r*cols + c] = 0;
+	    }
+	}
+    }
+    ckfree((char *) scr->text);
+    ckfree((char *) scr->attr);
+    scr->text = text;
+    scr->attr = attr;
+    scr->rows = rows;
+    scr->cols = cols;
+    if (scr->row >= rows) scr->row = rows - 1;
+    if (scr->col >= cols) scr->col = cols - 1;
+    if (scr->savedRow >= rows) scr->savedRow = rows - 1;
+    if (scr->savedCol >= cols) scr->savedCol = cols - 1;
+    scr->wrapPending = 0;
+    scr->top = 0;
+    scr->bottom = rows - 1;
+}
+
+/* scroll rows top..bottom up by n, blanking the rows uncovered */
+static void
+ScreenScrollUp (
+    struct ExpScreen *scr,
+    int top,
+    int bottom,
+    int n)
+{
+    int cols = scr->cols;
+    int height = bottom - top + 1;
+
+    if (n > height) n = height;
+    if (n < height) {
+	memmove(scr->text + top*cols, scr->text + (top+n)*cols,
+		(height-n) * cols * sizeof(Tcl_UniChar));
+	memmove(scr->attr + top*cols, scr->attr + (top+n)*cols,
+		(height-n) * cols * sizeof(unsigned short));
+    }
+    ScreenErase(scr, (bottom-n+1) * cols, (bottom+1) * cols);
+}
+
+/* scroll rows top..bottom down by n, blanking the rows uncovered */
+static void
+ScreenScrollDown (
+    struct ExpScreen *scr,
+    int top,
+    int bottom,
+    int n)
+{
+    int cols = scr->cols;
+    int height = bottom - top + 1;
+
+    if (n > height) n = height;
+    if (n < height) {
+	memmove(scr->text + (top+n)*cols, scr->text + top*cols,
+		(height-n) * cols * sizeof(Tcl_UniChar));
+	memmove(scr->attr + (top+n)*cols, scr->attr + top*cols,
+		(height-n) * cols * sizeof(unsigned short));
+    }
+    ScreenErase(scr, top * cols, (top+n) * cols);
+}
+
+/* IND: down a line, scrolling the region at its bottom margin */
+static void
+ScreenIndex (
+    struct ExpScreen *scr)
+{
+    if (scr->row == scr->bottom) {
+	ScreenScrollUp(scr, scr->top, scr->bottom, 1);
+    } else if (scr->row < scr->rows - 1) {
+	scr->row++;
+    }
+}
+
+/* RI: up a line, scrolling the region at its top margin */
+static void
+ScreenReverseIndex (
+    struct ExpScreen *scr)
+{
+    if (scr->row == scr->top) {
+	ScreenScrollDown(scr, scr->top, scr->bottom, 1);
+    } else if (scr->row > 0) {
+	scr->row--;
+    }
+}
+
+static void
+ScreenMoveTo (
+    struct ExpScreen *scr,
+    int row,
+    int col)
+{
+    if (row < 0) row = 0;
+    if (row >= scr->rows) row = scr->rows - 1;
+    if (col < 0) col = 0;
+    if (col >= scr->cols) col = scr->cols - 1;
+    scr->row = row;
+    scr->col = col;
+    scr->wrapPending = 0;
+}
+
+static void
+ScreenPut (
+    struct ExpScreen *scr,
+    Tcl_UniChar ch)
+{
+    int cell;
+
+    if (scr->wrapPending) {
+	scr->col = 0;
+	ScreenIndex(scr);
+	scr->wrapPending = 0;
+    }
+    cell = scr->row * scr->cols + scr->col;
+    scr->text[cell] = ch;
+    scr->attr[cell] = scr->curAttr;
+    if (scr->col < scr->cols - 1) {
+	scr->col++;
+    } else if (scr->autowrap) {
+	scr->wrapPending = 1;
+    }
+}
+
+/* CSI parameter i, or dflt if it was omitted or 0 */
+static int
+ScreenParam (
+    struct ExpScreen *scr,
+    int i,
+    int dflt)
+{
+    if (i >= scr->nparams || scr->params[i] <= 0) {
+	return dflt;
+    }
+    return scr->params[i];
+}
+
+static void
+ScreenSgr (
+    struct ExpScreen *scr)
+{
+    int i, p;
+    unsigned short a = scr->curAttr;
+
+    if (scr->nparams == 0) {
+	scr->curAttr = 0;
+	return;
+    }
+    for (i = 0; i < scr->nparams; i++) {
+	p = scr->params[i] < 0 ? 0 : scr->params[i];
+	if (p == 0) {
+	    a = 0;
+	} else if (p == 1) {
+	    a |= SCR_BOLD;
+	} else if (p == 4) {
+	    a |= SCR_UNDERLINE;
+	} else if (p == 5) {
+	    a |= SCR_BLINK;
+	} else if (p == 7) {
+	    a |= SCR_REVERSE;
+	} else if (p == 22) {
+	    a &= ~SCR_BOLD;
+	} else if (p == 24) {
+	    a &= ~SCR_UNDERLINE;
+	} else if (p == 25) {
+	    a &= ~SCR_BLINK;
+	} else if (p == 27) {
+	    a &= ~SCR_REVERSE;
+	} else if (p >= 30 && p <= 37) {
+	    a &= ~(SCR_COLOR_MASK << SCR_FG_SHIFT);
+	    a |= (p - 30 + 1) << SCR_FG_SHIFT;
+	} else if (p == 39) {
+	    a &= ~(SCR_COLOR_MASK << SCR_FG_SHIFT);
+	} else if (p >= 40 && p <= 47) {
+	    a &= ~(SCR_COLOR_MASK << SCR_BG_SHIFT);
+	    a |= (p - 40 + 1) << SCR_BG_SHIFT;
+	} else if (p == 49) {
+	    a &= ~(SCR_COLOR_MASK << SCR_BG_SHIFT);
+	} else if ((p == 38 || p == 48) && i + 1 < scr->nparams) {
+	    /* 256 color and rgb forms: skip their arguments */
+	    i += (scr->params[i+1] == 5) ? 2 : 4;
+	}
+    }
+    scr->curAttr = a;
+}
+
+/* CSI h and l */
+static void
+ScreenMode (
+    struct ExpScreen *scr,
+    int set)
+{
+    int i;
+
+    if (scr->priv != '?') {
+	return;
+    }
+    for (i = 0; i < scr->nparams; i++) {
+	switch (scr->params[i]) {
+	case 7:
+	    scr->autowrap = set;
+	    if (!set) scr->wrapPending = 0;
+	    break;
+	case 47:
+	case 1047:
+	case 1049:
+	    /* alternate screen: there is only one, start it clean */
+	    ScreenErase(scr, 0, scr->rows * scr->cols);
+	    break;
+	}
+    }
+}
+
+static void
+ScreenCsi (
+    struct ExpScreen *scr,
+    int final)
+{
+    int n = ScreenParam(scr, 0, 1);
+    int cols = scr->cols;
+    int here = scr->row * cols + scr->col;
+    int i;
+
+    switch (final) {
+    case 'A':					/* CUU */
+	ScreenMoveTo(scr, scr->row - n, scr->col);
+	break;
+    case 'B':					/* CUD */
+    case 'e':					/* VPR */
+	ScreenMoveTo(scr, scr->row + n, scr->col);
+	break;
+    case 'C':					/* CUF */
+    case 'a':					/* HPR */
+	ScreenMoveTo(scr, scr->row, scr->col + n);
+	break;
+    case 'D':					/* CUB */
+	ScreenMoveTo(scr, scr->row, scr->col - n);
+	break;
+    case 'E':					/* CNL */
+	ScreenMoveTo(scr, scr->row + n, 0);
+	break;
+    case 'F':					/* CPL */
+	ScreenMoveTo(scr, scr->row - n, 0);
+	break;
+    case 'G':					/* CHA */
+    case '`':					/* HPA */
+	ScreenMoveTo(scr, scr->row, n - 1);
+	break;
+    case 'd':					/* VPA */
+	ScreenMoveTo(scr, n - 1, scr->col);
+	break;
+    case 'H':					/* CUP */
+    case 'f':					/* HVP */
+	ScreenMoveTo(scr, n - 1, ScreenParam(scr, 1, 1) - 1);
+	break;
+    case 'J':					/* ED */
+	switch (scr->nparams ? scr->params[0] : 0) {
+	case -1:
+	case 0:
+	    ScreenErase(scr, here, scr->rows * cols);
+	    break;
+	case 1:
+	    ScreenErase(scr, 0, here + 1);
+	    break;
+	case 2:
+	case 3:
+	    ScreenErase(scr, 0, scr->rows * cols);
+	    break;
+	}
+	break;
+    case 'K':					/* EL */
+	switch (scr->nparams ? scr->params[0] : 0) {
+	case -1:
+	case 0:
+	    ScreenErase(scr, here, (scr->row + 1) * cols);
+	    break;
+	case 1:
+	    ScreenErase(scr, scr->row * cols, here + 1);
+	    break;
+	case 2:
+	    ScreenErase(scr, scr->row * cols, (scr->row + 1) * cols);
+	    break;
+	}
+	break;
+    case 'X':					/* ECH */
+	if (n > cols - scr->col) n = cols - scr->col;
+	ScreenErase(scr, here, here + n);
+	break;
+    case 'L':					/* IL */
+	if (scr->row >= scr->top && scr->row <= scr->bottom) {
+	    ScreenScrollDown(scr, scr->row, scr->bottom, n);
+	    scr->col = 0;
+	    scr->wrapPending = 0;
+	}
+	break;
+    case 'M':					/* DL */
+	if (scr->row >= scr->top && scr->row <= scr->bottom) {
+	    ScreenScrollUp(scr, scr->row, scr->bottom, n);
+	    scr->col = 0;
+	    scr->wrapPending = 0;
+	}
+	break;
+    case '@':					/* ICH */
+	if (n > cols - scr->col) n = cols - scr->col;
+	for (i = (scr->row + 1) * cols - 1; i >= here + n; i--) {
+	    scr->text[i] = scr->text[i-n];
+	    scr->attr[i] = scr->attr[i-n];
+	}
+	ScreenErase(scr, here, here + n);
+	break;
+    case 'P':					/* DCH */
+	if (n > cols - scr->col) n = cols - scr->col;
+	for (i = here; i < (scr->row + 1) * cols - n; i++) {
+	    scr->text[i] = scr->text[i+n];
+	    scr->attr[i] = scr->attr[i+n];
+	}
+	ScreenErase(scr, (scr->row + 1) * cols - n, (scr->row + 1) * cols);
+	break;
+    case 'S':					/* SU */
+	ScreenScrollUp(scr, scr->top, scr->bottom, n);
+	break;
+    case 'T':					/* SD */
+	if (scr->priv == 0) {
+	    ScreenScrollDown(scr, scr->top, scr->bottom, n);
+	}
+	break;
+    case 'r':					/* DECSTBM */
+	{
+	    int top = ScreenParam(scr, 0, 1) - 1;
+	    int bottom = ScreenParam(scr, 1, scr->rows) - 1;
+
+	    if (bottom >= scr->rows) bottom = scr->rows - 1;
+	    if (top < bottom) {
+		scr->top = top;
+		scr->bottom = bottom;
+		ScreenMoveTo(scr, 0, 0);
+	    }
+	}
+	break;
+    case 'm':					/* SGR */
+	if (scr->priv == 0) {
+	    ScreenSgr(scr);
+	}
+	break;
+    case 'h':					/* SM */
+	ScreenMode(scr, 1);
+	break;
+    case 'l':					/* RM */
+	ScreenMode(scr, 0);
+	break;
+    case 's':					/* SCOSC */
+	scr->savedRow = scr->row;
+	scr->savedCol = scr->col;
+	scr->savedAttr = scr->curAttr;
+	break;
+    case 'u':					/* SCORC */
+	ScreenMoveTo(scr, scr->savedRow, scr->savedCol);
+	scr->curAttr = scr->savedAttr;
+	break;
+    default:
+	/* device status reports, tab stops, LEDs... ignored */
+	break;
+    }
+}
+
+static void
+ScreenEsc (
+    struct ExpScreen *scr,
+    int ch)
+{
+    scr->state = SCR_GROUND;
+    switch (ch) {
+    case '[':
+	scr->state = SCR_CSI;
+	scr->nparams = 0;
+	scr->priv = 0;
+	break;
+    case ']':
+	scr->state = SCR_OSC;
+	break;
+    case '(':
+    case ')':
+    case '*':
+    case '+':
+	scr->state = SCR_CHARSET;
+	break;
+    case 'D':					/* IND */
+	ScreenIndex(scr);
+	scr->wrapPending = 0;
+	break;
+    case 'E':					/* NEL */
+	ScreenIndex(scr);
+	scr->col = 0;
+	scr->wrapPending = 0;
+	break;
+    case 'M':					/* RI */
+	ScreenReverseIndex(scr);
+	scr->wrapPending = 0;
+	break;
+    case '7':					/* DECSC */
+	scr->savedRow = scr->row;
+	scr->savedCol = scr->col;
+	scr->savedAttr = scr->curAttr;
+	break;
+    case '8':					/* DECRC */
+	ScreenMoveTo(scr, scr->savedRow, scr->savedCol);
+	scr->curAttr = scr->savedAttr;
+	break;
+    case 'c':					/* RIS */
+	ScreenReset(scr);
+	break;
+    default:
+	/* keypad modes and the like */
+	break;
+    }
+}
+
+static void
+ScreenChar (
+    struct ExpScreen *scr,
+    Tcl_UniChar ch)
+{
+    switch (scr->state) {
+    case SCR_ESC:
+	ScreenEsc(scr, ch);
+	return;
+    case SCR_CSI:
+	if (ch >= '0' && ch <= '9') {
+	    if (scr->nparams == 0) {
+		scr->params[scr->nparams++] = -1;
+	    }
+	    if (scr->params[scr->nparams-1] < 0) {
+		scr->params[scr->nparams-1] = 0;
+	    }
+	    if (scr->params[scr->nparams-1] < 100000) {
+		scr->params[scr->nparams-1] =
+			scr->params[scr->nparams-1] * 10 + (ch - '0');
+	    }
+	} else if (ch == ';' || ch == ':') {
+	    if (scr->nparams == 0) {
+		scr->params[scr->nparams++] = -1;
+	    }
+	    if (scr->nparams < SCR_MAXPARAMS) {
+		scr->params[scr->nparams++] = -1;
+	    }
+	} else if (ch >= '<' && ch <= '?') {
+	    scr->priv = ch;
+	} else if (ch >= 0x40 && ch <= 0x7e) {
+	    scr->state = SCR_GROUND;
+	    ScreenCsi(scr, ch);
+	} else if (ch == 0x1b) {
+	    scr->state = SCR_ESC;
+	} else if (ch < 0x20) {
+	    /* C0 controls are executed in the middle of a sequence */
+	    break;
+	}
+	/* intermediate bytes are ignored */
+	return;
+    case SCR_OSC:
+	if (ch == 0x07) {
+	    scr->state = SCR_GROUND;
+	} else if (ch == 0x1b) {
+	    scr->state = SCR_OSC_ESC;
+	}
+	return;
+    case SCR_OSC_ESC:
+	scr->state = (ch == '\\') ? SCR_GROUND : SCR_OSC;
+	return;
+    case SCR_CHARSET:
+	scr->state = SCR_GROUND;
+	return;
+    }
+
+    switch (ch) {
+    case 0x1b:
+	scr->state = SCR_ESC;
+	break;
+    case '\r':
+	scr->col = 0;
+	scr->wrapPending = 0;
+	break;
+    case '\n':
+    case 0x0b:
+    case 0x0c:
+	ScreenIndex(scr);
+	scr->wrapPending = 0;
+	break;
+    case '\b':
+	if (scr->col > 0) scr->col--;
+	scr->wrapPending = 0;
+	break;
+    case '\t':
+	ScreenMoveTo(scr, scr->row, (scr->col + 8) & ~7);
+	break;
+    default:
+	if (ch >= 0x20 && ch != 0x7f && (ch < 0x80 || ch >= 0xa0)) {
+	    ScreenPut(scr, ch);
+	}
+	/* BEL, SO/SI and other controls do not touch the screen */
+	break;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expScreenFeed --
+ *
+ *	Run newly read characters through the spawn id's screen, if it
+ *	has one.  Called by expIRead with the part of the buffer that a
+ *	read just appended.
+ *
+ * Results:
+ *	None.
+ *
+ * Side Effects:
+ *	The screen and its cursor are updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+expScreenFeed (
+    ExpState *esPtr,
+    CONST char *string,		/* UTF-8 */
+    int length)			/* in bytes */
+{
+    struct ExpScreen *scr = esPtr->screen;
+    CONST char *end = string + length;
+    Tcl_UniChar ch;
+
+    if (scr == NULL || length <= 0) {
+	return;
+    }
+    ScreenChanged(scr);
+    while (string < end) {
+	if (UCHAR(*string) < 0x80) {
+	    ch = UCHAR(*string++);
+	} else {
+	    string += Tcl_UtfToUniChar(string, &ch);
+	}
+	ScreenChar(scr, ch);
+    }
+}
+
+/* append a row's cells left..right-1, without trailing blanks */
+static void
+ScreenRowAppend (
+    struct ExpScreen *scr,
+    int row,
+    int left,
+    int right,
+    Tcl_DString *dsPtr)
+{
+    Tcl_UniChar *cell = scr->text + row * scr->cols;
+    char buf[TCL_UTF_MAX];
+    int c;
+
+    while (right > left && cell[right-1] == ' ') {
+	right--;
+    }
+    for (c = left; c < right; c++) {
+	if (cell[c] < 0x80) {
+	    buf[0] = (char) cell[c];
+	    Tcl_DStringAppend(dsPtr, buf, 1);
+	} else {
+	    Tcl_DStringAppend(dsPtr, buf, Tcl_UniCharToUtf(cell[c], buf));
+	}
+    }
+}
+
+static Tcl_Obj *
+ScreenRegion (
+    struct ExpScreen *scr,
+    int top,
+    int left,
+    int bottom,
+    int right)			/* all inclusive */
+{
+    Tcl_DString ds;
+    Tcl_Obj *objPtr;
+    int r;
+
+    Tcl_DStringInit(&ds);
+    for (r = top; r <= bottom; r++) {
+	if (r > top) Tcl_DStringAppend(&ds, "\n", 1);
+	ScreenRowAppend(scr, r, left, right + 1, &ds);
+    }
+    objPtr = Tcl_NewStringObj(Tcl_DStringValue(&ds), Tcl_DStringLength(&ds));
+    Tcl_DStringFree(&ds);
+    return objPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expScreenText --
+ *
+ *	The rendered screen of a spawn id: its rows without trailing
+ *	blanks, separated by newlines.  This is what "expect -screen"
+ *	patterns are matched against.
+ *
+ * Results:
+ *	A Tcl_Obj owned by the screen, valid until the next read, or
+ *	NULL if the spawn id has no screen.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_Obj *
+expScreenText (
+    ExpState *esPtr)
+{
+    struct ExpScreen *scr = esPtr->screen;
+
+    if (scr == NULL) {
+	return NULL;
+    }
+    if (scr->textObj == NULL) {
+	scr->textObj = ScreenRegion(scr, 0, 0, scr->rows - 1, scr->cols - 1);
+	Tcl_IncrRefCount(scr->textObj);
+    }
+    return scr->textObj;
+}
+
+void
+expScreenFree (
+    ExpState *esPtr)
+{
+    struct ExpScreen *scr = esPtr->screen;
+
+    if (scr) {
+	if (scr->textObj) {
+	    Tcl_DecrRefCount(scr->textObj);
+	}
+	ckfree((char *) scr->text);
+	ckfree((char *) scr->attr);
+	ckfree((char *) scr);
+	esPtr->screen = NULL;
+    }
+}
+
+static Tcl_Obj *
+ScreenCell (
+    struct ExpScreen *scr,
+    int row,
+    int col)
+{
+    static char *colors[] = {"default", "black", "red", "green", "yellow",
+	"blue", "magenta", "cyan", "white"};
+    int cell = row * scr->cols + col;
+    unsigned short a = scr->attr[cell];
+    Tcl_Obj *resultPtr = Tcl_NewListObj(0, NULL);
+    int fg = (a >> SCR_FG_SHIFT) & SCR_COLOR_MASK;
+    int bg = (a >> SCR_BG_SHIFT) & SCR_COLOR_MASK;
+
+#define CELL_ELEMENT(name, value) \
+    Tcl_ListObjAppendElement(NULL, resultPtr, Tcl_NewStringObj(name, -1)); \
+    Tcl_ListObjAppendElement(NULL, resultPtr, value)
+
+    CELL_ELEMENT("-char", Tcl_NewUnicodeObj(scr->text + cell, 1));
+    CELL_ELEMENT("-bold", Tcl_NewBooleanObj(a & SCR_BOLD));
+    CELL_ELEMENT("-underline", Tcl_NewBooleanObj(a & SCR_UNDERLINE));
+    CELL_ELEMENT("-blink", Tcl_NewBooleanObj(a & SCR_BLINK));
+    CELL_ELEMENT("-reverse", Tcl_NewBooleanObj(a & SCR_REVERSE));
+    CELL_ELEMENT("-fg", Tcl_NewStringObj(colors[fg < 9 ? fg : 0], -1));
+    CELL_ELEMENT("-bg", Tcl_NewStringObj(colors[bg < 9 ? bg : 0], -1));
+
+#undef CELL_ELEMENT
+    return resultPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Exp_ScreenObjCmd --
+ *
+ *	exp_screen ?-i spawn_id? ?-rows n? ?-cols n?
+ *	exp_screen ?-i spawn_id? -off | -reset | -info
+ *	exp_screen ?-i spawn_id? -dump | -cursor
+ *	exp_screen ?-i spawn_id? -row n
+ *	exp_screen ?-i spawn_id? -region top left bottom right
+ *	exp_screen ?-i spawn_id? -cell row col
+ *
+ *	The first form turns the screen on (or resizes it).  Rows and
+ *	columns are counted from 0.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Exp_ScreenObjCmd (
+    ClientData clientData,
+    Tcl_Interp *interp,
+    int objc,
+    Tcl_Obj *CONST objv[])
+{
+    static char *flags[] = {"-i", "-rows", "-cols", "-off", "-reset",
+	"-info", "-dump", "-cursor", "-row", "-region", "-cell", (char *)0};
+    enum flags {FLAG_SPAWN_ID, FLAG_ROWS, FLAG_COLS, FLAG_OFF, FLAG_RESET,
+	FLAG_INFO, FLAG_DUMP, FLAG_CURSOR, FLAG_ROW, FLAG_REGION, FLAG_CELL};
+    int i, j, index;
+    int action = -1;
+    int rows = -1, cols = -1;
+    int args[4];
+    int nargs = 0;
+    ExpState *esPtr = NULL;
+    char *chanName = NULL;
+    struct ExpScreen *scr;
+    Tcl_Obj *resultPtr;
+
+    for (i = 1; i < objc; i++) {
+	if (Tcl_GetIndexFromObj(interp, objv[i], flags, "flag", 0,
+		&index) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	switch ((enum flags) index) {
+	case FLAG_SPAWN_ID:
+	    if (++i >= objc) goto usage;
+	    chanName = Tcl_GetString(objv[i]);
+	    break;
+	case FLAG_ROWS:
+	case FLAG_COLS:
+	    if (++i >= objc) goto usage;
+	    if (Tcl_GetIntFromObj(interp, objv[i],
+		    index == FLAG_ROWS ? &rows : &cols) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+	    if ((index == FLAG_ROWS ? rows : cols) < 1) {
+		exp_error(interp, "%s must be at least 1", flags[index]);
+		return TCL_ERROR;
+	    }
+	    /* and small enough that rows*cols cells can't overflow */
+	    if ((index == FLAG_ROWS ? rows : cols) > SCR_MAX_SIZE) {
+		exp_error(interp, "%s must be at most %d", flags[index],
+			SCR_MAX_SIZE);
+		return TCL_ERROR;
+	    }
+	    break;
+	case FLAG_ROW:
+	case FLAG_REGION:
+	case FLAG_CELL:
+	    nargs = (index == FLAG_ROW) ? 1 : (index == FLAG_CELL) ? 2 : 4;
+	    if (i + nargs >= objc) goto usage;
+	    for (j = 0; j < nargs; j++) {
+		if (Tcl_GetIntFromObj(interp, objv[++i], &args[j]) != TCL_OK) {
+		    return TCL_ERROR;
+		}
+	    }
+	    /* fall through */
+	default:
+	    if (action != -1) goto usage;
+	    action = index;
+	    break;
+	}
+    }
+
+    if (chanName) {
+	esPtr = expStateFromChannelName(interp, chanName, 0, 0, 0,
+		"exp_screen");
+    } else {
+	esPtr = expStateCurrent(interp, 0, 0, 0);
+    }
+    if (esPtr == NULL) {
+	return TCL_ERROR;
+    }
+    scr = esPtr->screen;
+
+    /*
+     * What expect -screen sees changes without a read, so cases that
+     * failed against the old screen must be tried again.
+     */
+    if (action == -1) {
+	if (scr == NULL) {
+	    esPtr->screen = ScreenCreate(
+		    rows > 0 ? rows : SCR_DEFAULT_ROWS,
+		    cols > 0 ? cols : SCR_DEFAULT_COLS);
+	} else {
+	    ScreenResize(scr, rows > 0 ? rows : scr->rows,
+		    cols > 0 ? cols : scr->cols);
+	}
+	esPtr->generation++;
+	return TCL_OK;
+    }
+    if (rows != -1 || cols != -1) goto usage;
+
+    if (action == FLAG_OFF) {
+	expScreenFree(esPtr);
+	esPtr->generation++;
+	return TCL_OK;
+    }
+    if (action == FLAG_INFO) {
+	if (scr) {
+	    resultPtr = Tcl_NewListObj(0, NULL);
+	    Tcl_ListObjAppendElement(interp, resultPtr,
+		    Tcl_NewStringObj("-rows", -1));
+	    Tcl_ListObjAppendElement(interp, resultPtr,
+		    Tcl_NewIntObj(scr->rows));
+	    Tcl_ListObjAppendElement(interp, resultPtr,
+		    Tcl_NewStringObj("-cols", -1));
+	    Tcl_ListObjAppendElement(interp, resultPtr,
+		    Tcl_NewIntObj(scr->cols));
+	    Tcl_SetObjResult(interp, resultPtr);
+	}
+	return TCL_OK;
+    }
+    if (scr == NULL) {
+	exp_error(interp, "spawn id %s has no screen, use \"exp_screen\" first",
+		esPtr->name);
+	return TCL_ERROR;
+    }
+
+    switch ((enum flags) action) {
+    case FLAG_RESET:
+	ScreenReset(scr);
+	esPtr->generation++;
+	break;
+    case FLAG_DUMP:
+	Tcl_SetObjResult(interp, expScreenText(esPtr));
+	break;
+    case FLAG_CURSOR:
+	resultPtr = Tcl_NewListObj(0, NULL);
+	Tcl_ListObjAppendElement(interp, resultPtr, Tcl_NewIntObj(scr->row));
+	Tcl_ListObjAppendElement(interp, resultPtr, Tcl_NewIntObj(scr->col));
+	Tcl_SetObjResult(interp, resultPtr);
+	break;
+    case FLAG_ROW:
+	if (args[0] < 0 || args[0] >= scr->rows) goto range;
+	Tcl_SetObjResult(interp,
+		ScreenRegion(scr, args[0], 0, args[0], scr->cols - 1));
+	break;
+    case FLAG_REGION:
+	if (args[0] < 0 || args[2] >= scr->rows || args[0] > args[2]
+		|| args[1] < 0 || args[3] >= scr->cols || args[1] > args[3]) {
+	    goto range;
+	}
+	Tcl_SetObjResult(interp,
+		ScreenRegion(scr, args[0], args[1], args[2], args[3]));
+	break;
+    case FLAG_CELL:
+	if (args[0] < 0 || args[0] >= scr->rows
+		|| args[1] < 0 || args[1] >= scr->cols) {
+	    goto range;
+	}
+	Tcl_SetObjResult(interp, ScreenCell(scr, args[0], args[1]));
+	break;
+    default:
+	goto usage;
+    }
+    return TCL_OK;
+
+ range:
+    exp_error(interp, "position outside the %dx%d screen", scr->rows,
+	    scr->cols);
+    return TCL_ERROR;
+
+ usage:
+    exp_error(interp, "usage: ?-i spawn_id? ?-rows n? ?-cols n? | -off | "
+	    "-reset | -info | -dump | -cursor | -row n | "
+	    "-region top left bottom right | -cell row col");
+    return TCL_ERROR;
+}
+
+static struct exp_cmd_data cmd_data[]  = {
+{"exp_screen",	Exp_ScreenObjCmd,	0,	0,	0},
+{0}};
+
+void
+exp_init_screen_cmds (
+    Tcl_Interp *interp)
+{
+    exp_create_commands(interp,cmd_data);
+}
@@ -0,0 +1,444 @@
+/* ----------------------------------------------------------------------------
+ * exp_stream.c --
+ *
+ *	Streaming mode for a spawn id, for following logs and other output
+ *	where throughput matters and there is nothing to match.  Input is
+ *	split into records on a delimiter or into fixed length records,
+ *	and the records are handed to a Tcl command as a list, one call per
+ *	event loop wakeup (or per -batch records).  No cases are evaluated,
+ *	no buffer shuffles and no expect_out variables are set, but each
+ *	read is otherwise handled as expect would (expStreamRead) before
+ *	it is taken out of the expect buffer.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "expInt.h"
+
+#ifndef EXP_STREAM_READSIZE
+#define EXP_STREAM_READSIZE 65536	/* most chars taken by one wakeup */
+#endif
+
+#define STREAM_DEFAULT_BATCH 512
+
+struct ExpStream {
+    ExpState *esPtr;		/* NULL once stopped */
+    Tcl_Interp *interp;
+    Tcl_Obj *delim;		/* record separator, or NULL */
+    int length;			/* else chars per record */
+    int batch;			/* most records per call */
+    Tcl_Obj *command;		/* prefix, the records are appended */
+    Tcl_Obj *eofScript;		/* or NULL */
+    Tcl_Obj *pending;		/* read but not yet split into records */
+};
+
+static void
+StreamFree (
+    char *clientData)
+{
+    struct ExpStream *sPtr = (struct ExpStream *) clientData;
+
+    if (sPtr->delim) Tcl_DecrRefCount(sPtr->delim);
+    Tcl_DecrRefCount(sPtr->command);
+    if (sPtr->eofScript) Tcl_DecrRefCount(sPtr->eofScript);
+    Tcl_DecrRefCount(sPtr->pending);
+    ckfree((char *) sPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StreamDeliver --
+ *
+ *	Call the command with a list of records.
+ *
+ * Results:
+ *	0 if the stream was stopped by the command, else 1.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+StreamDeliver (
+    struct ExpStream *sPtr,
+    Tcl_Obj *records)
+{
+    Tcl_Interp *interp = sPtr->interp;
+    Tcl_Obj *cmdPtr;
+    int result;
+
+    cmdPtr = Tcl_DuplicateObj(sPtr->command);
+    Tcl_IncrRefCount(cmdPtr);
+    Tcl_ListObjAppendElement(NULL, cmdPtr, records);
+    result = Tcl_EvalObjEx(interp, cmdPtr, TCL_EVAL_GLOBAL);
+    Tcl_DecrRefCount(cmdPtr);
+    if (result != TCL_OK) {
+	Tcl_AddErrorInfo(interp, "\n    (exp_stream command)");
+	Tcl_BackgroundError(interp);
+    }
+    return sPtr->esPtr != NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StreamSplit --
+ *
+ *	Cut the complete records off the front of the pending data and
+ *	deliver them, -batch at a time.  At eof, whatever is left is the
+ *	last record.
+ *
+ * Results:
+ *	0 if the stream was stopped by the command, else 1.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+StreamSplit (
+    struct ExpStream *sPtr,
+    int eof)
+{
+    Tcl_Obj *records = NULL;
+    int count = 0;
+    char *str, *p, *end, *q;
+    int length, dlen = 0;
+    CONST char *dstr = NULL;
+    int i;
+
+    str = Tcl_GetStringFromObj(sPtr->pending, &length);
+    p = str;
+    end = str + length;
+    if (sPtr->delim) {
+	dstr = Tcl_GetStringFromObj(sPtr->delim, &dlen);
+    }
+
+    while (p < end) {
+	if (dstr) {
+	    for (q = p; (q = memchr(q, dstr[0], end - q)) != NULL; q++) {
+		if (end - q >= dlen && !memcmp(q, dstr, dlen)) break;
+		if (end - q < dlen) {
+		    q = NULL;
+		    break;
+		}
+	    }
+	} else {
+	    for (q = p, i = 0; i < sPtr->length && q < end; i++) {
+		q += Tcl_UtfNext(q) - q;
+	    }
+	    if (i < sPtr->length || q > end) q = NULL;
+	}
+	if (q == NULL) {
+	    if (!eof) break;
+	    q = end;
+	}
+
+	if (records == NULL) {
+	    records = Tcl_NewListObj(0, NULL);
+	    Tcl_IncrRefCount(records);
+	}
+	Tcl_ListObjAppendElement(NULL, records, Tcl_NewStringObj(p, q - p));
+	p = (q == end) ? end : q + (dstr ? dlen : 0);
+
+	if (++count == sPtr->batch) {
+	    /* the command may read more, so drop what it has first */
+	    memmove(str, p, end - p);
+	    Tcl_SetObjLength(sPtr->pending, end - p);
+	    if (!StreamDeliver(sPtr, records)) {
+		Tcl_DecrRefCount(records);
+		return 0;
+	    }
+	    Tcl_DecrRefCount(records);
+	    records = NULL;
+	    count = 0;
+	    str = Tcl_GetStringFromObj(sPtr->pending, &length);
+	    p = str;
+	    end = str + length;
+	}
+    }
+
+    memmove(str, p, end - p);
+    Tcl_SetObjLength(sPtr->pending, end - p);
+    if (records) {
+	int alive = StreamDeliver(sPtr, records);
+	Tcl_DecrRefCount(records);
+	return alive;
+    }
+    return 1;
+}
+
+/* move what is in the expect buffer to the end of the pending data */
+static void
+StreamTake (
+    struct ExpStream *sPtr)
+{
+    ExpState *esPtr = sPtr->esPtr;
+
+    if (expSizeGet(esPtr) == 0) {
+	return;
+    }
+    Tcl_AppendObjToObj(sPtr->pending, esPtr->buffer);
+    Tcl_SetObjLength(esPtr->buffer, 0);
+    esPtr->printed = 0;
+    esPtr->lineStart = 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StreamHandler --
+ *
+ *	Channel handler: read what is there, up to EXP_STREAM_READSIZE
+ *	chars so other events get a turn, and deliver the records.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+StreamHandler (
+    ClientData clientData,
+    int mask)
+{
+    struct ExpStream *sPtr = (struct ExpStream *) clientData;
+    ExpState *esPtr = sPtr->esPtr;
+    int cc, total = 0, eof = 0;
+
+    if (esPtr == NULL) {
+	return;
+    }
+    while (total < EXP_STREAM_READSIZE) {
+	cc = expStreamRead(esPtr);
+	StreamTake(sPtr);
+	if (cc == EXP_EOF) {
+	    eof = 1;
+	}
+	if (cc <= 0) {
+	    break;
+	}
+	total += cc;
+    }
+    if (total == 0 && !eof) {
+	return;
+    }
+
+    Tcl_Preserve((ClientData) sPtr);
+    if (StreamSplit(sPtr, eof) && eof) {
+	Tcl_Obj *script = sPtr->eofScript;
+
+	if (script) Tcl_IncrRefCount(script);
+	expStreamFree(esPtr);
+	if (script) {
+	    if (Tcl_EvalObjEx(sPtr->interp, script, TCL_EVAL_GLOBAL)
+		    != TCL_OK) {
+		Tcl_AddErrorInfo(sPtr->interp, "\n    (exp_stream -eof script)");
+		Tcl_BackgroundError(sPtr->interp);
+	    }
+	    Tcl_DecrRefCount(script);
+	}
+    }
+    Tcl_Release((ClientData) sPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expStreamFree --
+ *
+ *	Stop streaming a spawn id.  Called by "exp_stream -off", at eof
+ *	and when the spawn id is closed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+expStreamFree (
+    ExpState *esPtr)
+{
+    struct ExpStream *sPtr = esPtr->stream;
+
+    if (sPtr) {
+	Tcl_DeleteChannelHandler(esPtr->channel, StreamHandler,
+		(ClientData) sPtr);
+	sPtr->esPtr = NULL;
+	esPtr->stream = NULL;
+	Tcl_EventuallyFree((ClientData) sPtr, StreamFree);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Exp_StreamObjCmd --
+ *
+ *	exp_stream ?-i spawn_id? ?-delim string | -length n? ?-batch n?
+ *		-command prefix ?-eof script?
+ *	exp_stream ?-i spawn_id? -off | -info
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Exp_StreamObjCmd (
+    ClientData clientData,
+    Tcl_Interp *interp,
+    int objc,
+    Tcl_Obj *CONST objv[])
+{
+    static char *flags[] = {"-i", "-delim", "-length", "-batch", "-command",
+	"-eof", "-off", "-info", (char *)0};
+    enum flags {FLAG_SPAWN_ID, FLAG_DELIM, FLAG_LENGTH, FLAG_BATCH,
+	FLAG_COMMAND, FLAG_EOF, FLAG_OFF, FLAG_INFO};
+    int i, index;
+    int action = -1;
+    char *chanName = NULL;
+    Tcl_Obj *delim = NULL, *command = NULL, *eofScript = NULL;
+    int length = 0, batch = STREAM_DEFAULT_BATCH;
+    ExpState *esPtr;
+    struct ExpStream *sPtr;
+    Tcl_Obj *resultPtr;
+
+    for (i = 1; i < objc; i++) {
+	if (Tcl_GetIndexFromObj(interp, objv[i], flags, "flag", 0,
+		&index) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	switch ((enum flags) index) {
+	case FLAG_SPAWN_ID:
+	    if (++i >= objc) goto usage;
+	    chanName = Tcl_GetString(objv[i]);
+	    break;
+	case FLAG_DELIM:
+	    if (++i >= objc) goto usage;
+	    delim = objv[i];
+	    break;
+	case FLAG_LENGTH:
+	case FLAG_BATCH:
+	    if (++i >= objc) goto usage;
+	    if (Tcl_GetIntFromObj(interp, objv[i],
+		    index == FLAG_LENGTH ? &length : &batch) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+	    if ((index == FLAG_LENGTH ? length : batch) < 1) {
+		exp_error(interp, "%s must be at least 1", flags[index]);
+		return TCL_ERROR;
+	    }
+	    break;
+	case FLAG_COMMAND:
+	    if (++i >= objc) goto usage;
+	    command = objv[i];
+	    break;
+	case FLAG_EOF:
+	    if (++i >= objc) goto usage;
+	    eofScript = objv[i];
+	    break;
+	case FLAG_OFF:
+	case FLAG_INFO:
+	    action = index;
+	    break;
+	}
+    }
+
+    if (chanName) {
+	esPtr = expStateFromChannelName(interp, chanName, 0, 0, 0,
+		"exp_stream");
+    } else {
+	esPtr = expStateCurrent(interp, 0, 0, 0);
+    }
+    if (esPtr == NULL) {
+	return TCL_ERROR;
+    }
+
+    if (action == FLAG_OFF) {
+	expStreamFree(esPtr);
+	return TCL_OK;
+    }
+    if (action == FLAG_INFO) {
+	sPtr = esPtr->stream;
+	if (sPtr) {
+	    resultPtr = Tcl_NewListObj(0, NULL);
+	    if (sPtr->delim) {
+		Tcl_ListObjAppendElement(NULL, resultPtr,
+			Tcl_NewStringObj("-delim", -1));
+		Tcl_ListObjAppendElement(NULL, resultPtr, sPtr->delim);
+	    } else {
+		Tcl_ListObjAppendElement(NULL, resultPtr,
+			Tcl_NewStringObj("-length", -1));
+		Tcl_ListObjAppendElement(NULL, resultPtr,
+			Tcl_NewIntObj(sPtr->length));
+	    }
+	    Tcl_ListObjAppendElement(NULL, resultPtr,
+		    Tcl_NewStringObj("-batch", -1));
+	    Tcl_ListObjAppendElement(NULL, resultPtr,
+		    Tcl_NewIntObj(sPtr->batch));
+	    Tcl_ListObjAppendElement(NULL, resultPtr,
+		    Tcl_NewStringObj("-command", -1));
+	    Tcl_ListObjAppendElement(NULL, resultPtr, sPtr->command);
+	    if (sPtr->eofScript) {
+		Tcl_ListObjAppendElement(NULL, resultPtr,
+			Tcl_NewStringObj("-eof", -1));
+		Tcl_ListObjAppendElement(NULL, resultPtr, sPtr->eofScript);
+	    }
+	    Tcl_SetObjResult(interp, resultPtr);
+	}
+	return TCL_OK;
+    }
+
+    if (command == NULL || (delim && length)) goto usage;
+    if (delim && Tcl_GetCharLength(delim) == 0) {
+	exp_error(interp, "-delim must not be empty");
+	return TCL_ERROR;
+    }
+    if (!delim && !length) {
+	delim = Tcl_NewStringObj("\n", 1);
+    }
+    if (esPtr->bg_status != unarmed) {
+	exp_error(interp, "spawn id %s is in use by expect_background",
+		esPtr->name);
+	return TCL_ERROR;
+    }
+
+    expStreamFree(esPtr);
+    sPtr = (struct ExpStream *) ckalloc(sizeof(struct ExpStream));
+    sPtr->esPtr = esPtr;
+    sPtr->interp = interp;
+    sPtr->delim = delim;
+    if (delim) Tcl_IncrRefCount(delim);
+    sPtr->length = length;
+    sPtr->batch = batch;
+    sPtr->command = command;
+    Tcl_IncrRefCount(command);
+    sPtr->eofScript = eofScript;
+    if (eofScript) Tcl_IncrRefCount(eofScript);
+
+    /* what expect read but did not match comes first */
+    sPtr->pending = Tcl_DuplicateObj(esPtr->buffer);
+    Tcl_IncrRefCount(sPtr->pending);
+    Tcl_SetObjLength(esPtr->buffer, 0);
+    esPtr->generation++;
+    esPtr->printed = 0;
+    esPtr->lineStart = 0;
+
+    esPtr->stream = sPtr;
+    Tcl_CreateChannelHandler(esPtr->channel, TCL_READABLE, StreamHandler,
+	    (ClientData) sPtr);
+    return TCL_OK;
+
+ usage:
+    exp_error(interp, "usage: ?-i spawn_id? ?-delim string | -length n? "
+	    "?-batch n? -command prefix ?-eof script? | -off | -info");
+    return TCL_ERROR;
+}
+
+static struct exp_cmd_data cmd_data[]  = {
+{"exp_stream",	Exp_StreamObjCmd,	0,	0,	0},
+{0}};
+
+void
+exp_init_stream_cmds (
+    Tcl_Interp *interp)
+{
+    exp_create_commands(interp,cmd_data);
+}
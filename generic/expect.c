@@ -31,6 +31,10 @@
 #include "tcldbg.h"
 #endif
 
+#ifndef __WIN32__
+#include <sys/resource.h>	/* getrusage, for exp_cputime */
+#endif
+
 /* Fix the error in winnt.h */
 #if (_MSC_VER == 1200)
 #   undef DEFAULT_UNREACHABLE
@@ -47,7 +51,22 @@ int exp_default_match_max =	2000;
 #define INIT_EXPECT_TIMEOUT	10	/* seconds */
 int exp_default_parity =	TRUE;
 int exp_default_rm_nulls =	TRUE;
+int exp_default_strip_ansi =	FALSE;
 int exp_default_close_on_eof =  TRUE;
+int exp_default_direct_read =	FALSE;
+static unsigned long exp_read_serial = 0;
+
+/*
+ * The channel buffer, and so the size of each read from the process,
+ * follows the chunks seen: reads that fill it double it, and when the
+ * average chunk is well under it, it is halved again.
+ */
+#ifndef EXP_READ_MIN
+#define EXP_READ_MIN	4096
+#endif
+#ifndef EXP_READ_MAX
+#define EXP_READ_MAX	65536
+#endif
 
 /* user variable names */
 #define EXPECT_TIMEOUT		"timeout"
@@ -55,6 +74,27 @@ int exp_default_close_on_eof =  TRUE;
 
 typedef struct ThreadSpecificData {
     int timeout;
+
+    /*
+     * exp_coalesce: after a read returns data, expIRead goes on reading
+     * what is already there, up to this many bytes or microseconds, so a
+     * burst that arrives in small chunks is evaluated once.  Off if both
+     * are 0.
+     */
+    int coalesceBytes;
+    int coalesceUsec;
+
+    /* counters reported by "exp_profile -reads" */
+    Tcl_WideUInt reads;		/* reads made by expIRead */
+    Tcl_WideUInt readsCoalesced;	/* of which coalesced */
+    Tcl_WideUInt readEvals;	/* expRead returns with new data */
+
+    /* exp_profile entries, found by profile_get through profileTable */
+    Tcl_HashTable profileTable;
+    int profileTableInit;
+    struct exp_profile *profileFirst;
+    struct exp_profile **profileLast;
+    int profileInterps;		/* interps with the expect commands */
 } ThreadSpecificData;
 
 static Tcl_ThreadDataKey dataKey;
@@ -70,6 +110,12 @@ static ExpState DevttyPlaceholder;
 /* 1 ecase struct is reserved for each case in the expect command.  Note that
 eof/timeout don't use any of theirs, but the algorithm is simpler this way. */
 
+/* a case that failed against a spawn id whose buffer was at generation */
+struct exp_tried {
+	ExpState *esPtr;
+	int generation;
+};
+
 struct ecase {	/* case for expect command */
 	struct exp_i	*i_list;
 	Tcl_Obj *pat;	/* original pattern spec */
@@ -90,12 +136,70 @@ struct ecase {	/* case for expect command */
 	int indices;	/* if true, write indices */
 	int iread;	/* if true, reread indirects */
 	int timestamp;	/* if true, write timestamps */
+	int screen;	/* if true, match the virtual screen, not the buffer */
+	Tcl_Obj *capture; /* variable to set to a dict of the groups */
+	Tcl_Obj *names;	/* dict keys for groups 1..n, else their numbers */
+	Tcl_Obj *keys;	/* dict key of each group, made on first match */
+	struct exp_tried *tried; /* -i any: what each spawn id failed at */
+	int tried_count;
+	int tried_key;	/* expect_key when tried was filled in */
 #define CASE_UNKNOWN	0
 #define CASE_NORM	1
 #define CASE_LOWER	2
 	int Case;	/* convert case before doing match? */
+	struct exp_profile *prof; /* counters if being profiled, else 0 */
+};
+
+/*
+ * Per-pattern counters kept by "exp_profile" and "expect -profile".
+ * Entries are shared by every ecase with the same command type, pattern
+ * type, case sensitivity and pattern text, so the counters of a
+ * foreground expect inside a loop accumulate across invocations.
+ * Entries are never freed, only zeroed by "exp_profile -reset", because
+ * live ecases point at them.
+ */
+struct exp_profile {
+	int cmdtype;		/* EXP_CMD_XXX */
+	int use;		/* PAT_XXX */
+	int Case;
+	Tcl_Obj *pat;
+	Tcl_WideUInt evals;	/* # of times evaluated */
+	Tcl_WideUInt bytes;	/* bytes of buffer presented to pattern */
+	Tcl_WideUInt cycles;	/* time spent evaluating */
+	Tcl_WideUInt hits;	/* # of times it was chosen */
+	struct exp_profile *next;	/* in order of creation */
 };
 
+static int exp_profiling = FALSE;	/* profile every expect command */
+static int exp_lines_serial = 0;	/* last value given to eg->lines */
+
+/*
+ * Cheapest available clock for timing case evaluation.  Where there is
+ * no cycle counter, microseconds are used instead.
+ */
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#   include <intrin.h>
+#   define EXP_CYCLES()	((Tcl_WideUInt) __rdtsc())
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+static __inline__ Tcl_WideUInt
+exp_cycles()
+{
+	unsigned int lo, hi;
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((Tcl_WideUInt) hi << 32) | lo;
+}
+#   define EXP_CYCLES()	exp_cycles()
+#else
+static Tcl_WideUInt
+exp_cycles()
+{
+	Tcl_Time now;
+	Tcl_GetTime(&now);
+	return (Tcl_WideUInt) now.sec * 1000000 + now.usec;
+}
+#   define EXP_CYCLES()	exp_cycles()
+#endif
+
 /* descriptions of the pattern types, used for debugging */
 char *pattern_style[PAT_TYPES];
 
@@ -111,6 +215,9 @@ struct exp_cmd_descriptor {
 	int duration;			/* permanent or temporary */
 	int timeout_specified_by_flag;	/* if -timeout flag used */
 	int timeout;			/* timeout period if flag used */
+	int profile;			/* if -profile flag used */
+	int lines;			/* if -lines flag used, a serial */
+					/* number identifying this command */
 	struct exp_cases_descriptor ecd;
 	struct exp_i *i_list;
 } exp_cmds[4];
@@ -127,6 +234,8 @@ int cmdtype;
 {
 	cmd->duration = duration;
 	cmd->cmdtype = cmdtype;
+	cmd->profile = FALSE;
+	cmd->lines = 0;
 	cmd->ecd.cases = 0;
 	cmd->ecd.count = 0;
 	cmd->i_list = 0;
@@ -167,6 +276,15 @@ int free_ilist;		/* if we should free ilist */
     if (ec->i_list->duration == EXP_PERMANENT) {
 	if (ec->pat) Tcl_DecrRefCount(ec->pat);
 	if (ec->body) Tcl_DecrRefCount(ec->body);
+	if (ec->capture) Tcl_DecrRefCount(ec->capture);
+	if (ec->names) Tcl_DecrRefCount(ec->names);
+    }
+    if (ec->keys) Tcl_DecrRefCount(ec->keys);
+    if (ec->tried) ckfree((char *)ec->tried);
+
+    /* a temporary ecase is in the arena and goes when that is released */
+    if (ec->i_list->duration == EXP_PERMANENT) {
+	expSlabFree(ec,sizeof(struct ecase));
     }
 
     if (free_ilist) {
@@ -174,8 +292,6 @@ int free_ilist;		/* if we should free ilist */
 	if (ec->i_list->ecount == 0)
 	    exp_free_i(interp,ec->i_list,exp_indirect_update2);
     }
-
-    ckfree((char *)ec);	/* NEW */
 }
 
 /* free up any argv structures in the ecases */
@@ -192,7 +308,7 @@ int free_ilist;		/* if true, free ilists */
 	for (i=0;i<eg->ecd.count;i++) {
 		free_ecase(interp,eg->ecd.cases[i],free_ilist);
 	}
-	ckfree((char *)eg->ecd.cases);
+	/* the array itself is in the arena (parse_expect_args) */
 
 	eg->ecd.cases = 0;
 	eg->ecd.count = 0;
@@ -378,19 +494,124 @@ struct ecase *ec;
 	ec->indices = FALSE;
 	ec->iread = FALSE;
 	ec->timestamp = FALSE;
+	ec->screen = FALSE;
+	ec->capture = 0;
+	ec->names = 0;
+	ec->keys = 0;
+	ec->tried = 0;
+	ec->tried_count = 0;
+	ec->tried_key = -1;
 	ec->Case = CASE_NORM;
 	ec->use = PAT_GLOB;
+	ec->prof = 0;
 }
 
 static struct ecase *
-ecase_new()
+ecase_new(duration)
+int duration;
 {
-	struct ecase *ec = (struct ecase *)ckalloc(sizeof(struct ecase));
+	struct ecase *ec;
+
+	if (duration == EXP_PERMANENT) {
+		ec = (struct ecase *)expSlabAlloc(sizeof(struct ecase));
+	} else {
+		ec = (struct ecase *)expArenaAlloc(sizeof(struct ecase));
+	}
 
 	ecase_clear(ec);
 	return ec;
 }
 
+/* find or create the profile entry shared by cases that look like e */
+static struct exp_profile *
+profile_get(cmdtype,e)
+int cmdtype;
+struct ecase *e;
+{
+	ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+	Tcl_DString key;
+	Tcl_HashEntry *hPtr;
+	struct exp_profile *prof;
+	char buf[30];
+	int isNew;
+
+	if (!tsdPtr->profileTableInit) {
+		Tcl_InitHashTable(&tsdPtr->profileTable,TCL_STRING_KEYS);
+		tsdPtr->profileTableInit = TRUE;
+		tsdPtr->profileLast = &tsdPtr->profileFirst;
+	}
+
+	Tcl_DStringInit(&key);
+	sprintf(buf,"%d %d %d %d ",cmdtype,e->use,e->Case,e->screen);
+	Tcl_DStringAppend(&key,buf,-1);
+	Tcl_DStringAppend(&key,Tcl_GetString(e->pat),-1);
+	hPtr = Tcl_CreateHashEntry(&tsdPtr->profileTable,
+		Tcl_DStringValue(&key),&isNew);
+	Tcl_DStringFree(&key);
+
+	if (!isNew) return (struct exp_profile *)Tcl_GetHashValue(hPtr);
+
+	prof = (struct exp_profile *)ckalloc(sizeof(struct exp_profile));
+	memset((char *)prof,0,sizeof(struct exp_profile));
+	prof->cmdtype = cmdtype;
+	prof->use = e->use;
+	prof->Case = e->Case;
+	prof->pat = Tcl_DuplicateObj(e->pat);
+	Tcl_IncrRefCount(prof->pat);
+	*tsdPtr->profileLast = prof;
+	tsdPtr->profileLast = &prof->next;
+	Tcl_SetHashValue(hPtr,prof);
+	return prof;
+}
+
+/* turn profiling of every case in eg on or off */
+static void
+ecases_profile(eg,on)
+struct exp_cmd_descriptor *eg;
+int on;
+{
+	int i;
+
+	for (i=0;i<eg->ecd.count;i++) {
+		struct ecase *e = eg->ecd.cases[i];
+		e->prof = (on ? profile_get(eg->cmdtype,e) : 0);
+	}
+}
+
+/*
+ * Free the profile entries once the last interp with the expect
+ * commands is deleted.  The persistent cases are unhooked first; no
+ * foreground expect can be running by then.
+ */
+/*ARGSUSED*/
+static void
+profile_free(clientData,interp)
+ClientData clientData;
+Tcl_Interp *interp;
+{
+	ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+	struct exp_profile *prof, *next;
+
+	if (--tsdPtr->profileInterps > 0) return;
+
+	ecases_profile(&exp_cmds[EXP_CMD_BEFORE],FALSE);
+	ecases_profile(&exp_cmds[EXP_CMD_AFTER],FALSE);
+	ecases_profile(&exp_cmds[EXP_CMD_BG],FALSE);
+	exp_profiling = FALSE;
+
+	for (prof = tsdPtr->profileFirst;prof;prof = next) {
+		next = prof->next;
+		Tcl_DecrRefCount(prof->pat);
+		ckfree((char *)prof);
+	}
+	tsdPtr->profileFirst = 0;
+	tsdPtr->profileLast = &tsdPtr->profileFirst;
+	if (tsdPtr->profileTableInit) {
+		Tcl_DeleteHashTable(&tsdPtr->profileTable);
+		tsdPtr->profileTableInit = FALSE;
+	}
+}
+
 /*
 
 parse_expect_args parses the arguments to expect or its variants. 
@@ -403,6 +624,9 @@ eg->ecd.cases is an array of ecases
 eg->ecd.count is the # of ecases
 eg->i_list is a linked list of exp_i's which represent the -i info
 
+The caller must have marked the arena (exp_arena.c), which holds the
+eg->ecd.cases array and, for a foreground expect, the ecases.
+
 Each exp_i is chained to the next so that they can be easily free'd if
 necessary.  Each exp_i has a reference count.  If the -i is not used
 (e.g., has no following patterns), the ref count will be 0.
@@ -437,7 +661,7 @@ Tcl_Obj *CONST objv[];		/* Argument objects. */
     /* cases.  This will often be too large (i.e., if there are flags) */
     /* but won't affect anything. */
 
-    eg->ecd.cases = (struct ecase **)ckalloc(sizeof(struct ecase *) * (1+(objc/2)));
+    eg->ecd.cases = (struct ecase **)expArenaAlloc(sizeof(struct ecase *) * (1+(objc/2)));
 
     eg->ecd.count = 0;
 
@@ -448,13 +672,16 @@ Tcl_Obj *CONST objv[];		/* Argument objects. */
 	    static char *flags[] = {
 		"-glob", "-regexp", "-exact", "-notransfer", "-nocase",
 		"-i", "-indices", "-iread", "-timestamp", "-timeout",
-		"-nobrace", "--", (char *)0
+		"-nobrace", "-profile", "-screen", "-lines", "-capture",
+		"-names", "--", (char *)0
 	    };
 	    enum flags {
 		EXP_ARG_GLOB, EXP_ARG_REGEXP, EXP_ARG_EXACT,
 		EXP_ARG_NOTRANSFER, EXP_ARG_NOCASE, EXP_ARG_SPAWN_ID,
 		EXP_ARG_INDICES, EXP_ARG_IREAD, EXP_ARG_TIMESTAMP,
-		EXP_ARG_DASH_TIMEOUT, EXP_ARG_NOBRACE, EXP_ARG_DASH
+		EXP_ARG_DASH_TIMEOUT, EXP_ARG_NOBRACE, EXP_ARG_PROFILE,
+		EXP_ARG_SCREEN, EXP_ARG_LINES, EXP_ARG_CAPTURE,
+		EXP_ARG_NAMES, EXP_ARG_DASH
 	    };
 
 	    /*
@@ -517,8 +744,7 @@ Tcl_Obj *CONST objv[];		/* Argument objects. */
 		    Tcl_WrongNumArgs(interp, 1, objv, "-i spawn_id");
 		    goto error;
 		}
-		ec.i_list = exp_new_i_complex(interp,
-				      Tcl_GetString(objv[i]),
+		ec.i_list = exp_new_i_obj(interp, objv[i],
 				      eg->duration, exp_indirect_update2);
 		if (!ec.i_list) goto error;
 		ec.i_list->cmdtype = eg->cmdtype;
@@ -555,6 +781,40 @@ Tcl_Obj *CONST objv[];		/* Argument objects. */
 		/* of one argument that looks like it should */
 		/* be expanded to multiple arguments. */
 		break;
+	    case EXP_ARG_PROFILE:
+		/* applies to every case of this command */
+		eg->profile = TRUE;
+		break;
+	    case EXP_ARG_SCREEN:
+		ec.screen = TRUE;
+		break;
+	    case EXP_ARG_LINES:
+		/* applies to every case of this command */
+		if (eg->cmdtype != EXP_CMD_FG) {
+		    exp_error(interp,"-lines is only supported by expect");
+		    goto error;
+		}
+		if (!eg->lines) eg->lines = ++exp_lines_serial;
+		break;
+	    case EXP_ARG_CAPTURE:
+		i++;
+		if (i>=objc) {
+		    Tcl_WrongNumArgs(interp, 1, objv, "-capture varName");
+		    goto error;
+		}
+		ec.capture = objv[i];
+		break;
+	    case EXP_ARG_NAMES:
+		i++;
+		if (i>=objc) {
+		    Tcl_WrongNumArgs(interp, 1, objv, "-names list");
+		    goto error;
+		}
+		if (Tcl_ListObjLength(interp, objv[i], &index) != TCL_OK) {
+		    goto error;
+		}
+		ec.names = objv[i];
+		break;
 	    }
 	    /*
 	     * Keep processing arguments, we aren't ready for the
@@ -602,6 +862,11 @@ Tcl_Obj *CONST objv[];		/* Argument objects. */
 		break;
 	    }
 pattern:
+	    if ((ec.capture || ec.names) && ec.use != PAT_RE) {
+		exp_error(interp,"-capture and -names only apply to -re");
+		goto error;
+	    }
+
 	    /* if no -i, use previous one */
 	    if (!ec.i_list) {
 		/* if no -i flag has occurred yet, use default */
@@ -616,6 +881,10 @@ pattern:
 		}
 		ec.i_list = eg->i_list;
 	    }
+	    if (eg->duration == EXP_PERMANENT) {
+		if (ec.capture) Tcl_IncrRefCount(ec.capture);
+		if (ec.names) Tcl_IncrRefCount(ec.names);
+	    }
 	    ec.i_list->ecount++;
 
 	    /* save original pattern spec */
@@ -633,7 +902,7 @@ pattern:
 		ec.body = NULL;
 	    }
 
-	    *(eg->ecd.cases[eg->ecd.count] = ecase_new()) = ec;
+	    *(eg->ecd.cases[eg->ecd.count] = ecase_new(eg->duration)) = ec;
 
 		/* clear out for next set */
 	    ecase_clear(&ec);
@@ -655,6 +924,8 @@ pattern:
 	}
     }
 
+    if (exp_profiling || eg->profile) ecases_profile(eg,TRUE);
+
     return TCL_OK;
 
  error:
@@ -681,6 +952,10 @@ struct eval_out {
     Tcl_Obj *buffer;		/* buffer that matched */
     int match;			/* # of bytes in buffer that matched */
 			        /* or # of bytes in buffer at EOF */
+    int lineStart;		/* expect -lines: offset of the matched line */
+				/* in the ExpState buffer, else -1 */
+    int lineEnd;		/* offset just past its newline, or -1 if */
+				/* it is the incomplete last line */
 };
 
 
@@ -736,10 +1011,11 @@ string_case_first(string,pattern)	/* INTL */
 /* string match */
 /* returns EXP_X where X is MATCH, NOMATCH, FULLBUFFER, TCLERRROR */
 static int
-eval_case_string(interp,e,esPtr,o,last_esPtr,last_case,suffix)
+eval_case_string(interp,e,esPtr,line,o,last_esPtr,last_case,suffix)
 Tcl_Interp *interp;
 struct ecase *e;
 ExpState *esPtr;
+Tcl_Obj *line;			/* expect -lines: match this, not the buffer */
 struct eval_out *o;		/* 'output' - i.e., final case of interest */
 /* next two args are for debugging, when they change, reprint buffer */
 ExpState **last_esPtr;
@@ -753,11 +1029,37 @@ char *suffix;
     int length, flags;
     int result;
 
-    buffer = esPtr->buffer;
-    str = Tcl_GetStringFromObj(buffer, &length);
+    if (line) {
+	buffer = line;
+	str = Tcl_GetStringFromObj(buffer, &length);
+	expDiagLog("\r\nexpect%s: does line \"",suffix);
+	expDiagLogU(expPrintify(str));
+	expDiagLog("\" (spawn_id %s) match %s ",esPtr->name,pattern_style[e->use]);
+	*last_esPtr = 0;
+    } else if (e->screen && (e->use == PAT_GLOB || e->use == PAT_RE
+	    || e->use == PAT_EXACT)) {
+	/*
+	 * Screen patterns look at the rendered screen, but only when
+	 * something arrived since the last match consumed the buffer,
+	 * so that an unchanged screen does not match over and over.
+	 */
+	if (expSizeZero(esPtr) || !(buffer = expScreenText(esPtr))) {
+	    return(EXP_NOMATCH);
+	}
+	str = Tcl_GetStringFromObj(buffer, &length);
+	expDiagLog("\r\nexpect%s: does screen \"",suffix);
+	expDiagLogU(expPrintify(str));
+	expDiagLog("\" (spawn_id %s) match %s ",esPtr->name,pattern_style[e->use]);
+	/* make the next buffer case redisplay the buffer */
+	*last_esPtr = 0;
+    } else {
+	buffer = esPtr->buffer;
+	str = Tcl_GetStringFromObj(buffer, &length);
+    }
 
     /* if ExpState or case changed, redisplay debug-buffer */
-    if ((esPtr != *last_esPtr) || e->Case != *last_case) {
+    if (buffer == esPtr->buffer
+	    && ((esPtr != *last_esPtr) || e->Case != *last_case)) {
 	expDiagLog("\r\nexpect%s: does \"",suffix);
 	expDiagLogU(expPrintify(str));
 	expDiagLog("\" (spawn_id %s) match %s ",esPtr->name,pattern_style[e->use]);
@@ -876,6 +1178,258 @@ char *suffix;
     return(EXP_NOMATCH);
 }
 
+/* eval_case_string, plus counting and timing when the case is profiled */
+static int
+eval_case(interp,e,esPtr,line,o,last_esPtr,last_case,suffix)
+Tcl_Interp *interp;
+struct ecase *e;
+ExpState *esPtr;
+Tcl_Obj *line;
+struct eval_out *o;
+ExpState **last_esPtr;
+int *last_case;
+char *suffix;
+{
+    struct exp_profile *prof = e->prof;
+    Tcl_WideUInt start;
+    int status;
+
+    if (!prof) {
+	return eval_case_string(interp,e,esPtr,line,o,last_esPtr,last_case,suffix);
+    }
+
+    start = EXP_CYCLES();
+    status = eval_case_string(interp,e,esPtr,line,o,last_esPtr,last_case,suffix);
+    prof->cycles += EXP_CYCLES() - start;
+    prof->evals++;
+    if (line) {
+	int length;
+	Tcl_GetStringFromObj(line,&length);
+	prof->bytes += length;
+    } else {
+	prof->bytes += expSizeGet(esPtr);
+    }
+    if (status == EXP_MATCH || status == EXP_FULLBUFFER) prof->hits++;
+    return status;
+}
+
+/* leave a record of one case evaluation for exp_recorder */
+static void
+eval_case_record(eg,i,esPtr,o,status)
+struct exp_cmd_descriptor *eg;
+int i;			/* index of case within eg */
+ExpState *esPtr;
+struct eval_out *o;
+int status;
+{
+    int start = -1, end = -1;
+
+    if (o->e && o->esPtr == esPtr && status != EXP_TIMEOUT) {
+	start = (o->e->use == PAT_GLOB || o->e->use == PAT_EXACT) ?
+		o->e->simple_start : 0;
+	end = start + o->match;
+    }
+    expRecorderAdd(EXP_REC_CASE,esPtr,eg->cmdtype,i,status,start,end,
+	    esPtr ? expSizeGet(esPtr) : -1);
+}
+
+/* true if case e is matched a line at a time by expect -lines */
+#define LINE_CASE(eg,e) ((eg)->lines && !(e)->screen && \
+	((e)->use == PAT_GLOB || (e)->use == PAT_RE || (e)->use == PAT_EXACT))
+
+/*
+ * expect -lines: try the line cases of eg against each line of esPtr's
+ * buffer in turn, the first case to match a line winning.  Complete
+ * lines that no case matches are never looked at again by this command,
+ * esPtr->lineStart remembers where the untried lines begin.  The last,
+ * incomplete line is tried too (prompts rarely end in a newline) but
+ * stays untried.  Returns EXP_MATCH, EXP_NOMATCH or EXP_TCLERROR.
+ */
+static int
+eval_lines(interp,eg,esPtr,o,last_esPtr,last_case,suffix)
+Tcl_Interp *interp;
+struct exp_cmd_descriptor *eg;
+ExpState *esPtr;
+struct eval_out *o;
+ExpState **last_esPtr;
+int *last_case;
+char *suffix;
+{
+    struct exp_state_list *slPtr;
+    struct ecase *e;
+    char *str, *nl;
+    int length, start, end, next;
+    int i, status;
+
+    str = Tcl_GetStringFromObj(esPtr->buffer,&length);
+    if (esPtr->lineKey != eg->lines || esPtr->lineStart > length) {
+	esPtr->lineKey = eg->lines;
+	esPtr->lineStart = 0;
+    }
+
+    for (start = esPtr->lineStart; start < length; start = next) {
+	nl = memchr(str + start,'\n',length - start);
+	if (nl) {
+	    next = nl - str + 1;
+	    end = nl - str;
+	    if (end > start && str[end-1] == '\r') end--;
+	} else {
+	    next = end = length;
+	}
+
+	if (esPtr->lineObj) Tcl_DecrRefCount(esPtr->lineObj);
+	esPtr->lineObj = Tcl_NewStringObj(str + start,end - start);
+	Tcl_IncrRefCount(esPtr->lineObj);
+
+	for (i=0;i<eg->ecd.count;i++) {
+	    e = eg->ecd.cases[i];
+	    if (!LINE_CASE(eg,e)) continue;
+	    for (slPtr = e->i_list->state_list; slPtr; slPtr = slPtr->next) {
+		if (expStateAnyIs(slPtr->esPtr) || slPtr->esPtr == esPtr) break;
+	    }
+	    if (!slPtr) continue;
+
+	    status = eval_case(interp,e,esPtr,esPtr->lineObj,o,
+		    last_esPtr,last_case,suffix);
+	    eval_case_record(eg,i,esPtr,o,status);
+	    if (status == EXP_MATCH) {
+		o->lineStart = start;
+		o->lineEnd = nl ? next : -1;
+		return(status);
+	    }
+	    if (status != EXP_NOMATCH) return(status);
+	}
+	if (nl) esPtr->lineStart = next;
+    }
+    return(EXP_NOMATCH);
+}
+
+/*
+ * Each ExpState keeps, for expect_before, expect_after and
+ * expect_background, the cases whose spawn id lists name it (or name
+ * any_spawn_id), in case order.  An event then only looks at the cases
+ * that apply to the spawn id that is ready instead of walking every
+ * case's spawn id list.  Anything that changes the cases or the spawn
+ * id lists of those commands moves exp_dispatch_serial, and each list
+ * is rebuilt the next time it is needed.
+ */
+
+static int exp_dispatch_serial = 1;
+
+struct exp_dispatch_entry {
+	int i;		/* index of the case in ecd.cases */
+	int any;	/* the case names any_spawn_id */
+};
+
+struct ExpDispatch {
+	struct exp_dispatch {
+		int serial;	/* exp_dispatch_serial when built */
+		int count;
+		int space;
+		struct exp_dispatch_entry *entries;
+	} cmd[EXP_CMD_BG+1];
+};
+
+/* the cases or spawn ids of a global expect command changed */
+#define dispatch_changed()	(exp_dispatch_serial++)
+
+static struct exp_dispatch *
+dispatch_get(eg,esPtr)
+struct exp_cmd_descriptor *eg;
+ExpState *esPtr;
+{
+    struct exp_dispatch *d;
+    struct exp_state_list *slPtr;
+    int i;
+
+    if (!esPtr->dispatch) {
+	esPtr->dispatch = (struct ExpDispatch *)ckalloc(sizeof(struct ExpDispatch));
+	memset((char *)esPtr->dispatch,0,sizeof(struct ExpDispatch));
+    }
+    d = &esPtr->dispatch->cmd[eg->cmdtype];
+    if (d->serial == exp_dispatch_serial) return d;
+
+    d->count = 0;
+    for (i=0;i<eg->ecd.count;i++) {
+	for (slPtr = eg->ecd.cases[i]->i_list->state_list; slPtr;
+		slPtr = slPtr->next) {
+	    int any = expStateAnyIs(slPtr->esPtr);
+
+	    if (!any && slPtr->esPtr != esPtr) continue;
+	    if (d->count == d->space) {
+		d->space = d->space ? 2*d->space : 8;
+		d->entries = (struct exp_dispatch_entry *)ckrealloc(
+			(char *)d->entries,
+			d->space * sizeof(struct exp_dispatch_entry));
+	    }
+	    d->entries[d->count].i = i;
+	    d->entries[d->count].any = any;
+	    d->count++;
+	}
+    }
+    d->serial = exp_dispatch_serial;
+    return d;
+}
+
+/* called by expStateFree */
+void
+expDispatchFree(esPtr)
+ExpState *esPtr;
+{
+    int i;
+
+    if (!esPtr->dispatch) return;
+    for (i=0;i<=EXP_CMD_BG;i++) {
+	if (esPtr->dispatch->cmd[i].entries) {
+	    ckfree((char *)esPtr->dispatch->cmd[i].entries);
+	}
+    }
+    ckfree((char *)esPtr->dispatch);
+    esPtr->dispatch = 0;
+}
+
+/*
+ * With -i any_spawn_id, every case is tried against every spawn id of the
+ * command each time any one of them has new data.  A case that failed
+ * against a spawn id will fail again until that spawn id's buffer
+ * changes, so each case remembers, for each position in esPtrs, the
+ * buffer generation it last failed at.  That is only good while the
+ * same expect command (expect_key) is looking at the same spawn ids.
+ */
+static int
+case_tried(e,j,esPtr)
+struct ecase *e;
+int j;
+ExpState *esPtr;
+{
+    return (e->tried_key == expect_key && j < e->tried_count
+	    && e->tried[j].esPtr == esPtr
+	    && e->tried[j].generation == esPtr->generation);
+}
+
+static void
+case_tried_set(e,j,esPtr,mcount)
+struct ecase *e;
+int j;
+ExpState *esPtr;
+int mcount;
+{
+    int k;
+
+    if (e->tried_key != expect_key || e->tried_count < mcount) {
+	if (e->tried_count < mcount) {
+	    e->tried = (struct exp_tried *)ckrealloc((char *)e->tried,
+		    mcount * sizeof(struct exp_tried));
+	}
+	k = (e->tried_key == expect_key) ? e->tried_count : 0;
+	for (;k<mcount;k++) e->tried[k].esPtr = 0;
+	e->tried_count = mcount;
+	e->tried_key = expect_key;
+    }
+    e->tried[j].esPtr = esPtr;
+    e->tried[j].generation = esPtr->generation;
+}
+
 /* sets o.e if successfully finds a matching pattern, eof, timeout or deflt */
 /* returns original status arg or EXP_TCLERROR */
 static int
@@ -903,11 +1457,35 @@ char *suffix;
 	    e = eg->ecd.cases[i];
 	    if (e->use == PAT_TIMEOUT || e->use == PAT_DEFAULT) {
 		o->e = e;
+		if (e->prof) {
+		    e->prof->evals++;
+		    e->prof->hits++;
+		}
+		eval_case_record(eg,i,(ExpState *)0,o,status);
 		break;
 	    }
 	}
 	return(status);
     } else if (status == EXP_EOF) {
+	if (eg->cmdtype != EXP_CMD_FG && esPtr) {
+	    struct exp_dispatch *d = dispatch_get(eg,esPtr);
+	    int k;
+
+	    for (k=0;k<d->count;k++) {
+		i = d->entries[k].i;
+		e = eg->ecd.cases[i];
+		if (e->use == PAT_EOF || e->use == PAT_DEFAULT) {
+		    o->e = e;
+		    if (e->prof) {
+			e->prof->evals++;
+			e->prof->hits++;
+		    }
+		    eval_case_record(eg,i,esPtr,o,status);
+		    break;
+		}
+	    }
+	    return(status);
+	}
 	for (i=0;i<eg->ecd.count;i++) {
 	    e = eg->ecd.cases[i];
 	    if (e->use == PAT_EOF || e->use == PAT_DEFAULT) {
@@ -917,6 +1495,11 @@ char *suffix;
 		    em = slPtr->esPtr;
 		    if (expStateAnyIs(em) || em == esPtr) {
 			o->e = e;
+			if (e->prof) {
+			    e->prof->evals++;
+			    e->prof->hits++;
+			}
+			eval_case_record(eg,i,esPtr,o,status);
 			return(status);
 		    }
 		}
@@ -928,8 +1511,44 @@ char *suffix;
     /* the top loops are split from the bottom loop only because I can't */
     /* split'em further. */
 
+    if (eg->lines) {
+	status = eval_lines(interp,eg,esPtr,o,last_esPtr,last_case,suffix);
+	if (status != EXP_NOMATCH) return(status);
+    }
+
     /* The bufferful condition does not prevent a pattern match from */
     /* occurring and vice versa, so it is scanned with patterns */
+    if (eg->cmdtype != EXP_CMD_FG && esPtr) {
+	struct exp_dispatch *d = dispatch_get(eg,esPtr);
+	int j, k;
+
+	for (k=0;k<d->count;k++) {
+	    i = d->entries[k].i;
+	    e = eg->ecd.cases[i];
+	    if (e->use == PAT_TIMEOUT ||
+		    e->use == PAT_DEFAULT ||
+		    e->use == PAT_EOF) continue;
+
+	    if (d->entries[k].any) {
+		/* test against each spawn_id */
+		for (j=0;j<mcount;j++) {
+		    if (case_tried(e,j,esPtrs[j])) continue;
+		    status = eval_case(interp,e,esPtrs[j],(Tcl_Obj *)0,o,
+			    last_esPtr,last_case,suffix);
+		    eval_case_record(eg,i,esPtrs[j],o,status);
+		    if (status != EXP_NOMATCH) return(status);
+		    case_tried_set(e,j,esPtrs[j],mcount);
+		}
+	    } else {
+		status = eval_case(interp,e,esPtr,(Tcl_Obj *)0,o,
+			last_esPtr,last_case,suffix);
+		eval_case_record(eg,i,esPtr,o,status);
+		if (status != EXP_NOMATCH) return(status);
+	    }
+	}
+	return(EXP_NOMATCH);
+    }
+
     for (i=0;i<eg->ecd.count;i++) {
 	struct exp_state_list *slPtr;
 	int j;
@@ -937,7 +1556,8 @@ char *suffix;
 	e = eg->ecd.cases[i];
 	if (e->use == PAT_TIMEOUT ||
 		e->use == PAT_DEFAULT ||
-		e->use == PAT_EOF) continue;
+		e->use == PAT_EOF ||
+		LINE_CASE(eg,e)) continue;
 
 	for (slPtr = e->i_list->state_list; slPtr; slPtr = slPtr->next) {
 	    em = slPtr->esPtr;
@@ -946,15 +1566,20 @@ char *suffix;
 	    if (expStateAnyIs(em)) {
 		/* test against each spawn_id */
 		for (j=0;j<mcount;j++) {
-		    status = eval_case_string(interp,e,esPtrs[j],o,
+		    if (case_tried(e,j,esPtrs[j])) continue;
+		    status = eval_case(interp,e,esPtrs[j],(Tcl_Obj *)0,o,
 			    last_esPtr,last_case,suffix);
+		    eval_case_record(eg,i,esPtrs[j],o,status);
 		    if (status != EXP_NOMATCH) return(status);
+		    case_tried_set(e,j,esPtrs[j],mcount);
 		}
 	    } else {
 		/* reject things immediately from wrong spawn_id */
 		if (em != esPtr) continue;
 
-		status = eval_case_string(interp,e,esPtr,o,last_esPtr,last_case,suffix);
+		status = eval_case(interp,e,esPtr,(Tcl_Obj *)0,o,
+			last_esPtr,last_case,suffix);
+		eval_case_record(eg,i,esPtr,o,status);
 		if (status != EXP_NOMATCH) return(status);
 	    }
 	}
@@ -970,6 +1595,8 @@ struct exp_i *exp_i;
 {
 	int i;
 
+	dispatch_changed();
+
 	/* delete every ecase dependent on it */
 	for (i=0;i<ecmd->ecd.count;) {
 		struct ecase *e = ecmd->ecd.cases[i];
@@ -1035,6 +1662,8 @@ int direct;
     struct exp_i *exp_i, *next;
     struct exp_state_list **slPtr;
 
+    dispatch_changed();
+
     for (exp_i=ecmd->i_list;exp_i;exp_i=next) {
 	next = exp_i->next;
 
@@ -1123,6 +1752,15 @@ struct ecase *ec;
 	if (!ec->transfer) Tcl_AppendElement(interp,"-notransfer");
 	if (ec->indices) Tcl_AppendElement(interp,"-indices");
 	if (!ec->Case) Tcl_AppendElement(interp,"-nocase");
+	if (ec->screen) Tcl_AppendElement(interp,"-screen");
+	if (ec->capture) {
+		Tcl_AppendElement(interp,"-capture");
+		Tcl_AppendElement(interp,Tcl_GetString(ec->capture));
+	}
+	if (ec->names) {
+		Tcl_AppendElement(interp,"-names");
+		Tcl_AppendElement(interp,Tcl_GetString(ec->names));
+	}
 
 	if (ec->use == PAT_RE) Tcl_AppendElement(interp,"-re");
 	else if (ec->use == PAT_GLOB) Tcl_AppendElement(interp,"-gl");
@@ -1273,6 +1911,7 @@ Tcl_Obj *CONST objv[];		/* Argument objects. */
     struct exp_state_list *slPtr;   /* temp for interating over state_list */
     struct exp_cmd_descriptor eg;
     int count;
+    ExpArenaMark mark;
 
     struct exp_cmd_descriptor *ecmd = (struct exp_cmd_descriptor *) clientData;
 
@@ -1293,8 +1932,10 @@ Tcl_Obj *CONST objv[];		/* Argument objects. */
 
     exp_cmd_init(&eg,ecmd->cmdtype,EXP_PERMANENT);
 
+    expArenaMark(&mark);
     if (TCL_ERROR == parse_expect_args(interp,&eg,EXP_SPAWN_ID_BAD,
 	    objc,objv)) {
+	expArenaRelease(&mark);
 	return TCL_ERROR;
     }
 
@@ -1317,6 +1958,12 @@ Tcl_Obj *CONST objv[];		/* Argument objects. */
 		    result = TCL_ERROR;
 		    goto cleanup;
 		}
+		if (ecmd->cmdtype == EXP_CMD_BG && esPtr->stream) {
+		    exp_error(interp,"spawn id %s is in use by exp_stream",
+			    esPtr->name);
+		    result = TCL_ERROR;
+		    goto cleanup;
+		}
 	    }
 	    
 	    /* remove spawn id from exp_i */
@@ -1403,6 +2050,7 @@ Tcl_Obj *CONST objv[];		/* Argument objects. */
 
     /* append ecases */
 
+    dispatch_changed();
     count = ecmd->ecd.count + eg.ecd.count;
     if (eg.ecd.count) {
 	int start_index; /* where to add new ecases in old list */
@@ -1441,9 +2089,8 @@ Tcl_Obj *CONST objv[];		/* Argument objects. */
 	    exp_i = next;
 	}
 	free_ecases(interp,&eg,1);
-    } else {
-	if (eg.ecd.cases) ckfree((char *)eg.ecd.cases);
     }
+    expArenaRelease(&mark);
 
     if (ecmd->cmdtype == EXP_CMD_BG) {
 	exp_background_channelhandlers_run_all();
@@ -1496,48 +2143,108 @@ ExpState *esPtr;
 	    newObj = Tcl_NewStringObj(string + excessBytes,length - excessBytes);
 	} else {
 	    /*
-	     * too little data
+	     * too little data.  The buffer grows as data arrives, up to
+	     * new_msize, so just copy what's there.
 	     */
 
-	    /* first copy what's there */
 	    newObj = Tcl_NewStringObj(string,length);
-
-	    /*
-	     * Force object to allocate a buffer at least new_msize bytes long,
-	     * then reset correct string length.
-	     */
-
-	    Tcl_SetObjLength(newObj,new_msize);
-	    Tcl_SetObjLength(newObj,length);
 	}
 	Tcl_IncrRefCount(newObj);
 	Tcl_DecrRefCount(esPtr->buffer);
 	esPtr->buffer = newObj;
+	Tcl_GetStringFromObj(newObj, &length);
+	expBufferSetCharge(esPtr,length);
 
 	esPtr->key = expect_key++;
 	esPtr->msize = new_msize;
+	esPtr->generation++;
     }
 }
 
-#if OBSOLETE
-/* Strip parity */
-static void
-expParityStrip(obj,offsetBytes)
-    Tcl_Obj *obj;
-    int offsetBytes;
+/*
+ * Buffers are charged against match_max -global by the most they have
+ * held since they were last compacted, as Tcl keeps the memory of a
+ * string that gets shorter.  Call this wherever a buffer may have grown.
+ */
+void
+expBufferCharge(esPtr)
+ExpState *esPtr;
 {
-    char *p, ch;
-    
-    int changed = FALSE;
-    
-    for (p = Tcl_GetString(obj) + offsetBytes;*p;p++) {
-	ch = *p & 0x7f;
-	if (ch != *p) changed = TRUE;
-	else *p &= 0x7f;
+    int length;
+
+    Tcl_GetStringFromObj(esPtr->buffer, &length);
+    if (length > esPtr->charged) {
+	expBufferSetCharge(esPtr,length);
     }
+}
 
-    if (changed) {
-	/* invalidate the unicode rep */
+/*
+ * Reallocate the buffer to fit what it holds, after dropping all but
+ * the last keep bytes unless keep is negative.  The object itself is
+ * kept, since callers may hold on to it.  Returns the bytes released.
+ */
+int
+expBufferCompact(esPtr,keep)
+ExpState *esPtr;
+int keep;
+{
+    char *str, *copy;
+    CONST char *p;
+    int length, skiplen = 0, newlen, freed;
+
+    if (Tcl_IsShared(esPtr->buffer)) return 0;
+
+    str = Tcl_GetStringFromObj(esPtr->buffer, &length);
+    if (keep >= 0 && length > keep) {
+	/* stay on a UTF char boundary */
+	for (p=str;p < str + length - keep;p=Tcl_UtfNext(p)) {
+	    /* empty */
+	}
+	skiplen = p - str;
+    }
+    newlen = length - skiplen;
+    if (skiplen == 0 && newlen >= esPtr->charged) return 0;
+
+    copy = ckalloc((unsigned) newlen + 1);
+    memcpy(copy, str + skiplen, (size_t) newlen);
+    Tcl_SetStringObj(esPtr->buffer, copy, newlen);
+    ckfree(copy);
+
+    if (skiplen) {
+	expDiagLog("match_max -global: dropped %d bytes of %s\r\n",
+		skiplen, esPtr->name);
+	expRecorderAdd(EXP_REC_SHUFFLE,esPtr,0,0,0,0,skiplen,newlen);
+	esPtr->generation++;
+	esPtr->printed -= skiplen;
+	if (esPtr->printed < 0) esPtr->printed = 0;
+	esPtr->lineStart -= skiplen;
+	if (esPtr->lineStart < 0) esPtr->lineStart = 0;
+    }
+
+    freed = esPtr->charged - newlen;
+    expBufferSetCharge(esPtr,newlen);
+    return freed;
+}
+
+#if OBSOLETE
+/* Strip parity */
+static void
+expParityStrip(obj,offsetBytes)
+    Tcl_Obj *obj;
+    int offsetBytes;
+{
+    char *p, ch;
+    
+    int changed = FALSE;
+    
+    for (p = Tcl_GetString(obj) + offsetBytes;*p;p++) {
+	ch = *p & 0x7f;
+	if (ch != *p) changed = TRUE;
+	else *p &= 0x7f;
+    }
+
+    if (changed) {
+	/* invalidate the unicode rep */
 	if (obj->typePtr->freeIntRepProc) {
 	    obj->typePtr->freeIntRepProc(obj);
 	}
@@ -1621,6 +2328,303 @@ expNullStrip(obj,offsetBytes)
     return newsize;
 }
 
+/*
+ * States of the escape sequence stripper, kept in esPtr->ansi_state
+ * so that a sequence split across reads is still recognized.
+ */
+#define ANSI_GROUND	0
+#define ANSI_ESC	1	/* after ESC */
+#define ANSI_CSI	2	/* after ESC [, until a final byte */
+#define ANSI_STRING	3	/* OSC, DCS, APC, PM or SOS, until BEL or ST */
+#define ANSI_STRING_ESC	4	/* ESC inside a string, maybe ST */
+#define ANSI_NF		5	/* after ESC and an intermediate byte */
+
+/*
+ * Strip CSI, OSC and other escape sequences from object, beginning at
+ * offset.  Sequences are all ASCII, so this works on the UTF bytes; a
+ * malformed sequence ends at the first character that cannot be part of
+ * it, and that character is kept.
+ */
+static int
+expAnsiStrip(esPtr,offsetBytes)
+    ExpState *esPtr;
+    int offsetBytes;
+{
+    Tcl_Obj *obj = esPtr->buffer;
+    int state = esPtr->ansi_state;
+    int length;
+    unsigned char *src, *end, *dest;
+    unsigned char c;
+
+    src = (unsigned char *)Tcl_GetStringFromObj(obj,&length);
+    end = src + length;
+    src += offsetBytes;
+
+    /* nothing to do in the common case of a plain chunk */
+    if (state == ANSI_GROUND && !memchr(src,0x1b,end - src)) {
+	return length;
+    }
+
+    for (dest = src; src < end; src++) {
+	c = *src;
+	switch (state) {
+	case ANSI_GROUND:
+	    if (c == 0x1b) {
+		state = ANSI_ESC;
+		continue;
+	    }
+	    break;
+	case ANSI_ESC:
+	    if (c == '[') {
+		state = ANSI_CSI;
+	    } else if (c == ']' || c == 'P' || c == '_' || c == '^' ||
+		    c == 'X') {
+		state = ANSI_STRING;
+	    } else if (c >= 0x20 && c <= 0x2f) {
+		state = ANSI_NF;
+	    } else if (c > 0x2f && c < 0x7f) {
+		state = ANSI_GROUND;
+	    } else if (c != 0x1b) {
+		state = ANSI_GROUND;
+		break;
+	    }
+	    continue;
+	case ANSI_CSI:
+	    if (c >= 0x20 && c <= 0x3f) {
+		continue;
+	    } else if (c >= 0x40 && c < 0x7f) {
+		state = ANSI_GROUND;
+		continue;
+	    } else if (c == 0x1b) {
+		state = ANSI_ESC;
+		continue;
+	    }
+	    state = ANSI_GROUND;
+	    break;
+	case ANSI_STRING:
+	    if (c == 0x07) {
+		state = ANSI_GROUND;
+	    } else if (c == 0x1b) {
+		state = ANSI_STRING_ESC;
+	    }
+	    continue;
+	case ANSI_STRING_ESC:
+	    if (c == '\\') {
+		state = ANSI_GROUND;
+	    } else if (c != 0x1b) {
+		state = ANSI_STRING;
+	    }
+	    continue;
+	case ANSI_NF:
+	    if (c >= 0x20 && c <= 0x2f) {
+		continue;
+	    }
+	    state = ANSI_GROUND;
+	    if (c > 0x2f && c < 0x7f) {
+		continue;
+	    }
+	    break;
+	}
+	*dest++ = c;
+    }
+    esPtr->ansi_state = state;
+
+    length = (char *)dest - Tcl_GetString(obj);
+    Tcl_SetObjLength(obj,length);
+    return length;
+}
+
+/* one read into the buffer, which holds size bytes; returns chars read */
+static int
+expReadOnce(esPtr,size)
+ExpState *esPtr;
+int size;
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+    int cc;
+
+    tsdPtr->reads++;
+
+    /*
+     * Direct reads skip the channel buffers, but only once the channel
+     * has handed over anything it read before direct_read was turned on.
+     */
+    if (esPtr->direct && Tcl_InputBuffered(esPtr->channel) == 0) {
+	return expDirectRead(esPtr, esPtr->msize - (size / TCL_UTF_MAX));
+    }
+
+    cc = Tcl_ReadChars(esPtr->channel,
+	    esPtr->buffer,
+	    esPtr->msize - (size / TCL_UTF_MAX),
+	    1 /* append */);
+    if (cc > 0) {
+	int bytes = expSizeGet(esPtr) - size;
+	int bufSize = Tcl_GetChannelBufferSize(esPtr->channel);
+
+	/* kept times 8, or a difference under 8 would never move it */
+	esPtr->chunk8 += bytes - esPtr->chunk8 / 8;
+	if (bytes >= bufSize && bufSize < EXP_READ_MAX) {
+	    Tcl_SetChannelBufferSize(esPtr->channel, bufSize * 2);
+	} else if (esPtr->chunk8 < bufSize && bufSize > EXP_READ_MIN) {
+	    Tcl_SetChannelBufferSize(esPtr->channel, bufSize / 2);
+	}
+    }
+    return cc;
+}
+
+/*
+ * Having read something, read whatever else is already there, within
+ * the exp_coalesce budget and without filling the buffer, which would
+ * make the next read shuffle data away before it had been evaluated.
+ * size is the buffer length before the first read.  Returns the chars
+ * read.
+ */
+static int
+expCoalesce(esPtr,size)
+ExpState *esPtr;
+int size;
+{
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+    Tcl_WideInt start = tsdPtr->coalesceUsec ? expLatencyNow() : 0;
+    int total = 0;
+    int length, cc;
+
+    for (;;) {
+	length = expSizeGet(esPtr);
+	if (tsdPtr->coalesceBytes
+		&& length - size >= tsdPtr->coalesceBytes) break;
+	if (length + TCL_UTF_MAX >= esPtr->msize) break;
+	if (tsdPtr->coalesceUsec
+		&& expLatencyNow() - start >= tsdPtr->coalesceUsec) break;
+
+	cc = expReadOnce(esPtr,length);
+	if (cc <= 0) {
+	    if (cc == EXP_EOF || (cc == 0 && Tcl_Eof(esPtr->channel))
+		    || (cc < 0 && Tcl_GetErrno() != EAGAIN)) {
+		/* have the next expRead find the eof or error */
+		esPtr->notified = TRUE;
+		esPtr->notifiedMask = TCL_READABLE;
+	    }
+	    break;
+	}
+	tsdPtr->readsCoalesced++;
+	total += cc;
+    }
+    return total;
+}
+
+/* give what a read added after size bytes to the screen and capture */
+static void
+expReadFeed(esPtr,size)
+ExpState *esPtr;
+int size;
+{
+    int length;
+    char *str;
+
+    if (esPtr->screen || esPtr->capture) {
+	str = Tcl_GetStringFromObj(esPtr->buffer, &length);
+	if (esPtr->screen) expScreenFeed(esPtr, str + size, length - size);
+	if (esPtr->capture) expCaptureAdd(esPtr, str + size, length - size);
+    }
+}
+
+/* time the notification that led to a read of cc chars */
+static void
+expReadLatency(esPtr,cc)
+ExpState *esPtr;
+int cc;
+{
+    if (exp_latency_enabled) {
+	if (cc > 0) {
+	    Tcl_WideInt now = expLatencyNow();
+
+	    esPtr->arrivalTime = now;
+	    if (esPtr->notifyTime) {
+		expLatencyRecord(esPtr,EXP_LAT_NOTIFY,
+			now - esPtr->notifyTime);
+		esPtr->arrivalTime = esPtr->notifyTime;
+	    }
+	    esPtr->readTime = now;
+	}
+	esPtr->notifyTime = 0;
+    }
+}
+
+/*
+ * Log what has been read since esPtr->printed and strip it of nulls and
+ * escape sequences as asked.  Returns the new size of the buffer.
+ */
+static int
+expReadShow(esPtr)
+ExpState *esPtr;
+{
+    int size = expSizeGet(esPtr);
+
+    if (size - esPtr->printed) {
+	/*
+	 * Show chars to user if they've requested it, UNLESS they're seeing it
+	 * already because they're typing it and tty driver is echoing it.
+	 * Also send to Diag and Log if appropriate.
+	 */
+	expLogInteractionU(esPtr,Tcl_GetString(esPtr->buffer) + esPtr->printed);
+	    
+	/*
+	 * strip nulls from input, since there is no way for Tcl to deal with
+	 * such strings.  Doing it here lets them be sent to the screen, just
+	 * in case they are involved in formatting operations
+	 */
+	if (esPtr->rm_nulls) size = expNullStrip(esPtr->buffer,esPtr->printed);
+	/* likewise, escape sequences are logged but not matched */
+	if (esPtr->strip_ansi) size = expAnsiStrip(esPtr,esPtr->printed);
+	esPtr->printed = size; /* count'm even if not logging */
+    }
+    return size;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * expStreamRead --
+ *
+ *	One read for exp_stream, which takes the data out of the buffer
+ *	itself.  Everything expRead does with a read but matching happens
+ *	here too: the screen, the capture, the recorder, latency, logging,
+ *	remove_nulls and strip_ansi.  The new data is left at the end of
+ *	the buffer.
+ *
+ * Results:
+ *	The chars read, 0 if there are none yet, or EXP_EOF at eof or on
+ *	an error (ptys may say EIO rather than eof).
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+expStreamRead(esPtr)
+ExpState *esPtr;
+{
+    int size = expSizeGet(esPtr);
+    int cc;
+
+    cc = expReadOnce(esPtr,size);
+    if (cc > 0) {
+	esPtr->generation++;
+	esPtr->lastRead = ++exp_read_serial;
+	expBufferCharge(esPtr);
+	expReadFeed(esPtr,size);
+    } else if (cc == EXP_EOF || Tcl_Eof(esPtr->channel)
+	    || (cc < 0 && Tcl_GetErrno() != EAGAIN)) {
+	cc = EXP_EOF;
+    } else {
+	return 0;
+    }
+    expRecorderAdd(EXP_REC_READ,esPtr,0,0,cc,-1,-1,expSizeGet(esPtr));
+    expReadLatency(esPtr,cc);
+    if (cc > 0) expReadShow(esPtr);
+    return cc;
+}
+
 /* returns # of bytes read or (non-positive) error of form EXP_XXX */
 /* returns 0 for end of file */
 /* If timeout is non-zero, set an alarm before doing the read, else assume */
@@ -1633,6 +2637,7 @@ ExpState *esPtr;
 int timeout;
 int save_flags;
 {
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
     int cc = EXP_TIMEOUT;
     int size = expSizeGet(esPtr);
 
@@ -1651,11 +2656,21 @@ int save_flags;
     }
 #endif
 
-    cc = Tcl_ReadChars(esPtr->channel,
-	    esPtr->buffer,
-	    esPtr->msize - (size / TCL_UTF_MAX),
-	    1 /* append */);
+    cc = expReadOnce(esPtr,size);
     i_read_errno = errno;
+    if (cc > 0 && (tsdPtr->coalesceBytes || tsdPtr->coalesceUsec)) {
+	cc += expCoalesce(esPtr,size);
+    }
+    if (cc > 0) {
+	esPtr->generation++;
+	esPtr->lastRead = ++exp_read_serial;
+	expBufferCharge(esPtr);
+	expBufferPressure(esPtr);
+    }
+
+    if (cc > 0) {
+	expReadFeed(esPtr,size);
+    }
 
 #ifdef SIMPLE_EVENT
     alarm(0);
@@ -1702,11 +2717,10 @@ expRead(interp,esPtrs,esPtrsMax,esPtrOut,timeout,key)
     int timeout;
     int key;
 {
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
     ExpState *esPtr;
 
-    int size;
     int cc;
-    int write_count;
     int tcl_set_flags;	/* if we have to discard chars, this tells */
 			/* whether to show user locally or globally */
 
@@ -1741,11 +2755,14 @@ expRead(interp,esPtrs,esPtrsMax,esPtrOut,timeout,key)
 	    }
 	} else if (cc > 0) {
 	    /* successfully read data */
+	    tsdPtr->readEvals++;
 	} else {
 	    /* failed to read data - some sort of error was encountered such as
 	     * an interrupt with that forced an error return
 	     */
 	}
+	expRecorderAdd(EXP_REC_READ,esPtr,0,0,cc,-1,-1,expSizeGet(esPtr));
+	expReadLatency(esPtr,cc);
     } else if (cc == EXP_DATA_OLD) {
 	cc = 0;
     } else if (cc == EXP_RECONFIGURE) {
@@ -1790,26 +2807,7 @@ expRead(interp,esPtrs,esPtrsMax,esPtrOut,timeout,key)
      * update display
      */
 
-    size = expSizeGet(esPtr);
-    if (size) write_count = size - esPtr->printed;
-    else write_count = 0;
-    
-    if (write_count) {
-	/*
-	 * Show chars to user if they've requested it, UNLESS they're seeing it
-	 * already because they're typing it and tty driver is echoing it.
-	 * Also send to Diag and Log if appropriate.
-	 */
-	expLogInteractionU(esPtr,Tcl_GetString(esPtr->buffer) + esPtr->printed);
-	    
-	/*
-	 * strip nulls from input, since there is no way for Tcl to deal with
-	 * such strings.  Doing it here lets them be sent to the screen, just
-	 * in case they are involved in formatting operations
-	 */
-	if (esPtr->rm_nulls) size = expNullStrip(esPtr->buffer,esPtr->printed);
-	esPtr->printed = size; /* count'm even if not logging */
-    }
+    if (expSizeGet(esPtr)) expReadShow(esPtr);
     return(cc);
 }
 
@@ -1896,11 +2894,15 @@ CONST char *caller_name;
 
     newlen = length - skiplen;
     memmove(str,p, newlen);
+    expRecorderAdd(EXP_REC_SHUFFLE,esPtr,0,0,0,0,skiplen,newlen);
 
     Tcl_SetObjLength(esPtr->buffer,newlen);
+    esPtr->generation++;
 
     esPtr->printed -= skiplen;
     if (esPtr->printed < 0) esPtr->printed = 0;
+    esPtr->lineStart -= skiplen;
+    if (esPtr->lineStart < 0) esPtr->lineStart = 0;
 }
 
 /* map EXP_ style return value to TCL_ style return value */
@@ -1969,7 +2971,7 @@ Tcl_Interp *interp;
 }
 
 /* make a copy of a linked list (1st arg) and attach to end of another (2nd
-arg) */
+arg), in the arena */
 static int
 update_expect_states(i_list,i_union)
 struct exp_i *i_list;
@@ -1993,7 +2995,9 @@ struct exp_state_list **i_union;
 		if (slPtr->esPtr == u->esPtr) goto found;
 	    }
 	    /* if not found, link in as head of list */
-	    tmpslPtr = exp_new_state(slPtr->esPtr);
+	    tmpslPtr = (struct exp_state_list *)expArenaAlloc(
+		    sizeof(struct exp_state_list));
+	    tmpslPtr->esPtr = slPtr->esPtr;
 	    tmpslPtr->next = *i_union;
 	    *i_union = tmpslPtr;
 	    found:;
@@ -2083,6 +3087,7 @@ struct exp_i *exp_i;
 	 */
 
 	exp_i_update(interp,exp_i);
+	dispatch_changed();
 
 	/*
 	 * check validity of all fd's in variable
@@ -2110,6 +3115,336 @@ struct exp_i *exp_i;
 	return (char *)0;
 }
 
+/*
+ * lazy_out: instead of setting every element of expect_out when a case
+ * matches, remember where the match was and set an element the first
+ * time something reads it.  A trace on the expect_out array does the
+ * setting.  Each traced variable has its own LazyOut, so the global
+ * array and the locals of different procs keep their own matches.
+ */
+
+int exp_lazy_out = FALSE;
+
+/* done[] slots: buffer, spawn_id, then string, start and end per range */
+#define LAZY_BUFFER		0
+#define LAZY_SPAWN_ID		1
+#define LAZY_SLOT(i,k)		(2 + 3*(i) + (k))
+#define LAZY_SLOTS(n)		(2 + 3*(n))
+#define LAZY_INITIAL_RANGES	10
+
+typedef struct LazyOut {
+    Tcl_Obj *saved;		/* buffer up to the end of the match */
+    char spawn_id[EXP_CHANNELNAMELEN+1];
+    int pending;		/* some elements are not set yet */
+    int chars;			/* ranges count chars (-re), not bytes */
+    int nranges;		/* ranges in this match */
+    int space;			/* ranges allocated */
+    int *ranges;		/* start and end of each range */
+    char *done;			/* element set, or has no value to set */
+} LazyOut;
+
+static Tcl_VarTraceProc	LazyOutTrace;
+
+static void
+LazyOutFree(lazy)
+    LazyOut *lazy;
+{
+    Tcl_DecrRefCount(lazy->saved);
+    ckfree((char *)lazy->ranges);
+    ckfree(lazy->done);
+    ckfree((char *)lazy);
+}
+
+/* map an element name to its slot, or -1 if it is not one of ours */
+static int
+LazyOutSlot(lazy,name)
+    LazyOut *lazy;
+    CONST char *name;
+{
+    char *end;
+    int i;
+
+    if (streq(name,"buffer")) return LAZY_BUFFER;
+    if (streq(name,"spawn_id")) return LAZY_SPAWN_ID;
+    if (!isdigit(UCHAR(*name))) return -1;
+    i = strtol(name,&end,10);
+    if (i >= lazy->nranges) return -1;
+    if (streq(end,",string")) return LAZY_SLOT(i,0);
+    if (streq(end,",start")) return LAZY_SLOT(i,1);
+    if (streq(end,",end")) return LAZY_SLOT(i,2);
+    return -1;
+}
+
+static void
+LazyOutSetSlot(interp,lazy,name1,slot,flags)
+    Tcl_Interp *interp;
+    LazyOut *lazy;
+    CONST char *name1;
+    int slot;
+    int flags;
+{
+    char name[30];
+    Tcl_Obj *val;
+    int i, start, end;
+
+    lazy->done[slot] = TRUE;
+    if (slot == LAZY_BUFFER) {
+	/* handed over as is; the next match copies into a new object */
+	Tcl_SetVar2Ex(interp,name1,"buffer",lazy->saved,flags);
+	return;
+    }
+    if (slot == LAZY_SPAWN_ID) {
+	Tcl_SetVar2(interp,name1,"spawn_id",lazy->spawn_id,flags);
+	return;
+    }
+
+    i = (slot - 2) / 3;
+    start = lazy->ranges[2*i];
+    end = lazy->ranges[2*i+1];
+    switch ((slot - 2) % 3) {
+    case 0:
+	sprintf(name,"%d,string",i);
+	if (lazy->chars) {
+	    val = Tcl_GetRange(lazy->saved,start,end);
+	} else {
+	    val = Tcl_NewStringObj(Tcl_GetString(lazy->saved)+start,
+		    end-start+1);
+	}
+	break;
+    case 1:
+	sprintf(name,"%d,start",i);
+	val = Tcl_NewIntObj(start);
+	break;
+    default:
+	sprintf(name,"%d,end",i);
+	val = Tcl_NewIntObj(end);
+	break;
+    }
+    Tcl_SetVar2Ex(interp,name1,name,val,flags);
+}
+
+/* set the rest of a pending match */
+static void
+LazyOutFlush(interp,lazy,name1,flags)
+    Tcl_Interp *interp;
+    LazyOut *lazy;
+    CONST char *name1;
+    int flags;
+{
+    int slot;
+
+    if (!lazy->pending) return;
+    for (slot=0;slot<LAZY_SLOTS(lazy->nranges);slot++) {
+	if (!lazy->done[slot]) {
+	    LazyOutSetSlot(interp,lazy,name1,slot,flags);
+	}
+    }
+    lazy->pending = FALSE;
+}
+
+/*ARGSUSED*/
+static char *
+LazyOutTrace(clientData, interp, name1, name2, flags)
+    ClientData clientData;
+    Tcl_Interp *interp;	    /* Interpreter containing variable. */
+    CONST char *name1;	    /* Name of variable. */
+    CONST char *name2;	    /* Second part of variable name. */
+    int flags;		    /* Information about what happened. */
+{
+    LazyOut *lazy = (LazyOut *)clientData;
+    int scope = flags & (TCL_GLOBAL_ONLY|TCL_NAMESPACE_ONLY);
+    int slot;
+
+    if (flags & (TCL_TRACE_DESTROYED|TCL_INTERP_DESTROYED)) {
+	LazyOutFree(lazy);
+	return (char *)0;
+    }
+    if (!lazy->pending) return (char *)0;
+
+    if (flags & TCL_TRACE_ARRAY) {
+	/* array names, array get, ... see everything */
+	LazyOutFlush(interp,lazy,name1,scope);
+    } else if (name2 && (slot = LazyOutSlot(lazy,name2)) >= 0
+	    && !lazy->done[slot]) {
+	if (flags & TCL_TRACE_READS) {
+	    LazyOutSetSlot(interp,lazy,name1,slot,scope);
+	} else {
+	    /* written or unset by someone else, so leave it alone */
+	    lazy->done[slot] = TRUE;
+	}
+    }
+    return (char *)0;
+}
+
+/*
+ * Find the LazyOut of the expect_out that a match is about to set,
+ * tracing the variable if it has none yet.  Returns 0 if expect_out
+ * cannot be traced, in which case it is set the usual way.
+ */
+static LazyOut *
+LazyOutGet(interp,flags)
+    Tcl_Interp *interp;
+    int flags;
+{
+    LazyOut *lazy;
+
+    lazy = (LazyOut *)Tcl_VarTraceInfo(interp,EXPECT_OUT,flags,
+	    LazyOutTrace,(ClientData)0);
+    if (lazy) return lazy;
+
+    /* make sure expect_out is an array before it is traced */
+    if (!Tcl_SetVar2(interp,EXPECT_OUT,"spawn_id","",flags)) {
+	Tcl_ResetResult(interp);
+	return (LazyOut *)0;
+    }
+
+    lazy = (LazyOut *)ckalloc(sizeof(LazyOut));
+    lazy->saved = Tcl_NewObj();
+    Tcl_IncrRefCount(lazy->saved);
+    lazy->spawn_id[0] = '\0';
+    lazy->pending = FALSE;
+    lazy->chars = FALSE;
+    lazy->nranges = 0;
+    lazy->space = LAZY_INITIAL_RANGES;
+    lazy->ranges = (int *)ckalloc(2 * lazy->space * sizeof(int));
+    lazy->done = ckalloc(LAZY_SLOTS(lazy->space));
+
+    Tcl_TraceVar(interp,EXPECT_OUT,flags|TCL_TRACE_READS|TCL_TRACE_WRITES|
+	    TCL_TRACE_UNSETS|TCL_TRACE_ARRAY,LazyOutTrace,(ClientData)lazy);
+    return lazy;
+}
+
+/* remember a range of the match; -1 means there is nothing to set */
+static void
+LazyOutRange(lazy,i,start,end,string,indices)
+    LazyOut *lazy;
+    int i;
+    int start, end;
+    int string;			/* set i,string */
+    int indices;		/* set i,start and i,end */
+{
+    if (i >= lazy->space) {
+	while (i >= lazy->space) lazy->space *= 2;
+	lazy->ranges = (int *)ckrealloc((char *)lazy->ranges,
+		2 * lazy->space * sizeof(int));
+	lazy->done = ckrealloc(lazy->done,LAZY_SLOTS(lazy->space));
+    }
+    lazy->ranges[2*i] = start;
+    lazy->ranges[2*i+1] = end;
+    lazy->done[LAZY_SLOT(i,0)] = !string;
+    lazy->done[LAZY_SLOT(i,1)] = !indices;
+    lazy->done[LAZY_SLOT(i,2)] = !indices;
+    if (i >= lazy->nranges) lazy->nranges = i+1;
+}
+
+/* keep buf[0..length] and the spawn id until something asks for them */
+static void
+LazyOutSave(lazy,name,str,length)
+    LazyOut *lazy;
+    CONST char *name;
+    CONST char *str;
+    int length;
+{
+    strcpy(lazy->spawn_id,name);
+    if (Tcl_IsShared(lazy->saved)) {
+	/* the last buffer went to expect_out(buffer) */
+	Tcl_DecrRefCount(lazy->saved);
+	lazy->saved = Tcl_NewObj();
+	Tcl_IncrRefCount(lazy->saved);
+    }
+    Tcl_SetObjLength(lazy->saved,length);
+    memcpy(Tcl_GetString(lazy->saved),str,length);
+    lazy->done[LAZY_BUFFER] = FALSE;
+    lazy->done[LAZY_SPAWN_ID] = FALSE;
+    lazy->pending = TRUE;
+}
+
+/*
+ * expect -capture: set the variable to a dict of the groups of a -re
+ * match, keyed by the -names given or else by group number.  The dict is
+ * built as a name/value list in one pass over the match info.  Returns
+ * TCL_ERROR, with the message in the interp, if the variable can't be
+ * set.
+ */
+#define CAPTURE_STATIC	20
+
+static int
+capture_set(interp,e,buffer,info,flags,detail)
+    Tcl_Interp *interp;
+    struct ecase *e;
+    Tcl_Obj *buffer;		/* what the regexp was matched against */
+    Tcl_RegExpInfo *info;
+    int flags;
+    char *detail;
+{
+    Tcl_Obj *staticObjs[3*CAPTURE_STATIC];
+    Tcl_Obj **objv = staticObjs, **vals, **keyv, *value;
+    int n = info->nsubs + 1;
+    int i, j, count = 0, nkeys, length, ascii;
+    char *bytes;
+
+    if (!e->keys) {
+	Tcl_Obj **namev;
+	int nnames = 0;
+
+	if (e->names) Tcl_ListObjGetElements(NULL,e->names,&nnames,&namev);
+	e->keys = Tcl_NewListObj(0,NULL);
+	Tcl_IncrRefCount(e->keys);
+	for (i=0;i<n;i++) {
+	    Tcl_ListObjAppendElement(NULL,e->keys,
+		    (i > 0 && i <= nnames && Tcl_GetCharLength(namev[i-1]))
+		    ? namev[i-1] : Tcl_NewIntObj(i));
+	}
+    }
+    Tcl_ListObjGetElements(NULL,e->keys,&nkeys,&keyv);
+
+    if (n > CAPTURE_STATIC) {
+	objv = (Tcl_Obj **)ckalloc(3 * n * sizeof(Tcl_Obj *));
+    }
+    vals = objv + 2*n;
+
+    /* with only ASCII in the buffer, chars are bytes */
+    bytes = Tcl_GetStringFromObj(buffer,&length);
+    ascii = (Tcl_GetCharLength(buffer) == length);
+
+    for (i=0;i<n && i<nkeys;i++) {
+	int start = info->matches[i].start;
+	int end = info->matches[i].end;
+
+	vals[i] = 0;
+	if (start == -1) continue;	/* the group did not take part */
+
+	/* groups that matched the same text share one object */
+	for (j=0;j<i;j++) {
+	    if (vals[j] && info->matches[j].start == start
+		    && info->matches[j].end == end) {
+		vals[i] = vals[j];
+		break;
+	    }
+	}
+	if (!vals[i]) {
+	    vals[i] = ascii ? Tcl_NewStringObj(bytes + start, end - start)
+		    : Tcl_GetRange(buffer, start, end - 1);
+	}
+	objv[count++] = keyv[i];
+	objv[count++] = vals[i];
+    }
+
+    value = Tcl_NewListObj(count,objv);
+    if (objv != staticObjs) ckfree((char *)objv);
+
+    if (expDiagChannelGet() || expDiagToStderrGet()) {
+	expDiagLog("%s: set %s \"",detail,Tcl_GetString(e->capture));
+	expDiagLogU(expPrintifyObj(value));
+	expDiagLogU("\"\r\n");
+    }
+    if (!Tcl_ObjSetVar2(interp,e->capture,(Tcl_Obj *)0,value,
+	    flags|TCL_LEAVE_ERR_MSG)) {
+	return TCL_ERROR;
+    }
+    return TCL_OK;
+}
+
 int
 expMatchProcess(interp, eo, cc, bg, detail)
     Tcl_Interp *interp;
@@ -2127,6 +3462,8 @@ expMatchProcess(interp, eo, cc, bg, detail)
     char match_char;	/* place to hold char temporarily */
     /* uprooted by a NULL */
     int result = TCL_OK;
+    Tcl_WideInt matchTime = 0;	/* for exp_latency */
+    LazyOut *lazy = 0;		/* for lazy_out */
 
 #define out(indexName, value) \
  expDiagLog("%s: set %s(%s) \"",detail,EXPECT_OUT,indexName); \
@@ -2149,7 +3486,53 @@ expMatchProcess(interp, eo, cc, bg, detail)
 	buffer = eo->buffer;
     }			
 
-    if (match >= 0) {
+    if (exp_latency_enabled && e && esPtr && esPtr->readTime
+	    && cc != EXP_EOF) {
+	matchTime = expLatencyNow();
+	expLatencyRecord(esPtr,EXP_LAT_MATCH,matchTime - esPtr->readTime);
+	expLatencyRecord(esPtr,EXP_LAT_TOTAL,matchTime - esPtr->arrivalTime);
+    }
+
+    /*
+     * -lines and -screen matches are against something other than the
+     * buffer, and diagnostics show each element as it is set, so those
+     * set expect_out the usual way
+     */
+    if (exp_lazy_out && esPtr && match >= 0 && eo->lineStart < 0
+	    && (!e || buffer == esPtr->buffer)
+	    && !expDiagChannelGet() && !expDiagToStderrGet()) {
+	lazy = LazyOutGet(interp,(bg ? TCL_GLOBAL_ONLY : 0));
+    }
+
+    if (lazy) {
+	lazy->nranges = 0;
+	if (e && e->use == PAT_RE) {
+	    Tcl_RegExp re;
+	    Tcl_RegExpInfo info;
+	    int i;
+
+	    re = Tcl_GetRegExpFromObj(interp, e->pat, (e->Case == CASE_NORM) ?
+		    TCL_REG_ADVANCED : (TCL_REG_ADVANCED | TCL_REG_NOCASE));
+	    Tcl_RegExpGetInfo(re, &info);
+	    if (e->capture && capture_set(interp,e,buffer,&info,
+		    (bg ? TCL_GLOBAL_ONLY : 0),detail) != TCL_OK) {
+		result = TCL_ERROR;
+	    }
+	    lazy->chars = TRUE;
+	    for (i=0;i<=info.nsubs;i++) {
+		int start = info.matches[i].start;
+		LazyOutRange(lazy,i,start,info.matches[i].end-1,
+			start != -1,start != -1 && e->indices);
+	    }
+	} else if (e && (e->use == PAT_GLOB || e->use == PAT_EXACT)) {
+	    lazy->chars = FALSE;
+	    LazyOutRange(lazy,0,e->simple_start,e->simple_start + match - 1,
+		    TRUE,e->indices);
+	    match += e->simple_start;
+	} else if (e && e->use == PAT_NULL && e->indices) {
+	    LazyOutRange(lazy,0,match-1,match-1,FALSE,TRUE);
+	}
+    } else if (match >= 0) {
 	char name[20], value[20];
 	int i;
 
@@ -2166,6 +3549,10 @@ expMatchProcess(interp, eo, cc, bg, detail)
 		    
 	    re = Tcl_GetRegExpFromObj(interp, e->pat, flags);
 	    Tcl_RegExpGetInfo(re, &info);
+	    if (e->capture && capture_set(interp,e,buffer,&info,
+		    (bg ? TCL_GLOBAL_ONLY : 0),detail) != TCL_OK) {
+		result = TCL_ERROR;
+	    }
 
 	    for (i=0;i<=info.nsubs;i++) {
 		int start, end;
@@ -2209,7 +3596,7 @@ expMatchProcess(interp, eo, cc, bg, detail)
 	    }
 
 	    /* string itself */
-	    str = Tcl_GetString(esPtr->buffer) + e->simple_start;
+	    str = Tcl_GetString(buffer) + e->simple_start;
 	    /* temporarily null-terminate in middle */
 	    match_char = str[match];
 	    str[match] = 0;
@@ -2229,6 +3616,35 @@ expMatchProcess(interp, eo, cc, bg, detail)
 	} else if (e && e->use == PAT_FULLBUFFER) {
 	    expDiagLogU("expect_background: full buffer\r\n");
 	}
+
+	if (e && eo->lineStart >= 0) {
+	    /* expect -lines: hand over the lines no case wanted */
+	    Tcl_Obj *lines = Tcl_NewListObj(0,NULL);
+	    char *str = Tcl_GetString(esPtr->buffer);
+	    char *p = str, *nl;
+	    int len;
+
+	    while (p < str + eo->lineStart) {
+		nl = memchr(p,'\n',str + eo->lineStart - p);
+		if (!nl) break;
+		len = nl - p;
+		if (len > 0 && p[len-1] == '\r') len--;
+		Tcl_ListObjAppendElement(interp,lines,
+			Tcl_NewStringObj(p,len));
+		p = nl + 1;
+	    }
+	    expDiagLog("%s: set %s(lines) \"",detail,EXPECT_OUT);
+	    expDiagLogU(expPrintifyObj(lines));
+	    expDiagLogU("\"\r\n");
+	    Tcl_SetVar2Ex(interp,EXPECT_OUT,"lines",lines,
+		    (bg ? TCL_GLOBAL_ONLY : 0));
+
+	    /* a complete line goes with its newline */
+	    match = (eo->lineEnd >= 0) ? eo->lineEnd : eo->lineStart + match;
+	} else if (e && buffer != esPtr->buffer) {
+	    /* the screen shows everything read so far, so consume all of it */
+	    match = expSizeGet(esPtr);
+	}
     }
 
     /* this is broken out of (match > 0) (above) since it can */
@@ -2237,16 +3653,21 @@ expMatchProcess(interp, eo, cc, bg, detail)
 	char *str;
 	int length;
 
-	out("spawn_id",esPtr->name);
-
 	str = Tcl_GetStringFromObj(esPtr->buffer, &length);
-	/* Save buf[0..match] */
-	/* temporarily null-terminate string in middle */
-	match_char = str[match];
-	str[match] = 0;
-	out("buffer",str);
-	/* remove middle-null-terminator */
-	str[match] = match_char;
+	expRecorderAdd(EXP_REC_MATCH,esPtr,0,0,cc,0,match,length);
+	if (lazy) {
+	    LazyOutSave(lazy,esPtr->name,str,match);
+	} else {
+	    out("spawn_id",esPtr->name);
+
+	    /* Save buf[0..match] */
+	    /* temporarily null-terminate string in middle */
+	    match_char = str[match];
+	    str[match] = 0;
+	    out("buffer",str);
+	    /* remove middle-null-terminator */
+	    str[match] = match_char;
+	}
 
 	/* "!e" means no case matched - transfer by default */
 	if (!e || e->transfer) {
@@ -2256,7 +3677,10 @@ expMatchProcess(interp, eo, cc, bg, detail)
 		memmove(str,str+match,length-match);
 	    }
 	    Tcl_SetObjLength(esPtr->buffer, length-match);
+	    esPtr->generation++;
 	}
+	/* the body may use the buffer any way it likes */
+	esPtr->lineStart = 0;
 
 	if (cc == EXP_EOF) {
 	    /* exp_close() deletes all background bodies */
@@ -2268,14 +3692,24 @@ expMatchProcess(interp, eo, cc, bg, detail)
 	}
     }
 
-    if (body) {
+    if (result != TCL_OK) {
+	/* -capture failed, so the body is not run */
+	if (bg) Tcl_BackgroundError(interp);
+	if (body && cc == EXP_EOF) Tcl_DecrRefCount(body);
+    } else if (body) {
 	if (!bg) {
 	    result = Tcl_EvalObjEx(interp,body,0);
 	} else {
 	    result = Tcl_EvalObjEx(interp,body,TCL_EVAL_GLOBAL);
 	    if (result != TCL_OK) Tcl_BackgroundError(interp);
+	    if (result == TCL_ERROR) expRecorderDumpOnError();
 	}
 	if (cc == EXP_EOF) Tcl_DecrRefCount(body);
+	/* the body may have closed esPtr, so only the global one */
+	if (matchTime) {
+	    expLatencyRecord((ExpState *)0,EXP_LAT_BODY,
+		    expLatencyNow() - matchTime);
+	}
     }
     return result;
 }
@@ -2318,11 +3752,15 @@ int mask;
     } else {
 	esPtr->notifiedMask = mask;
 	esPtr->notified = FALSE;
+	if (exp_latency_enabled && !esPtr->notifyTime) {
+	    esPtr->notifyTime = expLatencyNow();
+	}
 	cc = expRead(interp,(ExpState **)0,0,&esPtr,EXP_TIME_INFINITY,0);
     }
 
 do_more_data:
     eo.e = 0;		/* no final case yet */
+    eo.lineStart = -1;
     eo.esPtr = 0;		/* no final file selected yet */
     eo.match = 0;		/* nothing matched yet */
 
@@ -2357,6 +3795,7 @@ do_more_data:
     if (cc == EXP_TCLERROR) {
 		/* only likely problem here is some internal regexp botch */
 		Tcl_BackgroundError(interp);
+		expRecorderDumpOnError();
 		goto finish;
     }
     /* special eof code that cannot be done in eval_cases */
@@ -2447,6 +3886,9 @@ Tcl_Obj *CONST objv[];		/* Argument objects. */
     int remtime;		/* remaining time in timeout */
     int reset_timer;		/* should timer be reset after continue? */
 
+    ExpArenaMark mark;		/* arena before this command */
+    ExpArenaMark statesMark;	/* and before state_list and esPtrs */
+
     if ((objc == 2) && exp_one_arg_braced(objv[1])) {
 	return(exp_eval_with_one_arg(clientData,interp,objv));
     } else if ((objc == 3) && streq(Tcl_GetString(objv[1]),"-brace")) {
@@ -2472,9 +3914,13 @@ Tcl_Obj *CONST objv[];		/* Argument objects. */
     exp_cmd_init(&eg,EXP_CMD_FG,EXP_TEMPORARY);
     state_list = 0;
     esPtrs = 0;
+    expArenaMark(&mark);
     if (TCL_ERROR == parse_expect_args(interp,&eg,
-	    (ExpState *)clientData,objc,objv))
+	    (ExpState *)clientData,objc,objv)) {
+	expArenaRelease(&mark);
 	return TCL_ERROR;
+    }
+    expArenaMark(&statesMark);
 
  restart_with_update:
     /* validate all descriptors and flatten ExpStates into array */
@@ -2498,10 +3944,17 @@ Tcl_Obj *CONST objv[];		/* Argument objects. */
 	    result = TCL_ERROR;
 	    goto cleanup;
 	}
+	/* exp_stream takes everything it reads, there'd be nothing to see */
+	if (slPtr->esPtr->stream) {
+	    exp_error(interp,"spawn id %s is in use by exp_stream",
+		    slPtr->esPtr->name);
+	    result = TCL_ERROR;
+	    goto cleanup;
+	}
     }
 
     /* make into an array */
-    esPtrs = (ExpState **)ckalloc(mcount * sizeof(ExpState *));
+    esPtrs = (ExpState **)expArenaAlloc(mcount * sizeof(ExpState *));
     for (slPtr=state_list,i=0;slPtr;slPtr=slPtr->next,i++) {
 	esPtrs[i] = slPtr->esPtr;
     }
@@ -2527,6 +3980,7 @@ Tcl_Obj *CONST objv[];		/* Argument objects. */
      */
 
     eo.e = 0;		/* no final case yet */
+    eo.lineStart = -1;
     eo.esPtr = 0;	/* no final ExpState selected yet */
     eo.match = 0;	/* nothing matched yet */
 
@@ -2620,23 +4074,22 @@ error:
 	goto restart;
     }
 
-    if (state_list) {
-	exp_free_state(state_list);
-	state_list = 0;
-    }
-    if (esPtrs) {
-	ckfree((char *)esPtrs);
-	esPtrs = 0;
-    }
+    /* state_list and esPtrs are rebuilt from scratch after an update */
+    expArenaRelease(&statesMark);
+    state_list = 0;
+    esPtrs = 0;
 
     if (result == EXP_CONTINUE) {
 	expDiagLogU("expect: continuing expect after update\r\n");
+	expArenaMark(&statesMark);
 	goto restart_with_update;
     }
 
     free_ecases(interp,&eg,0);	/* requires i_lists to be avail */
     exp_free_i(interp,eg.i_list,exp_indirect_update2);
+    expArenaRelease(&mark);
 
+    if (result == TCL_ERROR) expRecorderDumpOnError();
     return(result);
 }
 
@@ -2703,6 +4156,41 @@ Exp_TimestampCmd(clientData, interp, argc, argv)
 
 }
 
+/* parse a byte count such as 4096, 64k, 512M or 2G */
+int
+expGetBytes(interp,string,bytesPtr)
+    Tcl_Interp *interp;
+    CONST char *string;
+    Tcl_WideInt *bytesPtr;
+{
+    CONST char *p = string;
+    Tcl_WideInt bytes = 0;
+    Tcl_WideInt max = (Tcl_WideInt) (~((Tcl_WideUInt) 0) >> 1);
+    int shift = 0;
+
+    if (!isdigit(UCHAR(*p))) goto bad;
+    while (isdigit(UCHAR(*p))) {
+	if (bytes > (max - (*p - '0')) / 10) goto toobig;
+	bytes = bytes*10 + (*p++ - '0');
+    }
+    switch (*p) {
+    case 'k': case 'K': shift = 10; p++; break;
+    case 'm': case 'M': shift = 20; p++; break;
+    case 'g': case 'G': shift = 30; p++; break;
+    }
+    if (*p != '\0') goto bad;
+    if (bytes > (max >> shift)) goto toobig;
+    *bytesPtr = bytes << shift;
+    return TCL_OK;
+
+ bad:
+    exp_error(interp,"expected a size such as 512M but got \"%.50s\"",string);
+    return TCL_ERROR;
+ toobig:
+    exp_error(interp,"size \"%.50s\" is too large",string);
+    return TCL_ERROR;
+}
+
 /*ARGSUSED*/
 int
 Exp_MatchMaxCmd(clientData,interp,argc,argv)
@@ -2715,6 +4203,8 @@ Exp_MatchMaxCmd(clientData,interp,argc,argv)
     ExpState *esPtr = 0;
     CONST char *chanName = 0;
     int Default = FALSE;
+    int Global = FALSE;
+    int Usage = FALSE;
     Tcl_Obj *resultPtr;
 
     argc--; argv++;
@@ -2722,6 +4212,10 @@ Exp_MatchMaxCmd(clientData,interp,argc,argv)
     for (;argc>0;argc--,argv++) {
 	if (streq(*argv,"-d")) {
 	    Default = TRUE;
+	} else if (streq(*argv,"-global")) {
+	    Global = TRUE;
+	} else if (streq(*argv,"-usage")) {
+	    Usage = TRUE;
 	} else if (streq(*argv,"-i")) {
 	    argc--;argv++;
 	    if (argc < 1) {
@@ -2736,8 +4230,16 @@ Exp_MatchMaxCmd(clientData,interp,argc,argv)
 	exp_error(interp,"cannot do -d and -i at the same time");
 	return TCL_ERROR;
     }
+    if (Global && (Default || chanName)) {
+	exp_error(interp,"cannot do -global with -d or -i");
+	return TCL_ERROR;
+    }
+    if (Usage && Default) {
+	exp_error(interp,"cannot do -usage with -d");
+	return TCL_ERROR;
+    }
 
-    if (!Default) {
+    if (!Default && !Global) {
 	if (!chanName) {
 	    if (!(esPtr = expStateCurrent(interp,0,0,0))) {
 		return TCL_ERROR;
@@ -2749,6 +4251,34 @@ Exp_MatchMaxCmd(clientData,interp,argc,argv)
 	}
     }
 
+    if (Usage) {
+	if (argc > 0) {
+	    exp_error(interp,"-usage takes no size");
+	    return TCL_ERROR;
+	}
+	Tcl_SetWideIntObj(Tcl_GetObjResult(interp),
+		Global ? expMatchCharged() : (Tcl_WideInt) esPtr->charged);
+	return TCL_OK;
+    }
+
+    if (Global) {
+	Tcl_WideInt budget;
+
+	if (argc == 0) {
+	    Tcl_SetWideIntObj(Tcl_GetObjResult(interp), expMatchBudget());
+	    return TCL_OK;
+	}
+	if (argc > 1) {
+	    exp_error(interp,"too many arguments");
+	    return TCL_ERROR;
+	}
+	if (expGetBytes(interp,argv[0],&budget) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	expSetMatchBudget(budget);
+	return TCL_OK;
+    }
+
     if (argc == 0) {
 	if (Default) {
 	    size = exp_default_match_max;
@@ -2854,6 +4384,168 @@ Exp_RemoveNullsCmd(clientData,interp,argc,argv)
     return TCL_OK;
 }
 
+/*ARGSUSED*/
+static int
+Exp_StripAnsiCmd(clientData,interp,argc,argv)
+    ClientData clientData;
+    Tcl_Interp *interp;
+    int argc;
+    CONST84 char *argv[];
+{
+    int value = -1;
+    ExpState *esPtr = 0;
+    CONST char *chanName = 0;
+    int Default = FALSE;
+
+    argc--; argv++;
+
+    for (;argc>0;argc--,argv++) {
+	if (streq(*argv,"-d")) {
+	    Default = TRUE;
+	} else if (streq(*argv,"-i")) {
+	    argc--;argv++;
+	    if (argc < 1) {
+		exp_error(interp,"-i needs argument");
+		return TCL_ERROR;
+	    }
+	    chanName = *argv;
+	} else break;
+    }
+
+    if (Default && chanName) {
+	exp_error(interp,"cannot do -d and -i at the same time");
+	return TCL_ERROR;
+    }
+
+    if (!Default) {
+	if (!chanName) {
+	    if (!(esPtr = expStateCurrent(interp,0,0,0)))
+		return TCL_ERROR;
+	} else {
+	    if (!(esPtr = expStateFromChannelName(interp,chanName,0,0,0,"strip_ansi")))
+		return TCL_ERROR;
+	}
+    }
+
+    if (argc == 0) {
+	value = Default ? exp_default_strip_ansi : esPtr->strip_ansi;
+	Tcl_SetObjResult(interp, Tcl_NewIntObj(value));
+	return TCL_OK;
+    }
+
+    if (argc > 1) {
+	exp_error(interp,"too many arguments");
+	return TCL_ERROR;
+    }
+
+    if (Tcl_GetBoolean(interp,argv[0],&value) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    if (Default) {
+	exp_default_strip_ansi = value;
+    } else {
+	esPtr->strip_ansi = value;
+	esPtr->ansi_state = ANSI_GROUND;
+    }
+
+    return TCL_OK;
+}
+
+/*ARGSUSED*/
+static int
+Exp_DirectReadCmd(clientData,interp,argc,argv)
+    ClientData clientData;
+    Tcl_Interp *interp;
+    int argc;
+    CONST84 char *argv[];
+{
+    int value = -1;
+    ExpState *esPtr = 0;
+    CONST char *chanName = 0;
+    int Default = FALSE;
+
+    argc--; argv++;
+
+    for (;argc>0;argc--,argv++) {
+	if (streq(*argv,"-d")) {
+	    Default = TRUE;
+	} else if (streq(*argv,"-i")) {
+	    argc--;argv++;
+	    if (argc < 1) {
+		exp_error(interp,"-i needs argument");
+		return TCL_ERROR;
+	    }
+	    chanName = *argv;
+	} else break;
+    }
+
+    if (Default && chanName) {
+	exp_error(interp,"cannot do -d and -i at the same time");
+	return TCL_ERROR;
+    }
+
+    if (!Default) {
+	if (!chanName) {
+	    if (!(esPtr = expStateCurrent(interp,0,0,0)))
+		return TCL_ERROR;
+	} else {
+	    if (!(esPtr = expStateFromChannelName(interp,chanName,0,0,0,"direct_read")))
+		return TCL_ERROR;
+	}
+    }
+
+    if (argc == 0) {
+	value = Default ? exp_default_direct_read : (esPtr->direct != NULL);
+	Tcl_SetObjResult(interp, Tcl_NewIntObj(value));
+	return TCL_OK;
+    }
+
+    if (argc > 1) {
+	exp_error(interp,"too many arguments");
+	return TCL_ERROR;
+    }
+
+    if (Tcl_GetBoolean(interp,argv[0],&value) != TCL_OK) {
+	return TCL_ERROR;
+    }
+
+    if (Default) {
+	exp_default_direct_read = value;
+	return TCL_OK;
+    }
+
+    /* resamples -encoding and -translation when turned on */
+    return expDirectSet(interp,esPtr,value);
+}
+
+/*ARGSUSED*/
+static int
+Exp_LazyOutCmd(clientData,interp,argc,argv)
+    ClientData clientData;
+    Tcl_Interp *interp;
+    int argc;
+    CONST84 char *argv[];
+{
+    int value;
+
+    if (argc == 1) {
+	Tcl_SetObjResult(interp, Tcl_NewIntObj(exp_lazy_out));
+	return TCL_OK;
+    }
+
+    if (argc > 2) {
+	exp_error(interp,"usage: lazy_out ?value?");
+	return TCL_ERROR;
+    }
+
+    if (Tcl_GetBoolean(interp,argv[1],&value) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    exp_lazy_out = value;
+    return TCL_OK;
+}
+
 /*ARGSUSED*/
 int
 Exp_ParityCmd(clientData,interp,argc,argv)
@@ -3074,6 +4766,202 @@ char **argv;
 }
 #endif /*DEBUG_PERM_ECASES*/
 
+/* user+system CPU time of this process in microseconds */
+static Tcl_WideInt
+exp_cputime()
+{
+#ifdef __WIN32__
+    FILETIME created, exited, kernel, user;
+    ULARGE_INTEGER k, u;
+
+    if (!GetProcessTimes(GetCurrentProcess(),&created,&exited,&kernel,&user)) {
+	return -1;
+    }
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    /* FILETIME is in 100ns units */
+    return (Tcl_WideInt) ((k.QuadPart + u.QuadPart) / 10);
+#else
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF,&ru) != 0) return -1;
+    return ((Tcl_WideInt) ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000
+	    + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#endif
+}
+
+/*
+ * exp_cputime
+ */
+/*ARGSUSED*/
+static int
+Exp_CputimeObjCmd(clientData, interp, objc, objv)
+ClientData clientData;
+Tcl_Interp *interp;
+int objc;
+Tcl_Obj *CONST objv[];
+{
+    if (objc != 1) {
+	Tcl_WrongNumArgs(interp, 1, objv, NULL);
+	return TCL_ERROR;
+    }
+    Tcl_SetObjResult(interp, Tcl_NewWideIntObj(exp_cputime()));
+    return TCL_OK;
+}
+
+/*
+ * exp_profile -info
+ * exp_profile -reset
+ * exp_profile -report
+ * exp_profile -reads
+ * exp_profile -alloc
+ * exp_profile 0|1
+ */
+/*ARGSUSED*/
+static int
+Exp_ProfileObjCmd(clientData, interp, objc, objv)
+ClientData clientData;
+Tcl_Interp *interp;
+int objc;
+Tcl_Obj *CONST objv[];
+{
+    static char *cmdtypes[] = {"before", "after", "bg", "fg"};
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+    struct exp_profile *prof;
+    int value;
+
+    if (objc != 2) {
+	Tcl_WrongNumArgs(interp, 1, objv,
+		"-info|-reset|-report|-reads|-alloc|value");
+	return TCL_ERROR;
+    }
+
+    if (streq(Tcl_GetString(objv[1]),"-info")) {
+	Tcl_SetObjResult(interp, Tcl_NewBooleanObj(exp_profiling));
+	return TCL_OK;
+    }
+
+    if (streq(Tcl_GetString(objv[1]),"-reset")) {
+	for (prof = tsdPtr->profileFirst;prof;prof = prof->next) {
+	    prof->evals = prof->bytes = prof->cycles = prof->hits = 0;
+	}
+	tsdPtr->reads = tsdPtr->readsCoalesced = tsdPtr->readEvals = 0;
+	expAllocReport(interp,1);
+	return TCL_OK;
+    }
+
+    if (streq(Tcl_GetString(objv[1]),"-alloc")) {
+	expAllocReport(interp,0);
+	return TCL_OK;
+    }
+
+    if (streq(Tcl_GetString(objv[1]),"-reads")) {
+	Tcl_Obj *objs[6];
+
+	objs[0] = Tcl_NewStringObj("-reads", -1);
+	objs[1] = Tcl_NewWideIntObj((Tcl_WideInt) tsdPtr->reads);
+	objs[2] = Tcl_NewStringObj("-coalesced", -1);
+	objs[3] = Tcl_NewWideIntObj((Tcl_WideInt) tsdPtr->readsCoalesced);
+	objs[4] = Tcl_NewStringObj("-evals", -1);
+	objs[5] = Tcl_NewWideIntObj((Tcl_WideInt) tsdPtr->readEvals);
+	Tcl_SetObjResult(interp, Tcl_NewListObj(6, objs));
+	return TCL_OK;
+    }
+
+    if (streq(Tcl_GetString(objv[1]),"-report")) {
+	Tcl_Obj *listPtr = Tcl_NewListObj(0, NULL);
+
+	for (prof = tsdPtr->profileFirst;prof;prof = prof->next) {
+	    Tcl_Obj *objs[16];
+
+	    objs[0] = Tcl_NewStringObj("-cmd", -1);
+	    objs[1] = Tcl_NewStringObj(cmdtypes[prof->cmdtype], -1);
+	    objs[2] = Tcl_NewStringObj("-type", -1);
+	    objs[3] = Tcl_NewStringObj(pattern_style[prof->use], -1);
+	    objs[4] = Tcl_NewStringObj("-nocase", -1);
+	    objs[5] = Tcl_NewBooleanObj(prof->Case == CASE_LOWER);
+	    objs[6] = Tcl_NewStringObj("-pattern", -1);
+	    objs[7] = prof->pat;
+	    objs[8] = Tcl_NewStringObj("-evals", -1);
+	    objs[9] = Tcl_NewWideIntObj((Tcl_WideInt) prof->evals);
+	    objs[10] = Tcl_NewStringObj("-bytes", -1);
+	    objs[11] = Tcl_NewWideIntObj((Tcl_WideInt) prof->bytes);
+	    objs[12] = Tcl_NewStringObj("-cycles", -1);
+	    objs[13] = Tcl_NewWideIntObj((Tcl_WideInt) prof->cycles);
+	    objs[14] = Tcl_NewStringObj("-hits", -1);
+	    objs[15] = Tcl_NewWideIntObj((Tcl_WideInt) prof->hits);
+	    Tcl_ListObjAppendElement(interp, listPtr,
+		    Tcl_NewListObj(16, objs));
+	}
+	Tcl_SetObjResult(interp, listPtr);
+	return TCL_OK;
+    }
+
+    if (Tcl_GetBooleanFromObj(interp, objv[1], &value) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    exp_profiling = value;
+
+    /* the persistent sets were parsed earlier, so (un)hook them now */
+    ecases_profile(&exp_cmds[EXP_CMD_BEFORE],value);
+    ecases_profile(&exp_cmds[EXP_CMD_AFTER],value);
+    ecases_profile(&exp_cmds[EXP_CMD_BG],value);
+    return TCL_OK;
+}
+
+/*
+ * exp_coalesce ?-bytes n? ?-usec n?
+ */
+/*ARGSUSED*/
+static int
+Exp_CoalesceObjCmd(clientData, interp, objc, objv)
+ClientData clientData;
+Tcl_Interp *interp;
+int objc;
+Tcl_Obj *CONST objv[];
+{
+    static char *options[] = {"-bytes", "-usec", (char *) NULL};
+    enum options {COALESCE_BYTES, COALESCE_USEC};
+    ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+    int i, index, value;
+
+    if (objc % 2 != 1) {
+	Tcl_WrongNumArgs(interp, 1, objv, "?-bytes n? ?-usec n?");
+	return TCL_ERROR;
+    }
+    for (i = 1;i < objc;i += 2) {
+	if (Tcl_GetIndexFromObj(interp, objv[i], options, "option", 0,
+		&index) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	if (Tcl_GetIntFromObj(interp, objv[i+1], &value) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	if (value < 0) {
+	    Tcl_AppendResult(interp, Tcl_GetString(objv[i]),
+		    " must not be negative", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	if ((enum options) index == COALESCE_BYTES) {
+	    tsdPtr->coalesceBytes = value;
+	} else {
+	    tsdPtr->coalesceUsec = value;
+	}
+    }
+    if (objc == 1) {
+	Tcl_Obj *objs[4];
+
+	objs[0] = Tcl_NewStringObj("-bytes", -1);
+	objs[1] = Tcl_NewIntObj(tsdPtr->coalesceBytes);
+	objs[2] = Tcl_NewStringObj("-usec", -1);
+	objs[3] = Tcl_NewIntObj(tsdPtr->coalesceUsec);
+	Tcl_SetObjResult(interp, Tcl_NewListObj(4, objs));
+    }
+    return TCL_OK;
+}
+
 void
 expExpectVarsInit()
 {
@@ -3095,6 +4983,12 @@ cmd_data[]  = {
 {"parity",	exp_proc(Exp_ParityCmd),	0,	0},
 {"close_on_eof",exp_proc(Exp_CloseOnEofCmd),	0,	0},
 {"timestamp",	exp_proc(Exp_TimestampCmd),	0,	0},
+{"exp_profile",	Exp_ProfileObjCmd,	0,	0,	0},
+{"exp_coalesce",Exp_CoalesceObjCmd,	0,	0,	0},
+{"exp_cputime",	Exp_CputimeObjCmd,	0,	0,	0},
+{"strip_ansi",	exp_proc(Exp_StripAnsiCmd),	0,	0},
+{"direct_read",	exp_proc(Exp_DirectReadCmd),	0,	0},
+{"lazy_out",	exp_proc(Exp_LazyOutCmd),	0,	0},
 {0}};
 
 void
@@ -3103,6 +4997,12 @@ Tcl_Interp *interp;
 {
 	exp_create_commands(interp,cmd_data);
 
+	{
+		ThreadSpecificData *tsdPtr = TCL_TSD_INIT(&dataKey);
+
+		tsdPtr->profileInterps++;
+	}
+	Tcl_CallWhenDeleted(interp,profile_free,(ClientData)0);
 
 
 	Tcl_SetVar(interp,EXPECT_TIMEOUT,INIT_EXPECT_TIMEOUT_LIT,0);
@@ -0,0 +1,98 @@
+/* ----------------------------------------------------------------------------
+ * expect.h --
+ *
+ *	Public declarations for the C expect library (exp_clib.c): spawn
+ *	a process and expect its output from plain C or C++ without a Tcl
+ *	interpreter, channels or Tcl_Obj buffers.  See libexpect(3).
+ *	The interface is that of Don Libes' libexpect from the NIST
+ *	sources, so programs written for it build against this one.
+ *
+ *	Glob patterns use the same matcher as the expect command
+ *	(exp_glob.c).  Regexp patterns use Tcl's regexp engine, so the
+ *	library links against the Tcl library but never creates an
+ *	interpreter.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _EXPECT_H
+#define _EXPECT_H
+
+#include <stdio.h>
+#include "tcl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Values returned by the expect functions when no case matched.  These
+ * are the same as the ones in exp.h.
+ */
+
+#ifndef EXP_TIMEOUT
+#   define EXP_TIMEOUT		-2
+#   define EXP_TCLERROR		-3
+#   define EXP_FULLBUFFER	-5
+#   define EXP_EOF		-11
+#endif
+
+enum exp_type {
+    exp_end = 0,	/* placeholder - no more cases */
+    exp_glob,		/* glob-style */
+    exp_exact,		/* exact string */
+    exp_regexp,		/* regexp-style, uncompiled */
+    exp_compiled,	/* regexp-style, compiled */
+    exp_null		/* matches binary 0 */
+};
+
+struct exp_case {
+    char *pattern;
+    Tcl_RegExp re;	/* only used by exp_compiled */
+    enum exp_type type;
+    int value;		/* value to be returned upon match */
+};
+
+/*
+ * Spawning.
+ */
+
+extern int	exp_spawnl (char *file, ...);
+extern int	exp_spawnv (char *file, char *argv[]);
+extern int	exp_spawnfd (int fd);
+extern FILE *	exp_popen (char *command);
+extern int	exp_closefd (int fd);
+
+extern int	exp_pid;
+extern int	exp_ttycopy;
+extern int	exp_autoallocpty;
+extern int	exp_pty[2];
+extern char *	exp_pty_slave_name;
+extern void	(*exp_close_in_child) (void);
+extern void	(*exp_child_exec_prelude) (void);
+
+/*
+ * Expecting.
+ */
+
+extern int	exp_expectl (int fd, ...);
+extern int	exp_fexpectl (FILE *fp, ...);
+extern int	exp_expectv (int fd, struct exp_case *cases);
+extern int	exp_fexpectv (FILE *fp, struct exp_case *cases);
+extern int	exp_bufferedv (int fd, struct exp_case *cases);
+extern int	exp_fill (int fd, const char *data, int len);
+
+extern int	exp_timeout;
+extern int	exp_match_max;
+extern int	exp_full_buffer;
+extern int	exp_remove_nulls;
+extern char *	exp_match;
+extern char *	exp_match_end;
+extern char *	exp_buffer;
+extern char *	exp_buffer_end;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EXPECT_H */
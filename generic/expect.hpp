@@ -0,0 +1,1146 @@
+/* ----------------------------------------------------------------------------
+ * expect.hpp --
+ *
+ *	C++20 coroutine interface to the C expect library (exp_clib.c).
+ *	A Session owns one spawned process (or any descriptor) and a
+ *	Scheduler runs many Session coroutines on one thread:
+ *
+ *	    expect::Task login(expect::Session s) {
+ *		co_await s.send("\r");
+ *		expect::Result r = co_await s.expect(
+ *			{expect::ex("login:"), expect::re("\\$ $")}, 500ms);
+ *		...
+ *	    }
+ *
+ *	    expect::Scheduler sched;
+ *	    sched.spawn(login(expect::Session::spawn(sched, {"telnet", host})));
+ *	    sched.run();
+ *
+ *	The scheduler waits with epoll on Linux, poll elsewhere on UNIX and
+ *	by peeking the pipes on Windows.  On Linux 6.7 and later it can
+ *	use io_uring instead, if Scheduler::Backend::Uring asks for it:
+ *	every descriptor keeps one multishot read posted into a ring of
+ *	provided buffers, the data is queued with exp_fill and sends are
+ *	write SQEs, so a busy session costs no read, write or epoll_ctl
+ *	calls of its own.  Define
+ *	EXP_NO_IO_URING to leave it out.  No Tcl interpreter or event loop
+ *	is involved, and the exp_* globals are only touched from the
+ *	scheduler's thread.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef INC_expect_hpp__
+#define INC_expect_hpp__
+
+#include "expect.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <initializer_list>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#   include <windows.h>
+#   include <io.h>
+#else
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <poll.h>
+#   ifdef __linux__
+#	include <sys/epoll.h>
+#	if !defined(EXP_NO_IO_URING) && __has_include(<linux/io_uring.h>)
+#	    define EXP_IO_URING 1
+#	    include <linux/io_uring.h>
+#	    include <sys/mman.h>
+#	    include <sys/syscall.h>
+#	endif
+#   endif
+#endif
+
+namespace expect {
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::milliseconds;
+
+/*
+ * Patterns.  ex("...") is an exact string, gl("...") a glob pattern and
+ * re("...") a regexp, as with expect -ex, -gl and -re.
+ */
+
+struct Pattern {
+    enum exp_type type;
+    std::string text;
+};
+
+inline Pattern ex(std::string s) { return Pattern{exp_exact, std::move(s)}; }
+inline Pattern gl(std::string s) { return Pattern{exp_glob, std::move(s)}; }
+inline Pattern re(std::string s) { return Pattern{exp_regexp, std::move(s)}; }
+
+/*
+ * What an expect returned.  index is the position of the pattern that
+ * matched, or one of the negative values below.
+ */
+
+struct Result {
+    enum { Timeout = EXP_TIMEOUT, Eof = EXP_EOF, FullBuffer = EXP_FULLBUFFER };
+
+    int index = Timeout;
+    std::string match;		/* The bytes the pattern matched. */
+    std::string buffer;		/* Everything up to the end of the match. */
+
+    bool matched() const { return index >= 0; }
+    bool timeout() const { return index == Timeout; }
+    bool eof() const { return index == Eof; }
+};
+
+class Scheduler;
+
+/*
+ * Something suspended on a descriptor.  ready() is called each time the
+ * descriptor is readable (or writable) and returns true when the
+ * coroutine can continue; expired() is called when the deadline passes
+ * first.
+ */
+
+struct Waiter {
+    std::coroutine_handle<> handle;
+    int fd = -1;
+    bool write = false;
+    unsigned long serial = 0;
+
+    /*
+     * For writes on an io_uring scheduler, which does the writing: the
+     * bytes still to go and the errno if it failed.
+     */
+    std::string_view out;
+    int error = 0;
+
+    virtual bool ready() = 0;
+    virtual void expired() = 0;
+protected:
+    ~Waiter() = default;
+};
+
+/*
+ * A fire and forget coroutine owned by the Scheduler it is spawned on.
+ */
+
+class Task {
+public:
+    struct promise_type {
+	std::exception_ptr error;
+
+	Task get_return_object() {
+	    return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+	}
+	std::suspend_always initial_suspend() noexcept { return {}; }
+	std::suspend_always final_suspend() noexcept { return {}; }
+	void return_void() {}
+	void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    Task(Task &&o) noexcept : h(std::exchange(o.h, {})) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task() { if (h) h.destroy(); }
+
+private:
+    friend class Scheduler;
+    explicit Task(std::coroutine_handle<promise_type> h) : h(h) {}
+    std::coroutine_handle<promise_type> h;
+};
+
+#ifdef EXP_IO_URING
+
+/*
+ * Just enough io_uring for the Scheduler, spoken to the kernel directly
+ * so that liburing is not needed.  open() fails unless the kernel has
+ * multishot reads and provided buffer rings.
+ */
+
+class IoUring {
+public:
+    /* IORING_OP_READ_MULTISHOT (Linux 6.7), newer than some uapi headers. */
+    static constexpr unsigned char OpReadMultishot = 49;
+    static constexpr unsigned Entries = 1024;
+    static constexpr unsigned BufCount = 1024;	/* A power of two. */
+    static constexpr unsigned BufSize = 4096;
+
+    IoUring() = default;
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+    ~IoUring() { close(); }
+
+    bool open();
+    void close();
+    bool ok() const { return fd >= 0; }
+
+    /* The next SQE, zeroed.  Submitted by the next enter(). */
+    struct io_uring_sqe *sqe();
+
+    /*
+     * Submit what is queued and wait up to msec (forever if negative)
+     * for minComplete completions.
+     */
+    int enter(unsigned minComplete, int msec);
+
+    /* Call f on each completion, then hand recycled buffers back. */
+    template <class F> void reap(F f) {
+	unsigned head = *cqHead;
+	unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail; head++) {
+	    f(cqes[head & cqMask]);
+	}
+	__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+	__atomic_store_n(&bufRing->tail, bufTail, __ATOMIC_RELEASE);
+    }
+
+    char *buffer(unsigned bid) { return bufs + (size_t) bid * BufSize; }
+    void recycle(unsigned bid) {
+	/*
+	 * Not bufRing->bufs: under C++ the uapi flex array macro puts it
+	 * after a one byte empty struct, 8 bytes too far.
+	 */
+	struct io_uring_buf *b = (struct io_uring_buf *) bufRing
+		+ (bufTail & (BufCount - 1));
+
+	b->addr = (unsigned long) buffer(bid);
+	b->len = BufSize;
+	b->bid = (unsigned short) bid;
+	bufTail++;
+    }
+
+    unsigned long syscalls = 0;
+
+private:
+    int fd = -1;
+    void *ringMap = MAP_FAILED;
+    size_t ringLen = 0;
+    void *sqeMap = MAP_FAILED;
+    size_t sqeLen = 0;
+    void *bufRingMap = MAP_FAILED;
+    void *bufMap = MAP_FAILED;
+
+    unsigned *sqHead = nullptr, *sqTail = nullptr, *sqArray = nullptr;
+    unsigned sqMask = 0, sqEntries = 0, sqLocal = 0, toSubmit = 0;
+    struct io_uring_sqe *sqes = nullptr;
+    unsigned *cqHead = nullptr, *cqTail = nullptr;
+    unsigned cqMask = 0;
+    struct io_uring_cqe *cqes = nullptr;
+    struct io_uring_buf_ring *bufRing = nullptr;
+    char *bufs = nullptr;
+    unsigned short bufTail = 0;
+};
+
+inline bool
+IoUring::open()
+{
+    struct io_uring_params p;
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CLAMP;
+    fd = (int) syscall(__NR_io_uring_setup, Entries, &p);
+    if (fd < 0) {
+	return false;
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)
+	    || !(p.features & IORING_FEAT_EXT_ARG)
+	    || !(p.features & IORING_FEAT_NODROP)) {
+	close();
+	return false;
+    }
+
+    ringLen = std::max(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+	    p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe));
+    ringMap = mmap(nullptr, ringLen, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    sqeLen = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqeMap = mmap(nullptr, sqeLen, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ringMap == MAP_FAILED || sqeMap == MAP_FAILED) {
+	close();
+	return false;
+    }
+
+    char *q = (char *) ringMap;
+    sqHead = (unsigned *) (q + p.sq_off.head);
+    sqTail = (unsigned *) (q + p.sq_off.tail);
+    sqMask = *(unsigned *) (q + p.sq_off.ring_mask);
+    sqArray = (unsigned *) (q + p.sq_off.array);
+    sqEntries = p.sq_entries;
+    sqLocal = *sqTail;
+    cqHead = (unsigned *) (q + p.cq_off.head);
+    cqTail = (unsigned *) (q + p.cq_off.tail);
+    cqMask = *(unsigned *) (q + p.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *) (q + p.cq_off.cqes);
+    sqes = (struct io_uring_sqe *) sqeMap;
+
+    /* Is the multishot read there? */
+    std::vector<char> pb(sizeof(struct io_uring_probe)
+	    + 256 * sizeof(struct io_uring_probe_op), 0);
+    struct io_uring_probe *probe = (struct io_uring_probe *) pb.data();
+
+    syscalls++;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+	    256) < 0 || probe->last_op < OpReadMultishot
+	    || !(probe->ops[OpReadMultishot].flags & IO_URING_OP_SUPPORTED)) {
+	close();
+	return false;
+    }
+
+    /* Provided buffers, group 0. */
+    bufRingMap = mmap(nullptr, BufCount * sizeof(struct io_uring_buf),
+	    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    bufMap = mmap(nullptr, (size_t) BufCount * BufSize,
+	    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufRingMap == MAP_FAILED || bufMap == MAP_FAILED) {
+	close();
+	return false;
+    }
+    bufRing = (struct io_uring_buf_ring *) bufRingMap;
+    bufs = (char *) bufMap;
+
+    struct io_uring_buf_reg reg;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long) bufRing;
+    reg.ring_entries = BufCount;
+    reg.bgid = 0;
+    syscalls++;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg,
+	    1) < 0) {
+	close();
+	return false;
+    }
+    for (unsigned i = 0; i < BufCount; i++) {
+	recycle(i);
+    }
+    __atomic_store_n(&bufRing->tail, bufTail, __ATOMIC_RELEASE);
+    return true;
+}
+
+inline void
+IoUring::close()
+{
+    if (fd >= 0) {
+	::close(fd);
+	fd = -1;
+    }
+    if (ringMap != MAP_FAILED) munmap(ringMap, ringLen);
+    if (sqeMap != MAP_FAILED) munmap(sqeMap, sqeLen);
+    if (bufRingMap != MAP_FAILED) {
+	munmap(bufRingMap, BufCount * sizeof(struct io_uring_buf));
+    }
+    if (bufMap != MAP_FAILED) munmap(bufMap, (size_t) BufCount * BufSize);
+    ringMap = sqeMap = bufRingMap = bufMap = MAP_FAILED;
+}
+
+inline struct io_uring_sqe *
+IoUring::sqe()
+{
+    if (sqLocal - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+	enter(0, 0);
+    }
+
+    unsigned idx = sqLocal & sqMask;
+    struct io_uring_sqe *s = &sqes[idx];
+
+    memset(s, 0, sizeof(*s));
+    sqArray[idx] = idx;
+    sqLocal++;
+    toSubmit++;
+    return s;
+}
+
+inline int
+IoUring::enter(unsigned minComplete, int msec)
+{
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    unsigned flags = 0;
+    void *argp = nullptr;
+    size_t argsz = 0;
+
+    __atomic_store_n(sqTail, sqLocal, __ATOMIC_RELEASE);
+    if (minComplete > 0) {
+	flags |= IORING_ENTER_GETEVENTS;
+	if (msec >= 0) {
+	    ts.tv_sec = msec / 1000;
+	    ts.tv_nsec = (msec % 1000) * 1000000L;
+	    memset(&arg, 0, sizeof(arg));
+	    arg.ts = (unsigned long) &ts;
+	    flags |= IORING_ENTER_EXT_ARG;
+	    argp = &arg;
+	    argsz = sizeof(arg);
+	}
+    }
+    if (toSubmit == 0 && flags == 0) {
+	return 0;
+    }
+    syscalls++;
+    int n = (int) syscall(__NR_io_uring_enter, fd, toSubmit, minComplete,
+	    flags, argp, argsz);
+    if (n > 0) {
+	toSubmit -= std::min((unsigned) n, toSubmit);
+    }
+    return n;
+}
+
+#endif /* EXP_IO_URING */
+
+class Scheduler {
+public:
+    /*
+     * Poll is epoll, poll or pipe peeking, whichever the system has,
+     * and is what Auto picks.  Uring asks for io_uring and falls back
+     * to Poll when it is not usable; backend() tells which one was
+     * picked.  It saves system calls but, without batching, has much
+     * lower throughput and higher latency with many sessions, so it is
+     * opt-in.
+     */
+    enum class Backend { Auto, Poll, Uring };
+
+    explicit Scheduler(Backend want = Backend::Auto) {
+#if defined(__linux__)
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+	    throw std::system_error(errno, std::generic_category(),
+		    "epoll_create1");
+	}
+#endif
+#ifdef EXP_IO_URING
+	if (want == Backend::Uring && ring.open()) {
+	    backend_ = Backend::Uring;
+	}
+#else
+	(void) want;
+#endif
+    }
+    ~Scheduler() {
+	for (auto h : tasks) h.destroy();
+#if defined(__linux__)
+	close(epfd);
+#endif
+    }
+    Scheduler(const Scheduler &) = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+
+    /* Queue a coroutine; it first runs inside run(). */
+    void spawn(Task t) {
+	auto h = std::exchange(t.h, {});
+	tasks.push_back(h);
+	runnable.push_back(h);
+    }
+
+    /*
+     * Run until every spawned Task has returned.  The first exception a
+     * Task let escape is rethrown once the others are done.
+     */
+    void run();
+
+    size_t live() const { return tasks.size(); }
+
+    Backend backend() const { return backend_; }
+    bool uring() const { return backend_ == Backend::Uring; }
+
+    /* System calls made to wait, submit and (re)arm descriptors. */
+    unsigned long syscalls() const {
+#ifdef EXP_IO_URING
+	return nsyscalls + ring.syscalls;
+#else
+	return nsyscalls;
+#endif
+    }
+
+    /* Used by the awaiters in Session. */
+    void wait(Waiter *w, Clock::time_point *deadline);
+    void forget(int fd);
+
+private:
+    struct Timer {
+	Clock::time_point when;
+	int fd;
+	unsigned long serial;
+	bool operator>(const Timer &o) const { return when > o.when; }
+    };
+
+    void poll(Clock::time_point *until);
+    void wake(int fd);
+    Waiter *slot(int fd) const {
+	return (fd >= 0 && fd < (int) waiting.size()) ? waiting[fd] : nullptr;
+    }
+
+    std::vector<std::coroutine_handle<Task::promise_type>> tasks;
+    std::deque<std::coroutine_handle<>> runnable;
+    std::vector<Waiter *> waiting;	/* Indexed by descriptor. */
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    unsigned long serial = 0;
+    size_t nwaiting = 0;
+    unsigned long nsyscalls = 0;
+    Backend backend_ = Backend::Poll;
+#if defined(__linux__)
+    int epfd;
+    std::vector<char> registered;
+#endif
+#ifdef EXP_IO_URING
+    /* What a completion's user_data says. */
+    enum { OpRead, OpWrite, OpPoll, OpCancel };
+    enum { Idle, Armed, Rearm, Ended };	/* armed[] */
+
+    unsigned long long tag(int fd, int op) const {
+	return ((unsigned long long) gen[fd] << 32)
+		| ((unsigned long long) fd << 2) | op;
+    }
+    void track(int fd);
+    void arm(int fd);
+    void submitWrite(Waiter *w, bool whenWritable);
+    void complete(const struct io_uring_cqe &cqe);
+
+    IoUring ring;
+    std::vector<unsigned> gen;		/* Bumped by forget(). */
+    std::vector<char> armed;
+    std::vector<int> touched;		/* Descriptors with completions. */
+    std::vector<char> isTouched;
+    std::vector<int> rearm;
+#endif
+};
+
+/*
+ * A spawned process, or any descriptor handed to attach().  Move only;
+ * the descriptor is closed when the owning Session goes away.
+ */
+
+class Session {
+public:
+    static Session spawn(Scheduler &sched, std::vector<std::string> argv) {
+	std::vector<char *> v;
+
+	for (auto &a : argv) v.push_back(a.data());
+	v.push_back(nullptr);
+	int fd = exp_spawnv(v[0], v.data());
+	if (fd < 0) {
+	    throw std::system_error(errno, std::generic_category(), argv[0]);
+	}
+	return Session(sched, fd, exp_pid);
+    }
+
+    static Session attach(Scheduler &sched, int fd) {
+	if (exp_spawnfd(fd) < 0) {
+	    throw std::system_error(errno, std::generic_category(),
+		    "exp_spawnfd");
+	}
+	return Session(sched, fd, 0);
+    }
+
+    Session(Session &&o) noexcept
+	: sched(o.sched), fd_(std::exchange(o.fd_, -1)), pid_(o.pid_) {}
+    Session &operator=(Session &&o) noexcept {
+	if (this != &o) {
+	    close();
+	    sched = o.sched;
+	    fd_ = std::exchange(o.fd_, -1);
+	    pid_ = o.pid_;
+	}
+	return *this;
+    }
+    Session(const Session &) = delete;
+    Session &operator=(const Session &) = delete;
+    ~Session() { close(); }
+
+    int fd() const { return fd_; }
+    int pid() const { return pid_; }
+
+    void close() {
+	if (fd_ >= 0) {
+	    sched->forget(fd_);
+	    exp_closefd(fd_);
+	    fd_ = -1;
+	}
+    }
+
+    /*
+     * co_await s.expect({...}, timeout) -> Result.  A negative timeout
+     * waits forever.  exp_match_max, exp_remove_nulls and
+     * exp_full_buffer apply as for exp_expectv.
+     */
+
+    class ExpectOp : public Waiter {
+    public:
+	ExpectOp(Session &s, std::vector<Pattern> p, milliseconds timeout)
+	    : s(s), pats(std::move(p)) {
+	    for (size_t i = 0; i < pats.size(); i++) {
+		struct exp_case c;
+		c.pattern = pats[i].text.data();
+		c.re = nullptr;
+		c.type = pats[i].type;
+		c.value = (int) i;
+		cases.push_back(c);
+	    }
+	    cases.push_back(exp_case{nullptr, nullptr, exp_end, 0});
+	    if (timeout.count() >= 0) {
+		deadline = Clock::now() + timeout;
+		hasDeadline = true;
+	    }
+	    fd = s.fd_;
+	}
+
+	bool await_ready() {
+	    return finish(exp_bufferedv(fd, cases.data()));
+	}
+	void await_suspend(std::coroutine_handle<> h) {
+	    handle = h;
+	    s.sched->wait(this, hasDeadline ? &deadline : nullptr);
+	}
+	Result await_resume() {
+	    if (failed) {
+		throw std::system_error(failed, std::generic_category(),
+			"expect");
+	    }
+	    return std::move(r);
+	}
+
+	bool ready() override {
+	    if (s.sched->uring()) {
+		/* The scheduler has queued the new data with exp_fill. */
+		return finish(exp_bufferedv(fd, cases.data()));
+	    }
+
+	    int saved = exp_timeout;
+
+	    exp_timeout = 0;
+	    int rc = exp_expectv(fd, cases.data());
+	    exp_timeout = saved;
+	    if (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		return false;
+	    }
+	    return finish(rc);
+	}
+	void expired() override {
+	    r.index = Result::Timeout;
+	}
+
+    private:
+	bool finish(int rc) {
+	    if (rc == EXP_TIMEOUT) {
+		return false;
+	    }
+	    if (rc == -1) {
+		failed = errno;
+		return true;
+	    }
+	    r.index = rc;
+	    if (exp_match != nullptr) {
+		r.match.assign(exp_match, exp_match_end - exp_match);
+		r.buffer.assign(exp_buffer, exp_match_end - exp_buffer);
+	    } else if (exp_buffer != nullptr) {
+		r.buffer.assign(exp_buffer, exp_buffer_end - exp_buffer);
+	    }
+	    return true;
+	}
+
+	Session &s;
+	std::vector<Pattern> pats;
+	std::vector<struct exp_case> cases;
+	Clock::time_point deadline;
+	bool hasDeadline = false;
+	int failed = 0;
+	Result r;
+    };
+
+    ExpectOp expect(std::initializer_list<Pattern> p,
+	    milliseconds timeout = milliseconds(-1)) {
+	return ExpectOp(*this, std::vector<Pattern>(p), timeout);
+    }
+    ExpectOp expect(std::vector<Pattern> p,
+	    milliseconds timeout = milliseconds(-1)) {
+	return ExpectOp(*this, std::move(p), timeout);
+    }
+
+    /*
+     * co_await s.send("...").  Suspends only while the descriptor
+     * cannot take more.
+     */
+
+    class SendOp : public Waiter {
+    public:
+	SendOp(Session &s, std::string d) : s(s), data(std::move(d)) {
+	    fd = s.fd_;
+	    write = true;
+	}
+
+	bool await_ready() {
+	    if (s.sched->uring()) {
+		out = data;
+		return out.empty();
+	    }
+	    return ready();
+	}
+	void await_suspend(std::coroutine_handle<> h) {
+	    handle = h;
+	    s.sched->wait(this, nullptr);
+	}
+	void await_resume() {
+	    if (failed) {
+		throw std::system_error(failed, std::generic_category(),
+			"send");
+	    }
+	}
+
+	bool ready() override {
+	    if (s.sched->uring()) {
+		failed = error;
+		return out.empty();
+	    }
+	    while (off < data.size()) {
+#ifdef _WIN32
+		int n = _write(fd, data.data() + off,
+			(unsigned) (data.size() - off));
+#else
+		ssize_t n = ::write(fd, data.data() + off, data.size() - off);
+#endif
+		if (n < 0) {
+		    if (errno == EINTR) continue;
+		    if (errno == EAGAIN || errno == EWOULDBLOCK) return false;
+		    failed = errno;
+		    return true;
+		}
+		off += n;
+	    }
+	    return true;
+	}
+	void expired() override {}
+
+    private:
+	Session &s;
+	std::string data;
+	size_t off = 0;
+	int failed = 0;
+    };
+
+    SendOp send(std::string_view data) {
+	return SendOp(*this, std::string(data));
+    }
+
+private:
+    Session(Scheduler &sched, int fd, int pid)
+	: sched(&sched), fd_(fd), pid_(pid) {
+#ifndef _WIN32
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#endif
+    }
+
+    Scheduler *sched;
+    int fd_;
+    int pid_;
+};
+
+/*
+ *----------------------------------------------------------------------
+ * Scheduler
+ *----------------------------------------------------------------------
+ */
+
+inline void
+Scheduler::wait(Waiter *w, Clock::time_point *deadline)
+{
+    if (w->fd >= (int) waiting.size()) {
+	waiting.resize(w->fd + 1, nullptr);
+    }
+    waiting[w->fd] = w;
+    w->serial = ++serial;
+    nwaiting++;
+    if (deadline != nullptr) {
+	timers.push(Timer{*deadline, w->fd, w->serial});
+    }
+#ifdef EXP_IO_URING
+    if (uring()) {
+	track(w->fd);
+	if (w->write) {
+	    submitWrite(w, false);
+	} else if (armed[w->fd] == Idle) {
+	    arm(w->fd);
+	}
+	return;
+    }
+#endif
+#if defined(__linux__)
+    struct epoll_event ev;
+
+    ev.events = (w->write ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+    ev.data.fd = w->fd;
+    if (w->fd >= (int) registered.size()) {
+	registered.resize(w->fd + 1, 0);
+    }
+    nsyscalls++;
+    if (epoll_ctl(epfd, registered[w->fd] ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+	    w->fd, &ev) == 0) {
+	registered[w->fd] = 1;
+    }
+#endif
+}
+
+inline void
+Scheduler::forget(int fd)
+{
+    if (slot(fd) != nullptr) {
+	waiting[fd] = nullptr;
+	nwaiting--;
+    }
+#ifdef EXP_IO_URING
+    if (uring() && fd >= 0 && fd < (int) armed.size()) {
+	/*
+	 * Cancel by descriptor now, before the caller closes it; anything
+	 * that completes later carries the old generation and is dropped.
+	 */
+	struct io_uring_sqe *s = ring.sqe();
+
+	s->opcode = IORING_OP_ASYNC_CANCEL;
+	s->fd = fd;
+	s->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+	s->user_data = tag(fd, OpCancel);
+	ring.enter(0, 0);
+	gen[fd]++;
+	armed[fd] = Idle;
+	return;
+    }
+#endif
+#if defined(__linux__)
+    if (fd >= 0 && fd < (int) registered.size() && registered[fd]) {
+	nsyscalls++;
+	epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+	registered[fd] = 0;
+    }
+#endif
+}
+
+/*
+ * fd is ready: let its waiter make progress and resume the coroutine
+ * once it is done, or wait again.
+ */
+
+inline void
+Scheduler::wake(int fd)
+{
+    Waiter *w = slot(fd);
+
+    if (w == nullptr) {
+	return;
+    }
+    waiting[fd] = nullptr;
+    nwaiting--;
+    if (w->ready()) {
+	runnable.push_back(w->handle);
+    } else {
+	/* Still pending; keep the original deadline. */
+	waiting[fd] = w;
+	nwaiting++;
+#if defined(__linux__)
+	if (uring()) {
+	    return;
+	}
+
+	struct epoll_event ev;
+
+	ev.events = (w->write ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+	ev.data.fd = fd;
+	nsyscalls++;
+	epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+#endif
+    }
+}
+
+/*
+ * Wait for descriptors until 'until' (or forever) and wake the ones
+ * that are ready.
+ */
+
+inline void
+Scheduler::poll(Clock::time_point *until)
+{
+    int msec = -1;
+
+    if (until != nullptr) {
+	auto d = std::chrono::ceil<milliseconds>(*until - Clock::now());
+	msec = d.count() < 0 ? 0 : (int) d.count();
+    }
+
+#ifdef EXP_IO_URING
+    if (uring()) {
+	ring.enter(1, msec);
+	ring.reap([this](const struct io_uring_cqe &cqe) { complete(cqe); });
+
+	/* Multishot reads that ran out of buffers start again. */
+	for (int fd : rearm) {
+	    if (armed[fd] == Rearm) arm(fd);
+	}
+	rearm.clear();
+
+	std::vector<int> list;
+
+	list.swap(touched);
+	for (int fd : list) {
+	    isTouched[fd] = 0;
+	    wake(fd);
+	}
+	return;
+    }
+#endif
+#if defined(__linux__)
+    struct epoll_event evs[256];
+    int n = epoll_wait(epfd, evs, 256, msec);
+
+    nsyscalls++;
+    for (int i = 0; i < n; i++) {
+	wake(evs[i].data.fd);
+    }
+#elif !defined(_WIN32)
+    std::vector<struct pollfd> pfds;
+
+    for (int fd = 0; fd < (int) waiting.size(); fd++) {
+	if (waiting[fd] != nullptr) {
+	    pfds.push_back(pollfd{fd,
+		    (short) (waiting[fd]->write ? POLLOUT : POLLIN), 0});
+	}
+    }
+    if (::poll(pfds.data(), pfds.size(), msec) > 0) {
+	for (auto &p : pfds) {
+	    if (p.revents) wake(p.fd);
+	}
+    }
+#else
+    /*
+     * Anonymous and named pipes cannot be waited on for readability, so
+     * sweep them with PeekNamedPipe and nap briefly when nothing moved.
+     */
+    auto start = Clock::now();
+
+    for (;;) {
+	bool any = false;
+
+	for (int fd = 0; fd < (int) waiting.size(); fd++) {
+	    Waiter *w = waiting[fd];
+	    DWORD avail;
+
+	    if (w == nullptr) continue;
+	    if (w->write || !PeekNamedPipe((HANDLE) _get_osfhandle(fd),
+		    NULL, 0, NULL, &avail, NULL) || avail > 0) {
+		wake(fd);
+		any = true;
+	    }
+	}
+	if (any || (msec >= 0 && Clock::now() - start >= milliseconds(msec))) {
+	    break;
+	}
+	Sleep(1);
+    }
+#endif
+}
+
+#ifdef EXP_IO_URING
+
+inline void
+Scheduler::track(int fd)
+{
+    if (fd >= (int) gen.size()) {
+	gen.resize(fd + 1, 0);
+	armed.resize(fd + 1, Idle);
+	isTouched.resize(fd + 1, 0);
+    }
+}
+
+/* Post the multishot read that feeds fd from now on. */
+
+inline void
+Scheduler::arm(int fd)
+{
+    struct io_uring_sqe *s = ring.sqe();
+
+    s->opcode = IoUring::OpReadMultishot;
+    s->fd = fd;
+    s->flags = IOSQE_BUFFER_SELECT;
+    s->buf_group = 0;
+    s->off = (unsigned long long) -1;
+    s->user_data = tag(fd, OpRead);
+    armed[fd] = Armed;
+}
+
+/*
+ * Write what is left of w->out.  When the descriptor was full, the
+ * write is linked behind a poll for POLLOUT so both go in one submit.
+ */
+
+inline void
+Scheduler::submitWrite(Waiter *w, bool whenWritable)
+{
+    struct io_uring_sqe *s;
+
+    if (whenWritable) {
+	s = ring.sqe();
+	s->opcode = IORING_OP_POLL_ADD;
+	s->fd = w->fd;
+	s->poll32_events = POLLOUT;
+	s->flags = IOSQE_IO_LINK;
+	s->user_data = tag(w->fd, OpPoll);
+    }
+    s = ring.sqe();
+    s->opcode = IORING_OP_WRITE;
+    s->fd = w->fd;
+    s->addr = (unsigned long) w->out.data();
+    s->len = (unsigned) w->out.size();
+    s->off = (unsigned long long) -1;
+    s->user_data = tag(w->fd, OpWrite);
+}
+
+inline void
+Scheduler::complete(const struct io_uring_cqe &cqe)
+{
+    int fd = (int) ((cqe.user_data >> 2) & 0x3fffffff);
+    int op = (int) (cqe.user_data & 3);
+    bool current = (fd < (int) gen.size()
+	    && gen[fd] == (unsigned) (cqe.user_data >> 32));
+
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+	unsigned bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+
+	if (current && op == OpRead && cqe.res > 0) {
+	    exp_fill(fd, ring.buffer(bid), cqe.res);
+	}
+	ring.recycle(bid);
+    }
+    if (!current) {
+	return;
+    }
+
+    switch (op) {
+    case OpRead:
+	if (cqe.res == -ENOBUFS) {
+	    /* Everything was in use; go again once buffers are back. */
+	    armed[fd] = Rearm;
+	    rearm.push_back(fd);
+	    break;
+	}
+	if (cqe.res <= 0) {
+	    exp_fill(fd, nullptr, cqe.res);
+	    armed[fd] = Ended;
+	} else if (!(cqe.flags & IORING_CQE_F_MORE)) {
+	    armed[fd] = Rearm;
+	    rearm.push_back(fd);
+	}
+	break;
+
+    case OpWrite: {
+	Waiter *w = slot(fd);
+
+	if (w == nullptr || !w->write) {
+	    return;
+	}
+	if (cqe.res == -EAGAIN) {
+	    submitWrite(w, true);
+	    return;
+	}
+	if (cqe.res < 0) {
+	    w->error = -cqe.res;
+	    w->out = {};
+	} else {
+	    w->out.remove_prefix(cqe.res);
+	}
+	if (!w->out.empty()) {
+	    submitWrite(w, false);
+	    return;
+	}
+	break;
+    }
+
+    default:
+	return;
+    }
+
+    if (!isTouched[fd]) {
+	isTouched[fd] = 1;
+	touched.push_back(fd);
+    }
+}
+
+#endif /* EXP_IO_URING */
+
+inline void
+Scheduler::run()
+{
+    std::exception_ptr error;
+
+    while (!tasks.empty()) {
+	while (!runnable.empty()) {
+	    auto h = runnable.front();
+	    runnable.pop_front();
+	    h.resume();
+	}
+
+	/* Reap the tasks that returned. */
+	for (size_t i = 0; i < tasks.size(); ) {
+	    if (tasks[i].done()) {
+		if (tasks[i].promise().error && !error) {
+		    error = tasks[i].promise().error;
+		}
+		tasks[i].destroy();
+		tasks[i] = tasks.back();
+		tasks.pop_back();
+	    } else {
+		i++;
+	    }
+	}
+	if (tasks.empty()) {
+	    break;
+	}
+	if (nwaiting == 0) {
+	    /* Nothing can ever wake the rest. */
+	    break;
+	}
+
+	/* Drop timers whose waiter already finished. */
+	while (!timers.empty()) {
+	    const Timer &t = timers.top();
+	    Waiter *w = slot(t.fd);
+	    if (w != nullptr && w->serial == t.serial) break;
+	    timers.pop();
+	}
+	if (timers.empty()) {
+	    poll(nullptr);
+	} else {
+	    Clock::time_point when = timers.top().when;
+	    poll(&when);
+	}
+
+	/* Expire what is due and still waiting. */
+	auto now = Clock::now();
+	while (!timers.empty() && timers.top().when <= now) {
+	    Timer t = timers.top();
+	    Waiter *w = slot(t.fd);
+
+	    timers.pop();
+	    if (w != nullptr && w->serial == t.serial) {
+		waiting[t.fd] = nullptr;
+		nwaiting--;
+		w->expired();
+		runnable.push_back(w->handle);
+	    }
+	}
+    }
+    if (error) {
+	std::rethrow_exception(error);
+    }
+}
+
+} /* namespace expect */
+
+#endif /* INC_expect_hpp__ */
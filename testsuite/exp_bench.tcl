@@ -0,0 +1,285 @@
+# exp_bench.tcl --
+#
+#	Throughput and latency benchmarks for the expect engine.  Spawns
+#	exp_producer and measures, for each scenario and match_max:
+#
+#	    bytes_per_sec	bytes consumed per second of wall time
+#	    matches_per_sec	pattern matches per second
+#	    cpu_us_per_mb	CPU microseconds (user+sys) per MB consumed
+#	    p50_us p90_us p99_us  readable-to-match latency (exp_latency)
+#
+#	The pipe scenario is glob over 'spawn -pipe', to compare with the
+#	pty used by the others.  The printify scenario keeps 8KB of
+#	typical terminal output (prompts, \r\n, color escapes, some
+#	UTF-8) in the buffer and runs "expect -timeout 0" against it with
+#	a pattern that does not match, with diagnostics going to the null
+#	device; each call formats the whole buffer through expPrintify for
+#	them, which is most of its cost.
+#	Its bytes_per_sec is the bytes formatted per second and us_per_call
+#	the time of one such expect.
+#
+#	Each result is written as one line, a Tcl dict, so runs can be
+#	saved and compared:
+#
+#	    tclsh exp_bench.tcl -producer ./exp_producer -output new.txt
+#	    tclsh exp_bench.tcl -producer ./exp_producer -compare old.txt
+#
+#	With -compare the exit status is 1 if any scenario lost more than
+#	-tolerance percent of its throughput or used that much more CPU.
+
+array set opt {
+    -producer	./exp_producer
+    -loadfile	{}
+    -bytes	4000000
+    -sizes	{2000 20000 200000}
+    -scenarios	{glob pipe printify exact regexp manycase manyspawn background}
+    -spawns	8
+    -rate	0
+    -output	{}
+    -compare	{}
+    -tolerance	10
+}
+if {[llength $argv] % 2} {
+    puts stderr "usage: exp_bench.tcl ?-option value ...?\noptions: [array names opt]"
+    exit 2
+}
+foreach {name value} $argv {
+    if {![info exists opt($name)]} {
+	puts stderr "unknown option \"$name\", must be one of: [array names opt]"
+	exit 2
+    }
+    set opt($name) $value
+}
+
+if {$opt(-loadfile) ne ""} {
+    source $opt(-loadfile)
+} else {
+    package require Expect
+}
+exp_log_user 0
+set timeout 120
+
+# This still runs on Tcl 8.4, so no {*}, dict or clock microseconds.
+if {[catch {clock microseconds}]} {
+    proc usec {} {expr {[clock clicks -milliseconds] * 1000}}
+} else {
+    proc usec {} {clock microseconds}
+}
+
+# one field of a result line
+proc field {result name} {
+    array set f $result
+    return $f($name)
+}
+
+# The marker ends every 4th line; it is what every scenario matches.
+set marker PROMPT>
+set every 4
+
+proc producer {bytes args} {
+    global opt marker every
+    eval [list exp_spawn] $args [list $opt(-producer) -bytes $bytes \
+	    -every $every -marker $marker -rate $opt(-rate)]
+    return $spawn_id
+}
+
+# Count matches of the given expect case list until END, using
+# exp_continue so the loop stays inside the expect command.
+proc consume {ids cases} {
+    global matches
+    set body [list -i $ids]
+    foreach c $cases {
+	eval [list lappend body] $c [list {incr ::matches; exp_continue}]
+    }
+    lappend body END {} eof {} timeout {error "benchmark timed out"}
+    eval [list expect] $body
+}
+
+# About 8KB of what a shell session looks like.
+proc terminaltext {} {
+    set text {}
+    for {set i 0} {[string length $text] < 8192} {incr i} {
+	if {$i % 8 == 0} {
+	    append text "user@host:~/src\$ ls -l\r\n"
+	} elseif {$i % 8 == 5} {
+	    append text "caf\u00e9 r\u00e9sum\u00e9 na\u00efve $i\r\n"
+	} else {
+	    append text "drwxr-xr-x  2 user staff  4096 Oct 19 07:21 "
+	    append text "\033\[01;34mdir$i\033\[0m\r\n"
+	}
+    }
+    return "${text}printify-end"
+}
+
+proc manycases {} {
+    global marker
+    set cases {}
+    for {set i 0} {$i < 39} {incr i} {
+	lappend cases [list -gl "*NOMATCH$i*"]
+    }
+    lappend cases [list -gl "*$marker"]
+    return $cases
+}
+
+proc run {scenario size} {
+    global opt marker matches
+    set matches 0
+    match_max -d $size
+    exp_latency -reset
+    exp_latency 1
+
+    set cpu0 [exp_cputime]
+    set t0 [usec]
+    set bytes $opt(-bytes)
+    set calls 0
+    switch -- $scenario {
+	glob {
+	    set id [producer $opt(-bytes)]
+	    consume $id [list [list -gl "*$marker"]]
+	    set ids [list $id]
+	}
+	pipe {
+	    set id [producer $opt(-bytes) -pipe]
+	    consume $id [list [list -gl "*$marker"]]
+	    set ids [list $id]
+	}
+	printify {
+	    # a tclsh on a pipe echoes the text once and then waits
+	    set text [terminaltext]
+	    exp_spawn -pipe [info nameofexecutable]
+	    set id $spawn_id
+	    match_max -i $id [expr {2 * [string length $text]}]
+	    exp_send -i $id "[list proc terminaltext {} [info body terminaltext]]\n"
+	    exp_send -i $id "fconfigure stdout -translation lf\n"
+	    exp_send -i $id "puts -nonewline \[terminaltext\]; flush stdout\n"
+	    expect -i $id -notransfer -ex printify-end {} \
+		timeout {error "benchmark timed out"}
+	    set calls [expr {$opt(-bytes) / [string length $text]}]
+	    # expPrintify does nothing unless diagnostics go somewhere
+	    if {$::tcl_platform(platform) eq "windows"} {
+		exp_internal -f NUL 0
+	    } else {
+		exp_internal -f /dev/null 0
+	    }
+	    set t0 [usec]
+	    set cpu0 [exp_cputime]
+	    for {set n 0} {$n < $calls} {incr n} {
+		expect -i $id -timeout 0 -ex NOMATCH-printify {}
+	    }
+	    exp_internal 0
+	    set bytes [expr {$calls * [string length $text]}]
+	    set ids [list $id]
+	}
+	exact {
+	    set id [producer $opt(-bytes)]
+	    consume $id [list [list -ex $marker]]
+	    set ids [list $id]
+	}
+	regexp {
+	    set id [producer $opt(-bytes)]
+	    consume $id [list [list -re "(\[0-9\]+) \[a-z\]+ $marker"]]
+	    set ids [list $id]
+	}
+	manycase {
+	    set id [producer $opt(-bytes)]
+	    consume $id [manycases]
+	    set ids [list $id]
+	}
+	manyspawn {
+	    set ids {}
+	    for {set i 0} {$i < $opt(-spawns)} {incr i} {
+		lappend ids [producer [expr {$opt(-bytes) / $opt(-spawns)}]]
+	    }
+	    # each id finishes on its own END or eof
+	    set live $ids
+	    while {[llength $live]} {
+		expect -i $live -gl "*$marker" {
+		    incr ::matches
+		    exp_continue
+		} -i $live END {
+		    set live [lsearch -all -inline -not $live $expect_out(spawn_id)]
+		} -i $live eof {
+		    set live [lsearch -all -inline -not $live $expect_out(spawn_id)]
+		} timeout {
+		    error "benchmark timed out"
+		}
+	    }
+	}
+	background {
+	    set id [producer $opt(-bytes)]
+	    set ::done 0
+	    expect_background -i $id -gl "*$marker" {
+		incr ::matches
+	    } -i $id eof {
+		set ::done 1
+	    }
+	    vwait ::done
+	    expect_background -i $id
+	    set ids [list $id]
+	}
+    }
+    set seconds [expr {([usec] - $t0) / 1e6}]
+    set cpu [expr {[exp_cputime] - $cpu0}]
+    exp_latency 0
+    foreach id $ids {
+	catch {exp_close -i $id}
+	catch {exp_wait -i $id}
+    }
+
+    array set lat [exp_latency -report -percentiles {50 90 99}]
+    set mb [expr {$bytes / 1048576.0}]
+    set r [list scenario $scenario match_max $size \
+	    bytes $bytes matches $matches \
+	    seconds [format %.3f $seconds] \
+	    bytes_per_sec [expr {round($bytes / $seconds)}] \
+	    matches_per_sec [expr {round($matches / $seconds)}] \
+	    cpu_us_per_mb [expr {round($cpu / $mb)}] \
+	    p50_us $lat(-p50) p90_us $lat(-p90) p99_us $lat(-p99)]
+    if {$calls} {
+	lappend r us_per_call [format %.1f [expr {$seconds * 1e6 / $calls}]]
+    }
+    return $r
+}
+
+set results {}
+foreach scenario $opt(-scenarios) {
+    foreach size $opt(-sizes) {
+	set r [run $scenario $size]
+	puts $r
+	lappend results $r
+    }
+}
+
+if {$opt(-output) ne ""} {
+    set f [open $opt(-output) w]
+    puts $f [join $results \n]
+    close $f
+}
+
+if {$opt(-compare) ne ""} {
+    set f [open $opt(-compare)]
+    set regressed 0
+    foreach line [split [read $f] \n] {
+	if {$line eq ""} continue
+	set old([field $line scenario],[field $line match_max]) $line
+    }
+    close $f
+    foreach r $results {
+	set key [field $r scenario],[field $r match_max]
+	if {![info exists old($key)]} continue
+	set tol [expr {$opt(-tolerance) / 100.0}]
+	set was [field $old($key) bytes_per_sec]
+	set now [field $r bytes_per_sec]
+	if {$now < $was * (1 - $tol)} {
+	    puts "REGRESSION $key bytes_per_sec $was -> $now"
+	    set regressed 1
+	}
+	set was [field $old($key) cpu_us_per_mb]
+	set now [field $r cpu_us_per_mb]
+	if {$now > $was * (1 + $tol)} {
+	    puts "REGRESSION $key cpu_us_per_mb $was -> $now"
+	    set regressed 1
+	}
+    }
+    exit $regressed
+}
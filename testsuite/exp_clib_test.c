@@ -0,0 +1,181 @@
+/*
+ * exp_clib_test -- tests for the C expect library (exp_clib.c).
+ *
+ * Drives sh on a pty through exp_spawnl and exp_expectl, and checks the
+ * exp_fill/exp_bufferedv path without a process.  Prints one line per
+ * test and exits with the number that failed.  Unix only.
+ *
+ *   exp_clib_test
+ */
+
+#include "expect.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+static int failed = 0;
+
+static void
+check(name, ok)
+    char *name;
+    int ok;
+{
+    printf("%s: %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok) failed++;
+}
+
+/* true if exp_match..exp_match_end is exactly s */
+
+static int
+matched(s)
+    char *s;
+{
+    return exp_match != NULL && exp_match_end - exp_match == (int) strlen(s)
+	    && strncmp(exp_match, s, strlen(s)) == 0;
+}
+
+static void
+reap(fd)
+    int fd;
+{
+    exp_closefd(fd);
+    waitpid(exp_pid, NULL, 0);
+}
+
+static void
+test_expect()
+{
+    int fd, rc;
+
+    exp_timeout = 10;
+    fd = exp_spawnl("sh", "sh", "-c",
+	    "echo hello; read x; echo got $x; read y; echo done", (char *) NULL);
+    check("spawn", fd >= 0);
+    if (fd < 0) return;
+
+    check("spawn-cloexec", (fcntl(fd, F_GETFD) & FD_CLOEXEC) != 0);
+
+    rc = exp_expectl(fd, exp_exact, "hello", 1, exp_end);
+    check("expect-exact", rc == 1 && matched("hello"));
+
+    write(fd, "abc\n", 4);
+    rc = exp_expectl(fd, exp_glob, "never*", 1, exp_regexp, "got (a.c)", 2,
+	    exp_end);
+    check("expect-regexp", rc == 2 && matched("got abc"));
+
+    exp_timeout = 1;
+    rc = exp_expectl(fd, exp_exact, "never", 1, exp_end);
+    check("expect-timeout", rc == EXP_TIMEOUT);
+
+    /* nothing is pending, so this must not block in read */
+    exp_timeout = 0;
+    alarm(5);
+    rc = exp_expectl(fd, exp_exact, "never", 1, exp_end);
+    alarm(0);
+    check("expect-timeout-0", rc == EXP_TIMEOUT);
+
+    exp_timeout = 10;
+    write(fd, "\n", 1);
+    rc = exp_expectl(fd, exp_glob, "*done", 1, exp_end);
+    check("expect-glob", rc == 1);
+    rc = exp_expectl(fd, exp_exact, "never", 1, exp_end);
+    check("expect-eof", rc == EXP_EOF);
+    reap(fd);
+}
+
+/*
+ * A descriptor past FD_SETSIZE must still be waited on, which select
+ * cannot do.
+ */
+
+static void
+test_high_fd()
+{
+    struct rlimit rl;
+    int fd, high = FD_SETSIZE + 16, rc;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur <= (rlim_t) high) {
+	rl.rlim_cur = (rl.rlim_max > (rlim_t) high + 1 ? (rlim_t) high + 1
+		: rl.rlim_max);
+	setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    exp_timeout = 10;
+    fd = exp_spawnl("sh", "sh", "-c", "sleep 1; echo late", (char *) NULL);
+    if (fd < 0 || dup2(fd, high) != high) {
+	printf("expect-high-fd: skipped (%s)\n", strerror(errno));
+	if (fd >= 0) reap(fd);
+	return;
+    }
+    exp_closefd(fd);
+    exp_spawnfd(high);
+    rc = exp_expectl(high, exp_exact, "late", 1, exp_end);
+    check("expect-high-fd", rc == 1 && matched("late"));
+    reap(high);
+}
+
+/* exp_bufferedv for a single exact pattern, which returns 1 */
+
+static int
+buffered(fd, pattern)
+    int fd;
+    char *pattern;
+{
+    struct exp_case cases[2];
+
+    cases[0].pattern = pattern;
+    cases[0].re = NULL;
+    cases[0].type = exp_exact;
+    cases[0].value = 1;
+    cases[1].type = exp_end;
+    return exp_bufferedv(fd, cases);
+}
+
+static void
+test_buffered()
+{
+    int fd = 1000, rc;
+
+    exp_spawnfd(fd);
+    exp_fill(fd, "abc", 3);
+    rc = buffered(fd, "b");
+    check("buffered-match", rc == 1 && matched("b"));
+
+    rc = buffered(fd, "x");
+    check("buffered-timeout", rc == EXP_TIMEOUT);
+
+    exp_fill(fd, "x\0y", 3);
+    rc = buffered(fd, "cxy");
+    check("buffered-nulls", rc == 1 && matched("cxy"));
+
+    exp_fill(fd, NULL, 0);
+    rc = buffered(fd, "x");
+    check("buffered-eof", rc == EXP_EOF);
+    exp_spawnfd(fd);
+
+    exp_match_max = 4;
+    exp_full_buffer = 1;
+    exp_fill(fd, "abcdefghij", 10);
+    rc = buffered(fd, "z");
+    check("buffered-full", rc == EXP_FULLBUFFER
+	    && exp_buffer_end - exp_buffer == 8);
+    exp_match_max = 2000;
+    exp_full_buffer = 0;
+    exp_spawnfd(fd);
+}
+
+int
+main(argc, argv)
+    int argc;
+    char *argv[];
+{
+    test_expect();
+    test_high_fd();
+    test_buffered();
+    return failed;
+}
@@ -0,0 +1,173 @@
+/*
+ * exp_coro_bench -- drive many fake sessions with the coroutine API.
+ *
+ * Each session is one end of a socketpair; a second coroutine plays the
+ * device on the other end.  The client sends "ping <n>:" plus -payload
+ * bytes of filler and expects "pong <n>" followed by a prompt, rounds
+ * times over.  Reports the exchange rate, the latency of each expect and
+ * the system calls per megabyte moved, so the -backend choices can be
+ * compared.  See expect.hpp.
+ *
+ *   exp_coro_bench [-sessions n] [-rounds n] [-payload n]
+ *	[-backend auto|poll|uring]
+ */
+
+#include "expect.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+using namespace std::chrono_literals;
+
+static std::vector<double> latencies;
+static long exchanges = 0, failures = 0;
+static double moved = 0;
+static std::string filler;
+
+/* read and write calls made so far, from /proc/self/io. */
+
+static unsigned long
+rwcalls()
+{
+    FILE *f = fopen("/proc/self/io", "r");
+    char line[128];
+    unsigned long n = 0, v;
+
+    if (f == nullptr) {
+	return 0;
+    }
+    while (fgets(line, sizeof(line), f) != nullptr) {
+	if (sscanf(line, "syscr: %lu", &v) == 1
+		|| sscanf(line, "syscw: %lu", &v) == 1) {
+	    n += v;
+	}
+    }
+    fclose(f);
+    return n;
+}
+
+
+static expect::Task
+device(expect::Session s, int rounds)
+{
+    std::vector<expect::Pattern> ping = {expect::re("ping (\\d+):[^\n]*\n")};
+
+    for (int i = 0; i < rounds; i++) {
+	expect::Result r = co_await s.expect(ping);
+	if (!r.matched()) {
+	    break;
+	}
+	moved += r.match.size();
+	std::string reply = "pong " + r.match.substr(5, r.match.find(':') - 5)
+		+ "\r\n$ ";
+	moved += reply.size();
+	co_await s.send(reply);
+    }
+}
+
+static expect::Task
+client(expect::Session s, int rounds)
+{
+    std::vector<expect::Pattern> pong = {
+	expect::ex("error"),
+	expect::re("pong (\\d+)\r\n\\$ $")
+    };
+
+    std::string msg = "ping 0:" + filler + "\n";
+
+    moved += msg.size();
+    co_await s.send(msg);
+    for (int i = 0; i < rounds; i++) {
+	auto start = expect::Clock::now();
+	expect::Result r = co_await s.expect(pong, 5000ms);
+
+	latencies.push_back(std::chrono::duration<double, std::micro>(
+		expect::Clock::now() - start).count());
+	if (r.index != 1) {
+	    failures++;
+	    break;
+	}
+	exchanges++;
+	if (i + 1 < rounds) {
+	    msg = "ping " + std::to_string(i + 1) + ":" + filler + "\n";
+	    moved += msg.size();
+	    co_await s.send(msg);
+	}
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int sessions = 10000, rounds = 20;
+    expect::Scheduler::Backend want = expect::Scheduler::Backend::Auto;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+	if (!strcmp(argv[i], "-sessions")) {
+	    sessions = atoi(argv[i + 1]);
+	} else if (!strcmp(argv[i], "-rounds")) {
+	    rounds = atoi(argv[i + 1]);
+	} else if (!strcmp(argv[i], "-payload")) {
+	    filler.assign(atoi(argv[i + 1]), 'x');
+	} else if (!strcmp(argv[i], "-backend")
+		&& !strcmp(argv[i + 1], "poll")) {
+	    want = expect::Scheduler::Backend::Poll;
+	} else if (!strcmp(argv[i], "-backend")
+		&& !strcmp(argv[i + 1], "uring")) {
+	    want = expect::Scheduler::Backend::Uring;
+	} else if (strcmp(argv[i], "-backend") || strcmp(argv[i + 1], "auto")) {
+	    fprintf(stderr, "usage: %s [-sessions n] [-rounds n] [-payload n]"
+		    " [-backend auto|poll|uring]\n", argv[0]);
+	    return 1;
+	}
+    }
+
+    /* Two descriptors per session. */
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+	if ((rlim_t) sessions * 2 + 16 > rl.rlim_cur) {
+	    sessions = (int) ((rl.rlim_cur - 16) / 2);
+	    fprintf(stderr, "descriptor limit: running %d sessions\n",
+		    sessions);
+	}
+    }
+
+    expect::Scheduler sched(want);
+    for (int i = 0; i < sessions; i++) {
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+	    perror("socketpair");
+	    return 1;
+	}
+	sched.spawn(device(expect::Session::attach(sched, sv[0]), rounds));
+	sched.spawn(client(expect::Session::attach(sched, sv[1]), rounds));
+    }
+
+    auto start = expect::Clock::now();
+    unsigned long calls = sched.syscalls() + rwcalls();
+    sched.run();
+    double secs = std::chrono::duration<double>(
+	    expect::Clock::now() - start).count();
+    calls = sched.syscalls() + rwcalls() - calls;
+
+    std::sort(latencies.begin(), latencies.end());
+    auto pct = [](double p) {
+	return latencies.empty() ? 0.0
+		: latencies[(size_t) (p * (latencies.size() - 1))];
+    };
+    printf("sessions %d  rounds %d  exchanges %ld  failures %ld\n",
+	    sessions, rounds, exchanges, failures);
+    printf("elapsed %.3fs  %.0f exchanges/s\n", secs, exchanges / secs);
+    printf("expect latency us: p50 %.1f  p99 %.1f  max %.1f\n",
+	    pct(0.50), pct(0.99), pct(1.0));
+    printf("backend %s  moved %.1fMB  syscalls %lu  %.0f per MB\n",
+	    sched.uring() ? "uring" : "poll", moved / 1048576, calls,
+	    moved > 0 ? calls / (moved / 1048576) : 0.0);
+    return failures != 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * exp_producer -- a synthetic child for benchmarking the expect engine.
+ *
+ * Writes numbered lines of filler text, ending every Nth one with a
+ * marker (a stand-in for a device prompt), optionally at a fixed rate,
+ * then writes END and exits.  See exp_bench.tcl.
+ *
+ *   exp_producer [-bytes n] [-line n] [-every n] [-marker string]
+ *		  [-rate bytes_per_sec] [-chunk n]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#   include <windows.h>
+#   include <io.h>
+#   define write _write
+#else
+#   include <unistd.h>
+#   include <sys/time.h>
+#endif
+
+static double
+now()
+{
+#ifdef _WIN32
+    return GetTickCount() / 1000.0;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+}
+
+static void
+nap(seconds)
+    double seconds;
+{
+#ifdef _WIN32
+    Sleep((DWORD) (seconds * 1000));
+#else
+    usleep((useconds_t) (seconds * 1000000));
+#endif
+}
+
+static void
+usage()
+{
+    fprintf(stderr, "usage: exp_producer [-bytes n] [-line n] [-every n] "
+	    "[-marker string] [-rate bytes_per_sec] [-chunk n]\n");
+    exit(1);
+}
+
+int
+main(argc, argv)
+    int argc;
+    char *argv[];
+{
+    long bytes = 1000000;	/* total to write */
+    int line = 80;		/* bytes per line, including \r\n */
+    int every = 1;		/* every Nth line carries the marker */
+    char *marker = "PROMPT>";
+    long rate = 0;		/* bytes/sec, 0 for as fast as possible */
+    int chunk = 4096;		/* bytes per write */
+    char *buf;
+    long written = 0, seq = 0;
+    int used = 0, i;
+    double start;
+
+    for (i = 1; i < argc; i++) {
+	if (i + 1 >= argc) usage();
+	if (!strcmp(argv[i], "-bytes")) bytes = atol(argv[++i]);
+	else if (!strcmp(argv[i], "-line")) line = atoi(argv[++i]);
+	else if (!strcmp(argv[i], "-every")) every = atoi(argv[++i]);
+	else if (!strcmp(argv[i], "-marker")) marker = argv[++i];
+	else if (!strcmp(argv[i], "-rate")) rate = atol(argv[++i]);
+	else if (!strcmp(argv[i], "-chunk")) chunk = atoi(argv[++i]);
+	else usage();
+    }
+    if (line < (int) strlen(marker) + 12) line = strlen(marker) + 12;
+    if (every < 1) every = 1;
+    if (chunk < line) chunk = line;
+
+    buf = malloc(chunk + line);
+    start = now();
+
+    while (written < bytes) {
+	char *p = buf + used;
+	int fill = line - 2 - 9;	/* after "%08ld " and before \r\n */
+	int c;
+
+	sprintf(p, "%08ld ", seq % 100000000);
+	p += 9;
+	if ((++seq % every) == 0) {
+	    fill -= strlen(marker) + 1;
+	}
+	for (c = 0; c < fill; c++) {
+	    *p++ = 'a' + (char) ((seq + c) % 26);
+	}
+	if ((seq % every) == 0) {
+	    *p++ = ' ';
+	    memcpy(p, marker, strlen(marker));
+	    p += strlen(marker);
+	}
+	*p++ = '\r';
+	*p++ = '\n';
+	used = p - buf;
+
+	if (used >= chunk || written + used >= bytes) {
+	    if (write(1, buf, used) != used) return 1;
+	    written += used;
+	    used = 0;
+	    if (rate > 0) {
+		double due = start + (double) written / rate;
+		double t = now();
+		if (due > t) nap(due - t);
+	    }
+	}
+    }
+    if (write(1, "END\r\n", 5) != 5) return 1;
+    return 0;
+}
@@ -36,6 +36,11 @@ static Tcl_DriverWatchProc ExpSpawnWatch;
 static Tcl_DriverGetHandleProc ExpSpawnGetHandle;
 static Tcl_DriverBlockModeProc	ExpSpawnBlock;
 
+static Tcl_Channel	ExpUnixCreatePipeChild (Tcl_Interp *interp,
+			    Exp_SpawnOptionSet *opts, int objc,
+			    struct Tcl_Obj * CONST objv[], unsigned long *pid,
+			    Tcl_Pid *theUglyHandleHackJob);
+
 static Tcl_ChannelType ExpSpawnChannelType = {
     "spawn",
     TCL_CHANNEL_VERSION_2,
@@ -82,8 +87,251 @@ Exp_CreateSpawnChannel (
     Exp_SpawnOptionSet *opts,
     int objc,
     struct Tcl_Obj * CONST objv[],
-    unsigned long *pid)
+    unsigned long *pid,
+    Tcl_Pid *theUglyHandleHackJob)
+{
+    *pid = 0;
+    *theUglyHandleHackJob = NULL;
+    if (opts->pipe) {
+	return ExpUnixCreatePipeChild(interp, opts, objc, objv, pid,
+		theUglyHandleHackJob);
+    }
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpSetPipeSize --
+ *
+ *	Ask for a larger pipe buffer where the system allows it.  Linux
+ *	caps unprivileged requests at /proc/sys/fs/pipe-max-size, so a
+ *	failure here is not an error.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ExpSetPipeSize (
+    int fd,
+    int size)
+{
+#ifdef F_SETPIPE_SZ
+    fcntl(fd, F_SETPIPE_SZ, size);
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpUnixCreatePipeChild --
+ *
+ *	The guts of 'spawn -pipe'.  Forks the child with its standard
+ *	descriptors on pipes instead of a pty.  There is no line
+ *	discipline, echo or stty setup, so output arrives in chunks as
+ *	large as the pipe.
+ *
+ * Results:
+ *	An exp_pair channel over the pipes, or NULL with an error in
+ *	interp.
+ *
+ * Side Effects:
+ *	A new process is created.  With -stderr separate, opts->stderrChan
+ *	is set to a readable channel on the child's stderr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Channel
+ExpUnixCreatePipeChild (
+    Tcl_Interp *interp,
+    Exp_SpawnOptionSet *opts,
+    int objc,
+    struct Tcl_Obj * CONST objv[],
+    unsigned long *pid,
+    Tcl_Pid *theUglyHandleHackJob)
 {
+    int in[2], out[2], err[2] = {-1, -1};
+    int status[2];		/* carries errno back if exec fails */
+    int i, j, listLen, errnum, n, envc, maxFd;
+    Tcl_Obj **elemArray;
+    char **argv, **envp = NULL, *dir;
+    Tcl_DString envBuf;
+    Tcl_Channel inChan, outChan, newChan;
+    pid_t child;
+
+    if (pipe(in) < 0) {
+	goto error0;
+    }
+    if (pipe(out) < 0) {
+	goto error1;
+    }
+    if (opts->stderrMode == EXP_STDERR_SEPARATE && pipe(err) < 0) {
+	goto error2;
+    }
+    if (pipe(status) < 0) {
+	goto error3;
+    }
+    fcntl(status[1], F_SETFD, FD_CLOEXEC);
+    ExpSetPipeSize(in[1], opts->pipeSize);
+    ExpSetPipeSize(out[1], opts->pipeSize);
+    if (err[1] != -1) {
+	ExpSetPipeSize(err[1], opts->pipeSize);
+    }
+
+    /*
+     * Everything the child needs is made here, before the fork: between
+     * fork and exec it may only make async-signal-safe calls, which
+     * Tcl_GetString and setenv are not.
+     */
+
+    argv = (char **) ckalloc((objc + 1) * sizeof(char *));
+    for (i = 0; i < objc; i++) {
+	argv[i] = Tcl_GetString(objv[i]);
+    }
+    argv[objc] = NULL;
+    dir = (opts->dir ? Tcl_GetString(opts->dir) : NULL);
+
+    /*
+     * The environment is ours with each -env name replaced or added,
+     * as "name=value" strings laid end to end in envBuf.
+     */
+
+    Tcl_DStringInit(&envBuf);
+    if (opts->env) {
+	char *p;
+
+	Tcl_ListObjGetElements(NULL, opts->env, &listLen, &elemArray);
+	listLen &= ~1;
+	for (i = 0; i < listLen; i += 2) {
+	    Tcl_DStringAppend(&envBuf, Tcl_GetString(elemArray[i]), -1);
+	    Tcl_DStringAppend(&envBuf, "=", 1);
+	    Tcl_DStringAppend(&envBuf, Tcl_GetString(elemArray[i+1]), -1);
+	    Tcl_DStringSetLength(&envBuf, Tcl_DStringLength(&envBuf) + 1);
+	}
+	for (envc = 0; environ[envc] != NULL; envc++) {
+	    /* count them */
+	}
+	envp = (char **) ckalloc((envc + listLen / 2 + 1) * sizeof(char *));
+	for (n = 0, i = 0; i < envc; i++) {
+	    for (j = 0; j < listLen; j += 2) {
+		size_t len = strlen(Tcl_GetString(elemArray[j]));
+
+		if (strncmp(environ[i], Tcl_GetString(elemArray[j]), len) == 0
+			&& environ[i][len] == '=') {
+		    break;
+		}
+	    }
+	    if (j == listLen) {
+		envp[n++] = environ[i];
+	    }
+	}
+	for (p = Tcl_DStringValue(&envBuf), i = 0; i < listLen; i += 2) {
+	    envp[n++] = p;
+	    p += strlen(p) + 1;
+	}
+	envp[n] = NULL;
+    }
+
+    maxFd = (int) sysconf(_SC_OPEN_MAX);
+    if (maxFd < 0) {
+	maxFd = 1024;
+    }
+
+    child = fork();
+    if (child == 0) {
+	dup2(in[0], 0);
+	dup2(out[1], 1);
+	dup2((err[1] != -1) ? err[1] : out[1], 2);
+	for (i = 3; i < maxFd; i++) {
+	    if (i != status[1]) {
+		close(i);
+	    }
+	}
+	if (dir != NULL && chdir(dir) < 0) {
+	    goto childError;
+	}
+	if (envp != NULL) {
+	    environ = envp;
+	}
+	execvp(argv[0], argv);
+    childError:
+	errnum = errno;
+	write(status[1], &errnum, sizeof(errnum));
+	_exit(127);
+    }
+    errnum = errno;
+    ckfree((char *) argv);
+    if (envp != NULL) {
+	ckfree((char *) envp);
+    }
+    Tcl_DStringFree(&envBuf);
+
+    close(in[0]);
+    close(out[1]);
+    if (err[1] != -1) {
+	close(err[1]);
+    }
+    close(status[1]);
+
+    if (child < 0) {
+	close(status[0]);
+	close(in[1]);
+	close(out[0]);
+	if (err[0] != -1) {
+	    close(err[0]);
+	}
+	errno = errnum;
+	goto error0;
+    }
+
+    /* the status pipe closes on a successful exec */
+    n = read(status[0], &errnum, sizeof(errnum));
+    close(status[0]);
+    if (n == sizeof(errnum)) {
+	waitpid(child, NULL, 0);
+	close(in[1]);
+	close(out[0]);
+	if (err[0] != -1) {
+	    close(err[0]);
+	}
+	errno = errnum;
+	Tcl_AppendResult(interp, "couldn't execute \"", Tcl_GetString(objv[0]),
+		"\": ", Tcl_PosixError(interp), (char *) NULL);
+	return NULL;
+    }
+
+    *pid = child;
+    *theUglyHandleHackJob = (Tcl_Pid) (long) child;
+
+    outChan = Tcl_MakeFileChannel((ClientData) (long) out[0], TCL_READABLE);
+    inChan = Tcl_MakeFileChannel((ClientData) (long) in[1], TCL_WRITABLE);
+    Tcl_SetChannelOption(interp, outChan, "-blocking", "0");
+    Tcl_SetChannelOption(interp, inChan, "-blocking", "0");
+    newChan = Exp_CreatePairChannel(interp, outChan, inChan, NULL);
+    Tcl_SetChannelOption(interp, newChan, "-closechildren", "1");
+
+    if (err[0] != -1) {
+	opts->stderrChan = Tcl_MakeFileChannel((ClientData) (long) err[0],
+		TCL_READABLE);
+	Tcl_SetChannelOption(interp, opts->stderrChan, "-blocking", "0");
+    }
+    return newChan;
+
+error3:
+    if (err[0] != -1) {
+	close(err[0]);
+	close(err[1]);
+    }
+error2:
+    close(out[0]);
+    close(out[1]);
+error1:
+    close(in[0]);
+    close(in[1]);
+error0:
+    Tcl_AppendResult(interp, "couldn't create pipe: ", Tcl_PosixError(interp),
+	    (char *) NULL);
     return NULL;
 }
 
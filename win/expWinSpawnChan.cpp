@@ -821,6 +821,136 @@ ExpWinSpawnRemoveAllPendingEvents (Tcl_Event *ev, ClientData cData)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpWinCreatePipeChild --
+ *
+ *	The guts of 'spawn -pipe'.  Runs the child with its standard
+ *	handles on anonymous pipes instead of under the console debugger.
+ *	Nothing is injected and there is no console to scrape, so output
+ *	arrives as fast as the child writes it, in chunks as large as the
+ *	pipe.  Programs that insist on a console won't like it.
+ *
+ * Results:
+ *	An exp_pair channel over the pipes, or NULL with the reason in
+ *	GetLastError().
+ *
+ * Side Effects:
+ *	A new process is created.  With -stderr separate, opts->stderrChan
+ *	is set to a readable channel on the child's stderr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Channel
+ExpWinCreatePipeChild (
+    Tcl_Interp *interp,
+    Exp_SpawnOptionSet *opts,
+    TCHAR *cmdline,
+    TCHAR *env,
+    TCHAR *dir,
+    unsigned long *pid,
+    Tcl_Pid *theUglyHandleHackJob)
+{
+    SECURITY_ATTRIBUTES sa;
+    STARTUPINFO si;
+    PROCESS_INFORMATION pi;
+    HANDLE inRead = NULL, inWrite = NULL;
+    HANDLE outRead = NULL, outWrite = NULL;
+    HANDLE errRead = NULL, errWrite = NULL;
+    Tcl_Channel inChan, outChan, newChan;
+    DWORD err;
+    BOOL ok;
+
+    sa.nLength = sizeof(SECURITY_ATTRIBUTES);
+    sa.lpSecurityDescriptor = NULL;
+    sa.bInheritHandle = TRUE;
+
+    // The size is only a hint to the pipe's buffer quota.
+    if (!CreatePipe(&inRead, &inWrite, &sa, opts->pipeSize)
+	    || !CreatePipe(&outRead, &outWrite, &sa, opts->pipeSize)
+	    || (opts->stderrMode == EXP_STDERR_SEPARATE
+		&& !CreatePipe(&errRead, &errWrite, &sa, opts->pipeSize))) {
+	goto error;
+    }
+
+    // Our ends must not be inherited, or the child holds its own
+    // stdin open and never sees EOF.
+    SetHandleInformation(inWrite, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(outRead, HANDLE_FLAG_INHERIT, 0);
+    if (errRead) {
+	SetHandleInformation(errRead, HANDLE_FLAG_INHERIT, 0);
+    }
+
+    ZeroMemory(&pi, sizeof(PROCESS_INFORMATION));
+    ZeroMemory(&si, sizeof(STARTUPINFO));
+    si.cb = sizeof(STARTUPINFO);
+    si.dwFlags = STARTF_USESTDHANDLES | STARTF_USESHOWWINDOW;
+    si.wShowWindow = (ExpWinNTDebug() ? SW_SHOWNOACTIVATE : SW_HIDE);
+    si.hStdInput = inRead;
+    si.hStdOutput = outWrite;
+    si.hStdError = (errWrite ? errWrite : outWrite);
+
+    ok = expWinProcs->createProcessProc(
+	    0L,		// Module name (not needed).
+	    cmdline,	// Command line string (must be writable!).
+	    0L,		// Process handle will not be inheritable.
+	    0L,		// Thread handle will not be inheritable.
+	    TRUE,	// Inherit the pipe ends.
+	    CREATE_NO_WINDOW | CREATE_DEFAULT_ERROR_MODE |
+		(expWinProcs->useWide ? CREATE_UNICODE_ENVIRONMENT : 0),
+	    env,	// Use custom environment block, or parent's if NULL.
+	    dir,	// Use custom starting directory, or parent's if NULL.
+	    &si,	// Pointer to STARTUPINFO structure.
+	    &pi);	// Pointer to PROCESS_INFORMATION structure.
+    err = GetLastError();
+
+    // The child's ends are its own now.
+    CloseHandle(inRead);
+    CloseHandle(outWrite);
+    if (errWrite) {
+	CloseHandle(errWrite);
+    }
+    inRead = outWrite = errWrite = NULL;
+
+    if (!ok) {
+	SetLastError(err);
+	goto error;
+    }
+
+    // The process handle is to be closed by Tcl_WaitPid.
+    CloseHandle(pi.hThread);
+    TclWinAddProcess(pi.hProcess, pi.dwProcessId);
+    *pid = pi.dwProcessId;
+    *theUglyHandleHackJob = (Tcl_Pid) pi.hProcess;
+
+    outChan = Tcl_MakeFileChannel((ClientData) outRead, TCL_READABLE);
+    inChan = Tcl_MakeFileChannel((ClientData) inWrite, TCL_WRITABLE);
+    Tcl_SetChannelOption(interp, outChan, "-blocking", "0");
+    Tcl_SetChannelOption(interp, inChan, "-blocking", "0");
+    newChan = Exp_CreatePairChannel(interp, outChan, inChan, NULL);
+    Tcl_SetChannelOption(interp, newChan, "-closechildren", "1");
+
+    if (errRead) {
+	opts->stderrChan = Tcl_MakeFileChannel((ClientData) errRead,
+		TCL_READABLE);
+	Tcl_SetChannelOption(interp, opts->stderrChan, "-blocking", "0");
+    }
+    return newChan;
+
+error:
+    err = GetLastError();
+    if (inRead) CloseHandle(inRead);
+    if (inWrite) CloseHandle(inWrite);
+    if (outRead) CloseHandle(outRead);
+    if (outWrite) CloseHandle(outWrite);
+    if (errRead) CloseHandle(errRead);
+    if (errWrite) CloseHandle(errWrite);
+    SetLastError(err);
+    return NULL;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -969,6 +1099,18 @@ Exp_CreateSpawnChannel (
     Exp_WinBuildCommandLine(Tcl_DStringValue(&exeFullPathUTF),
 	    objc, objv, &cmdLine);
 
+    if (opts->pipe) {
+	newChan = ExpWinCreatePipeChild(interp, opts,
+		Tcl_DStringValue(&cmdLine), envBlock, startDir, pid,
+		theUglyHandleHackJob);
+	if (newChan == NULL) {
+	    Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		    ExpWinError(interp, Tcl_DStringValue(&exeFullPathUTF), 0L),
+		    -1));
+	}
+	goto out;
+    }
+
     /* Where's the injector dll? */
     Tcl_UtfToExternalDString(Tcl_GetEncoding(NULL, "cp1252"),
 	    Tcl_GetVar(interp, "::exp::injector_path", 0), -1, &injDS);
@@ -44,6 +44,9 @@ Test_SpawnObjCmd (
     opts.console = 0;
     opts.pty_only = 0;
     opts.leaveOpen = 0;
+    opts.pipe = 0;
+    opts.stderrMode = EXP_STDERR_MERGE;
+    opts.stderrChan = NULL;
     opts.slave_write_ioctls = 1;
 		/* by default, slave will be write-ioctled this many times */
     opts.slave_opens = 3;
@@ -191,6 +191,14 @@ BuildCmds= \
 # End Source File
 # Begin Source File
 
+SOURCE=..\generic\exp_arena.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\generic\exp_capture.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\generic\exp_chan.c
 # End Source File
 # Begin Source File
@@ -211,6 +219,14 @@ SOURCE=..\generic\exp_glob.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\generic\exp_interact.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\generic\exp_latency.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\generic\exp_log.c
 # End Source File
 # Begin Source File
@@ -223,6 +239,18 @@ SOURCE=..\generic\exp_pty.c
 # End Source File
 # Begin Source File
 
+SOURCE=..\generic\exp_recorder.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\generic\exp_screen.c
+# End Source File
+# Begin Source File
+
+SOURCE=..\generic\exp_stream.c
+# End Source File
+# Begin Source File
+
 SOURCE=..\generic\exp_trap.c
 # End Source File
 # Begin Source File